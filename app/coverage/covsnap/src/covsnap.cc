@@ -0,0 +1,344 @@
+/// COVSNAP - post-processing for coverage snapshots.
+/// Works on the sorted snapshot files written by dumptgl and
+/// dump_func_cov_to_json with --snapshot, without touching UCAPI.
+
+#include "snapshot.hh"
+#include "snapindex.hh"
+#include "merge.hh"
+#include "trend.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* progName = "covsnap";
+
+static void usage(const char* nm)
+{
+    std::cout << "Usage: " << nm << " <command> [args]\n"
+              << "Commands:\n"
+              << "  diff OLD NEW      report items added, removed, newly covered"
+                 " or newly uncovered\n"
+              << "  trend FILE [--kind K] [PREFIX]\n"
+              << "                    time series of the rollups under PREFIX in"
+                 " a trend store\n"
+              << "  index SNAP...     build the prefix index SNAP.idx of each"
+                 " snapshot\n"
+              << "  query SNAP [--list|--uncovered] PATH...\n"
+              << "                    totals, items or uncovered items at and"
+                 " below each PATH\n"
+              << "  merge [-j N] [--at-least N] OUT SNAP...\n"
+              << "                    merge snapshots of separate VDBs into OUT\n";
+    exit(1);
+}
+
+static void printCounts(FILE* out, const SnapRecord* rec)
+{
+    if (rec) {
+        fprintf(out, "%ld/%ld", rec->covered, rec->coverable);
+    } else {
+        fputc('-', out);
+    }
+}
+
+static void printChange(const char* change, const SnapRecord* oldRec,
+                        const SnapRecord* newRec)
+{
+    const SnapRecord* rec = oldRec ? oldRec : newRec;
+    fprintf(stdout, "%s\t%s\t%016llx\t", change, rec->key.c_str(),
+            (unsigned long long)rec->id);
+    printCounts(stdout, oldRec);
+    fputc('\t', stdout);
+    printCounts(stdout, newRec);
+    fputc('\n', stdout);
+}
+
+static bool openSnapshot(SnapshotReader& rd, const char* path)
+{
+    std::string err;
+    if (!rd.open(path, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// Sorted-merge join of two snapshots.  Only one record of each input
+/// is held at a time, so memory does not grow with snapshot size.
+static int cmdDiff(int argc, const char* argv[])
+{
+    if (argc != 3) usage(progName);
+
+    SnapshotReader olds, news;
+    if (!openSnapshot(olds, argv[1]) || !openSnapshot(news, argv[2])) {
+        return 1;
+    }
+    if (olds.kind() != news.kind()) {
+        std::cerr << "Error: cannot diff a " << olds.kind()
+                  << " snapshot against a " << news.kind() << " snapshot"
+                  << std::endl;
+        return 1;
+    }
+
+    static char obuf[1 << 20];
+    setvbuf(stdout, obuf, _IOFBF, sizeof(obuf));
+
+    long added = 0, removed = 0, covered = 0, uncovered = 0;
+    SnapRecord o, n;
+    bool haveOld = olds.next(o);
+    bool haveNew = news.next(n);
+    while (haveOld || haveNew) {
+        int c = !haveOld ? 1 : !haveNew ? -1 : o.key.compare(n.key);
+        if (c < 0) {
+            printChange("removed", &o, NULL);
+            removed++;
+            haveOld = olds.next(o);
+        } else if (c > 0) {
+            printChange("added", NULL, &n);
+            added++;
+            haveNew = news.next(n);
+        } else {
+            if (!o.isCovered() && n.isCovered()) {
+                printChange("newly_covered", &o, &n);
+                covered++;
+            } else if (o.isCovered() && !n.isCovered()) {
+                printChange("newly_uncovered", &o, &n);
+                uncovered++;
+            }
+            haveOld = olds.next(o);
+            haveNew = news.next(n);
+        }
+    }
+    fflush(stdout);
+
+    if (!olds.error().empty() || !news.error().empty()) {
+        std::cerr << "Error: "
+                  << (olds.error().empty() ? news.error() : olds.error())
+                  << std::endl;
+        return 1;
+    }
+    std::cerr << "added " << added << ", removed " << removed
+              << ", newly covered " << covered
+              << ", newly uncovered " << uncovered << std::endl;
+    return 0;
+}
+
+/// True if path is prefix or below it in the hierarchy
+static bool underPrefix(const std::string& path, const std::string& prefix)
+{
+    if (path.compare(0, prefix.size(), prefix)) return false;
+    return path.size() == prefix.size() || prefix.empty() ||
+           prefix.back() == '.' || path[prefix.size()] == '.';
+}
+
+/// Every record of the paths under the prefix, one series per path in
+/// (kind, path) order and each in time order.  Paths are selected up
+/// front into a table indexed by path, so the scan over the mapped
+/// records is one lookup per record.
+static int cmdTrend(int argc, const char* argv[])
+{
+    const char* file = NULL;
+    const char* kind = NULL;
+    std::string prefix;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--kind") && i + 1 < argc) {
+            kind = argv[++i];
+        } else if (!file) {
+            file = argv[i];
+        } else if (prefix.empty()) {
+            prefix = argv[i];
+        } else {
+            usage(progName);
+        }
+    }
+    if (!file) usage(progName);
+
+    TrendReader store;
+    std::string err;
+    if (!store.open(file, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+
+    // rank of each selected path in output order, -1 if not selected
+    const std::vector<TrendPath>& paths = store.paths();
+    std::vector<uint32_t> selected;
+    for (uint32_t k = 0; k < paths.size(); k++) {
+        if ((!kind || paths[k].kind == kind) && underPrefix(paths[k].path, prefix)) {
+            selected.push_back(k);
+        }
+    }
+    std::sort(selected.begin(), selected.end(), [&](uint32_t a, uint32_t b) {
+        int c = paths[a].kind.compare(paths[b].kind);
+        return c ? c < 0 : paths[a].path < paths[b].path;
+    });
+    std::vector<long> rank(paths.size(), -1);
+    for (size_t i = 0; i < selected.size(); i++) rank[selected[i]] = (long)i;
+
+    std::vector<const TrendRecord*> points;
+    const TrendRecord* recs = store.records();
+    for (size_t i = 0; i < store.size(); i++) {
+        if (recs[i].path < rank.size() && rank[recs[i].path] >= 0) {
+            points.push_back(&recs[i]);
+        }
+    }
+    std::stable_sort(points.begin(), points.end(),
+                     [&](const TrendRecord* a, const TrendRecord* b) {
+        long ra = rank[a->path], rb = rank[b->path];
+        return ra != rb ? ra < rb : a->time < b->time;
+    });
+
+    static char obuf[1 << 20];
+    setvbuf(stdout, obuf, _IOFBF, sizeof(obuf));
+    for (size_t i = 0; i < points.size(); i++) {
+        const TrendRecord& rec = *points[i];
+        const TrendPath& p = paths[rec.path];
+        char when[32];
+        time_t t = (time_t)rec.time;
+        struct tm tm;
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&t, &tm));
+        fprintf(stdout, "%s\t%s\t%s\t%lld\t%lld\t", when, p.kind.c_str(),
+                p.path.c_str(), (long long)rec.covered, (long long)rec.coverable);
+        if (rec.coverable > 0) {
+            fprintf(stdout, "%.2f\n", 100.0 * rec.covered / rec.coverable);
+        } else {
+            fputs("-\n", stdout);
+        }
+    }
+    fflush(stdout);
+    std::cerr << selected.size() << " paths, " << points.size() << " points of "
+              << store.size() << " records" << std::endl;
+    return 0;
+}
+
+/// (Re)build the index of every snapshot given
+static int cmdIndex(int argc, const char* argv[])
+{
+    if (argc < 2) usage(progName);
+    for (int i = 1; i < argc; i++) {
+        std::string err;
+        if (!SnapIndex::build(argv[i], err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/// Subtree queries answered from the prefix index: a few binary
+/// searches per path, then either the totals or the matching lines
+/// copied straight from the mapped snapshot.
+static int cmdQuery(int argc, const char* argv[])
+{
+    enum { Totals, List, Uncovered } mode = Totals;
+    const char* snap = NULL;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--list")) {
+            mode = List;
+        } else if (!strcmp(argv[i], "--uncovered")) {
+            mode = Uncovered;
+        } else if (!snap) {
+            snap = argv[i];
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (!snap || paths.empty()) usage(progName);
+
+    SnapIndex index;
+    std::string err;
+    if (!index.open(snap, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    if (!index.warning().empty()) {
+        std::cerr << "Warning: index kept in memory: " << index.warning() << std::endl;
+    }
+
+    static char obuf[1 << 20];
+    setvbuf(stdout, obuf, _IOFBF, sizeof(obuf));
+    std::vector<SnapRange> ranges;
+    long printed = 0;
+    for (size_t p = 0; p < paths.size(); p++) {
+        index.subtree(paths[p], ranges);
+        if (mode == Totals) {
+            SnapTotals t = index.totals(ranges);
+            fprintf(stdout, "%s\t%lld\t%lld\t%lld\t%lld\t", paths[p],
+                    (long long)t.covered, (long long)t.coverable,
+                    (long long)t.items, (long long)t.uncovered);
+            if (t.coverable > 0) {
+                fprintf(stdout, "%.2f\n", 100.0 * t.covered / t.coverable);
+            } else {
+                fputs("-\n", stdout);
+            }
+            continue;
+        }
+        for (size_t r = 0; r < ranges.size(); r++) {
+            for (size_t i = ranges[r].begin; i < ranges[r].end; i++) {
+                if (mode == Uncovered && !index.isUncovered(i)) continue;
+                std::string_view line = index.line(i);
+                fwrite(line.data(), 1, line.size(), stdout);
+                fputc('\n', stdout);
+                printed++;
+            }
+        }
+    }
+    fflush(stdout);
+    if (mode != Totals) {
+        std::cerr << printed << " of " << index.size() << " items" << std::endl;
+    }
+    return 0;
+}
+
+/// Combine the snapshots of several VDBs into one, see merge.hh
+static int cmdMerge(int argc, const char* argv[])
+{
+    MergeOptions opt;
+    opt.jobs = std::max(1u, std::thread::hardware_concurrency());
+    const char* out = NULL;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            opt.jobs = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--at-least") && i + 1 < argc) {
+            opt.atLeast = atol(argv[++i]);
+        } else if (!out) {
+            out = argv[i];
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (!out || inputs.empty() || opt.jobs == 0 || opt.atLeast < 1) usage(progName);
+
+    MergeStats stats;
+    std::string err;
+    if (!mergeSnapshots(out, inputs, opt, stats, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    std::cerr << "merged " << inputs.size() << " snapshots: " << stats.records
+              << " items, " << stats.covered << "/" << stats.coverable
+              << " covered" << std::endl;
+    return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+    progName = argv[0];
+    if (argc < 2) usage(argv[0]);
+
+    if (!strcmp(argv[1], "diff")) return cmdDiff(argc - 1, argv + 1);
+    if (!strcmp(argv[1], "trend")) return cmdTrend(argc - 1, argv + 1);
+    if (!strcmp(argv[1], "index")) return cmdIndex(argc - 1, argv + 1);
+    if (!strcmp(argv[1], "query")) return cmdQuery(argc - 1, argv + 1);
+    if (!strcmp(argv[1], "merge")) return cmdMerge(argc - 1, argv + 1);
+
+    usage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,263 @@
+/// Merging snapshots of separate VDBs - see merge.hh.
+
+#include "merge.hh"
+#include "snapindex.hh"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+/// Records per key range: a few MB of snapshot text
+static const size_t RANGE_RECORDS = 1 << 16;
+
+/// Run fn(i) for i in [0, n) on up to jobs threads, as in the dumpers'
+/// parallel.hh (which needs rapidjson)
+template <class Fn>
+static void parallelFor(size_t n, unsigned jobs, Fn fn)
+{
+    if (jobs > n) jobs = (unsigned)n;
+    if (jobs <= 1) {
+        for (size_t i = 0; i < n; i++) fn(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < jobs; t++) {
+        pool.push_back(std::thread([&]() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < n) fn(i);
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+}
+
+/// One record, parsed in place from a mapped line
+struct MergeItem {
+    std::string_view key;
+    std::string_view id;        // copied through as written
+    long covered;
+    long coverable;
+    long count;
+};
+
+/// Cut the next tab-separated field off line
+static std::string_view field(std::string_view& line)
+{
+    size_t tab = line.find('\t');
+    std::string_view f = line.substr(0, tab);
+    line.remove_prefix(tab == std::string_view::npos ? line.size() : tab + 1);
+    return f;
+}
+
+static bool parseLong(std::string_view f, long& v)
+{
+    std::from_chars_result r = std::from_chars(f.data(), f.data() + f.size(), v);
+    return r.ec == std::errc() && r.ptr == f.data() + f.size();
+}
+
+static bool parseItem(std::string_view line, MergeItem& it)
+{
+    it.key = field(line);
+    it.id = field(line);
+    return !it.id.empty() && parseLong(field(line), it.covered) &&
+           parseLong(field(line), it.coverable) && parseLong(line, it.count);
+}
+
+static void appendLong(std::string& out, long v)
+{
+    char buf[24];
+    std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), v);
+    out.append(buf, r.ptr - buf);
+}
+
+/// Records [next, end) of one input within a key range
+struct Cursor {
+    const SnapIndex* index;
+    size_t next;
+    size_t end;
+    MergeItem item;
+};
+
+/// Merges one key range of every input into text
+class RangeMerger {
+public:
+    RangeMerger(bool recount, long atLeast)
+            : _recount(recount), _atLeast(atLeast), _bad(false) {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    void merge(std::vector<Cursor>& cursors) {
+        // min-heap of cursor indices by current key
+        std::vector<size_t> heap;
+        for (size_t c = 0; c < cursors.size(); c++) {
+            if (advance(cursors[c])) heap.push_back(c);
+        }
+        auto later = [&](size_t a, size_t b) {
+            return cursors[a].item.key > cursors[b].item.key;
+        };
+        std::make_heap(heap.begin(), heap.end(), later);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            size_t c = heap.back();
+            MergeItem acc = cursors[c].item;
+            if (advance(cursors[c])) {
+                std::push_heap(heap.begin(), heap.end(), later);
+            } else {
+                heap.pop_back();
+            }
+            while (!heap.empty() && cursors[heap.front()].item.key == acc.key) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                size_t d = heap.back();
+                combine(acc, cursors[d].item);
+                if (advance(cursors[d])) {
+                    std::push_heap(heap.begin(), heap.end(), later);
+                } else {
+                    heap.pop_back();
+                }
+            }
+            emit(acc);
+        }
+    }
+
+    std::string& text() { return _text; }
+    const MergeStats& stats() const { return _stats; }
+    bool bad() const { return _bad; }
+
+private:
+    bool _recount;
+    long _atLeast;
+    bool _bad;
+    std::string _text;
+    MergeStats _stats;
+
+    bool advance(Cursor& c) {
+        if (c.next >= c.end) return false;
+        if (!parseItem(c.index->line(c.next++), c.item)) {
+            _bad = true;
+            return false;
+        }
+        return true;
+    }
+
+    void combine(MergeItem& acc, const MergeItem& it) {
+        acc.covered = std::max(acc.covered, it.covered);
+        acc.coverable = std::max(acc.coverable, it.coverable);
+        acc.count += it.count;
+    }
+
+    void emit(MergeItem& it) {
+        if (_recount && it.coverable > 0 && it.count >= _atLeast) {
+            it.covered = std::max(it.covered, it.coverable);
+        }
+        _text.append(it.key);
+        _text += '\t';
+        _text.append(it.id);
+        _text += '\t';
+        appendLong(_text, it.covered);
+        _text += '\t';
+        appendLong(_text, it.coverable);
+        _text += '\t';
+        appendLong(_text, it.count);
+        _text += '\n';
+        _stats.records++;
+        _stats.covered += it.covered;
+        _stats.coverable += it.coverable;
+    }
+};
+
+bool mergeSnapshots(const std::string& out, const std::vector<std::string>& inputs,
+                    const MergeOptions& opt, MergeStats& stats, std::string& err)
+{
+    std::vector<std::unique_ptr<SnapIndex> > indexes;
+    size_t largest = 0;
+    for (size_t j = 0; j < inputs.size(); j++) {
+        indexes.emplace_back(new SnapIndex);
+        if (!indexes[j]->open(inputs[j], err)) return false;
+        if (indexes[j]->kind() != indexes[0]->kind()) {
+            err = "cannot merge " + inputs[j] + " (" + indexes[j]->kind() +
+                  ") with " + inputs[0] + " (" + indexes[0]->kind() + ")";
+            return false;
+        }
+        if (indexes[j]->size() > indexes[largest]->size()) largest = j;
+    }
+
+    // key ranges: bounds[r * inputs + j] is where range r starts in input j
+    size_t n = indexes[largest]->size();
+    size_t ranges = std::max((size_t)1, std::min(n, std::max(
+            (size_t)opt.jobs * 4, n / RANGE_RECORDS)));
+    std::vector<size_t> bounds((ranges + 1) * inputs.size());
+    for (size_t j = 0; j < inputs.size(); j++) {
+        bounds[ranges * inputs.size() + j] = indexes[j]->size();
+    }
+    for (size_t r = 1; r < ranges; r++) {
+        std::string_view split = indexes[largest]->key(r * n / ranges);
+        for (size_t j = 0; j < inputs.size(); j++) {
+            bounds[r * inputs.size() + j] = indexes[j]->lowerBound(split);
+        }
+    }
+
+    // OUT is renamed into place, and stdout gets a copy, only once the
+    // whole merge has succeeded: a malformed input writes nothing
+    bool toStdout = out == "-";
+    std::string tmp = toStdout ? "a temporary file" : out + ".tmp." + std::to_string(getpid());
+    FILE* fp = toStdout ? tmpfile() : fopen(tmp.c_str(), "w");
+    if (!fp) {
+        err = "cannot create " + tmp + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = fprintf(fp, "#covsnap 2 %s\n", indexes[0]->kind().c_str()) > 0;
+    bool bad = false;
+    memset(&stats, 0, sizeof(stats));
+
+    // a batch of ranges at a time, written in order as it completes, so
+    // memory is bounded by the batch and not the output
+    bool recount = indexes[0]->kind() == "group";
+    for (size_t first = 0; ok && !bad && first < ranges; first += opt.jobs) {
+        size_t count = std::min((size_t)opt.jobs, ranges - first);
+        std::vector<std::unique_ptr<RangeMerger> > mergers(count);
+        parallelFor(count, opt.jobs, [&](size_t i) {
+            size_t r = first + i;
+            std::vector<Cursor> cursors(inputs.size());
+            for (size_t j = 0; j < inputs.size(); j++) {
+                cursors[j].index = indexes[j].get();
+                cursors[j].next = bounds[r * inputs.size() + j];
+                cursors[j].end = bounds[(r + 1) * inputs.size() + j];
+            }
+            mergers[i].reset(new RangeMerger(recount, opt.atLeast));
+            mergers[i]->merge(cursors);
+        });
+        for (size_t i = 0; i < count; i++) bad = bad || mergers[i]->bad();
+        for (size_t i = 0; !bad && i < count; i++) {
+            const std::string& text = mergers[i]->text();
+            ok = ok && fwrite(text.data(), 1, text.size(), fp) == text.size();
+            stats.records += mergers[i]->stats().records;
+            stats.covered += mergers[i]->stats().covered;
+            stats.coverable += mergers[i]->stats().coverable;
+        }
+    }
+
+    ok = !fflush(fp) && ok;
+    if (ok && !bad && toStdout) {
+        char buf[1 << 16];
+        size_t got;
+        rewind(fp);
+        while (ok && (got = fread(buf, 1, sizeof(buf), fp)) > 0) {
+            ok = fwrite(buf, 1, got, stdout) == got;
+        }
+        ok = ok && !ferror(fp) && !fflush(stdout);
+    }
+    ok = !fclose(fp) && ok;
+    if (bad) {
+        err = "malformed record in an input snapshot";
+    } else if (!ok || (!toStdout && rename(tmp.c_str(), out.c_str()))) {
+        err = "cannot write " + out + ": " + strerror(errno);
+    }
+    if (!err.empty() && !toStdout) unlink(tmp.c_str());
+    return err.empty();
+}
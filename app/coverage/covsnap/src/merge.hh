@@ -0,0 +1,40 @@
+/// Merging snapshots of separate VDBs (covsnap merge).
+///
+/// Snapshots of the same design from separate VDBs are combined record
+/// by record, without UCAPI:
+///
+///     toggle  an object is covered if it is covered in any input, and
+///             coverable if it is coverable in any input
+///     group   hit counts are summed; a bin is covered if it is covered
+///             in any input or its summed count reaches atLeast
+///
+/// Records present in only some inputs are kept as they are.  The inputs
+/// are sorted by key, so this is a k-way merge; the key space is cut into
+/// ranges at keys of the largest input, located in every input with its
+/// prefix index (snapindex.hh), and the ranges are merged on separate
+/// threads and written in order.
+
+#ifndef MERGE_HH
+#define MERGE_HH
+
+#include <string>
+#include <vector>
+
+struct MergeOptions {
+    unsigned jobs;      // threads
+    long atLeast;       // hits that cover a group bin
+
+    MergeOptions() : jobs(1), atLeast(1) { }
+};
+
+struct MergeStats {
+    long records;
+    long covered;
+    long coverable;
+};
+
+/// Merge the snapshots inputs into out ("-" for stdout)
+bool mergeSnapshots(const std::string& out, const std::vector<std::string>& inputs,
+                    const MergeOptions& opt, MergeStats& stats, std::string& err);
+
+#endif
@@ -0,0 +1,248 @@
+/// Prefix index over a snapshot - see snapindex.hh.
+
+#include "snapindex.hh"
+#include "snapshot.hh"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char indexMagic[] = "#covsnap-index 1\n";
+
+struct SnapIndexHeader {
+    char magic[24];
+    uint64_t count;
+    uint64_t snapSize;          // size and mtime of the snapshot indexed
+    int64_t snapSec;
+    int64_t snapNsec;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(SnapIndexHeader) == 64, "SnapIndexHeader is stored as is");
+static_assert(sizeof(SnapIndexEntry) == 32, "SnapIndexEntry is stored as is");
+
+static void fillHeader(SnapIndexHeader& hdr, const struct stat& st, size_t count)
+{
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, indexMagic, sizeof(indexMagic) - 1);
+    hdr.count = count;
+    hdr.snapSize = st.st_size;
+    hdr.snapSec = st.st_mtim.tv_sec;
+    hdr.snapNsec = st.st_mtim.tv_nsec;
+}
+
+/// Read snap record by record into entries; st is the snapshot's
+/// stat, checked again at the end so a snapshot rewritten meanwhile
+/// is not indexed
+static bool readEntries(const std::string& snap, const struct stat& st,
+                        std::vector<SnapIndexEntry>& entries, std::string& err)
+{
+    SnapshotReader rd;
+    if (!rd.open(snap.c_str(), err)) return false;
+    SnapIndexEntry e = { 0, 0, 0, 0 };
+    SnapRecord rec;
+    entries.clear();
+    while (rd.next(rec)) {
+        e.offset = rd.offset();
+        entries.push_back(e);
+        e.covered += rec.covered;
+        e.coverable += rec.coverable;
+        if (rec.coverable > 0 && rec.covered < rec.coverable) e.uncovered++;
+    }
+    if (!rd.error().empty()) {
+        err = rd.error();
+        return false;
+    }
+    e.offset = rd.end();
+    entries.push_back(e);
+    if (e.offset != (uint64_t)st.st_size) {
+        err = snap + ": changed while indexing";
+        return false;
+    }
+    return true;
+}
+
+/// Write the index next to snap, renamed into place whole
+static bool saveIndex(const std::string& snap, const struct stat& st,
+                      const std::vector<SnapIndexEntry>& entries, std::string& err)
+{
+    std::string file = snap + ".idx";
+    std::string tmp = file + ".tmp." + std::to_string(getpid());
+    SnapIndexHeader hdr;
+    fillHeader(hdr, st, entries.size() - 1);
+    FILE* fp = fopen(tmp.c_str(), "w");
+    if (!fp) {
+        err = "cannot create " + tmp + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+              fwrite(entries.data(), sizeof(SnapIndexEntry), entries.size(), fp)
+                      == entries.size();
+    ok = !fclose(fp) && ok;
+    if (!ok || rename(tmp.c_str(), file.c_str())) {
+        err = "cannot write " + file + ": " + strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SnapIndex::build(const std::string& snap, std::string& err)
+{
+    struct stat st;
+    if (stat(snap.c_str(), &st)) {
+        err = "cannot open " + snap + ": " + strerror(errno);
+        return false;
+    }
+    std::vector<SnapIndexEntry> entries;
+    return readEntries(snap, st, entries, err) && saveIndex(snap, st, entries, err);
+}
+
+SnapIndex::SnapIndex()
+        : _data(NULL), _dataSize(0), _map(NULL), _mapSize(0), _entries(NULL),
+          _count(0)
+{
+}
+
+SnapIndex::~SnapIndex()
+{
+    if (_data) munmap((void*)_data, _dataSize);
+    if (_map) munmap(_map, _mapSize);
+}
+
+/// Map all of fd read-only; NULL for an empty file
+static void* mapFile(int fd, size_t size)
+{
+    if (size == 0) return NULL;
+    void* p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+bool SnapIndex::open(const std::string& snap, std::string& err)
+{
+    int fd = ::open(snap.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        err = "cannot open " + snap + ": " + strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    _dataSize = st.st_size;
+    _data = (const char*)mapFile(fd, _dataSize);
+    close(fd);
+    const char* nl = _data ? (const char*)memchr(_data, '\n', _dataSize) : NULL;
+    if (!nl || strncmp(_data, "#covsnap 2 ", 11)) {
+        err = snap + ": not a covsnap snapshot";
+        return false;
+    }
+    _kind.assign(_data + 11, nl - _data - 11);
+    if (!_kind.empty() && _kind.back() == '\r') _kind.erase(_kind.size() - 1);
+
+    // the saved index, if it was built from this very snapshot
+    SnapIndexHeader want;
+    fillHeader(want, st, 0);
+    std::string file = snap + ".idx";
+    fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat ist;
+    if (fd >= 0 && !fstat(fd, &ist) && (size_t)ist.st_size >= sizeof(SnapIndexHeader)) {
+        _mapSize = ist.st_size;
+        _map = mapFile(fd, _mapSize);
+    }
+    if (fd >= 0) close(fd);
+    if (_map) {
+        const SnapIndexHeader* hdr = (const SnapIndexHeader*)_map;
+        if (!memcmp(hdr->magic, want.magic, sizeof(want.magic)) &&
+            hdr->snapSize == want.snapSize && hdr->snapSec == want.snapSec &&
+            hdr->snapNsec == want.snapNsec &&
+            _mapSize == sizeof(SnapIndexHeader) +
+                        (hdr->count + 1) * sizeof(SnapIndexEntry)) {
+            _entries = (const SnapIndexEntry*)(hdr + 1);
+            _count = hdr->count;
+            return true;
+        }
+        munmap(_map, _mapSize);
+        _map = NULL;
+    }
+
+    // missing or stale: build it, and keep it in memory if it cannot be saved
+    if (!readEntries(snap, st, _built, err)) return false;
+    std::string saveErr;
+    if (!saveIndex(snap, st, _built, saveErr)) _warning = saveErr;
+    _entries = _built.data();
+    _count = _built.size() - 1;
+    return true;
+}
+
+std::string_view SnapIndex::line(size_t i) const
+{
+    size_t begin = _entries[i].offset, end = _entries[i + 1].offset;
+    if (end > begin && _data[end - 1] == '\n') end--;
+    return std::string_view(_data + begin, end - begin);
+}
+
+std::string_view SnapIndex::key(size_t i) const
+{
+    std::string_view l = line(i);
+    return l.substr(0, l.find('\t'));
+}
+
+size_t SnapIndex::search(std::string_view p, bool past) const
+{
+    size_t lo = 0, hi = _count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        std::string_view k = key(mid);
+        int c = past ? k.substr(0, p.size()).compare(p) : k.compare(p);
+        if (past ? c <= 0 : c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void SnapIndex::addPrefix(std::string_view p, std::vector<SnapRange>& ranges) const
+{
+    SnapRange r = { search(p, false), search(p, true) };
+    if (r.begin < r.end) ranges.push_back(r);
+}
+
+void SnapIndex::subtree(std::string_view path, std::vector<SnapRange>& ranges) const
+{
+    ranges.clear();
+    if (path.empty() || path.back() == '.') {
+        addPrefix(path, ranges);
+        return;
+    }
+    size_t exact = search(path, false);
+    if (exact < _count && key(exact) == path) {
+        SnapRange r = { exact, exact + 1 };
+        ranges.push_back(r);
+    }
+    // '.' < ':' < '[', so the ranges come out in key order
+    std::string p(path);
+    p += '.';
+    addPrefix(p, ranges);
+    p.back() = ':';
+    addPrefix(p, ranges);
+    p.back() = '[';
+    addPrefix(p, ranges);
+}
+
+SnapTotals SnapIndex::totals(const std::vector<SnapRange>& ranges) const
+{
+    SnapTotals t = { 0, 0, 0, 0 };
+    for (size_t i = 0; i < ranges.size(); i++) {
+        const SnapIndexEntry& b = _entries[ranges[i].begin];
+        const SnapIndexEntry& e = _entries[ranges[i].end];
+        t.covered += e.covered - b.covered;
+        t.coverable += e.coverable - b.coverable;
+        t.uncovered += e.uncovered - b.uncovered;
+        t.items += ranges[i].end - ranges[i].begin;
+    }
+    return t;
+}
@@ -0,0 +1,105 @@
+/// Prefix index over a snapshot (covsnap index, covsnap query).
+///
+/// The index of snapshot SNAP is SNAP.idx, built on first use and
+/// rebuilt when SNAP's size or mtime no longer match.  It is binary, in
+/// the host's byte order:
+///
+///     header   64 bytes: magic, record count, size and mtime of SNAP
+///     entries  count + 1 SnapIndexEntry, one per record in key order
+///              and a last one for the end of the data
+///
+/// An entry holds the offset of its record's line in SNAP and the
+/// covered, coverable and uncovered-item totals of all records before
+/// it.  A query maps both files and binary-searches the keys in place,
+/// so nothing is parsed at startup; the totals of a run of records are
+/// the difference of two entries, so a subtree rollup costs a few
+/// searches whatever its size.
+
+#ifndef SNAPINDEX_HH
+#define SNAPINDEX_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SnapIndexEntry {
+    uint64_t offset;        // of the record's line in the snapshot
+    int64_t covered;        // totals of the records before this one
+    int64_t coverable;
+    int64_t uncovered;      // items with 0 < coverable, covered < coverable
+};
+
+/// Totals of a set of records
+struct SnapTotals {
+    int64_t covered;
+    int64_t coverable;
+    int64_t items;
+    int64_t uncovered;
+};
+
+/// Records [begin, end) of an index
+struct SnapRange {
+    size_t begin;
+    size_t end;
+};
+
+class SnapIndex {
+public:
+    SnapIndex();
+    ~SnapIndex();
+
+    /// Build or rebuild the index of snap and save it as snap.idx
+    static bool build(const std::string& snap, std::string& err);
+
+    /// Map snap and its index, building the index first if it is missing
+    /// or stale.  If the index cannot be saved it is kept in memory and
+    /// warning() says why.
+    bool open(const std::string& snap, std::string& err);
+
+    const std::string& kind() const { return _kind; }
+    const std::string& warning() const { return _warning; }
+
+    /// Number of records
+    size_t size() const { return _count; }
+
+    /// Records at or below path in the hierarchy: the key path itself
+    /// and keys continuing it with '.', ':' or '[' (instance, toggle
+    /// direction, bit).  An empty path or one ending in '.' matches by
+    /// plain prefix.  Ranges are in key order and do not overlap.
+    void subtree(std::string_view path, std::vector<SnapRange>& ranges) const;
+
+    SnapTotals totals(const std::vector<SnapRange>& ranges) const;
+
+    /// First record whose key is >= key
+    size_t lowerBound(std::string_view key) const { return search(key, false); }
+
+    /// Record i's line, without the newline
+    std::string_view line(size_t i) const;
+    std::string_view key(size_t i) const;
+    bool isUncovered(size_t i) const {
+        return _entries[i + 1].uncovered != _entries[i].uncovered;
+    }
+
+private:
+    const char* _data;          // the mapped snapshot
+    size_t _dataSize;
+    void* _map;                 // the mapped index, if read from disk
+    size_t _mapSize;
+    std::vector<SnapIndexEntry> _built;     // or built here
+    const SnapIndexEntry* _entries;
+    size_t _count;
+    std::string _kind;
+    std::string _warning;
+
+    /// First record whose key is >= p, or with past, whose key neither
+    /// starts with p nor sorts before it
+    size_t search(std::string_view p, bool past) const;
+    void addPrefix(std::string_view p, std::vector<SnapRange>& ranges) const;
+
+    SnapIndex(const SnapIndex&);
+    SnapIndex& operator=(const SnapIndex&);
+};
+
+#endif
@@ -0,0 +1,143 @@
+/// Coverage snapshot files - see snapshot.hh for the format.
+
+#include "snapshot.hh"
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+
+static const char* MAGIC = "#covsnap 2 ";
+static const size_t IOBUF = 1 << 20;
+
+SnapshotReader::SnapshotReader()
+        : _fp(NULL), _line(NULL), _cap(0), _lineno(0), _offset(0), _end(0)
+{
+}
+
+SnapshotReader::~SnapshotReader()
+{
+    if (_fp && _fp != stdin) fclose(_fp);
+    free(_line);
+}
+
+bool SnapshotReader::open(const char* path, std::string& err)
+{
+    _path = path;
+    _fp = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!_fp) {
+        err = std::string("cannot open ") + path;
+        return false;
+    }
+    setvbuf(_fp, NULL, _IOFBF, IOBUF);
+
+    ssize_t n = getline(&_line, &_cap, _fp);
+    _lineno = 1;
+    _end = n > 0 ? n : 0;
+    if (n <= 0 || strncmp(_line, MAGIC, strlen(MAGIC))) {
+        err = std::string(path) + ": not a covsnap snapshot";
+        return false;
+    }
+    _kind.assign(_line + strlen(MAGIC));
+    while (!_kind.empty() && (_kind.back() == '\n' || _kind.back() == '\r')) {
+        _kind.erase(_kind.size() - 1);
+    }
+    return true;
+}
+
+/// Parse a number at p, which must run up to a tab; p is left past it
+static bool field(char*& p, uint64_t& v)
+{
+    char* end;
+    v = strtoull(p, &end, 16);
+    if (end == p || *end != '\t') return false;
+    p = end + 1;
+    return true;
+}
+
+static bool field(char*& p, long& v)
+{
+    char* end;
+    v = strtol(p, &end, 10);
+    if (end == p || *end != '\t') return false;
+    p = end + 1;
+    return true;
+}
+
+/// Parse the last number of a line, which must run up to its end
+static bool lastField(char* p, long& v)
+{
+    char* end;
+    v = strtol(p, &end, 10);
+    if (end == p) return false;
+    if (*end == '\r') end++;
+    return *end == '\n' || *end == '\0';
+}
+
+bool SnapshotReader::next(SnapRecord& rec)
+{
+    ssize_t n = getline(&_line, &_cap, _fp);
+    if (n <= 0) return false;
+    _lineno++;
+    _offset = _end;
+    _end += n;
+
+    char* tab = strchr(_line, '\t');
+    char* p = tab ? tab + 1 : NULL;
+    bool ok = p && field(p, rec.id) && field(p, rec.covered) &&
+              field(p, rec.coverable) && lastField(p, rec.count);
+    if (!ok) {
+        std::ostringstream os;
+        os << _path << ":" << _lineno << ": malformed record";
+        _err = os.str();
+        return false;
+    }
+    rec.key.assign(_line, tab - _line);
+    if (_lineno > 2 && rec.key <= _prev) {
+        std::ostringstream os;
+        os << _path << ":" << _lineno << ": key out of order: " << rec.key;
+        _err = os.str();
+        return false;
+    }
+    _prev = rec.key;
+    return true;
+}
+
+SnapshotWriter::SnapshotWriter()
+        : _fp(NULL), _ok(true)
+{
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    close();
+}
+
+bool SnapshotWriter::open(const char* path, const std::string& kind,
+                          std::string& err)
+{
+    _fp = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!_fp) {
+        err = std::string("cannot create ") + path;
+        return false;
+    }
+    setvbuf(_fp, NULL, _IOFBF, IOBUF);
+    _ok = fprintf(_fp, "%s%s\n", MAGIC, kind.c_str()) > 0;
+    return _ok;
+}
+
+void SnapshotWriter::write(const SnapRecord& rec)
+{
+    if (fprintf(_fp, "%s\t%016llx\t%ld\t%ld\t%ld\n", rec.key.c_str(),
+                (unsigned long long)rec.id, rec.covered, rec.coverable,
+                rec.count) < 0) {
+        _ok = false;
+    }
+}
+
+bool SnapshotWriter::close()
+{
+    if (!_fp) return _ok;
+    if (fflush(_fp)) _ok = false;
+    if (_fp != stdout && fclose(_fp)) _ok = false;
+    _fp = NULL;
+    return _ok;
+}
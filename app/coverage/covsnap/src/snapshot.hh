@@ -0,0 +1,99 @@
+/// Coverage snapshot files.
+///
+/// A snapshot is the flat, sorted form of a dumper's output, written with
+/// --snapshot FILE by dumptgl and dump_func_cov_to_json:
+///
+///     #covsnap 2 <kind>
+///     <key>\t<id>\t<covered>\t<coverable>\t<count>
+///     ...
+///
+/// <kind> is "toggle" or "group".  Every coverable item is one line,
+/// keyed by its canonical hierarchical path (toggle: instance.signal[bit]
+/// plus ":0->1" or ":1->0"; group: parent.variant.coverpoint.container.
+/// bin).  <id> is the item's stable 64-bit id as 16 hex digits, the
+/// same value the dumpers emit in their JSON (see objid.hh in either
+/// dumper).  Lines are sorted by key in byte order, so two snapshots can be
+/// joined with a single streaming merge.
+
+#ifndef SNAPSHOT_HH
+#define SNAPSHOT_HH
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+struct SnapRecord {
+    std::string key;
+    uint64_t id;
+    long covered;
+    long coverable;
+    long count;
+
+    /// Fully covered: every coverable unit is covered
+    bool isCovered() const { return coverable > 0 && covered >= coverable; }
+};
+
+/// Streams records from a snapshot file, checking the header and that
+/// keys arrive in strictly increasing order.
+class SnapshotReader {
+public:
+    SnapshotReader();
+    ~SnapshotReader();
+
+    /// Open path ("-" for stdin) and read its header
+    bool open(const char* path, std::string& err);
+
+    const std::string& kind() const { return _kind; }
+    const std::string& path() const { return _path; }
+
+    /// Read the next record.  Returns false at end of file or on a
+    /// malformed/out-of-order line, in which case error() is set.
+    bool next(SnapRecord& rec);
+
+    const std::string& error() const { return _err; }
+
+    /// Byte offset of the line of the record last read, and of the
+    /// first byte not read yet
+    uint64_t offset() const { return _offset; }
+    uint64_t end() const { return _end; }
+
+private:
+    FILE* _fp;
+    char* _line;
+    size_t _cap;
+    long _lineno;
+    uint64_t _offset;
+    uint64_t _end;
+    std::string _path;
+    std::string _kind;
+    std::string _err;
+    std::string _prev;
+
+    SnapshotReader(const SnapshotReader&);
+    SnapshotReader& operator=(const SnapshotReader&);
+};
+
+/// Writes records in the snapshot format.  Callers are responsible for
+/// handing records over in key order.
+class SnapshotWriter {
+public:
+    SnapshotWriter();
+    ~SnapshotWriter();
+
+    /// Open path ("-" for stdout) and write the header for kind
+    bool open(const char* path, const std::string& kind, std::string& err);
+
+    void write(const SnapRecord& rec);
+
+    /// Flush and close; false if any write failed
+    bool close();
+
+private:
+    FILE* _fp;
+    bool _ok;
+
+    SnapshotWriter(const SnapshotWriter&);
+    SnapshotWriter& operator=(const SnapshotWriter&);
+};
+
+#endif
@@ -0,0 +1,270 @@
+/// ExtractCache - see cache.hh.
+
+#include "cache.hh"
+#include "objid.hh"
+#include "shards.hh"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+
+// bump when the fingerprint or entry layout changes
+static const char cacheFormat[] = "covcache 1";
+
+// files up to this size are fingerprinted by content as well
+static const off_t hashLimit = 64 << 10;
+
+bool readFile(const std::string& path, std::string& out)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    out.clear();
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return false;
+        }
+        out.append(buf, n);
+    }
+    close(fd);
+    return true;
+}
+
+/// Copy everything readable from in to out
+static bool copyFd(int in, int out)
+{
+    char buf[1 << 16];
+    for (;;) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n == 0) return true;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        for (char* p = buf; n > 0; ) {
+            ssize_t w = write(out, p, n);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            p += w;
+            n -= w;
+        }
+    }
+}
+
+static bool copyFile(const std::string& from, const std::string& to)
+{
+    int in = open(from.c_str(), O_RDONLY);
+    if (in < 0) return false;
+    int out = open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool ok = out >= 0 && copyFd(in, out);
+    close(in);
+    if (out >= 0 && close(out)) ok = false;
+    return ok;
+}
+
+static void removeEntry(const std::string& dir)
+{
+    unlink((dir + "/fingerprint").c_str());
+    unlink((dir + "/report").c_str());
+    unlink((dir + "/snapshot").c_str());
+    rmdir(dir.c_str());
+}
+
+/// Fingerprint lines of every file under root/rel; the names of test
+/// directories (snps/coverage/db/testdata/<test>) are added to tests
+static void walkVdb(const std::string& root, const std::string& rel,
+                    std::vector<std::string>& files,
+                    std::vector<std::string>& tests)
+{
+    std::string dir = rel.empty() ? root : root + "/" + rel;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    while (struct dirent* e = readdir(d)) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        std::string path = rel.empty() ? e->d_name : rel + "/" + e->d_name;
+        struct stat st;
+        if (stat((root + "/" + path).c_str(), &st)) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (rel == "snps/coverage/db/testdata") tests.push_back(e->d_name);
+            walkVdb(root, path, files, tests);
+        } else if (S_ISREG(st.st_mode)) {
+            char line[128];
+            snprintf(line, sizeof(line), " %lld %lld.%09ld", (long long)st.st_size,
+                     (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+            std::string text = "file " + path + line;
+            std::string content;
+            if (st.st_size <= hashLimit && readFile(root + "/" + path, content)) {
+                text += " " + idToHex(objectId(content));
+            }
+            files.push_back(text);
+        }
+    }
+    closedir(d);
+}
+
+ExtractCache::ExtractCache(const std::string& dir)
+        : _dir(dir), _lockFd(-1), _savedStdout(-1)
+{
+}
+
+ExtractCache::~ExtractCache()
+{
+    release();
+    if (!_tmp.empty()) removeEntry(_tmp);
+    if (_lockFd >= 0) close(_lockFd);
+}
+
+bool ExtractCache::fingerprint(const std::string& tool,
+                               const std::vector<std::string>& options,
+                               const std::vector<std::string>& inputs,
+                               const char* vdb, std::string& err)
+{
+    struct stat st;
+    if (stat(vdb, &st) || !S_ISDIR(st.st_mode)) {
+        err = std::string("not a directory: ") + vdb;
+        return false;
+    }
+
+    _text = std::string(cacheFormat) + "\ntool " + tool + "\n";
+    // a rebuilt tool may write different output
+    if (!stat("/proc/self/exe", &st)) {
+        _text += "exe " + std::to_string((long long)st.st_size) + " " +
+                 std::to_string((long long)st.st_mtime) + "\n";
+    }
+    for (size_t i = 0; i < options.size(); i++) {
+        _text += "option " + options[i] + "\n";
+    }
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::string content;
+        if (!readFile(inputs[i], content)) {
+            err = "cannot read " + inputs[i];
+            return false;
+        }
+        _text += "input " + idToHex(objectId(content)) + "\n";
+    }
+
+    std::vector<std::string> files, tests;
+    walkVdb(vdb, "", files, tests);
+    std::sort(tests.begin(), tests.end());
+    std::sort(files.begin(), files.end());
+    for (size_t i = 0; i < tests.size(); i++) _text += "test " + tests[i] + "\n";
+    for (size_t i = 0; i < files.size(); i++) _text += files[i] + "\n";
+
+    _key = idToHex(objectId(_text));
+    return true;
+}
+
+bool ExtractCache::lock(std::string& err)
+{
+    if (!makeDirs(_dir, err)) return false;
+    std::string path = entry() + ".lock";
+    _lockFd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+    if (_lockFd < 0) {
+        err = "cannot open " + path + ": " + strerror(errno);
+        return false;
+    }
+    while (flock(_lockFd, LOCK_EX)) {
+        if (errno != EINTR) {
+            err = "cannot lock " + path + ": " + strerror(errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ExtractCache::fetch(const char* snapshot)
+{
+    // the key is only a hash; the stored fingerprint decides
+    std::string text;
+    if (!readFile(entry() + "/fingerprint", text) || text != _text) return false;
+    if (snapshot && !copyFile(entry() + "/snapshot", snapshot)) return false;
+
+    int fd = open((entry() + "/report").c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    std::cout.flush();
+    bool ok = copyFd(fd, STDOUT_FILENO);
+    close(fd);
+    return ok;
+}
+
+bool ExtractCache::capture(std::string& err)
+{
+    _tmp = entry() + ".tmp." + std::to_string((long)getpid());
+    removeEntry(_tmp);
+    if (mkdir(_tmp.c_str(), 0777)) {
+        err = "cannot create " + _tmp + ": " + strerror(errno);
+        _tmp.clear();
+        return false;
+    }
+    int fd = open((_tmp + "/report").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        err = "cannot write " + _tmp + "/report: " + strerror(errno);
+        return false;
+    }
+    std::cout.flush();
+    fflush(stdout);
+    _savedStdout = dup(STDOUT_FILENO);
+    if (_savedStdout < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+        err = std::string("cannot redirect stdout: ") + strerror(errno);
+        if (_savedStdout >= 0) close(_savedStdout);
+        _savedStdout = -1;
+        close(fd);
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+/// Stop capturing and pass what was captured on to the real stdout
+bool ExtractCache::release()
+{
+    if (_savedStdout < 0) return true;
+    std::cout.flush();
+    fflush(stdout);
+    dup2(_savedStdout, STDOUT_FILENO);
+    close(_savedStdout);
+    _savedStdout = -1;
+
+    int fd = open((_tmp + "/report").c_str(), O_RDONLY);
+    bool ok = fd >= 0 && copyFd(fd, STDOUT_FILENO);
+    if (fd >= 0) close(fd);
+    return ok;
+}
+
+bool ExtractCache::store(const char* snapshot, std::string& err)
+{
+    if (!release()) {
+        err = "cannot copy the report to stdout";
+        return false;
+    }
+    if (_tmp.empty()) return true;
+
+    std::string text = _tmp + "/fingerprint";
+    int fd = open(text.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    bool ok = fd >= 0 && write(fd, _text.data(), _text.size()) == (ssize_t)_text.size();
+    if (fd >= 0 && close(fd)) ok = false;
+    if (ok && snapshot) ok = copyFile(snapshot, _tmp + "/snapshot");
+
+    // an entry with another fingerprint but the same key is replaced
+    if (ok) {
+        removeEntry(entry());
+        ok = !rename(_tmp.c_str(), entry().c_str());
+    }
+    if (!ok) {
+        err = "cannot store cache entry " + entry() + ": " + strerror(errno);
+        return false;
+    }
+    _tmp.clear();
+    return true;
+}
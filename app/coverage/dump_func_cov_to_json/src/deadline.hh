@@ -0,0 +1,69 @@
+/// Deadline-bounded extraction (--deadline, --skipped, --resume).
+///
+/// The walk is cut into units: top instances and each of their
+/// children, definitions (module view) and covergroups.  With a deadline
+/// the walker takes instance and covergroup units cheapest first (by the
+/// number of instances below them) and asks admit() before each one;
+/// once the deadline has passed no unit is started, and the units not
+/// walked are listed in a manifest:
+///
+///     #covskip 1
+///     instance<TAB>top.u_soc.u_ddr
+///     covergroup<TAB>cg_mode
+///
+/// A later run given the manifest with --resume walks only the units it
+/// lists (and the instances above them, without their own objects), so
+/// the two runs' outputs cover the design between them.  That run may
+/// have a deadline as well and leave a manifest of its own.
+
+#ifndef DEADLINE_HH
+#define DEADLINE_HH
+
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+
+class Deadline {
+public:
+    enum Kind { Instance, Definition, Covergroup };
+    enum Admit {
+        Skip,       // don't walk the unit
+        Walk,       // walk it and everything below it
+        Through     // walk only the units listed below it (--resume)
+    };
+
+    Deadline();
+
+    /// Stop starting units seconds from now
+    void set(double seconds);
+
+    /// Walk only the units listed in the manifest file
+    bool resume(const std::string& file, std::string& err);
+
+    bool expired() const;
+
+    /// Decide on the unit kind/name.  parent is the decision for the
+    /// top instance enclosing it, or start() for top-level units.  Units
+    /// turned away by the deadline are recorded as skipped.
+    Admit admit(Kind kind, const char* name, Admit parent);
+
+    /// The decision every top-level unit is made under
+    Admit start() const { return _resuming ? Through : Walk; }
+
+    size_t skipped() const { return _skipped.size(); }
+
+    /// Write the units skipped, renamed into place
+    bool writeManifest(const std::string& file, std::string& err) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    bool _set;
+    Clock::time_point _end;
+    std::set<std::string> _resume;      // "<kind>\t<name>" listed
+    std::vector<std::string> _skipped;  // the same, in walk order
+    bool _resuming;
+};
+
+#endif
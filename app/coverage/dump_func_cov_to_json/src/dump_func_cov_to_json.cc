@@ -4,8 +4,30 @@
 
 #include "covdb_user.h"
 #include "visit.hh"
+#include "pathfilter.hh"
+#include "objid.hh"
+#include "jsonout.hh"
+#include "parallel.hh"
+#include "shards.hh"
+#include "cache.hh"
+#include "state.hh"
+#include "watch.hh"
+#include "html.hh"
+#include "trend.hh"
+#include "progress.hh"
+#include "deadline.hh"
+#include "spill.hh"
+#include "holes.hh"
 #include <iostream>
 #include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <vector>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
@@ -13,15 +35,173 @@
 
 using namespace rapidjson;
 
-class GroupVisCpp : public UcapiVisitor {
+/// Coverage rolled up over a subtree of the covergroup model.  Raw
+/// covered/coverable bin counts are summed; the score is the mean of
+/// each bin container's covered/coverable ratio weighted by its
+/// covdbWeight, which is how covergroup scores combine coverpoints.
+/// Holes are ranked by the uncovered bins times the same weight.
+struct Rollup {
+    long covered;
+    long coverable;
+    double weighted;
+    long weight;
+    long uncoveredWeight;
+
+    Rollup() : covered(0), coverable(0), weighted(0), weight(0), uncoveredWeight(0) { }
+
+    void add(const Rollup& o) {
+        covered += o.covered;
+        coverable += o.coverable;
+        weighted += o.weighted;
+        weight += o.weight;
+        uncoveredWeight += o.uncoveredWeight;
+    }
+
+    /// Account for one bin container's counts at the given weight
+    void addContainer(long ed, long ab, int wt) {
+        covered += ed;
+        coverable += ab;
+        if (ab > 0 && wt > 0) {
+            weighted += (double)wt * ed / ab;
+            weight += wt;
+            if (ed < ab) uncoveredWeight += wt * (ab - ed);
+        }
+    }
+};
+
+/// One bin in a snapshot file
+struct SnapRecord {
+    std::string key;
+    uint64_t id;
+    int covered;
+    int coverable;
+    long count;
+
+    bool operator<(const SnapRecord& o) const { return key < o.key; }
+
+    // for SortedRuns
+    size_t bytes() const { return sizeof(*this) + key.capacity(); }
+    void spill(SpillFile& f) const {
+        f.putString(key);
+        f.putFixed64(id);
+        f.putSigned(covered);
+        f.putSigned(coverable);
+        f.putSigned(count);
+    }
+    bool unspill(SpillFile& f) {
+        f.getString(key);
+        id = f.getFixed64();
+        covered = (int)f.getSigned();
+        coverable = (int)f.getSigned();
+        count = (long)f.getSigned();
+        return f.good();
+    }
+};
+
+/// Covergroup-only traversal: hooks are bound at compile time, see UcapiWalker
+class GroupVisCpp : public UcapiWalker<GroupVisCpp, TestbenchMetric> {
 private:
     bool _warned;
     Document _jsonDoc;
     Value* _currentInstance;
     Value* _currentVariant;
+    Value _variant;
+    Rollup _variantRollup;
+    std::vector<Rollup> _instanceRollups;
+    Rollup _totalRollup;
+
+    // optional path filter and the path/verdict of the current variant
+    const PathFilter* _filter;
+    std::string _variantPath;
+    PathFilter::Verdict _variantVerdict;
+
+    // bin records for --snapshot, keyed by their path
+    bool _snapshot;
+    SortedRuns<SnapRecord> _snapRecords;
+
+    // --mem-budget: the first _instanceBase instances, complete with
+    // their coverage, were spilled to _spill in walk order and dropped
+    // from _jsonDoc
+    size_t _memBudget;
+    std::unique_ptr<SpillFile> _spill;
+    size_t _instanceBase;
+    std::string _spillErr;
+
+    // --holes: the top holes so far, the covergroup definitions' rollups
+    // (complete only at the end) and the instance being walked
+    std::unique_ptr<HoleReport> _holes;
+    size_t _holeGroups, _holeInstances, _holeCoverpoints;
+    std::map<std::string, Rollup> _groupRollups;
+    std::string _holeInstance;
+    std::string _holeGroup;
+    size_t _holeIndex;      // into _instanceRollups; npos: none open
+
+    // canonical names of every bin given an id, for --check-ids
+    std::vector<IdName>* _idNames;
+
+    // --uncovered-only: skip fully covered containers and bins
+    bool _uncoveredOnly;
+
+    // --state: hits of earlier tests, keyed by bin id
+    CovState* _state;
+
+    /// Read the covered/coverable counts of a bin or bin container and
+    /// tell whether there is nothing left to cover in it.  With a state
+    /// or a snapshot nothing is skipped this way: every bin has to be
+    /// visited to record its hits or its snapshot entry, and covered bins
+    /// are dropped after that.
+    bool fullyCovered(covdbHandle h, covdbHandle reghdl, int& ed, int& ab) {
+        if (_state || _snapshot) return false;
+        ab = covdb_get(h, reghdl, getTest(), covdbCoverable);
+        ed = covdb_get(h, reghdl, getTest(), covdbCovered);
+        return ab <= 0 || ed >= ab;
+    }
+
+    /// Extend path by one level and, with a filter, classify it
+    PathFilter::Verdict extendPath(std::string& path, std::string_view name,
+                                   PathFilter::Verdict parent) {
+        path += ".";
+        path += name;
+        return _filter ? _filter->classify(path, parent) : PathFilter::Accept;
+    }
+
+    PathFilter::Verdict extendPath(std::string& path, const char* name,
+                                   PathFilter::Verdict parent) {
+        return extendPath(path, std::string_view(name ? name : "unknown"), parent);
+    }
+
+    /// Rollup as {"covered", "coverable", "weight", "score"}; score is a
+    /// percentage rounded to two decimals, omitted if nothing is weighted.
+    Value rollupJson(const Rollup& r) {
+        Value cov(kObjectType);
+        cov.AddMember("covered", (int64_t)r.covered, _jsonDoc.GetAllocator());
+        cov.AddMember("coverable", (int64_t)r.coverable, _jsonDoc.GetAllocator());
+        cov.AddMember("weight", (int64_t)r.weight, _jsonDoc.GetAllocator());
+        if (r.weight > 0) {
+            double score = 100.0 * r.weighted / r.weight;
+            cov.AddMember("score", floor(score * 100 + 0.5) / 100, _jsonDoc.GetAllocator());
+        }
+        return cov;
+    }
     
 
-    Value showBin(covdbHandle bin, covdbHandle reghdl, bool isAuto, bool isCross) {
+    /// Give the object at path its id: cg:<path>
+    uint64_t binId(const std::string& path) {
+        std::string name = "cg:" + path;
+        uint64_t id = objectId(name);
+        if (_idNames) {
+            IdName idn;
+            idn.id = id;
+            idn.name = name;
+            _idNames->push_back(idn);
+        }
+        return id;
+    }
+
+    /// Describe bin, whose path is parent + "." + its name; cross
+    /// components are named parent + "/" + component instead.
+    Value showBin(covdbHandle bin, covdbHandle reghdl, bool isAuto, bool isCross,
+                  const std::string& parent, char sep = '.') {
         Value binObj(kObjectType);
         
         // Add basic bin information
@@ -29,12 +209,18 @@ private:
         const char* binName = covdb_get_str(bin, covdbName);
         if (!typeName) typeName = "unknown";
         if (!binName) binName = "unknown";
+        std::string path = parent + sep + binName;
+        uint64_t binid = binId(path);
+        std::string id = idToHex(binid);
         binObj.AddMember("type", Value(typeName, _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
         binObj.AddMember("name", Value(binName, _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
+        binObj.AddMember("id", Value(id.c_str(), _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
         
         int ed = covdb_get(bin, reghdl, getTest(), covdbCovered);
         int ab = covdb_get(bin, reghdl, getTest(), covdbCoverable);
-        int ct = covdb_get(bin, reghdl, getTest(), covdbCovCount);
+        int64_t ct = covdb_get(bin, reghdl, getTest(), covdbCovCount);
+        // covered is OR-ed (max) over the tests, counts are summed
+        if (_state) _state->merge(binid, ed, ct);
         
         binObj.AddMember("covered", ed, _jsonDoc.GetAllocator());
         binObj.AddMember("coverable", ab, _jsonDoc.GetAllocator());
@@ -55,7 +241,7 @@ private:
             Value objects(kArrayType);
             covdbHandle cm, cs = covdb_iterate(bin, covdbObjects);
             while((cm = covdb_scan(cs))) {
-                objects.PushBack(showBin(cm, reghdl, isAuto, isCross), _jsonDoc.GetAllocator());
+                objects.PushBack(showBin(cm, reghdl, isAuto, isCross, path), _jsonDoc.GetAllocator());
             }
             covdb_release_handle(cs);
             binObj.AddMember("objects", objects, _jsonDoc.GetAllocator());
@@ -63,7 +249,7 @@ private:
             Value components(kArrayType);
             covdbHandle cmp, cmps = covdb_iterate(bin, covdbComponents);
             while((cmp = covdb_scan(cmps))) {
-                components.PushBack(showBin(cmp, reghdl, isAuto, isCross), _jsonDoc.GetAllocator());
+                components.PushBack(showBin(cmp, reghdl, isAuto, isCross, path, '/'), _jsonDoc.GetAllocator());
             }
             covdb_release_handle(cmps);
             binObj.AddMember("components", components, _jsonDoc.GetAllocator());
@@ -71,7 +257,7 @@ private:
             Value objects(kArrayType);
             covdbHandle k, ks = covdb_iterate(bin, covdbObjects);
             while((k = covdb_scan(ks))) {
-                objects.PushBack(showBin(k, reghdl, isAuto, isCross), _jsonDoc.GetAllocator());
+                objects.PushBack(showBin(k, reghdl, isAuto, isCross, path), _jsonDoc.GetAllocator());
             }
             covdb_release_handle(ks);
             binObj.AddMember("objects", objects, _jsonDoc.GetAllocator());
@@ -79,7 +265,7 @@ private:
             Value objects(kArrayType);
             covdbHandle kid, kids = covdb_iterate(bin, covdbObjects);
             while((kid = covdb_scan(kids))) {
-                objects.PushBack(showBin(kid, reghdl, isAuto, isCross), _jsonDoc.GetAllocator());
+                objects.PushBack(showBin(kid, reghdl, isAuto, isCross, path), _jsonDoc.GetAllocator());
             }
             covdb_release_handle(kids);
             binObj.AddMember("objects", objects, _jsonDoc.GetAllocator());
@@ -90,30 +276,46 @@ private:
     }
 
     /// iterate all coverpoints and crosses (and their bins) from a
-    /// testbench-qualified instance or definition handle
-    Value iterateGroupObjects(covdbHandle reghdl) {
+    /// testbench-qualified instance or definition handle, rolling their
+    /// coverage up into rollup as each coverpoint completes
+    Value iterateGroupObjects(covdbHandle reghdl, Rollup& rollup) {
         Value coverpoints(kArrayType);
         covdbHandle cpcr, cpcrs = covdb_iterate(reghdl, covdbObjects);
         while((cpcr = covdb_scan(cpcrs))) {
+            const char* cpName = covdb_get_str(cpcr, covdbName);
+            std::string cpPath = _variantPath;
+            PathFilter::Verdict cpVerdict = extendPath(cpPath, cpName, _variantVerdict);
+            if (cpVerdict == PathFilter::Reject) continue;
+
             const char* ann = covdb_get_annotation(cpcr, IS_CROSS);
             bool isCross = (*ann == '1');
             
             Value coverpoint(kObjectType);
-            const char* cpName = covdb_get_str(cpcr, covdbName);
             coverpoint.AddMember("type", Value(isCross ? "cross" : "coverpoint", _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
             coverpoint.AddMember("name", Value(cpName, _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
             coverpoint.AddMember("width", covdb_get(cpcr, reghdl, NULL, covdbWidth), _jsonDoc.GetAllocator());
 
+            Rollup cpRollup;
             Value containers(kArrayType);
             covdbHandle cont, conts = covdb_iterate(cpcr, covdbObjects);
             if (conts) {
                 while((cont = covdb_scan(conts))) {
                     const char* contName = covdb_get_str(cont, covdbName);
                     if (!contName) contName = "unknown";
+
+                    std::string contPath = cpPath;
+                    PathFilter::Verdict contVerdict = extendPath(contPath, contName, cpVerdict);
+                    if (contVerdict == PathFilter::Reject) continue;
+
+                    int wt = covdb_get(cont, reghdl, getTest(), covdbWeight);
+                    int contEd, contAb;
+                    if (_uncoveredOnly && fullyCovered(cont, reghdl, contEd, contAb)) {
+                        cpRollup.addContainer(contEd, contAb, wt);
+                        continue;
+                    }
                     
                     const char* autonm = "Automatically";
                     bool isAuto2 = covdb_get(cont, reghdl, NULL, covdbAutomatic);
-                    int wt = covdb_get(cont, reghdl, getTest(), covdbWeight);
                     bool isAuto = false;
                     if (contName && !strncmp(autonm, contName, sizeof(autonm))) {
                         isAuto = true;
@@ -124,20 +326,82 @@ private:
                     container.AddMember("weight", wt, _jsonDoc.GetAllocator());
                     container.AddMember("isAuto", isAuto, _jsonDoc.GetAllocator());
 
+                    long contCovered = 0, contCoverable = 0;
                     Value bins(kArrayType);
                     covdbHandle bin, bins_iter = covdb_iterate(cont, covdbObjects);
                     if (bins_iter) {
                         while((bin = covdb_scan(bins_iter))) {
-                            bins.PushBack(showBin(bin, reghdl, isAuto, isCross), _jsonDoc.GetAllocator());
+                            // counts before names: without a filter a
+                            // covered bin is dropped before any string
+                            // is fetched for it
+                            int binEd, binAb;
+                            if (_uncoveredOnly && !_filter &&
+                                fullyCovered(bin, reghdl, binEd, binAb)) {
+                                contCovered += binEd;
+                                contCoverable += binAb;
+                                continue;
+                            }
+                            std::string binPath = contPath;
+                            if (extendPath(binPath, covdb_get_str(bin, covdbName),
+                                           contVerdict) != PathFilter::Accept) {
+                                continue;
+                            }
+                            if (_uncoveredOnly && _filter &&
+                                fullyCovered(bin, reghdl, binEd, binAb)) {
+                                contCovered += binEd;
+                                contCoverable += binAb;
+                                continue;
+                            }
+                            Value binObj = showBin(bin, reghdl, isAuto, isCross, contPath);
+                            binEd = binObj["covered"].GetInt();
+                            binAb = binObj["coverable"].GetInt();
+                            contCovered += binEd;
+                            contCoverable += binAb;
+                            if (_snapshot) {
+                                SnapRecord rec;
+                                rec.key = binPath;
+                                rec.id = objectId("cg:" + binPath);
+                                rec.covered = binEd;
+                                rec.coverable = binAb;
+                                rec.count = (long)binObj["count"].GetInt64();
+                                std::replace(rec.key.begin(), rec.key.end(), '\t', ' ');
+                                std::replace(rec.key.begin(), rec.key.end(), '\n', ' ');
+                                _snapRecords.add(std::move(rec));
+                            }
+                            // with a state or a snapshot, covered bins
+                            // are only dropped now
+                            if (_uncoveredOnly && (binAb <= 0 || binEd >= binAb)) {
+                                continue;
+                            }
+                            bins.PushBack(binObj, _jsonDoc.GetAllocator());
                         }
                         covdb_release_handle(bins_iter);
                     }
                     container.AddMember("bins", bins, _jsonDoc.GetAllocator());
+
+                    Rollup contRollup;
+                    contRollup.addContainer(contCovered, contCoverable, wt);
+                    if (_uncoveredOnly &&
+                        (contCoverable <= 0 || contCovered >= contCoverable)) {
+                        cpRollup.add(contRollup);
+                        continue;
+                    }
+                    container.AddMember("coverage", rollupJson(contRollup), _jsonDoc.GetAllocator());
+                    cpRollup.add(contRollup);
                     containers.PushBack(container, _jsonDoc.GetAllocator());
                 }
                 covdb_release_handle(conts);
             }
+            rollup.add(cpRollup);
+            if (_holes && _holes->wants(_holeCoverpoints, cpRollup.uncoveredWeight)) {
+                _holes->add(_holeCoverpoints, cpPath,
+                            cpRollup.coverable - cpRollup.covered,
+                            cpRollup.coverable, cpRollup.uncoveredWeight);
+            }
+            // nothing left to report for a fully covered coverpoint
+            if (_uncoveredOnly && containers.Size() == 0) continue;
             coverpoint.AddMember("containers", containers, _jsonDoc.GetAllocator());
+            coverpoint.AddMember("coverage", rollupJson(cpRollup), _jsonDoc.GetAllocator());
             coverpoints.PushBack(coverpoint, _jsonDoc.GetAllocator());
         }
         covdb_release_handle(cpcrs);
@@ -145,24 +409,111 @@ private:
     }
 
 public:
-    GroupVisCpp(covdbHandle design) : UcapiVisitor(design) {
+    // coverpoints and bins are named from their handles, never from names()
+    static constexpr bool ContainerNames = false;
+
+    GroupVisCpp(covdbHandle design, covdbHandle test) : UcapiWalker(design, test) {
         _warned = false;
         _jsonDoc.SetObject();
         _jsonDoc.AddMember("coverageData", Value("vdb2json_output", _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
         _jsonDoc.AddMember("instances", Value(kArrayType), _jsonDoc.GetAllocator());
         _currentInstance = nullptr;
         _currentVariant = nullptr;
+        _filter = nullptr;
+        _variantVerdict = PathFilter::Accept;
+        _snapshot = false;
+        _idNames = nullptr;
+        _uncoveredOnly = false;
+        _state = nullptr;
+        _memBudget = 0;
+        _instanceBase = 0;
+        _holeGroups = _holeInstances = _holeCoverpoints = 0;
+        _holeIndex = std::string::npos;
     }
-    virtual ~GroupVisCpp() { }
+    ~GroupVisCpp() { }
 
-    virtual void startQualifiedInstance(covdbHandle inst, covdbHandle met) {
+    /// Prune covergroup instances, variants, coverpoints, bin containers
+    /// and bins rejected by filter.  Instances match their full name;
+    /// everything else matches <variant parent>.<variant>.<coverpoint>.
+    /// <container>.<bin>.
+    void setFilter(const PathFilter* filter) {
+        _filter = filter;
+    }
+
+    /// Also collect every bin as a flat record for writeSnapshot()
+    void enableSnapshot() {
+        _snapshot = true;
+    }
+
+    bool acceptQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        if (!_filter || !isTestbenchMetric(met)) return true;
+        return _filter->classify(std::string(names().regionFullName), _filter->root())
+                != PathFilter::Reject;
+    }
+
+    /// Only report bins that are not covered; fully covered bin
+    /// containers are rolled up from their counts without being iterated
+    void setUncoveredOnly(bool on) {
+        _uncoveredOnly = on;
+    }
+
+    /// Merge the hits of the loaded tests into state and report the
+    /// merged coverage
+    void setState(CovState* state) {
+        _state = state;
+    }
+
+    /// Keep the document under bytes of memory by spilling complete
+    /// instances (and the snapshot records under as much by sorting them
+    /// in runs).  The instance being walked always stays in memory.
+    void setMemBudget(size_t bytes) {
+        _memBudget = bytes;
+        _snapRecords.setBudget(bytes);
+    }
+
+    const std::string& spillError() const { return _spillErr; }
+
+    /// Rank the biggest holes as the walk goes: covergroup definitions,
+    /// covergroup instances and coverpoints by their uncovered bins times
+    /// the container weight, top of each for writeHoles()
+    void enableHoles(size_t top) {
+        _holes.reset(new HoleReport(top));
+        _holeGroups = _holes->level("covergroups", true);
+        _holeInstances = _holes->level("instances", true);
+        _holeCoverpoints = _holes->level("coverpoints", true);
+    }
+
+    /// Collect the canonical name behind every id assigned, for the
+    /// collision check pass
+    void collectIdNames(std::vector<IdName>* names) {
+        _idNames = names;
+    }
+
+    /// Variants also fix the path prefix that bin ids and filter rules
+    /// are matched against
+    bool acceptVariant(covdbHandle var, covdbHandle met) {
+        if (!isTestbenchMetric(met)) return true;
+        const char* parName = "";
+        covdbHandle par = covdb_get_handle(var, covdbParent);
+        if (par) {
+            covdbObjTypesT pty = (covdbObjTypesT)covdb_get(par, NULL, NULL, covdbType);
+            parName = covdb_get_str(par, covdbSourceDefinition == pty ?
+                                         covdbName : covdbFullName);
+        }
+        _variantPath = parName ? parName : "";
+        _variantVerdict = extendPath(_variantPath, names().regionName,
+                                     _filter ? _filter->root() : PathFilter::Accept);
+        return _variantVerdict != PathFilter::Reject;
+    }
+
+    void startQualifiedInstance(covdbHandle inst, covdbHandle met) {
         if (!isTestbenchMetric(met)) return;
         
         Value& instances = _jsonDoc["instances"];
         Value instance(kObjectType);
         
-        const char* instName = covdb_get_str(inst, covdbFullName);
-        instance.AddMember("name", Value(instName, _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
+        std::string_view instName = names().regionFullName;
+        instance.AddMember("name", Value(instName.data(), instName.size(), _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
         
         covdbHandle def = covdb_get_handle(inst, covdbDefinition);
         const char* defName = def ? covdb_get_str(def, covdbName) : "NULL";
@@ -178,6 +529,28 @@ public:
         
         instance.AddMember("variants", Value(kArrayType), _jsonDoc.GetAllocator());
         instances.PushBack(instance, _jsonDoc.GetAllocator());
+        _instanceRollups.push_back(Rollup());
+        startHoleInstance(instName, defName);
+    }
+
+    /// A new instance was added: the previous one is complete, so it is
+    /// offered as a hole
+    void startHoleInstance(std::string_view name, std::string_view group) {
+        if (!_holes) return;
+        finishHoleInstance();
+        _holeInstance = name;
+        _holeGroup = group;
+        _holeIndex = _instanceRollups.size() - 1;
+    }
+
+    void finishHoleInstance() {
+        if (_holeIndex == std::string::npos) return;
+        const Rollup& r = _instanceRollups[_holeIndex];
+        if (_holes->wants(_holeInstances, r.uncoveredWeight)) {
+            _holes->add(_holeInstances, _holeInstance, r.coverable - r.covered,
+                        r.coverable, r.uncoveredWeight);
+        }
+        _holeIndex = std::string::npos;
     }
 
     /// This method is called for each covergroup variant (distinct shape
@@ -185,7 +558,7 @@ public:
     /// its parent will be a covdbSourceInstance.  If the variant does not
     /// have type_option.instance set to 1, the parent will be a 
     /// covdbSourceDefinition (i.e., a module).
-    virtual void startVariant(covdbHandle var, covdbHandle met) {
+    void startVariant(covdbHandle var, covdbHandle met) {
         if (!isTestbenchMetric(met)) return;
         
         Value& instances = _jsonDoc["instances"];
@@ -198,14 +571,14 @@ public:
             instance.AddMember("parent", Value("", _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
             instance.AddMember("variants", Value(kArrayType), _jsonDoc.GetAllocator());
             instances.PushBack(instance, _jsonDoc.GetAllocator());
+            _instanceRollups.push_back(Rollup());
+            startHoleInstance("covergroup_showcase", "covergroup_showcase");
         }
         
-        Value& currentInstance = instances[instances.Size() - 1];
-        Value& variants = currentInstance["variants"];
-        
-        Value variant(kObjectType);
-        const char* varName = covdb_get_str(var, covdbName);
-        variant.AddMember("name", Value(varName, _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
+        Value& variant = _variant;
+        variant.SetObject();
+        std::string_view varName = names().regionName;
+        variant.AddMember("name", Value(varName.data(), varName.size(), _jsonDoc.GetAllocator()), _jsonDoc.GetAllocator());
         
         covdbHandle par = covdb_get_handle(var, covdbParent);
         if (par) {
@@ -227,45 +600,805 @@ public:
         }
 
         // Get the coverpoints and crosses for this variant
-        variant.AddMember("coverpoints", iterateGroupObjects(var), _jsonDoc.GetAllocator());
-        variants.PushBack(variant, _jsonDoc.GetAllocator());
+        _variantRollup = Rollup();
+        variant.AddMember("coverpoints", iterateGroupObjects(var, _variantRollup), _jsonDoc.GetAllocator());
     }
 
-    virtual void warnNoDesign() {
+    /// The variant's coverpoints are complete: attach its rollup and fold
+    /// it into the owning instance and the design total.
+    void finishVariant(covdbHandle var, covdbHandle met) {
+        if (!isTestbenchMetric(met)) return;
+
+        Value& instances = _jsonDoc["instances"];
+        Value& variants = instances[instances.Size() - 1]["variants"];
+        _variant.AddMember("coverage", rollupJson(_variantRollup), _jsonDoc.GetAllocator());
+        variants.PushBack(_variant, _jsonDoc.GetAllocator());
+
+        _instanceRollups.back().add(_variantRollup);
+        _totalRollup.add(_variantRollup);
+        if (_holes) _groupRollups[_holeGroup].add(_variantRollup);
+
+        if (_memBudget && instances.Size() > 1 &&
+            _jsonDoc.GetAllocator().Size() > _memBudget) {
+            spillInstances();
+        }
+    }
+
+    /// Spill every instance but the last, which may still get variants,
+    /// and rebuild the document without them: its allocator only frees
+    /// everything at once.
+    void spillInstances() {
+        if (!_spillErr.empty()) return;
+        if (!_spill) {
+            _spill.reset(new SpillFile);
+            if (!_spill->create(_spillErr)) return;
+        }
+        Value& instances = _jsonDoc["instances"];
+        SizeType last = instances.Size() - 1;
+        for (SizeType i = 0; i < last; i++) {
+            instances[i].AddMember("coverage", rollupJson(_instanceRollups[_instanceBase + i]), _jsonDoc.GetAllocator());
+            spillValue(*_spill, instances[i]);
+        }
+        _instanceBase += last;
+
+        Document doc;
+        doc.SetObject();
+        for (Value::ConstMemberIterator m = _jsonDoc.MemberBegin();
+             m != _jsonDoc.MemberEnd(); ++m) {
+            Value name(m->name, doc.GetAllocator());
+            if (&m->value == &instances) {
+                Value kept(kArrayType);
+                kept.PushBack(Value(instances[last], doc.GetAllocator()), doc.GetAllocator());
+                doc.AddMember(name, kept, doc.GetAllocator());
+            } else {
+                doc.AddMember(name, Value(m->value, doc.GetAllocator()), doc.GetAllocator());
+            }
+        }
+        _jsonDoc.Swap(doc);
+    }
+
+    void warnNoDesign() {
         if (!_warned) {
             std::cout << "\n\nWarning: the VDB does not contain compilation data. If this database contains only functional coverage data, please recompile using -covg_dump_design\n\n";
             _warned = true;
         }
     }
     
-    void outputJSON() {
+    /// Write the collected bins as a snapshot sorted by path (see
+    /// covsnap/src/snapshot.hh for the format)
+    bool writeSnapshot(const char* path, std::string& err) {
+        if (!_snapRecords.finish(err)) return false;
+        AtomicFile out(path);
+        if (!out.open(err)) return false;
+        FILE* fp = out.stream();
+        fprintf(fp, "#covsnap 2 group\n");
+        std::string last;
+        bool first = true;
+        while (SnapRecord* rec = _snapRecords.next()) {
+            // identical paths can only come from duplicate bin names
+            if (!first && rec->key == last) continue;
+            fprintf(fp, "%s\t%s\t%d\t%d\t%ld\n", rec->key.c_str(),
+                    idToHex(rec->id).c_str(), rec->covered, rec->coverable,
+                    rec->count);
+            last.swap(rec->key);
+            first = false;
+        }
+        if (!_snapRecords.error().empty()) {
+            err = _snapRecords.error();
+            return false;
+        }
+        return out.commit(err);
+    }
+
+    /// Write the holes ranked during the walk to file.  Covergroups
+    /// collect their counts over every instance, so they are ranked here.
+    bool writeHoles(const char* file, JsonOut::Style style, std::string& err) {
+        finishHoleInstance();
+        for (std::map<std::string, Rollup>::const_iterator it = _groupRollups.begin();
+             it != _groupRollups.end(); ++it) {
+            const Rollup& r = it->second;
+            _holes->add(_holeGroups, it->first, r.coverable - r.covered,
+                        r.coverable, r.uncoveredWeight);
+        }
+        long uncovered = _totalRollup.coverable - _totalRollup.covered;
+        _holes->setTotal(_holeGroups, uncovered, _totalRollup.uncoveredWeight);
+        _holes->setTotal(_holeInstances, uncovered, _totalRollup.uncoveredWeight);
+        _holes->setTotal(_holeCoverpoints, uncovered, _totalRollup.uncoveredWeight);
+        return _holes->write(file, "dump_func_cov_to_json", style, err);
+    }
+
+    /// Add the instance and total rollups to the document, once
+    void finishDocument() {
+        if (_jsonDoc.HasMember("coverage")) return;
+        Value& instances = _jsonDoc["instances"];
+        for (SizeType i = 0; i < instances.Size(); i++) {
+            instances[i].AddMember("coverage", rollupJson(_instanceRollups[_instanceBase + i]), _jsonDoc.GetAllocator());
+        }
+        _jsonDoc.AddMember("coverage", rollupJson(_totalRollup), _jsonDoc.GetAllocator());
+    }
+
+    /// Write the report to dir instead of stdout: one file per covergroup
+    /// definition under definitions/, holding the definition's instances
+    /// and their rollup, and manifest.json listing them.  Shards are
+    /// formatted and compressed on opt.jobs threads.
+    bool outputShards(const char* dir, const JsonOptions& opt, bool gzip,
+                      std::string& err) {
+        finishDocument();
+        const Value& instances = _jsonDoc["instances"];
+
+        // instances by definition, in name order
+        std::map<std::string, std::vector<SizeType> > byDef;
+        for (SizeType i = 0; i < instances.Size(); i++) {
+            byDef[instances[i]["definition"].GetString()].push_back(i);
+        }
+        std::vector<std::string> defs;
+        std::vector<Value> coverage;
+        for (std::map<std::string, std::vector<SizeType> >::const_iterator it = byDef.begin();
+             it != byDef.end(); ++it) {
+            Rollup r;
+            for (size_t j = 0; j < it->second.size(); j++) r.add(_instanceRollups[it->second[j]]);
+            defs.push_back(it->first);
+            coverage.push_back(rollupJson(r));
+        }
+
+        ShardWriter writer(dir, gzip, opt.style);
+        if (!writer.open(err)) return false;
+        std::vector<ShardFile> files;
+        bool ok = writer.write("definitions", defs.size(), opt.jobs,
+                               [&](size_t i) { return defs[i]; },
+                               [&](size_t i, JsonOut& out) {
+            const std::vector<SizeType>& members = byDef.find(defs[i])->second;
+            out.StartObject();
+            out.key("definition");
+            out.string(defs[i]);
+            out.key("coverage");
+            coverage[i].Accept(out);
+            out.key("instances");
+            out.StartArray();
+            for (size_t j = 0; j < members.size(); j++) instances[members[j]].Accept(out);
+            out.EndArray();
+            out.EndObject();
+        }, files, err);
+        if (!ok) return false;
+
+        return writer.writeManifest([&](JsonOut& out) {
+            out.StartObject();
+            out.key("format");
+            out.string("covshard 1");
+            out.key("tool");
+            out.string("dump_func_cov_to_json");
+            out.key("compression");
+            out.string(writer.compression());
+            out.key("coverage");
+            _jsonDoc["coverage"].Accept(out);
+            out.key("definitions");
+            out.StartArray();
+            for (size_t i = 0; i < defs.size(); i++) {
+                out.StartObject();
+                out.key("definition");
+                out.string(defs[i]);
+                ShardWriter::describe(files[i], out);
+                out.key("instances");
+                out.Uint64(byDef.find(defs[i])->second.size());
+                out.key("coverage");
+                coverage[i].Accept(out);
+                out.EndObject();
+            }
+            out.EndArray();
+            out.EndObject();
+        }, err);
+    }
+
+    /// Append this run's rollups to the trend store at file: every
+    /// covergroup definition and every covergroup instance, skipping
+    /// those with nothing coverable
+    bool appendTrend(const char* file, std::string& err) {
+        const Value& instances = _jsonDoc["instances"];
+        std::map<std::string, Rollup> byDef;
+        TrendWriter trend;
+        for (SizeType i = 0; i < instances.Size(); i++) {
+            const Rollup& r = _instanceRollups[i];
+            byDef[instances[i]["definition"].GetString()].add(r);
+            if (r.coverable == 0) continue;
+            trend.add("cginstance", instances[i]["name"].GetString(),
+                      r.covered, r.coverable);
+        }
+        for (std::map<std::string, Rollup>::const_iterator it = byDef.begin();
+             it != byDef.end(); ++it) {
+            if (it->second.coverable == 0) continue;
+            trend.add("covergroup", it->first, it->second.covered,
+                      it->second.coverable);
+        }
+        return trend.append(file, (int64_t)time(NULL), err);
+    }
+
+    /// Score for HtmlOut::coverage(), -1 when nothing is weighted
+    static double htmlScore(const Rollup& r) {
+        if (r.weight <= 0) return -1;
+        double score = 100.0 * r.weighted / r.weight;
+        return floor(score * 100 + 0.5) / 100;
+    }
+
+    /// Write the HTML report to dir: index.html with the total rollup and
+    /// a table of the covergroup definitions, and definitions/<def>.html
+    /// (split into pages of rowsPerPage bins) listing the top-level bins
+    /// of every instance of the definition, uncovered ones highlighted.
+    /// Definitions are written on jobs threads.
+    bool outputHtml(const char* dir, size_t rowsPerPage, unsigned jobs,
+                    std::string& err) {
+        finishDocument();
+        const Value& instances = _jsonDoc["instances"];
+        if (!htmlStart(dir, "definitions", err)) return false;
+
+        // instances by definition, in name order
+        std::map<std::string, std::vector<SizeType> > byDef;
+        for (SizeType i = 0; i < instances.Size(); i++) {
+            byDef[instances[i]["definition"].GetString()].push_back(i);
+        }
+        std::vector<std::string> defs;
+        std::vector<Rollup> rollups;
+        for (std::map<std::string, std::vector<SizeType> >::const_iterator it = byDef.begin();
+             it != byDef.end(); ++it) {
+            Rollup r;
+            for (size_t j = 0; j < it->second.size(); j++) r.add(_instanceRollups[it->second[j]]);
+            defs.push_back(it->first);
+            rollups.push_back(r);
+        }
+        std::vector<std::string> stems = fileStems(defs);
+
+        static const std::vector<std::string> columns = {
+            "instance", "variant", "coverpoint", "container", "bin",
+            "covered", "coverable", "count"
+        };
+        std::vector<std::string> errs(defs.size());
+        parallelFor(defs.size(), jobs, [&](size_t i) {
+            const std::vector<SizeType>& members = byDef.find(defs[i])->second;
+
+            // bins are walked twice: counted for the page links, then written
+            size_t rows = 0;
+            auto eachBin = [&](auto fn) {
+                for (size_t j = 0; j < members.size(); j++) {
+                    const Value& inst = instances[members[j]];
+                    const Value& variants = inst["variants"];
+                    for (SizeType v = 0; v < variants.Size(); v++) {
+                        const Value& cps = variants[v]["coverpoints"];
+                        for (SizeType c = 0; c < cps.Size(); c++) {
+                            if (!cps[c].HasMember("containers")) continue;
+                            const Value& conts = cps[c]["containers"];
+                            for (SizeType k = 0; k < conts.Size(); k++) {
+                                const Value& bins = conts[k]["bins"];
+                                for (SizeType b = 0; b < bins.Size(); b++) {
+                                    fn(inst, variants[v], cps[c], conts[k], bins[b]);
+                                }
+                            }
+                        }
+                    }
+                }
+            };
+            eachBin([&](const Value&, const Value&, const Value&, const Value&,
+                        const Value&) { rows++; });
+
+            const Rollup& r = rollups[i];
+            std::string summary = std::to_string(members.size()) + " instances, " +
+                                  std::to_string(r.covered) + " of " +
+                                  std::to_string(r.coverable) + " bins covered";
+            HtmlPages pages(std::string(dir) + "/definitions", stems[i],
+                            "covergroup " + defs[i], summary, columns, rows,
+                            rowsPerPage);
+            eachBin([&](const Value& inst, const Value& var, const Value& cp,
+                        const Value& cont, const Value& bin) {
+                int64_t ed = bin["covered"].GetInt();
+                int64_t ab = bin["coverable"].GetInt();
+                HtmlOut& out = pages.row(ed < ab);
+                out.cell(std::string_view(inst["name"].GetString(), inst["name"].GetStringLength()));
+                out.cell(std::string_view(var["name"].GetString(), var["name"].GetStringLength()));
+                out.cell(std::string_view(cp["name"].GetString(), cp["name"].GetStringLength()));
+                out.cell(std::string_view(cont["name"].GetString(), cont["name"].GetStringLength()));
+                out.cell(std::string_view(bin["name"].GetString(), bin["name"].GetStringLength()));
+                out.cell(ed);
+                out.cell(ab);
+                out.cell(bin["count"].GetInt64());
+            });
+            pages.finish(errs[i]);
+        });
+        for (size_t i = 0; i < errs.size(); i++) {
+            if (!errs[i].empty()) {
+                err = errs[i];
+                return false;
+            }
+        }
+
+        std::string index = std::string(dir) + "/index.html";
+        AtomicFile file(index);
+        if (!file.open(err)) return false;
+        {
+            HtmlOut out(file.fd());
+            out.beginPage("Functional coverage", "style.css");
+            out.raw("<table>\n<tr><th></th><th>covered</th><th>coverable</th>"
+                    "<th>score</th></tr>\n<tr><td>total</td>");
+            out.coverage(_totalRollup.covered, _totalRollup.coverable,
+                         htmlScore(_totalRollup));
+            out.raw("</tr>\n</table>\n<h2>Covergroups</h2>\n<table>\n"
+                    "<tr><th>definition</th><th>instances</th><th>covered</th>"
+                    "<th>coverable</th><th>score</th></tr>\n");
+            for (size_t i = 0; i < defs.size(); i++) {
+                const Rollup& r = rollups[i];
+                out.raw(r.covered < r.coverable ? "<tr class=\"hole\">" : "<tr>");
+                out.raw("<td><a href=\"definitions/");
+                out.text(stems[i]);
+                out.raw(".html\">");
+                out.text(defs[i]);
+                out.raw("</a></td>");
+                out.cell((int64_t)byDef.find(defs[i])->second.size());
+                out.coverage(r.covered, r.coverable, htmlScore(r));
+                out.raw("</tr>\n");
+            }
+            out.raw("</table>\n");
+            out.endPage();
+            if (!out.flush()) {
+                err = "cannot write " + index;
+                return false;
+            }
+        }
+        return file.commit(err);
+    }
+
+    /// Write the spilled instances, read back one at a time
+    bool spilledInstancesOut(JsonOut& out) {
+        if (!_spill->rewind(_spillErr)) return false;
+        for (size_t i = 0; i < _instanceBase; i++) {
+            Document instance;
+            if (!unspillValue(*_spill, instance, instance.GetAllocator())) {
+                _spillErr = "cannot read back a spilled instance";
+                return false;
+            }
+            instance.Accept(out);
+        }
+        return true;
+    }
+
+    /// Write the JSON report to fd.  With opt.jobs > 1 the instances are
+    /// formatted on that many threads and written in order with writev;
+    /// the bytes are the same as the serial writer's, and the same again
+    /// when instances were spilled and are read back here.
+    bool outputJSON(const JsonOptions& opt, int fd) {
+        finishDocument();
+        Value& instances = _jsonDoc["instances"];
+
+        // the document is complete, so formatting only reads it
+        std::cout.flush();
+        if (!opt.useRapidJson) {
+            JsonOut out(fd, opt.style);
+            out.StartObject();
+            for (Value::ConstMemberIterator m = _jsonDoc.MemberBegin();
+                 m != _jsonDoc.MemberEnd(); ++m) {
+                out.Key(m->name.GetString(), m->name.GetStringLength());
+                if (_instanceBase && &m->value == &instances) {
+                    // the spill is read back in order, so on this thread
+                    out.StartArray();
+                    if (!spilledInstancesOut(out)) return false;
+                    for (SizeType i = 0; i < instances.Size(); i++) {
+                        instances[i].Accept(out);
+                    }
+                    out.EndArray();
+                } else if (opt.jobs > 1 && &m->value == &instances) {
+                    out.StartArray();
+                    forkElements(out, instances.Size(), opt.jobs,
+                                 [&](size_t i, JsonOut& writer) {
+                                     instances[(SizeType)i].Accept(writer);
+                                 });
+                    out.EndArray();
+                } else {
+                    m->value.Accept(out);
+                }
+            }
+            out.EndObject();
+            out.raw("\n");
+            return out.flush();
+        }
+
+        if (opt.jobs > 1) {
+            auto emit = [&](size_t i, auto& writer) {
+                instances[(SizeType)i].Accept(writer);
+            };
+            std::vector<std::string> chunks;
+            if (opt.style == JsonOut::Compact) {
+                jsonChunks<Writer<StringBuffer> >(_jsonDoc, "instances", instances.Size(),
+                                                  opt.jobs, emit, chunks);
+            } else {
+                jsonChunks<PrettyWriter<StringBuffer> >(_jsonDoc, "instances", instances.Size(),
+                                                        opt.jobs, emit, chunks);
+            }
+            chunks.push_back("\n");
+            return writeChunks(fd, chunks);
+        }
+
         StringBuffer buffer;
-        PrettyWriter<StringBuffer> writer(buffer);
-        _jsonDoc.Accept(writer);
-        std::cout << buffer.GetString() << std::endl;
+        writeRapidJson(_jsonDoc, opt.style, buffer);
+        std::vector<std::string> chunks;
+        chunks.push_back(std::string(buffer.GetString(), buffer.GetSize()));
+        chunks.push_back("\n");
+        return writeChunks(fd, chunks);
     }
 };
 
 void usage(const char* nm) {
-    std::cout << "Usage: " << nm << " vdbdir\n";
+    std::cout << "Usage: " << nm << " [options] vdbdir\n"
+              << "Options:\n"
+              << "  --filter FILE     include/exclude rules for covergroup"
+                 " instance, coverpoint and bin paths; a\n"
+              << "                    re: include turns off pruning, so every"
+                 " covergroup is walked\n"
+              << "  --snapshot FILE   also write a sorted per-bin snapshot"
+                 " (see covsnap)\n"
+              << "  --check-ids       verify that no two bins share an id\n"
+              << "  --uncovered-only  list only uncovered bins and skip fully"
+                 " covered containers\n"
+              << "  --jobs N          format the JSON instances on N threads\n"
+              << "  --compact         write JSON without whitespace\n"
+              << "  --json-writer W   fast (default) or rapidjson\n"
+              << "  --outdir DIR      write one file per covergroup definition"
+                 " and a manifest to DIR instead of stdout\n"
+              << "  --compress C      gzip (default) or none, for --outdir\n"
+              << "  --cache-dir DIR   reuse the outputs of an earlier run on the"
+                 " same VDB and options\n"
+              << "  --state FILE      merge only tests not yet in FILE and save"
+                 " the merged coverage to it\n"
+              << "  --output FILE     write the JSON report to FILE, renamed into"
+                 " place, instead of stdout\n"
+              << "  --watch           keep running and update the outputs as"
+                 " tests land in the VDB (needs --output or --html)\n"
+              << "  --debounce MS     with --watch, wait until the VDB has been"
+                 " quiet for MS ms (default 2000)\n"
+              << "  --html DIR        write an HTML report to DIR: an index and"
+                 " paged covergroup tables\n"
+              << "  --html-rows N     bins per HTML page (default 1000)\n"
+              << "  --trend FILE      append the covergroup and instance rollups"
+                 " to the trend store FILE\n"
+              << "  --progress FD     write a JSON progress line to file"
+                 " descriptor FD (2: stderr) periodically\n"
+              << "  --progress-interval S\n"
+              << "                    seconds between progress lines"
+                 " (default 10)\n"
+              << "  --deadline S      start no covergroup after S seconds;"
+                 " write what was done\n"
+              << "  --skipped FILE    with --deadline, list the covergroups not"
+                 " done in FILE\n"
+              << "  --resume FILE     walk only the covergroups listed in FILE"
+                 " by --skipped\n"
+              << "  --mem-budget SIZE keep the collected instances under SIZE"
+                 " (k, m, g) and spill the rest to $TMPDIR\n"
+              << "  --holes FILE      write the biggest coverage holes (covergroups,"
+                 " instances, coverpoints) to FILE\n"
+              << "  --holes-top K     holes listed per level (default 20)\n";
     exit(1);
 }
 
-int main(int argc, const char* argv[]) {
-    if (2 != argc) usage(argv[0]);
+/// Options of one extraction
+struct DumpOptions {
+    const char* filterFile;
+    const PathFilter* filter;
+    const char* snapshotFile;
+    bool checkIds;
+    bool uncoveredOnly;
+    JsonOptions json;
+    const char* outDir;
+    bool gzip;
+    const char* outputFile;
+    const char* stateFile;
+    const char* htmlDir;
+    size_t htmlRows;
+    const char* trendFile;
+    size_t memBudget;
+    const char* holesFile;
+    size_t holesTop;
 
-    covdbHandle des = covdb_load(covdbDesign, NULL, argv[1]);
+    DumpOptions()
+            : filterFile(NULL), filter(NULL), snapshotFile(NULL),
+              checkIds(false), uncoveredOnly(false), outDir(NULL),
+              gzip(true), outputFile(NULL), stateFile(NULL),
+              htmlDir(NULL), htmlRows(1000), trendFile(NULL), memBudget(0),
+              holesFile(NULL), holesTop(20) { }
+};
+
+/// Load the design in dir, or exit with the usage message
+// heartbeat for --progress, stopped (with a last line) at exit
+static Progress progress;
+
+static covdbHandle loadDesign(const char* dir, const char* nm) {
+    progress.restart();
+    covdbHandle des = covdb_load(covdbDesign, NULL, dir);
     if (!des) {
-        std::cout << "Could not open design in directory " << argv[1] << "\n";
-        usage(argv[0]);
+        std::cout << "Could not open design in directory " << dir << "\n";
+        usage(nm);
     }
+    return des;
+}
 
+/// Merge the tests of des that state has not seen yet (all of them
+/// without a state) and write the outputs.  With newTestsOnly, nothing
+/// is written if there are no new tests.  Returns the exit status.
+static int dumpDesign(covdbHandle des, const DumpOptions& opt, CovState* state,
+                      bool newTestsOnly) {
     covdb_qualified_configure(des, covdbShowGroupsInDesign, "1");
 
-    GroupVisCpp vis(des);
+    // with a state only the tests it has not seen are loaded
+    std::vector<std::string> tests = UcapiBase::availableTests(des);
+    if (state) {
+        tests = state->testsToLoad(tests);
+        if (!state->restarted().empty()) {
+            std::cerr << "Warning: " << state->restarted() << ", merging all tests\n";
+        }
+        if (newTestsOnly && state->replaying()) return 0;
+    }
+
+    GroupVisCpp vis(des, UcapiBase::loadTests(des, tests));
+    if (opt.filter) vis.setFilter(opt.filter);
+    if (state) vis.setState(state);
+    std::vector<IdName> idNames;
+    if (opt.snapshotFile) vis.enableSnapshot();
+    if (opt.checkIds) vis.collectIdNames(&idNames);
+    vis.setUncoveredOnly(opt.uncoveredOnly);
+    vis.setMemBudget(opt.memBudget);
+    if (opt.holesFile) vis.enableHoles(opt.holesTop);
     vis.execute();
-    vis.outputJSON();
+    if (!vis.spillError().empty()) {
+        std::cout << "Error: " << vis.spillError() << "\n";
+        return 1;
+    }
+    if (opt.checkIds && checkIdCollisions(idNames, std::cout) > 0) {
+        std::cout << "Error: bin id collisions found\n";
+        return 2;
+    }
+    progress.phase("write");
+    std::string err;
+    if (opt.outDir) {
+        if (!vis.outputShards(opt.outDir, opt.json, opt.gzip, err)) {
+            std::cout << "Error: " << err << "\n";
+            return 1;
+        }
+    } else if (opt.outputFile) {
+        AtomicFile out(opt.outputFile);
+        if (!out.open(err) || !vis.outputJSON(opt.json, out.fd()) ||
+            !out.commit(err)) {
+            if (err.empty()) err = vis.spillError();
+            std::cout << "Error: could not write JSON output " << opt.outputFile
+                      << (err.empty() ? "" : ": ") << err << "\n";
+            return 1;
+        }
+    } else if (!opt.htmlDir && !vis.outputJSON(opt.json, STDOUT_FILENO)) {
+        err = vis.spillError();
+        std::cout << "Error: could not write JSON output"
+                  << (err.empty() ? "" : ": ") << err << "\n";
+        return 1;
+    }
+    if (opt.htmlDir &&
+        !vis.outputHtml(opt.htmlDir, opt.htmlRows, opt.json.jobs, err)) {
+        std::cout << "Error: " << err << "\n";
+        return 1;
+    }
+    if (opt.snapshotFile && !vis.writeSnapshot(opt.snapshotFile, err)) {
+        std::cout << "Error: could not write snapshot " << opt.snapshotFile
+                  << (err.empty() ? "" : ": ") << err << "\n";
+        return 1;
+    }
+    if (opt.trendFile && !vis.appendTrend(opt.trendFile, err)) {
+        std::cout << "Error: " << err << "\n";
+        return 1;
+    }
+    if (opt.holesFile && !vis.writeHoles(opt.holesFile, opt.json.style, err)) {
+        std::cout << "Error: " << err << "\n";
+        return 1;
+    }
+    if (opt.stateFile && !state->save(opt.stateFile, err)) {
+        std::cout << "Error: " << err << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    const char* dir = NULL;
+    DumpOptions opt;
+    const char* cacheDir = NULL;
+    bool watch = false;
+    unsigned debounceMs = 2000;
+    int progressFd = -1;
+    double progressInterval = 10;
+    double deadlineSec = 0;
+    const char* skippedFile = NULL;
+    const char* resumeFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            opt.filterFile = argv[++i];
+        } else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+            opt.snapshotFile = argv[++i];
+        } else if (!strcmp(argv[i], "--check-ids")) {
+            opt.checkIds = true;
+        } else if (!strcmp(argv[i], "--uncovered-only")) {
+            opt.uncoveredOnly = true;
+        } else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+            opt.json.jobs = (unsigned)atoi(argv[++i]);
+            if (opt.json.jobs == 0) opt.json.jobs = std::thread::hardware_concurrency();
+        } else if (!strcmp(argv[i], "--compact")) {
+            opt.json.style = JsonOut::Compact;
+        } else if (!strcmp(argv[i], "--json-writer") && i + 1 < argc &&
+                   (!strcmp(argv[i + 1], "fast") || !strcmp(argv[i + 1], "rapidjson"))) {
+            opt.json.useRapidJson = !strcmp(argv[++i], "rapidjson");
+        } else if (!strcmp(argv[i], "--outdir") && i + 1 < argc) {
+            opt.outDir = argv[++i];
+        } else if (!strcmp(argv[i], "--compress") && i + 1 < argc &&
+                   (!strcmp(argv[i + 1], "gzip") || !strcmp(argv[i + 1], "none"))) {
+            opt.gzip = !strcmp(argv[++i], "gzip");
+        } else if (!strcmp(argv[i], "--cache-dir") && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (!strcmp(argv[i], "--state") && i + 1 < argc) {
+            opt.stateFile = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            opt.outputFile = argv[++i];
+        } else if (!strcmp(argv[i], "--watch")) {
+            watch = true;
+        } else if (!strcmp(argv[i], "--debounce") && i + 1 < argc) {
+            debounceMs = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--html") && i + 1 < argc) {
+            opt.htmlDir = argv[++i];
+        } else if (!strcmp(argv[i], "--html-rows") && i + 1 < argc) {
+            opt.htmlRows = (size_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--trend") && i + 1 < argc) {
+            opt.trendFile = argv[++i];
+        } else if (!strcmp(argv[i], "--holes") && i + 1 < argc) {
+            opt.holesFile = argv[++i];
+        } else if (!strcmp(argv[i], "--holes-top") && i + 1 < argc) {
+            opt.holesTop = (size_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--progress") && i + 1 < argc) {
+            progressFd = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--progress-interval") && i + 1 < argc) {
+            progressInterval = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--deadline") && i + 1 < argc) {
+            deadlineSec = atof(argv[++i]);
+            if (!(deadlineSec > 0)) usage(argv[0]);
+        } else if (!strcmp(argv[i], "--skipped") && i + 1 < argc) {
+            skippedFile = argv[++i];
+        } else if (!strcmp(argv[i], "--resume") && i + 1 < argc) {
+            resumeFile = argv[++i];
+        } else if (!strcmp(argv[i], "--mem-budget") && i + 1 < argc) {
+            if (!parseSize(argv[++i], opt.memBudget)) usage(argv[0]);
+        } else if (argv[i][0] == '-' || dir) {
+            usage(argv[0]);
+        } else {
+            dir = argv[i];
+        }
+    }
+    if (!dir || (opt.outDir && opt.outputFile) ||
+        (cacheDir && (opt.outDir || opt.outputFile || opt.htmlDir ||
+                      opt.trendFile || opt.holesFile || opt.stateFile ||
+                      watch)) ||
+        (watch && (opt.outDir || (!opt.outputFile && !opt.htmlDir))) ||
+        opt.htmlRows == 0 || opt.holesTop == 0 || !(progressInterval > 0) ||
+        (skippedFile && !deadlineSec) ||
+        ((deadlineSec || resumeFile) &&
+         (cacheDir || opt.stateFile || opt.trendFile || watch)) ||
+        // spilled instances are only read back by the JSON writer
+        (opt.memBudget && (opt.outDir || opt.htmlDir || opt.trendFile ||
+                           opt.json.useRapidJson))) {
+        usage(argv[0]);
+    }
+    if (progressFd >= 0) {
+        if (fcntl(progressFd, F_GETFD) < 0) {
+            std::cout << "Error: --progress " << progressFd
+                      << " is not an open file descriptor\n";
+            return 1;
+        }
+        UcapiBase::setProgress(&progress);
+        progress.start(progressFd, (unsigned)(progressInterval * 1000));
+    }
+    Deadline deadline;
+    if (deadlineSec || resumeFile) {
+        std::string err;
+        if (resumeFile && !deadline.resume(resumeFile, err)) {
+            std::cout << "Error: " << err << "\n";
+            return 1;
+        }
+        if (deadlineSec) deadline.set(deadlineSec);
+        UcapiBase::setDeadline(&deadline);
+    }
+
+    PathFilter filter;
+    if (opt.filterFile) {
+        std::string err;
+        if (!filter.load(opt.filterFile, err)) {
+            std::cout << "Error: " << err << "\n";
+            return 1;
+        }
+        if (!filter.empty()) opt.filter = &filter;
+    }
+
+    // watch mode keeps the merged coverage in memory between updates
+    CovState state("dump_func_cov_to_json");
+    std::string err;
+    if (opt.stateFile) {
+        std::vector<std::string> inputs;
+        if (opt.filterFile) inputs.push_back(opt.filterFile);
+        if (!state.load(opt.stateFile, inputs, err)) {
+            std::cout << "Error: " << err << "\n";
+            return 1;
+        }
+        if (!state.restarted().empty()) {
+            std::cerr << "Warning: " << opt.stateFile << ": " << state.restarted()
+                      << ", merging all tests\n";
+        }
+    }
+
+    if (watch) {
+        VdbWatcher watcher(dir, debounceMs);
+        if (!watcher.open(err)) {
+            std::cout << "Error: " << err << "\n";
+            return 1;
+        }
+        // the outputs are written once up front, then after every burst
+        // of changes that brought new tests
+        bool newTestsOnly = false;
+        for (;;) {
+            covdbHandle des = loadDesign(dir, argv[0]);
+            int rc = dumpDesign(des, opt, &state, newTestsOnly);
+            if (rc) return rc;
+            covdb_unload(des);
+            newTestsOnly = true;
+            progress.phase("wait");
+            if (!watcher.wait(err)) {
+                std::cout << "Error: " << err << "\n";
+                return 1;
+            }
+        }
+    }
+
+    ExtractCache cache(cacheDir ? cacheDir : "");
+    bool caching = cacheDir != NULL;
+    if (caching) {
+        // options that change the outputs; --jobs and the writer don't
+        std::vector<std::string> options;
+        if (opt.snapshotFile) options.push_back("--snapshot");
+        if (opt.checkIds) options.push_back("--check-ids");
+        if (opt.uncoveredOnly) options.push_back("--uncovered-only");
+        if (opt.json.style == JsonOut::Compact) options.push_back("--compact");
+        std::vector<std::string> inputs;
+        if (opt.filterFile) inputs.push_back(opt.filterFile);
+
+        if (!cache.fingerprint("dump_func_cov_to_json", options, inputs, dir, err) ||
+            !cache.lock(err)) {
+            std::cerr << "Warning: not using the cache: " << err << "\n";
+            caching = false;
+        } else if (cache.fetch(opt.snapshotFile)) {
+            return 0;
+        }
+    }
+
+    covdbHandle des = loadDesign(dir, argv[0]);
+    if (caching && !cache.capture(err)) {
+        std::cerr << "Warning: not using the cache: " << err << "\n";
+        caching = false;
+    }
+
+    int rc = dumpDesign(des, opt, opt.stateFile ? &state : NULL, false);
+    if (rc) return rc;
     covdb_unload(des);
-    
+
+    if (skippedFile && !deadline.writeManifest(skippedFile, err)) {
+        std::cout << "Error: " << err << "\n";
+        return 1;
+    }
+    if (deadline.skipped()) {
+        // the outputs are complete for everything but the skipped covergroups
+        std::cerr << "Warning: deadline reached, " << deadline.skipped()
+                  << " covergroups skipped";
+        if (skippedFile) std::cerr << ", listed in " << skippedFile;
+        std::cerr << "\n";
+        return 3;
+    }
+
+    if (caching && !cache.store(opt.snapshotFile, err)) {
+        std::cerr << "Warning: " << err << "\n";
+    }
     return 0;
 }
@@ -0,0 +1,95 @@
+/// Ranked coverage holes (--holes FILE).
+///
+/// While the walk rolls its counts up, every instance, signal, module,
+/// covergroup or coverpoint whose counts are final is offered to a level
+/// of the report with its uncovered items.  A level keeps only the top K
+/// on a min-heap, so the report costs K entries per level and no second
+/// pass over the data.  Holes are ranked by weight: the uncovered
+/// objects for toggles, the uncovered bins times their container's
+/// covdbWeight for covergroups.  Ties are broken by name, so the report
+/// is the same in every run:
+///
+///     {"tool":"dumptgl","top":20,
+///      "instances":{"uncovered":344113,"holes":[{"name":"top.u_soc",
+///                   "uncovered":301522,"coverable":1817518,"share":87.62},...]},
+///      "signals":{...},
+///      "modules":{...}}
+///
+/// A level's uncovered (and weighted) total is that of everything it
+/// ranks, and share is a hole's weight as a percentage of it.  Holes that
+/// nest (an instance and its subtree) both count the same items.
+
+#ifndef HOLES_HH
+#define HOLES_HH
+
+#include "jsonout.hh"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct Hole {
+    std::string name;
+    long uncovered;
+    long coverable;
+    long weight;        // ranking key
+};
+
+/// The K heaviest holes seen so far
+class TopHoles {
+public:
+    explicit TopHoles(size_t k) : _k(k) { }
+
+    /// Whether a hole of this weight could make the top K; the name is
+    /// only built for those that can
+    bool wants(long weight) const {
+        return weight > 0 && (_heap.size() < _k || weight >= _heap.front().weight);
+    }
+
+    void add(Hole&& hole);
+
+    /// Heaviest first
+    std::vector<Hole> ranked() const;
+
+private:
+    size_t _k;
+    std::vector<Hole> _heap;    // lightest on top
+};
+
+class HoleReport {
+public:
+    explicit HoleReport(size_t top);
+
+    /// Add a level, written in the order added; weighted levels also
+    /// report the weight.  Returns its index.
+    size_t level(const char* name, bool weighted = false);
+
+    bool wants(size_t level, long weight) const {
+        return _levels[level].top.wants(weight);
+    }
+    void add(size_t level, std::string name, long uncovered, long coverable,
+             long weight);
+    void add(size_t level, std::string name, long uncovered, long coverable) {
+        add(level, std::move(name), uncovered, coverable, uncovered);
+    }
+
+    /// The total uncovered items and weight of a level, for the shares
+    void setTotal(size_t level, long uncovered, long weight);
+
+    /// Write the report to file, renamed into place
+    bool write(const std::string& file, const char* tool, JsonOut::Style style,
+               std::string& err) const;
+
+private:
+    struct Level {
+        std::string name;
+        bool weighted;
+        TopHoles top;
+        long uncovered;
+        long weight;
+    };
+
+    size_t _top;
+    std::vector<Level> _levels;
+};
+
+#endif
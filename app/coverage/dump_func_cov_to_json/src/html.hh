@@ -0,0 +1,121 @@
+/// HTML coverage report (--html DIR).
+///
+/// The report is a directory: index.html with the rollups and a table
+/// linking every module (toggle) or covergroup definition (functional),
+/// and per module or definition a run of pages of at most a fixed number
+/// of rows each, so a browser only loads the page in view.  Rows with
+/// something left to cover are highlighted.  All pages share style.css.
+///
+/// Pages are written as the rows are produced: HtmlOut streams escaped
+/// text through a small buffer into the page file and HtmlPages starts
+/// the next page when one is full, so the memory used does not depend on
+/// the size of the report.  Every file is renamed into place when done.
+
+#ifndef HTML_HH
+#define HTML_HH
+
+#include "shards.hh"
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Buffered HTML text written to a file descriptor
+class HtmlOut {
+public:
+    explicit HtmlOut(int fd, size_t bufSize = 1 << 16);
+    ~HtmlOut();
+
+    /// Markup, copied as is
+    void raw(std::string_view s) {
+        if (_buf.size() + s.size() > _bufSize) flush();
+        _buf.append(s.data(), s.size());
+    }
+
+    /// Text, with &, <, >, " and ' escaped
+    void text(std::string_view s);
+
+    void number(int64_t v) { raw(std::to_string((long long)v)); }
+
+    /// One table cell holding text or a number
+    void cell(std::string_view s) {
+        raw("<td>");
+        text(s);
+        raw("</td>");
+    }
+    void cell(int64_t v) {
+        raw("<td class=\"num\">");
+        number(v);
+        raw("</td>");
+    }
+
+    /// Three cells: covered, coverable and the score (a percentage,
+    /// shown as a bar; "-" when negative, i.e. nothing to score)
+    void coverage(int64_t covered, int64_t coverable, double score);
+
+    /// <!DOCTYPE> up to the opening <body>, and what closes it
+    void beginPage(std::string_view title, std::string_view css);
+    void endPage();
+
+    bool flush();
+    bool good() const { return _good; }
+
+private:
+    int _fd;
+    size_t _bufSize;
+    std::string _buf;
+    bool _good;
+};
+
+/// Create dir and dir/subdir and write dir/style.css
+bool htmlStart(const std::string& dir, const char* subdir, std::string& err);
+
+/// The pages of one module or definition: <stem>.html, <stem>-2.html, ...
+/// under dir, with perPage rows each out of rows in total.  Every page
+/// has the title, the summary (markup), links to the index and to the
+/// neighbouring pages, and a table with the given column headings.
+class HtmlPages {
+public:
+    HtmlPages(const std::string& dir, const std::string& stem,
+              const std::string& title, const std::string& summary,
+              const std::vector<std::string>& columns, size_t rows,
+              size_t perPage);
+    ~HtmlPages();
+
+    /// Start the next row, highlighted if hole is set, opening the next
+    /// page when this one is full.  The caller writes the cells.
+    HtmlOut& row(bool hole);
+
+    /// Finish the last page (an empty table if there were no rows)
+    bool finish(std::string& err);
+
+    /// Name of page k (0-based) relative to dir
+    std::string pageFile(size_t k) const;
+
+    size_t pages() const { return _pages; }
+
+private:
+    std::string _dir;
+    std::string _stem;
+    std::string _title;
+    std::string _summary;
+    std::vector<std::string> _columns;
+    size_t _perPage;
+    size_t _pages;
+    size_t _page;       // page being written
+    size_t _row;        // rows written to it
+    bool _inRow;
+    std::unique_ptr<AtomicFile> _file;
+    std::unique_ptr<HtmlOut> _out;
+    std::string _err;
+
+    void openPage(size_t k);
+    void closePage();
+    void nav();
+
+    HtmlPages(const HtmlPages&);
+    HtmlPages& operator=(const HtmlPages&);
+};
+
+#endif
@@ -0,0 +1,277 @@
+/// JsonOut - see jsonout.hh.
+
+#include "jsonout.hh"
+#include "parallel.hh"
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <new>
+#include <rapidjson/internal/dtoa.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Escape of every byte as rapidjson::Writer does it: 0 for none, 'u' for
+// \u00XX, otherwise the character after the backslash
+#define Z16 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+static const char escapes[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    Z16, Z16,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+    Z16, Z16, Z16, Z16, Z16, Z16, Z16, Z16, Z16, Z16
+};
+#undef Z16
+
+static const char hexDigits[] = "0123456789ABCDEF";
+
+static const char digitPairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// A newline followed by the indentation of up to 64 levels
+static const std::string newlineIndent = "\n" + std::string(4 * 64, ' ');
+
+/// Length of the prefix of s[0, n) that needs no escaping
+static size_t plainPrefix(const char* s, size_t n)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+        // bytes <= 0x1f are those whose unsigned max with 0x1f is 0x1f
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+#endif
+    while (i < n && !escapes[(unsigned char)s[i]]) i++;
+    return i;
+}
+
+/// Decimal digits of v, written backwards so they end just before end
+static char* formatUint(uint64_t v, char* end)
+{
+    while (v >= 100) {
+        unsigned r = (unsigned)(v % 100);
+        v /= 100;
+        end -= 2;
+        memcpy(end, digitPairs + 2 * r, 2);
+    }
+    if (v >= 10) {
+        end -= 2;
+        memcpy(end, digitPairs + 2 * v, 2);
+    } else {
+        *--end = (char)('0' + v);
+    }
+    return end;
+}
+
+JsonName::JsonName(std::string_view name)
+{
+    JsonOut out(-1, JsonOut::Compact, 64);
+    out.string(name);
+    _quoted.assign(out.data(), out.size());
+}
+
+JsonOut::JsonOut(int fd, Style style, size_t bufSize)
+        : _fd(fd), _style(style), _buf(NULL), _len(0), _cap(bufSize),
+          _ok(true), _afterKey(false)
+{
+    _buf = (char*)malloc(_cap);
+    if (!_buf) throw std::bad_alloc();
+}
+
+JsonOut::JsonOut(JsonOut&& o)
+        : _fd(o._fd), _style(o._style), _buf(o._buf), _len(o._len),
+          _cap(o._cap), _ok(o._ok), _afterKey(o._afterKey),
+          _levels(std::move(o._levels))
+{
+    o._fd = -1;
+    o._buf = NULL;
+    o._len = o._cap = 0;
+}
+
+JsonOut::~JsonOut()
+{
+    flush();
+    free(_buf);
+}
+
+/// Make room for n more bytes: write out what is pending if there is a
+/// file descriptor, and enlarge the buffer if that is not enough
+void JsonOut::grow(size_t n)
+{
+    if (_fd >= 0) flush();
+    if (_len + n <= _cap) return;
+    size_t cap = 2 * _cap > _len + n ? 2 * _cap : _len + n;
+    char* buf = (char*)realloc(_buf, cap);
+    if (!buf) throw std::bad_alloc();
+    _buf = buf;
+    _cap = cap;
+}
+
+bool JsonOut::flush()
+{
+    if (_fd < 0 || !_len) return _ok;
+    const char* p = _buf;
+    size_t left = _len;
+    while (left > 0) {
+        ssize_t n = write(_fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            _ok = false;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    // on error the output is lost either way; don't let it pile up
+    _len = 0;
+    return _ok;
+}
+
+void JsonOut::separate()
+{
+    if (_levels.empty()) return;
+    Level& level = _levels.back();
+    if (level.count++) put(',');
+    if (_style == Pretty) newline(_levels.size());
+}
+
+void JsonOut::newline(size_t depth)
+{
+    size_t n = 1 + 4 * depth;
+    if (n <= newlineIndent.size()) {
+        put(newlineIndent.data(), n);
+        return;
+    }
+    put('\n');
+    for (size_t i = 1; i < n; i++) put(' ');
+}
+
+bool JsonOut::start(char bracket, bool array)
+{
+    value();
+    put(bracket);
+    Level level = { array, 0 };
+    _levels.push_back(level);
+    return true;
+}
+
+bool JsonOut::end(char bracket)
+{
+    size_t count = _levels.back().count;
+    _levels.pop_back();
+    if (count && _style == Pretty) newline(_levels.size());
+    put(bracket);
+    return true;
+}
+
+bool JsonOut::Key(const char* s, rapidjson::SizeType n, bool)
+{
+    separate();
+    writeString(s, n);
+    _style == Pretty ? put(": ", 2) : put(':');
+    _afterKey = true;
+    return true;
+}
+
+void JsonOut::key(const JsonName& k)
+{
+    separate();
+    put(k.quoted());
+    _style == Pretty ? put(": ", 2) : put(':');
+    _afterKey = true;
+}
+
+bool JsonOut::Int64(int64_t i)
+{
+    value();
+    char tmp[21];
+    char* end = tmp + sizeof(tmp);
+    char* p = formatUint(i < 0 ? 0 - (uint64_t)i : (uint64_t)i, end);
+    if (i < 0) *--p = '-';
+    put(p, end - p);
+    return true;
+}
+
+bool JsonOut::Uint64(uint64_t u)
+{
+    value();
+    char tmp[20];
+    char* end = tmp + sizeof(tmp);
+    char* p = formatUint(u, end);
+    put(p, end - p);
+    return true;
+}
+
+bool JsonOut::Double(double d)
+{
+    value();
+    // like rapidjson::Writer, which has no representation for these
+    if (!isfinite(d)) return false;
+    char tmp[25];
+    char* end = rapidjson::internal::dtoa(d, tmp);
+    put(tmp, end - tmp);
+    return true;
+}
+
+void JsonOut::writeString(const char* s, size_t n)
+{
+    put('"');
+    for (;;) {
+        size_t plain = plainPrefix(s, n);
+        put(s, plain);
+        s += plain;
+        n -= plain;
+        if (!n) break;
+
+        unsigned char c = (unsigned char)*s++;
+        n--;
+        char e = escapes[c];
+        char* p = reserve(6);
+        p[0] = '\\';
+        if (e == 'u') {
+            p[1] = 'u';
+            p[2] = '0';
+            p[3] = '0';
+            p[4] = hexDigits[c >> 4];
+            p[5] = hexDigits[c & 0xf];
+            _len += 6;
+        } else {
+            p[1] = e;
+            _len += 2;
+        }
+    }
+    put('"');
+}
+
+JsonOut JsonOut::fork(size_t index) const
+{
+    JsonOut w(-1, _style, 64 << 10);
+    w._levels = _levels;
+    if (!w._levels.empty()) w._levels.back().count += index;
+    return w;
+}
+
+bool JsonOut::splice(const std::vector<std::string>& chunks)
+{
+    if (!_levels.empty()) _levels.back().count += chunks.size();
+    if (_fd < 0) {
+        for (size_t i = 0; i < chunks.size(); i++) put(chunks[i]);
+        return true;
+    }
+    if (flush() && !writeChunks(_fd, chunks)) _ok = false;
+    return _ok;
+}
@@ -0,0 +1,167 @@
+/// JsonOut - a streaming JSON writer specialised for the dumpers' reports.
+///
+/// The reports are mostly long runs of small fixed-schema records.  JsonOut
+/// writes them straight into a large output buffer: keys and enum-like
+/// values are escaped and quoted once (JsonName), indentation is copied
+/// from a precomputed run of spaces, integers are formatted with a digit
+/// pair table and strings are scanned for characters that need escaping
+/// 16 bytes at a time where SSE2 is available.
+///
+/// It also implements rapidjson's Handler interface, so the parts of a
+/// report that are still built as rapidjson::Value trees can be written
+/// with Value::Accept().  Pretty output is byte-identical to
+/// rapidjson::PrettyWriter with its defaults (4-space indent) and compact
+/// output to rapidjson::Writer.
+
+#ifndef JSONOUT_HH
+#define JSONOUT_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <rapidjson/document.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+/// A string escaped and quoted once, for keys and values that are
+/// written over and over
+class JsonName {
+public:
+    explicit JsonName(std::string_view name);
+
+    /// The quoted form, e.g. "\"status\""
+    std::string_view quoted() const { return _quoted; }
+
+private:
+    std::string _quoted;
+};
+
+class JsonOut {
+public:
+    enum Style { Pretty, Compact };
+
+    /// Buffer output and write it to fd whenever bufSize bytes are
+    /// pending.  With fd < 0 everything is kept in memory (see data()).
+    explicit JsonOut(int fd, Style style = Pretty, size_t bufSize = 1 << 20);
+    JsonOut(JsonOut&& o);
+    ~JsonOut();
+
+    // rapidjson Handler interface
+    bool Null() { value(); put("null", 4); return true; }
+    bool Bool(bool b) { value(); b ? put("true", 4) : put("false", 5); return true; }
+    bool Int(int i) { return Int64(i); }
+    bool Uint(unsigned u) { return Uint64(u); }
+    bool Int64(int64_t i);
+    bool Uint64(uint64_t u);
+    bool Double(double d);
+    bool RawNumber(const char* s, rapidjson::SizeType n, bool) {
+        value(); put(s, n); return true;
+    }
+    bool String(const char* s, rapidjson::SizeType n, bool = false) {
+        value(); writeString(s, n); return true;
+    }
+    bool Key(const char* s, rapidjson::SizeType n, bool = false);
+    bool StartObject() { return start('{', false); }
+    bool EndObject(rapidjson::SizeType = 0) { return end('}'); }
+    bool StartArray() { return start('[', true); }
+    bool EndArray(rapidjson::SizeType = 0) { return end(']'); }
+
+    // Fast paths for the fixed parts of a record
+    void key(const JsonName& k);
+    void key(std::string_view k) { Key(k.data(), (rapidjson::SizeType)k.size()); }
+    void string(const JsonName& s) { value(); put(s.quoted()); }
+    void string(std::string_view s) { value(); writeString(s.data(), s.size()); }
+
+    /// Bytes written as they are, outside the nesting structure (e.g.
+    /// the final newline)
+    void raw(std::string_view s) { put(s); }
+
+    /// A writer in the same nesting state as this one that is about to
+    /// write element index of the current array (counting from the
+    /// elements already written), buffering in memory.  The forked
+    /// writer's output is what this writer would produce for the element.
+    JsonOut fork(size_t index) const;
+
+    /// Write the chunks produced by forked writers, in order, and count
+    /// them as elements of the current array
+    bool splice(const std::vector<std::string>& chunks);
+
+    /// Write out everything that is pending.  Returns false if any write
+    /// to the file descriptor has failed.
+    bool flush();
+
+    bool good() const { return _ok; }
+    const char* data() const { return _buf; }
+    size_t size() const { return _len; }
+
+private:
+    struct Level {
+        bool array;
+        size_t count;   // values (arrays) or keys (objects) written
+    };
+
+    int _fd;
+    Style _style;
+    char* _buf;
+    size_t _len;
+    size_t _cap;
+    bool _ok;
+    bool _afterKey;     // the separator for the next value is written
+    std::vector<Level> _levels;
+
+    JsonOut(const JsonOut&);
+    JsonOut& operator=(const JsonOut&);
+
+    /// Room for n more bytes at _buf + _len
+    char* reserve(size_t n) {
+        if (_len + n > _cap) grow(n);
+        return _buf + _len;
+    }
+    void grow(size_t n);
+    void put(const char* s, size_t n) {
+        memcpy(reserve(n), s, n);
+        _len += n;
+    }
+    void put(std::string_view s) { put(s.data(), s.size()); }
+    void put(char c) { *reserve(1) = c; _len++; }
+
+    /// Separator and indentation before a value or key
+    void separate();
+    void value() {
+        if (_afterKey) _afterKey = false;
+        else separate();
+    }
+    void newline(size_t depth);
+    bool start(char bracket, bool array);
+    bool end(char bracket);
+    void writeString(const char* s, size_t n);
+};
+
+/// Report options common to the dumpers (--json-writer, --compact, --jobs)
+struct JsonOptions {
+    bool useRapidJson;      // write with rapidjson instead of JsonOut
+    JsonOut::Style style;
+    unsigned jobs;          // formatting threads
+
+    JsonOptions() : useRapidJson(false), style(JsonOut::Pretty), jobs(1) { }
+};
+
+/// Serialize v with rapidjson's own writers into buf, the reference
+/// output JsonOut is measured and checked against
+inline void writeRapidJson(const rapidjson::Value& v, JsonOut::Style style,
+                           rapidjson::StringBuffer& buf)
+{
+    if (style == JsonOut::Compact) {
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+        v.Accept(writer);
+    } else {
+        rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buf);
+        v.Accept(writer);
+    }
+}
+
+#endif
@@ -0,0 +1,175 @@
+/// Parallel JSON serialization with ordered output.
+///
+/// The dumpers' output is one root object with a large array member
+/// (toggle modules, covergroup instances).  jsonChunks() formats the
+/// array elements concurrently, each into its own buffer, such that
+/// concatenating the chunks in order gives exactly the bytes a single
+/// rapidjson writer would have produced; writeChunks() then hands them
+/// to the kernel in order with writev.  forkElements() does the same for
+/// JsonOut (jsonout.hh).
+///
+/// Byte identity works because a writer's output for a value only
+/// depends on the nesting state it is written in: a writer primed with
+/// the same levels (an object holding an array, with or without an
+/// earlier element) emits the same separator and indentation, and the
+/// bytes after the priming are cut off and kept.
+
+#ifndef PARALLEL_HH
+#define PARALLEL_HH
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <rapidjson/document.h>
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+#include "jsonout.hh"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/// Run fn(i) for i in [0, n) on up to jobs threads.  Indices are handed
+/// out one at a time, so uneven items balance across threads.
+template <class Fn>
+void parallelFor(size_t n, unsigned jobs, Fn fn)
+{
+    if (jobs > n) jobs = (unsigned)n;
+    if (jobs <= 1) {
+        for (size_t i = 0; i < n; i++) fn(i);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < jobs; t++) {
+        pool.push_back(std::thread([&]() {
+            size_t i;
+            while ((i = next.fetch_add(1)) < n) fn(i);
+        }));
+    }
+    for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+}
+
+/// Put w in the state it has just before writing element index of an
+/// array that is a member of the root object
+template <class Writer>
+void primeChunkWriter(Writer& w, size_t index)
+{
+    w.StartObject();
+    w.Key("");
+    w.StartArray();
+    if (index > 0) w.Null();
+}
+
+/// Write root, an object with an array member named arrayKey of n
+/// elements, with rapidjson Writer (PrettyWriter or Writer) as chunks: the
+/// part up to the array's opening bracket, one chunk per element
+/// (formatted on up to jobs threads), and the rest.  root's own arrayKey
+/// member is not written; emit(i, writer) writes element i instead and
+/// must be safe to call concurrently.
+template <class Writer, class Emit>
+void jsonChunks(const rapidjson::Value& root, const char* arrayKey,
+                size_t n, unsigned jobs, Emit emit,
+                std::vector<std::string>& chunks)
+{
+    chunks.assign(n + 2, std::string());
+    rapidjson::Value::ConstMemberIterator m = root.MemberBegin();
+
+    // head: the members before the array, then its opening bracket
+    {
+        rapidjson::StringBuffer buf;
+        Writer w(buf);
+        w.StartObject();
+        for (; m != root.MemberEnd() && strcmp(m->name.GetString(), arrayKey); ++m) {
+            m->name.Accept(w);
+            m->value.Accept(w);
+        }
+        w.Key(arrayKey);
+        w.StartArray();
+        chunks[0].assign(buf.GetString(), buf.GetSize());
+        if (m != root.MemberEnd()) ++m;
+    }
+
+    // elements, each with its leading separator and indentation
+    parallelFor(n, jobs, [&](size_t i) {
+        rapidjson::StringBuffer buf;
+        Writer w(buf);
+        primeChunkWriter(w, i);
+        size_t start = buf.GetSize();
+        emit(i, w);
+        chunks[i + 1].assign(buf.GetString() + start, buf.GetSize() - start);
+    });
+
+    // tail: closing bracket and the members after the array
+    {
+        rapidjson::StringBuffer buf;
+        Writer w(buf);
+        primeChunkWriter(w, n);
+        size_t start = buf.GetSize();
+        w.EndArray();
+        for (; m != root.MemberEnd(); ++m) {
+            m->name.Accept(w);
+            m->value.Accept(w);
+        }
+        w.EndObject();
+        chunks[n + 1].assign(buf.GetString() + start, buf.GetSize() - start);
+    }
+}
+
+/// Write n elements into the current array of out, formatting them on up
+/// to jobs threads with writers forked from out.  emit(i, writer) writes
+/// element i and must be safe to call concurrently.
+template <class Emit>
+bool forkElements(JsonOut& out, size_t n, unsigned jobs, Emit emit)
+{
+    std::vector<std::string> chunks(n);
+    parallelFor(n, jobs, [&](size_t i) {
+        JsonOut w = out.fork(i);
+        emit(i, w);
+        chunks[i].assign(w.data(), w.size());
+    });
+    return out.splice(chunks);
+}
+
+/// Write chunks to fd in order with as few writev calls as possible.
+/// Returns false on a write error.
+inline bool writeChunks(int fd, const std::vector<std::string>& chunks)
+{
+    std::vector<struct iovec> iov;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i].empty()) continue;
+        struct iovec v;
+        v.iov_base = (void*)chunks[i].data();
+        v.iov_len = chunks[i].size();
+        iov.push_back(v);
+    }
+
+    size_t first = 0;
+    while (first < iov.size()) {
+        int cnt = (int)std::min(iov.size() - first, (size_t)IOV_MAX);
+        ssize_t n = writev(fd, &iov[first], cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        // skip what was written, possibly ending inside a buffer
+        while (first < iov.size() && (size_t)n >= iov[first].iov_len) {
+            n -= iov[first].iov_len;
+            first++;
+        }
+        if (n > 0) {
+            iov[first].iov_base = (char*)iov[first].iov_base + n;
+            iov[first].iov_len -= n;
+        }
+    }
+    return true;
+}
+
+#endif
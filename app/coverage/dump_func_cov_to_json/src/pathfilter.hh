@@ -0,0 +1,85 @@
+/// PathFilter - compiled include/exclude rules over hierarchical paths.
+///
+/// A filter file holds one rule per line:
+///
+///     # comment
+///     exclude **.clk            (or: -**.clk)
+///     exclude re:scan_(in|out)  (or: -re:scan_(in|out))
+///     include soc.cpu*          (or: +soc.cpu*)
+///
+/// Glob patterns match the whole path: '*' and '?' stay within one
+/// hierarchy level (they never match '.'), '**' matches across levels,
+/// '[abc]' / '[!abc]' are character classes and '\' escapes the next
+/// character (e.g. 'data\[3\]').  Patterns prefixed with 're:' are
+/// ECMAScript regular expressions searched anywhere in the path; anchor
+/// them with ^ and $ as needed.
+///
+/// Excludes always win.  When there are no include rules everything not
+/// excluded is kept; otherwise only paths matching an include, and the
+/// subtrees below them, are kept.  A path that matches is pruned or
+/// kept together with everything below it.
+///
+/// Only include globs prune: a subtree no include glob can reach is not
+/// walked.  A regex could match anywhere below, so with any 're:' include
+/// the whole hierarchy is walked and only the matching paths are kept.
+/// Every rule needs a pattern; a bare '+' or '-' is an error.
+
+#ifndef PATHFILTER_HH
+#define PATHFILTER_HH
+
+#include <regex>
+#include <string>
+#include <vector>
+
+class PathFilter {
+public:
+    /// Verdict for a node of the hierarchy.  Maybe means the node itself
+    /// is not kept but something below it still could be.
+    enum Verdict { Reject, Maybe, Accept };
+
+    PathFilter();
+
+    /// Compile the rules in file.  Returns false and sets err on failure.
+    bool load(const char* file, std::string& err);
+
+    bool empty() const { return _nrules == 0; }
+
+    /// Verdict for the root of the hierarchy, before any path is seen
+    Verdict root() const;
+
+    /// Verdict for path given the verdict of its parent node
+    Verdict classify(const std::string& path, Verdict parent) const;
+
+private:
+    struct Node {
+        std::vector<std::pair<char, int> > next;   // sorted by char
+        std::vector<int> globs;   // globs whose literal prefix ends here
+    };
+
+    /// Globs of one kind (include or exclude), indexed by a trie over
+    /// their literal prefixes so a path only runs the matcher against
+    /// patterns that share its leading characters.
+    struct GlobSet {
+        std::vector<Node> nodes;
+        std::vector<std::string> tails;   // pattern text after the prefix
+        GlobSet() : nodes(1) { }
+        void add(const std::string& glob);
+        int child(int node, char c) const;
+        bool match(const std::string& path) const;
+        bool mayMatchBelow(const std::string& path) const;
+    };
+
+    GlobSet _includeGlobs;
+    GlobSet _excludeGlobs;
+    std::vector<std::regex> _includeRes;
+    std::vector<std::regex> _excludeRes;
+    size_t _nrules;
+
+    bool included(const std::string& path) const;
+    bool excluded(const std::string& path) const;
+    bool hasIncludes() const;
+
+    static bool globMatch(const char* pat, const char* str);
+};
+
+#endif
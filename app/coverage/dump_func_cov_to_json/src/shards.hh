@@ -0,0 +1,140 @@
+/// ShardWriter - the report as a directory of shards (--outdir).
+///
+/// Instead of one document on stdout, the report is split into one JSON
+/// document per module (toggle) or covergroup definition (functional),
+/// each in its own file, gzip-compressed unless disabled, plus a
+/// manifest.json listing every shard with its file and sizes.  Readers
+/// fetch the manifest and then only the shards they need.  Shards are
+/// formatted and compressed on a pool of threads.
+
+#ifndef SHARDS_HH
+#define SHARDS_HH
+
+#include "jsonout.hh"
+#include "parallel.hh"
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// mkdir -p
+bool makeDirs(const std::string& path, std::string& err);
+
+/// A safe, unique file name stem for each of names: characters other
+/// than letters, digits, '_', '-' and inner '.' become '_', and names
+/// that had to be changed get a hash of the real name appended
+std::vector<std::string> fileStems(const std::vector<std::string>& names);
+
+/// A file written under a temporary name next to path and renamed over
+/// it by commit(), so readers see either the old or the new file, never
+/// a partial one.  Uncommitted temporaries are removed.
+class AtomicFile {
+public:
+    explicit AtomicFile(const std::string& path);
+    ~AtomicFile();
+
+    bool open(std::string& err);
+
+    /// The temporary file, as a descriptor or (opened on first use) a stream
+    int fd() const { return _fd; }
+    FILE* stream();
+
+    /// Close the temporary file and rename it to path
+    bool commit(std::string& err);
+
+private:
+    std::string _path;
+    std::string _tmp;
+    int _fd;
+    FILE* _fp;
+
+    AtomicFile(const AtomicFile&);
+    AtomicFile& operator=(const AtomicFile&);
+};
+
+/// One file written to the output directory
+struct ShardFile {
+    std::string name;       // module or definition the shard holds
+    std::string file;       // path relative to the output directory
+    size_t bytes;           // JSON size
+    size_t stored;          // size on disk
+    std::string error;      // set if writing the file failed
+
+    ShardFile() : bytes(0), stored(0) { }
+};
+
+class ShardWriter {
+public:
+    ShardWriter(const std::string& dir, bool gzip, JsonOut::Style style);
+
+    /// Create the output directory and its parents
+    bool open(std::string& err);
+
+    /// Write shards [0, n) to subdir on up to jobs threads.  name(i) is
+    /// the name of shard i, emit(i, out) writes its document and must be
+    /// safe to call concurrently.  File names are derived from the names
+    /// and made unique.  Returns false with the first error in err if any
+    /// shard could not be written.
+    template <class Name, class Emit>
+    bool write(const char* subdir, size_t n, unsigned jobs, Name name,
+               Emit emit, std::vector<ShardFile>& files, std::string& err) {
+        files.assign(n, ShardFile());
+        std::vector<std::string> names(n);
+        for (size_t i = 0; i < n; i++) names[i] = name(i);
+        if (!shardFiles(subdir, names, files, err)) return false;
+        parallelFor(n, jobs, [&](size_t i) {
+            JsonOut out(-1, _style);
+            emit(i, out);
+            out.raw("\n");
+            store(std::string_view(out.data(), out.size()), files[i]);
+        });
+        for (size_t i = 0; i < n; i++) {
+            if (!files[i].error.empty()) {
+                err = files[i].error;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Write one document as base (".gz" is appended when compressing)
+    template <class Emit>
+    bool writeOne(const std::string& base, Emit emit, ShardFile& f, std::string& err) {
+        JsonOut out(-1, _style);
+        emit(out);
+        out.raw("\n");
+        f.name = base;
+        f.file = base + suffix();
+        store(std::string_view(out.data(), out.size()), f);
+        err = f.error;
+        return err.empty();
+    }
+
+    /// Write manifest.json, uncompressed, with emit(out)
+    template <class Emit>
+    bool writeManifest(Emit emit, std::string& err) {
+        JsonOut out(-1, JsonOut::Pretty);
+        emit(out);
+        out.raw("\n");
+        return writeFile("manifest.json", out.data(), out.size(), err);
+    }
+
+    /// The manifest members describing f: "file", "bytes", "stored"
+    static void describe(const ShardFile& f, JsonOut& out);
+
+    const char* compression() const { return _gzip ? "gzip" : "none"; }
+
+private:
+    std::string _dir;
+    bool _gzip;
+    JsonOut::Style _style;
+
+    const char* suffix() const { return _gzip ? ".json.gz" : ".json"; }
+    bool shardFiles(const char* subdir, const std::vector<std::string>& names,
+                    std::vector<ShardFile>& files, std::string& err);
+    void store(std::string_view json, ShardFile& f);
+    bool writeFile(const std::string& file, const char* data, size_t n,
+                   std::string& err);
+};
+
+#endif
@@ -0,0 +1,226 @@
+/// Spilling collected records to disk (--mem-budget).
+///
+/// A dumper holds everything it reports until the end of the walk,
+/// because its output is ordered (modules by name, snapshot records by
+/// path, covergroup instances in walk order).  With a memory budget, the
+/// records collected so far are written out as a run once they outgrow
+/// it: a temporary file in $TMPDIR (default /tmp), unlinked as soon as it
+/// is created, holding the records in a compact binary form (LEB128
+/// varints, length-prefixed strings, ids as 8 fixed bytes).  Every run
+/// is in output order, so the output is produced by merging the runs and
+/// what is left in memory, each read sequentially, and is the same as
+/// without a budget.
+
+#ifndef SPILL_HH
+#define SPILL_HH
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <rapidjson/document.h>
+
+/// An anonymous temporary file written once and then read back
+class SpillFile {
+public:
+    SpillFile();
+    ~SpillFile();
+
+    bool create(std::string& err);
+
+    void putByte(uint8_t b) { putc(b, _fp); }
+    void putVarint(uint64_t v);
+    void putSigned(int64_t v) { putVarint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+    void putFixed64(uint64_t v);
+    void putDouble(double d);
+    void putString(std::string_view s);
+
+    /// Done writing: flush and start reading from the beginning
+    bool rewind(std::string& err);
+
+    /// Reads set good() to false at the end of the file or on an error
+    uint8_t getByte();
+    uint64_t getVarint();
+    int64_t getSigned() {
+        uint64_t v = getVarint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+    uint64_t getFixed64();
+    double getDouble();
+    void getString(std::string& s);
+
+    bool good() const { return _good; }
+    uint64_t bytes() const { return _bytes; }
+
+private:
+    FILE* _fp;
+    bool _good;
+    uint64_t _bytes;    // written
+
+    SpillFile(const SpillFile&);
+    SpillFile& operator=(const SpillFile&);
+};
+
+/// A rapidjson value in the binary form, and back
+void spillValue(SpillFile& f, const rapidjson::Value& v);
+bool unspillValue(SpillFile& f, rapidjson::Value& v,
+                  rapidjson::Document::AllocatorType& allocator);
+
+/// Parse a size: a number of bytes with an optional k, m or g suffix
+bool parseSize(const char* s, size_t& bytes);
+
+/// Records collected in any order and read back sorted, stably: records
+/// that compare equal come back in the order they were added.  Rec needs
+/// operator<, bytes() (its memory), spill(SpillFile&) and
+/// unspill(SpillFile&).  With a budget, the records in memory are sorted
+/// and spilled as a run whenever their bytes() exceed it, and the runs
+/// are merged back on a heap.  Runs are merged in rounds as they pile up,
+/// Fanout runs of a round into one of the next, so only a few files are
+/// ever open however small the budget is.
+template <class Rec>
+class SortedRuns {
+public:
+    enum { Fanout = 16 };
+
+    explicit SortedRuns(size_t budget = 0)
+            : _budget(budget), _bytes(0), _spilled(0), _first(0), _memNext(0) { }
+
+    void setBudget(size_t budget) { _budget = budget; }
+
+    void add(Rec&& rec) {
+        _bytes += rec.bytes();
+        _records.push_back(std::move(rec));
+        if (_budget && _bytes > _budget) spill();
+    }
+
+    /// Done adding: sort what is in memory and start merging
+    bool finish(std::string& err) {
+        std::stable_sort(_records.begin(), _records.end());
+        startMerge(0);
+        if (!_err.empty()) {
+            err = _err;
+            return false;
+        }
+        return true;
+    }
+
+    /// The next record in order, NULL at the end or on a read error
+    Rec* next() {
+        if (_heap.empty() || !_err.empty()) return NULL;
+        std::pop_heap(_heap.begin(), _heap.end(), later());
+        size_t r = _heap.back();
+        _heap.pop_back();
+        _current = std::move(_heads[r]);
+        load(r);
+        return _err.empty() ? &_current : NULL;
+    }
+
+    size_t runs() const { return _runs.size(); }
+    size_t spilled() const { return _spilled; }
+    const std::string& error() const { return _err; }
+
+private:
+    struct Run {
+        std::unique_ptr<SpillFile> file;
+        uint64_t left;      // records not read yet
+        unsigned round;     // merges it went through
+    };
+
+    size_t _budget;
+    size_t _bytes;
+    size_t _spilled;
+    std::vector<Rec> _records;
+    std::vector<Run> _runs;
+    std::string _err;
+
+    // merge of the runs from _first on and of memory (last): the current
+    // record of each, and a heap of those that have one
+    size_t _first;
+    std::vector<Rec> _heads;
+    std::vector<size_t> _heap;
+    size_t _memNext;
+    Rec _current;
+
+    /// Heap order: the smallest record on top, the earlier run on ties
+    auto later() {
+        return [this](size_t a, size_t b) {
+            if (_heads[b] < _heads[a]) return true;
+            return !(_heads[a] < _heads[b]) && a > b;
+        };
+    }
+
+    void spill() {
+        if (!_err.empty()) return;
+        std::stable_sort(_records.begin(), _records.end());
+        Run run;
+        run.file.reset(new SpillFile);
+        run.left = _records.size();
+        run.round = 0;
+        if (!run.file->create(_err)) return;
+        for (size_t i = 0; i < _records.size(); i++) _records[i].spill(*run.file);
+        _spilled += _records.size();
+        _runs.push_back(std::move(run));
+        std::vector<Rec>().swap(_records);
+        _bytes = 0;
+
+        // the last Fanout runs of a round make one of the next
+        while (_err.empty() && _runs.size() >= Fanout &&
+               _runs[_runs.size() - Fanout].round == _runs.back().round) {
+            mergeRuns(_runs.size() - Fanout);
+        }
+    }
+
+    /// Merge the runs from first on into one; memory is empty here
+    void mergeRuns(size_t first) {
+        Run merged;
+        merged.file.reset(new SpillFile);
+        merged.left = 0;
+        merged.round = _runs.back().round + 1;
+        if (!merged.file->create(_err)) return;
+        startMerge(first);
+        while (Rec* rec = next()) {
+            rec->spill(*merged.file);
+            merged.left++;
+        }
+        if (!_err.empty()) return;
+        _runs.erase(_runs.begin() + first, _runs.end());
+        _runs.push_back(std::move(merged));
+        _heads.clear();
+    }
+
+    void startMerge(size_t first) {
+        _first = first;
+        _heads.clear();
+        _heads.resize(_runs.size() - first + 1);
+        _heap.clear();
+        for (size_t r = first; r < _runs.size() && _err.empty(); r++) {
+            if (_runs[r].file->rewind(_err)) load(r - first);
+        }
+        if (_err.empty()) load(_runs.size() - first);
+    }
+
+    /// Read the next record of merged run r (memory if r is the last)
+    /// onto the heap
+    void load(size_t r) {
+        if (_first + r == _runs.size()) {
+            if (_memNext == _records.size()) return;
+            _heads[r] = std::move(_records[_memNext++]);
+        } else {
+            Run& run = _runs[_first + r];
+            if (run.left == 0) return;
+            run.left--;
+            if (!_heads[r].unspill(*run.file)) {
+                _err = "cannot read back a spilled run";
+                return;
+            }
+        }
+        _heap.push_back(r);
+        std::push_heap(_heap.begin(), _heap.end(), later());
+    }
+};
+
+#endif
@@ -0,0 +1,150 @@
+/// CovState - see state.hh.
+///
+/// The file is text: a "#covstate 1 <tool>" header, an "inputs" line
+/// with a hash per input file, one "test <name>" line per merged test
+/// and then one "<id>\t<covered>\t<count>" line per object with a hit,
+/// ids in 16 hex digits and in ascending order.
+
+#include "state.hh"
+#include "cache.hh"
+#include "shards.hh"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+
+// bump when the layout changes
+static const char stateFormat[] = "#covstate 1";
+
+CovState::CovState(const std::string& tool)
+        : _tool(tool), _replay(false)
+{
+}
+
+void CovState::clear(const std::string& why)
+{
+    _tests.clear();
+    _seen.clear();
+    _values.clear();
+    _restarted = why;
+}
+
+bool CovState::load(const char* file, const std::vector<std::string>& inputs,
+                    std::string& err)
+{
+    _restarted.clear();
+    _inputs = "inputs";
+    for (size_t i = 0; i < inputs.size(); i++) {
+        std::string content;
+        if (!readFile(inputs[i], content)) {
+            err = "cannot read " + inputs[i];
+            return false;
+        }
+        _inputs += " " + idToHex(objectId(content));
+    }
+
+    std::string text;
+    if (access(file, F_OK) && errno == ENOENT) return true;
+    if (!readFile(file, text)) {
+        err = std::string("cannot read ") + file;
+        return false;
+    }
+
+    size_t pos = 0, line = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        std::string l = text.substr(pos, end - pos);
+        pos = end + 1;
+        line++;
+
+        if (line == 1) {
+            if (l != std::string(stateFormat) + " " + _tool) {
+                clear("written by another tool or version");
+                return true;
+            }
+        } else if (line == 2) {
+            if (l != _inputs) {
+                clear("the inputs changed");
+                return true;
+            }
+        } else if (!l.compare(0, 5, "test ")) {
+            std::string name = l.substr(5);
+            if (_seen.insert(name).second) _tests.push_back(name);
+        } else {
+            const char* p = l.c_str();
+            char* next;
+            uint64_t id = strtoull(p, &next, 16);
+            bool ok = next == p + 16 && *next == '\t';
+            Value v;
+            v.covered = ok ? (int)strtol(next + 1, &next, 10) : 0;
+            ok = ok && *next == '\t';
+            v.count = ok ? strtoll(next + 1, &next, 10) : 0;
+            if (!ok || *next) {
+                err = std::string(file) + ":" + std::to_string(line) +
+                      ": malformed state line";
+                return false;
+            }
+            _values[id] = v;
+        }
+    }
+    if (line < 2) clear("empty state file");
+    return true;
+}
+
+std::vector<std::string> CovState::testsToLoad(const std::vector<std::string>& available)
+{
+    // a test that disappeared may have been removed or replaced; its
+    // hits cannot be taken out again
+    _restarted.clear();
+    std::unordered_set<std::string> present(available.begin(), available.end());
+    for (size_t i = 0; i < _tests.size(); i++) {
+        if (!present.count(_tests[i])) {
+            clear("test " + _tests[i] + " is no longer in the VDB");
+            break;
+        }
+    }
+
+    std::vector<std::string> load;
+    _replay = false;
+    for (size_t i = 0; i < available.size(); i++) {
+        if (_seen.insert(available[i]).second) {
+            _tests.push_back(available[i]);
+            load.push_back(available[i]);
+        }
+    }
+    if (load.empty() && !available.empty()) {
+        _replay = true;
+        load.push_back(available[0]);
+    }
+    return load;
+}
+
+bool CovState::save(const char* file, std::string& err) const
+{
+    std::vector<uint64_t> ids;
+    ids.reserve(_values.size());
+    for (std::unordered_map<uint64_t, Value>::const_iterator it = _values.begin();
+         it != _values.end(); ++it) {
+        ids.push_back(it->first);
+    }
+    std::sort(ids.begin(), ids.end());
+
+    AtomicFile out(file);
+    if (!out.open(err)) return false;
+    FILE* fp = out.stream();
+    fprintf(fp, "%s %s\n%s\n", stateFormat, _tool.c_str(), _inputs.c_str());
+    for (size_t i = 0; i < _tests.size(); i++) {
+        fprintf(fp, "test %s\n", _tests[i].c_str());
+    }
+    char hex[17];
+    hex[16] = 0;
+    for (size_t i = 0; i < ids.size(); i++) {
+        const Value& v = _values.find(ids[i])->second;
+        idToHex(ids[i], hex);
+        fprintf(fp, "%s\t%d\t%lld\n", hex, v.covered, (long long)v.count);
+    }
+    return out.commit(err);
+}
@@ -0,0 +1,107 @@
+/// CovState - coverage merged over the tests seen so far (--state).
+///
+/// Tests are merged into a VDB one after another during the day.
+/// Instead of loading and merging every test on every run, a dumper can
+/// keep a state file with the names of the tests it has merged and, per
+/// object id, the merged values: covered is the largest value any test
+/// had (an OR for 0/1 objects) and count is the sum of the hit counts.
+/// The next run loads only the tests it has not seen, folds each
+/// object's values in those tests into the state while it visits the
+/// object, writes the report from the merged values and saves the
+/// state.  Loading and merging tests scales with the new tests; the
+/// traversal itself still visits every object once.
+///
+/// A state only holds values for the objects a run visited, so it is
+/// tied to the tool and to the inputs deciding which objects those are
+/// (the --filter file).  A state for other inputs, or one that names a
+/// test the VDB no longer has, is started over from all tests.
+
+#ifndef STATE_HH
+#define STATE_HH
+
+#include "objid.hh"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/// Id of the index-th member of the object with id base, for objects
+/// that have no id of their own (e.g. the bits of a signal)
+inline uint64_t memberId(uint64_t base, uint64_t index)
+{
+    char bytes[16];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (char)(base >> (8 * i));
+        bytes[8 + i] = (char)(index >> (8 * i));
+    }
+    return objectId(bytes, sizeof(bytes));
+}
+
+class CovState {
+public:
+    explicit CovState(const std::string& tool);
+
+    /// Read the state in file; a missing file is an empty state.
+    /// inputs are the files the set of visited objects depends on.
+    bool load(const char* file, const std::vector<std::string>& inputs,
+              std::string& err);
+
+    /// The tests to load out of those in the VDB, which are recorded as
+    /// seen.  With nothing new the first test is returned for the
+    /// traversal, and merge() then only reports the stored values.  May
+    /// be called again when more tests have arrived.
+    std::vector<std::string> testsToLoad(const std::vector<std::string>& available);
+
+    /// Why the last load() or testsToLoad() dropped the stored state,
+    /// empty if it did not
+    const std::string& restarted() const { return _restarted; }
+
+    /// Fold the values object id has in the loaded tests into the state;
+    /// covered and count are replaced by the merged values
+    void merge(uint64_t id, int& covered, int64_t& count) {
+        std::unordered_map<uint64_t, Value>::iterator it = _values.find(id);
+        if (_replay) {
+            covered = it == _values.end() ? 0 : it->second.covered;
+            count = it == _values.end() ? 0 : it->second.count;
+            return;
+        }
+        if (it != _values.end()) {
+            if (it->second.covered > covered) covered = it->second.covered;
+            count += it->second.count;
+            it->second.covered = covered;
+            it->second.count = count;
+        } else if (covered || count) {
+            Value& v = _values[id];
+            v.covered = covered;
+            v.count = count;
+        }
+    }
+
+    /// Write the state to file, renamed into place
+    bool save(const char* file, std::string& err) const;
+
+    /// True when the last testsToLoad() found no new test
+    bool replaying() const { return _replay; }
+
+    size_t tests() const { return _tests.size(); }
+    size_t objects() const { return _values.size(); }
+
+private:
+    struct Value {
+        int covered;
+        int64_t count;
+    };
+
+    std::string _tool;
+    std::string _inputs;        // hashes of the input files
+    std::vector<std::string> _tests;
+    std::unordered_set<std::string> _seen;
+    std::unordered_map<uint64_t, Value> _values;   // objects with a hit only
+    bool _replay;
+    std::string _restarted;
+
+    void clear(const std::string& why);
+};
+
+#endif
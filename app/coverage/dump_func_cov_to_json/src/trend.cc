@@ -0,0 +1,241 @@
+/// Coverage trend store - see trend.hh.
+
+#include "trend.hh"
+#include "objid.hh"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+static_assert(sizeof(TrendRecord) == 32, "TrendRecord is stored as is");
+
+static const char pathsHeader[] = "#covtrend 1 paths\n";
+
+// the records file header, padded with NULs to one record
+static const char recordsMagic[] = "#covtrend 1 records\n";
+static const size_t headerSize = sizeof(TrendRecord);
+
+/// All of fd from offset 0
+static bool readAll(int fd, std::string& out)
+{
+    out.clear();
+    char buf[1 << 16];
+    off_t off = 0;
+    for (;;) {
+        ssize_t n = pread(fd, buf, sizeof(buf), off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return true;
+        out.append(buf, n);
+        off += n;
+    }
+}
+
+static bool writeAll(int fd, const char* p, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+void TrendWriter::add(const char* kind, const std::string& path,
+                      int64_t covered, int64_t coverable)
+{
+    Point p;
+    p.key = kind;
+    p.key += '\t';
+    p.key += path;
+    // tabs and newlines would break the paths file
+    for (size_t i = p.key.find('\t') + 1; i < p.key.size(); i++) {
+        if (p.key[i] == '\t' || p.key[i] == '\n') p.key[i] = ' ';
+    }
+    p.covered = covered;
+    p.coverable = coverable;
+    _points.push_back(p);
+}
+
+bool TrendWriter::append(const std::string& file, int64_t time,
+                         std::string& err) const
+{
+    std::string pathsFile = file + ".paths";
+    int pfd = open(pathsFile.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    if (pfd < 0) {
+        err = "cannot open " + pathsFile + ": " + strerror(errno);
+        return false;
+    }
+    while (flock(pfd, LOCK_EX)) {
+        if (errno != EINTR) {
+            err = "cannot lock " + pathsFile + ": " + strerror(errno);
+            close(pfd);
+            return false;
+        }
+    }
+
+    // index the paths recorded so far; a torn last line is dropped
+    std::string text;
+    if (!readAll(pfd, text)) {
+        err = "cannot read " + pathsFile + ": " + strerror(errno);
+        close(pfd);
+        return false;
+    }
+    size_t end = text.rfind('\n');
+    end = end == std::string::npos ? 0 : end + 1;
+    if (end == 0 && !text.empty()) {
+        err = pathsFile + ": not a trend store";
+        close(pfd);
+        return false;
+    }
+    if (end < text.size()) {
+        if (ftruncate(pfd, end)) {
+            err = "cannot write " + pathsFile + ": " + strerror(errno);
+            close(pfd);
+            return false;
+        }
+        text.resize(end);
+    }
+    std::string added;
+    if (text.empty()) {
+        added = pathsHeader;
+    } else if (text.compare(0, sizeof(pathsHeader) - 1, pathsHeader)) {
+        err = pathsFile + ": not a trend store";
+        close(pfd);
+        return false;
+    }
+    std::unordered_map<std::string, uint32_t> index;
+    uint32_t next = 0;
+    for (size_t pos = text.find('\n') + 1; pos < text.size(); next++) {
+        size_t eol = text.find('\n', pos);
+        // <id>\t<kind>\t<path>: the key is what follows the id
+        size_t tab = text.find('\t', pos);
+        if (tab < eol) index[text.substr(tab + 1, eol - tab - 1)] = next;
+        pos = eol + 1;
+    }
+
+    std::vector<TrendRecord> records(_points.size());
+    for (size_t i = 0; i < _points.size(); i++) {
+        const Point& p = _points[i];
+        std::pair<std::unordered_map<std::string, uint32_t>::iterator, bool> ins =
+                index.insert(std::make_pair(p.key, next));
+        if (ins.second) {
+            std::string name = p.key;
+            name.replace(name.find('\t'), 1, ":");
+            added += idToHex(objectId("trend:" + name));
+            added += '\t';
+            added += p.key;
+            added += '\n';
+            next++;
+        }
+        TrendRecord& rec = records[i];
+        rec.time = time;
+        rec.path = ins.first->second;
+        rec.reserved = 0;
+        rec.covered = p.covered;
+        rec.coverable = p.coverable;
+    }
+    if (!writeAll(pfd, added.data(), added.size())) {
+        err = "cannot write " + pathsFile + ": " + strerror(errno);
+        close(pfd);
+        return false;
+    }
+
+    // then the records, after cutting off a partial one
+    int rfd = open(file.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    struct stat st;
+    bool ok = rfd >= 0 && !fstat(rfd, &st);
+    if (ok && st.st_size == 0) {
+        char header[headerSize] = { 0 };
+        memcpy(header, recordsMagic, sizeof(recordsMagic) - 1);
+        ok = writeAll(rfd, header, sizeof(header));
+    } else if (ok && st.st_size % sizeof(TrendRecord)) {
+        ok = !ftruncate(rfd, st.st_size - st.st_size % sizeof(TrendRecord));
+    }
+    ok = ok && writeAll(rfd, (const char*)records.data(),
+                        records.size() * sizeof(TrendRecord));
+    if (!ok) err = "cannot write " + file + ": " + strerror(errno);
+    if (rfd >= 0) close(rfd);
+    close(pfd);
+    return ok;
+}
+
+TrendReader::TrendReader()
+        : _map(NULL), _mapSize(0), _records(NULL), _count(0)
+{
+}
+
+TrendReader::~TrendReader()
+{
+    if (_map) munmap(_map, _mapSize);
+}
+
+bool TrendReader::open(const std::string& file, std::string& err)
+{
+    std::string pathsFile = file + ".paths";
+    int pfd = ::open(pathsFile.c_str(), O_RDONLY | O_CLOEXEC);
+    std::string text;
+    if (pfd < 0 || !readAll(pfd, text)) {
+        err = "cannot read " + pathsFile + ": " + strerror(errno);
+        if (pfd >= 0) close(pfd);
+        return false;
+    }
+    close(pfd);
+    if (text.compare(0, sizeof(pathsHeader) - 1, pathsHeader)) {
+        err = pathsFile + ": not a trend store";
+        return false;
+    }
+    // complete lines only: an append may be under way
+    for (size_t pos = sizeof(pathsHeader) - 1; ; ) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) break;
+        size_t t1 = text.find('\t', pos);
+        size_t t2 = t1 < eol ? text.find('\t', t1 + 1) : eol;
+        TrendPath p;
+        p.id = t1 < eol ? strtoull(text.c_str() + pos, NULL, 16) : 0;
+        if (t2 < eol) {
+            p.kind = text.substr(t1 + 1, t2 - t1 - 1);
+            p.path = text.substr(t2 + 1, eol - t2 - 1);
+        }
+        _paths.push_back(p);
+        pos = eol + 1;
+    }
+
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        err = "cannot read " + file + ": " + strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    if ((size_t)st.st_size < headerSize) {
+        close(fd);
+        return true;
+    }
+    _mapSize = st.st_size;
+    _map = mmap(NULL, _mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_map == MAP_FAILED) {
+        _map = NULL;
+        err = "cannot map " + file + ": " + strerror(errno);
+        return false;
+    }
+    if (memcmp(_map, recordsMagic, sizeof(recordsMagic) - 1)) {
+        err = file + ": not a trend store";
+        return false;
+    }
+    _records = (const TrendRecord*)((const char*)_map + headerSize);
+    _count = (_mapSize - headerSize) / sizeof(TrendRecord);
+    return true;
+}
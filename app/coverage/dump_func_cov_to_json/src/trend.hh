@@ -0,0 +1,87 @@
+/// Coverage trend store (--trend FILE, covsnap trend).
+///
+/// Every run of a dumper with --trend FILE appends the covered/coverable
+/// counts of its rollups (toggle: every instance subtree and every
+/// module; functional: every covergroup definition and instance),
+/// stamped with the time of the run.  The store is two append-only files:
+///
+///     FILE.paths  text, "#covtrend 1 paths" and then one line per path
+///                 ever recorded: <16 hex id>\t<kind>\t<path>.  Line k
+///                 (from 0, after the header) is path index k.  The id is
+///                 objectId("trend:<kind>:<path>"), the same in every
+///                 store.
+///     FILE        binary, a 32-byte header and then fixed-size
+///                 TrendRecords in the host's byte order, one per path
+///                 per run, in the order they were appended.
+///
+/// Appends take an exclusive lock on FILE.paths, write the new paths
+/// before the records referring to them and drop a torn tail left by an
+/// interrupted append, so concurrent regressions can share a store.  A
+/// reader maps FILE and needs no lock: it ignores a partial last record.
+
+#ifndef TREND_HH
+#define TREND_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+struct TrendRecord {
+    int64_t time;           // seconds since the epoch
+    uint32_t path;          // index into FILE.paths
+    uint32_t reserved;
+    int64_t covered;
+    int64_t coverable;
+};
+
+/// Collects the counts of one run and appends them to a store
+class TrendWriter {
+public:
+    void add(const char* kind, const std::string& path, int64_t covered,
+             int64_t coverable);
+
+    /// Append everything added to the store at file, stamped with time
+    bool append(const std::string& file, int64_t time, std::string& err) const;
+
+    size_t size() const { return _points.size(); }
+
+private:
+    struct Point {
+        std::string key;    // <kind>\t<path>
+        int64_t covered;
+        int64_t coverable;
+    };
+    std::vector<Point> _points;
+};
+
+struct TrendPath {
+    uint64_t id;
+    std::string kind;
+    std::string path;
+};
+
+/// Read access to a store: the paths, and the records mapped in place
+class TrendReader {
+public:
+    TrendReader();
+    ~TrendReader();
+
+    bool open(const std::string& file, std::string& err);
+
+    const std::vector<TrendPath>& paths() const { return _paths; }
+    const TrendRecord* records() const { return _records; }
+    size_t size() const { return _count; }
+
+private:
+    std::vector<TrendPath> _paths;
+    void* _map;
+    size_t _mapSize;
+    const TrendRecord* _records;
+    size_t _count;
+
+    TrendReader(const TrendReader&);
+    TrendReader& operator=(const TrendReader&);
+};
+
+#endif
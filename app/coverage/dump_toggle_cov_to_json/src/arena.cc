@@ -0,0 +1,161 @@
+/// Arena, StringIndex and HeapStats - see arena.hh.
+
+#include "arena.hh"
+#include "objid.hh"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <sys/resource.h>
+
+Arena::Arena(size_t blockSize)
+        : _blockSize(blockSize), _head(NULL), _cur(NULL), _end(NULL),
+          _blocks(0), _bytes(0), _allocs(0)
+{
+}
+
+Arena::~Arena()
+{
+    while (_head) {
+        Block* next = _head->next;
+        free(_head);
+        _head = next;
+    }
+}
+
+/// Start a new block big enough for n bytes at align.  Oversized
+/// requests get a block of their own.
+void* Arena::grow(size_t n, size_t align)
+{
+    size_t need = sizeof(Block) + n + align;
+    size_t size = need > _blockSize ? need : _blockSize;
+    Block* b = (Block*)malloc(size);
+    if (!b) throw std::bad_alloc();
+    b->next = _head;
+    _head = b;
+    _cur = (char*)(b + 1);
+    _end = (char*)b + size;
+    _blocks++;
+    _bytes += size;
+    return alloc(n, align);
+}
+
+std::string_view Arena::copy(std::string_view s)
+{
+    char* p = (char*)alloc(s.size() + 1, 1);
+    memcpy(p, s.data(), s.size());
+    p[s.size()] = '\0';
+    return std::string_view(p, s.size());
+}
+
+StringIndex::StringIndex(Arena& arena)
+        : _arena(arena), _slots(NULL), _mask(0), _size(0)
+{
+}
+
+StringIndex::Slot* StringIndex::probe(std::string_view key,
+                                      uint64_t hash) const
+{
+    for (size_t i = hash & _mask; ; i = (i + 1) & _mask) {
+        Slot* s = &_slots[i];
+        if (!s->entry.key.data()) return s;
+        if (s->hash == hash && s->entry.key == key) return s;
+    }
+}
+
+StringIndex::Entry* StringIndex::find(std::string_view key) const
+{
+    if (!_slots) return NULL;
+    Slot* s = probe(key, objectId(key.data(), key.size()));
+    return s->entry.key.data() ? &s->entry : NULL;
+}
+
+StringIndex::Entry& StringIndex::get(std::string_view key, bool& inserted)
+{
+    // keep the load factor at or below 1/2
+    if (2 * (_size + 1) > _mask + 1) rehash();
+    uint64_t hash = objectId(key.data(), key.size());
+    Slot* s = probe(key, hash);
+    inserted = !s->entry.key.data();
+    if (inserted) {
+        s->hash = hash;
+        s->entry.key = _arena.copy(key);
+        s->entry.value = 0;
+        _size++;
+    }
+    return s->entry;
+}
+
+/// Double the table.  The old slot array stays in the arena; the total
+/// left behind is less than the final table size.
+void StringIndex::rehash()
+{
+    size_t cap = _slots ? 2 * (_mask + 1) : 64;
+    Slot* old = _slots;
+    size_t oldCap = _slots ? _mask + 1 : 0;
+
+    _slots = _arena.array<Slot>(cap);
+    memset((void*)_slots, 0, cap * sizeof(Slot));
+    _mask = cap - 1;
+    for (size_t i = 0; i < oldCap; i++) {
+        if (!old[i].entry.key.data()) continue;
+        size_t j = old[i].hash & _mask;
+        while (_slots[j].entry.key.data()) j = (j + 1) & _mask;
+        _slots[j] = old[i];
+    }
+}
+
+// Counting replacements for the global allocation functions; the other
+// forms of operator new/delete forward to these.
+static std::atomic<size_t> heapAllocs(0);
+static std::atomic<size_t> heapBytes(0);
+
+void* operator new(size_t n)
+{
+    heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    heapBytes.fetch_add(n, std::memory_order_relaxed);
+    void* p = malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t n)
+{
+    return operator new(n);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+size_t HeapStats::allocations()
+{
+    return heapAllocs.load(std::memory_order_relaxed);
+}
+
+size_t HeapStats::bytes()
+{
+    return heapBytes.load(std::memory_order_relaxed);
+}
+
+long HeapStats::peakRssKb()
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru)) return -1;
+    return ru.ru_maxrss;
+}
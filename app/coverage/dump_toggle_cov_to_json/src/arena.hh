@@ -0,0 +1,117 @@
+/// Arena - bump allocation for records that live until the program ends,
+/// and StringIndex, an open-addressing hash table over arena strings.
+///
+/// Everything allocated from an Arena is released in one shot when the
+/// arena is destroyed; destructors of the objects are never run, so only
+/// trivially destructible types may be placed in it.
+
+#ifndef ARENA_HH
+#define ARENA_HH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <string_view>
+#include <type_traits>
+
+class Arena {
+public:
+    explicit Arena(size_t blockSize = 1 << 20);
+    ~Arena();
+
+    /// n bytes aligned to align, which must be a power of two
+    void* alloc(size_t n, size_t align = alignof(max_align_t)) {
+        uintptr_t p = ((uintptr_t)_cur + align - 1) & ~(uintptr_t)(align - 1);
+        if (p + n > (uintptr_t)_end) return grow(n, align);
+        _cur = (char*)(p + n);
+        _allocs++;
+        return (void*)p;
+    }
+
+    /// A value-initialized T
+    template <class T> T* make() {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "arena objects are never destroyed");
+        return new (alloc(sizeof(T), alignof(T))) T();
+    }
+
+    /// An uninitialized array of n T
+    template <class T> T* array(size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "arena objects are never destroyed");
+        return (T*)alloc(n * sizeof(T), alignof(T));
+    }
+
+    /// NUL-terminated copy of s
+    std::string_view copy(std::string_view s);
+
+    size_t blocks() const { return _blocks; }
+    size_t bytes() const { return _bytes; }
+    size_t allocations() const { return _allocs; }
+
+private:
+    struct Block {
+        Block* next;
+    };
+
+    size_t _blockSize;
+    Block* _head;
+    char* _cur;
+    char* _end;
+    size_t _blocks;
+    size_t _bytes;
+    size_t _allocs;
+
+    void* grow(size_t n, size_t align);
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+};
+
+/// Maps strings to 32-bit values with linear probing.  Keys are copied
+/// into the arena, so a looked-up key can be kept as an interned string
+/// for as long as the arena lives.
+class StringIndex {
+public:
+    struct Entry {
+        std::string_view key;
+        uint32_t value;
+    };
+
+    explicit StringIndex(Arena& arena);
+
+    /// The entry for key, or NULL if there is none
+    Entry* find(std::string_view key) const;
+
+    /// The entry for key, inserted with value 0 if there was none
+    Entry& get(std::string_view key, bool& inserted);
+
+    size_t size() const { return _size; }
+
+private:
+    struct Slot {
+        uint64_t hash;
+        Entry entry;       // entry.key.data() is NULL while free
+    };
+
+    Arena& _arena;
+    Slot* _slots;
+    size_t _mask;
+    size_t _size;
+
+    Slot* probe(std::string_view key, uint64_t hash) const;
+    void rehash();
+
+    StringIndex(const StringIndex&);
+    StringIndex& operator=(const StringIndex&);
+};
+
+/// Process-wide heap statistics for --stats: operator new calls and
+/// bytes requested since start-up, and the peak resident set size.
+struct HeapStats {
+    static size_t allocations();
+    static size_t bytes();
+    static long peakRssKb();
+};
+
+#endif
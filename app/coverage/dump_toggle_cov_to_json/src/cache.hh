@@ -0,0 +1,72 @@
+/// ExtractCache - content-addressed cache of a dumper's outputs
+/// (--cache-dir).
+///
+/// A run is identified by its fingerprint: the tool and its binary, the
+/// options that affect the output, the contents of input files such as
+/// --filter, the test names in the VDB and every file of the VDB
+/// directory with its size and mtime (and a hash of its contents for
+/// small files).  The entry for a fingerprint lives in a directory named
+/// after a hash of it and holds the fingerprint itself, the report
+/// written to stdout and the snapshot, if one was requested.  A hit
+/// replays those without opening the VDB.
+///
+/// Concurrent runs are safe: runs with the same fingerprint serialize on
+/// a lock file (the second one waits and then hits), and entries are
+/// built in a temporary directory that is renamed into place, so a
+/// reader never sees a partial entry.
+
+#ifndef CACHE_HH
+#define CACHE_HH
+
+#include <string>
+#include <vector>
+
+/// Read the whole file at path into out
+bool readFile(const std::string& path, std::string& out);
+
+class ExtractCache {
+public:
+    explicit ExtractCache(const std::string& dir);
+    ~ExtractCache();
+
+    /// Compute the fingerprint of this run
+    bool fingerprint(const std::string& tool,
+                     const std::vector<std::string>& options,
+                     const std::vector<std::string>& inputs,
+                     const char* vdb, std::string& err);
+
+    /// Lock the entry, waiting for a concurrent run with the same
+    /// fingerprint.  The lock is held until the cache is destroyed.
+    bool lock(std::string& err);
+
+    /// On a hit, write the cached report to stdout and the cached
+    /// snapshot to snapshot (if not NULL) and return true
+    bool fetch(const char* snapshot);
+
+    /// Send stdout to a temporary file so the report can be stored
+    bool capture(std::string& err);
+
+    /// Stop capturing, copy the report to the real stdout and store it
+    /// and snapshot (if not NULL) as the entry.  The report reaches
+    /// stdout even if storing fails.
+    bool store(const char* snapshot, std::string& err);
+
+    /// The hash naming the entry, as 16 hex digits
+    const std::string& key() const { return _key; }
+
+private:
+    std::string _dir;
+    std::string _text;      // the fingerprint
+    std::string _key;
+    int _lockFd;
+    int _savedStdout;       // the real stdout while capturing
+    std::string _tmp;       // entry being built
+
+    std::string entry() const { return _dir + "/" + _key; }
+    bool release();
+
+    ExtractCache(const ExtractCache&);
+    ExtractCache& operator=(const ExtractCache&);
+};
+
+#endif
@@ -8,33 +8,376 @@
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
+#include <cmath>
 #include "covdb_user.h"
 #include "visit.hh"
-#include <map>
+#include "pathfilter.hh"
+#include "objid.hh"
+#include "arena.hh"
+#include "jsonout.hh"
+#include "parallel.hh"
+#include "shards.hh"
+#include "cache.hh"
+#include "state.hh"
+#include "watch.hh"
+#include "html.hh"
+#include "trend.hh"
+#include "progress.hh"
+#include "deadline.hh"
+#include "sample.hh"
+#include "spill.hh"
+#include "holes.hh"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <memory>
 #include <string>
 #include <vector>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/prettywriter.h>
 
-struct ToggleData {
-    std::string signal_name;
-    std::string hdl_signal_path;
-    std::string toggle_type;
-    std::string status;
+enum ToggleStatus { StatusCovered, StatusExcluded, StatusUncovered };
+
+static const char* const toggleStatusNames[] = {
+    "Covered", "Excluded", "Uncovered"
+};
+static const char* const toggleTypeNames[] = { "0 -> 1", "1 -> 0" };
+
+// The same names and the module-view keys, quoted once for JsonOut
+static const JsonName toggleStatusJson[] = {
+    JsonName("Covered"), JsonName("Excluded"), JsonName("Uncovered")
+};
+static const JsonName toggleTypeJson[] = { JsonName("0 -> 1"), JsonName("1 -> 0") };
+static const JsonName modulesKey("modules"), designKey("design"),
+    moduleKey("module"), coverageKey("coverage"), toggleCoverageKey("toggle_coverage"),
+    idKey("id"), pathKey("hdl_signal_path"), typeKey("toggle_type"),
+    statusKey("status"), coveredKey("covered"), coverableKey("coverable"),
+    scoreKey("score");
+
+/// One module-view toggle record.  Records are plain data kept in the
+/// arena; the signal path is interned, so all records of a signal share
+/// one copy of it.
+struct ToggleRecord {
+    const char* hdl_signal_path;
+    uint64_t id;
+    uint8_t toggle_type;    // index into toggleTypeNames
+    uint8_t status;         // ToggleStatus
+};
+
+/// Records of a module are appended to a list of fixed-size chunks
+struct RecordChunk {
+    enum { Size = 256 };
+    RecordChunk* next;
+    unsigned count;
+    ToggleRecord records[Size];
+};
+
+/// Covered/coverable object counts rolled up over a subtree.
+/// Excluded objects are not coverable.
+struct Rollup {
+    long covered;
+    long coverable;
+
+    Rollup() : covered(0), coverable(0) { }
+    void add(const Rollup& o) {
+        covered += o.covered;
+        coverable += o.coverable;
+    }
 };
 
 struct ModuleData {
+    std::string_view module_name;   // interned in the arena
+    uint32_t index;                 // position in DumpTgl::_modules
+    RecordChunk* first;
+    RecordChunk* last;
+    Rollup rollup;
+
+    void append(const ToggleRecord& rec, Arena& arena) {
+        if (!last || last->count == RecordChunk::Size) {
+            RecordChunk* chunk = arena.make<RecordChunk>();
+            (last ? last->next : first) = chunk;
+            last = chunk;
+        }
+        last->records[last->count++] = rec;
+    }
+
+    size_t records() const {
+        size_t n = 0;
+        for (const RecordChunk* chunk = first; chunk; chunk = chunk->next) n += chunk->count;
+        return n;
+    }
+};
+
+/// One signal of a module.  Every bit has two toggle objects
+/// (0 -> 1 followed by 1 -> 0), so a signal owns 2*width status bits;
+/// a signal with an odd number of objects has a padding bit at the end.
+struct SignalSchema {
+    std::string name;
+    unsigned width;
+    unsigned objects;
+
+    bool operator==(const SignalSchema& o) const {
+        return width == o.width && objects == o.objects && name == o.name;
+    }
+};
+
+/// Signal list shared by all instances of a module.  A module can have
+/// more than one schema when parameterization changes its signals.
+struct ModuleSchema {
     std::string module_name;
-    std::vector<ToggleData> toggle_data;
+    std::vector<SignalSchema> signals;
+    size_t num_bits;
 };
 
-class DumpTgl : public UcapiVisitor {
-    std::map<std::string, ModuleData> _modules_data;
-    std::string _current_module;
-    std::string _current_instance;
-    std::vector<std::string> _instance_hierarchy;
+/// Per-instance toggle results, bit-packed against a ModuleSchema:
+/// bit i is set when toggle object i of the schema is covered/excluded.
+struct InstanceData {
+    std::string name;
+    std::string module_name;
+    int schema;
+    std::vector<uint64_t> covered;
+    std::vector<uint64_t> excluded;
+    std::vector<size_t> children;
+    Rollup own;     // this instance's toggle objects
+    Rollup total;   // own plus all descendants, set at finishInstance
+};
+
+/// One toggle object in a snapshot file
+struct SnapRecord {
+    std::string key;
+    uint64_t id;
+    int covered;
+    int coverable;
+
+    bool operator<(const SnapRecord& o) const { return key < o.key; }
+
+    // for SortedRuns
+    size_t bytes() const { return sizeof(*this) + key.capacity(); }
+    void spill(SpillFile& f) const {
+        f.putString(key);
+        f.putFixed64(id);
+        f.putByte((uint8_t)(covered | coverable << 1));
+    }
+    bool unspill(SpillFile& f) {
+        f.getString(key);
+        id = f.getFixed64();
+        uint8_t b = f.getByte();
+        covered = b & 1;
+        coverable = (b >> 1) & 1;
+        return f.good();
+    }
+};
+
+/// A run of spilled module records, and the merges it went through
+struct ModuleRun {
+    std::unique_ptr<SpillFile> file;
+    unsigned round;
+};
+
+/// Read position in a run of spilled module records
+struct RunCursor {
+    SpillFile* file;
+    uint64_t next;      // index + 1 of the module whose records follow; 0: done
+    uint64_t count;     // of its records
+
+    void advance() {
+        next = file->getVarint();
+        count = next ? file->getVarint() : 0;
+    }
+};
+
+/// Toggle-only traversal: hooks are bound at compile time, see UcapiWalker
+class DumpTgl : public UcapiWalker<DumpTgl, ToggleMetric> {
+    // module view: modules live in _arena and are found through
+    // _module_index (name -> position in _modules) once per variant;
+    // their records and signal paths live in _record_arena, which is
+    // dropped whenever the records are spilled
+    Arena _arena;
+    StringIndex _module_index;
+    std::unique_ptr<Arena> _record_arena;
+    std::unique_ptr<StringIndex> _signal_paths;
+    std::vector<ModuleData*> _modules;
+    ModuleData* _current_module;
+
+    // --mem-budget: runs of module records spilled so far, each in
+    // module name order (see spillModules)
+    size_t _mem_budget;
+    std::vector<ModuleRun> _module_runs;
+    size_t _spilled_records;
+    std::string _spill_err;
+
+    // interned path of the signal whose objects are being visited; reset
+    // whenever a container starts or finishes
+    const char* _signal_path;
+    std::string _path_buf;
+    std::string _id_buf;
+
+    // design-wide instance tree; a deque keeps references stable
+    std::deque<InstanceData> _instances;
+    std::vector<size_t> _top_instances;
+    std::vector<size_t> _instance_stack;
+    std::vector<ModuleSchema> _schemas;
+    std::map<std::string, std::vector<int> > _module_schemas;
+
+    // scratch state while visiting the toggle objects of one instance
+    bool _in_instance;
+    int _container_depth;
+    std::vector<SignalSchema> _inst_signals;
+    std::vector<uint64_t> _inst_covered;
+    std::vector<uint64_t> _inst_excluded;
+    size_t _inst_bits;
+    unsigned _signal_objects;
+    Rollup _inst_rollup;
+    Rollup _variant_rollup;
+
+    // optional path filter: verdict and path of each open instance, and
+    // the verdict of the module currently visited through its variants
+    const PathFilter* _filter;
+    std::vector<PathFilter::Verdict> _filter_verdicts;
+    std::vector<std::string> _filter_paths;
+    PathFilter::Verdict _module_verdict;
+
+    // index of the next object within each open container of the module
+    // view (the bottom entry counts bare objects of the region); even
+    // indices are 0 -> 1 toggles, odd ones 1 -> 0
+    std::vector<unsigned> _object_index;
+
+    // --uncovered-only: skip fully covered signals and only fetch names
+    // for objects that are not covered
+    bool _uncovered_only;
+
+    // canonical names of everything given an id, for --check-ids
+    std::vector<IdName>* _id_names;
+
+    // --state: hits of earlier tests, keyed by object id; instance-view
+    // bits are members of their signal's key
+    CovState* _state;
+    uint64_t _signal_key;
+
+    // --holes: the top holes so far, and the full name and counts of the
+    // instance and signal being visited
+    std::unique_ptr<HoleReport> _holes;
+    size_t _hole_instances, _hole_signals, _hole_modules;
+    std::string _hole_path;
+    long _signal_uncovered;
+    long _signal_coverable;
+
+    static void setBit(std::vector<uint64_t>& bits, size_t i) {
+        if (bits.size() <= i / 64) bits.resize(i / 64 + 1, 0);
+        bits[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+
+    static bool testBit(const std::vector<uint64_t>& bits, size_t i) {
+        return i / 64 < bits.size() && ((bits[i / 64] >> (i % 64)) & 1);
+    }
+
+    /// Hex encoding of a bit vector, least significant nibble first:
+    /// character k holds objects 4k..4k+3 (bit j of the nibble = 4k+j).
+    static std::string bitsToHex(const std::vector<uint64_t>& bits,
+                                 size_t nbits) {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex((nbits + 3) / 4, '0');
+        for (size_t k = 0; k < hex.size(); k++) {
+            size_t i = k * 4;
+            unsigned nib = 0;
+            if (i / 64 < bits.size()) {
+                nib = (unsigned)(bits[i / 64] >> (i % 64)) & 0xf;
+            }
+            hex[k] = digits[nib];
+        }
+        return hex;
+    }
+
+    /// Pad the last signal to an even number of objects so that every
+    /// schema signal maps onto exactly 2*width status bits.
+    void closeSignal() {
+        if (_inst_signals.empty() || _signal_objects == 0) return;
+        if (_signal_objects % 2) _inst_bits++;
+        _inst_signals.back().width = (_signal_objects + 1) / 2;
+        _inst_signals.back().objects = _signal_objects;
+        _signal_objects = 0;
+        if (_holes && _holes->wants(_hole_signals, _signal_uncovered)) {
+            _holes->add(_hole_signals, _hole_path + "." + _inst_signals.back().name,
+                        _signal_uncovered, _signal_coverable);
+        }
+    }
+
+    void openSignal(std::string_view name) {
+        closeSignal();
+        _signal_uncovered = _signal_coverable = 0;
+        SignalSchema sig;
+        sig.name = name.empty() ? "unknown" : name;
+        sig.width = 0;
+        sig.objects = 0;
+        _inst_signals.push_back(sig);
+        if (_state) {
+            _path_buf = "tglstate:";
+            _path_buf += names().regionFullName;
+            _path_buf += ".";
+            _path_buf += sig.name;
+            _signal_key = objectId(_path_buf);
+        }
+    }
+
+    /// With a state, fold the hits object id had in earlier tests into
+    /// its status st
+    int mergeStatus(uint64_t id, int st) {
+        int covered = (st & covdbStatusCovered) != 0;
+        int64_t count = 0;
+        _state->merge(id, covered, count);
+        return covered ? (st | covdbStatusCovered) : (st & ~covdbStatusCovered);
+    }
+
+    /// Id of the index-th object of the module-view signal at path:
+    /// tglmod:<module>.<signal>:<direction>, plus #k for the k-th pair of
+    /// objects within the container.  The name is left in _id_buf.
+    uint64_t moduleObjectId(const char* path, unsigned index) {
+        _id_buf = "tglmod:";
+        _id_buf += path;
+        _id_buf += ":";
+        _id_buf += toggleTypeNames[index % 2];
+        if (index / 2) _id_buf += "#" + std::to_string(index / 2);
+        return objectId(_id_buf);
+    }
+
+    /// Decide whether a top-level signal of the instance or module being
+    /// visited passes the filter.  Signals are the finest filter level.
+    bool acceptSignal(const char* name) {
+        std::string path;
+        PathFilter::Verdict parent;
+        if (_in_instance) {
+            path = _filter_paths.back();
+            parent = _filter_verdicts.back();
+        } else {
+            path = _current_module->module_name;
+            parent = _module_verdict;
+        }
+        path += ".";
+        path += name ? name : "unknown";
+        return _filter->classify(path, parent) == PathFilter::Accept;
+    }
+
+    /// Find the schema matching the signals just collected for an
+    /// instance of module mn, or register a new one.
+    int lookupSchema(const std::string& mn) {
+        std::vector<int>& cands = _module_schemas[mn];
+        for (size_t i = 0; i < cands.size(); i++) {
+            if (_schemas[cands[i]].signals == _inst_signals) return cands[i];
+        }
+        ModuleSchema schema;
+        schema.module_name = mn;
+        schema.signals.swap(_inst_signals);
+        schema.num_bits = _inst_bits;
+        _schemas.push_back(schema);
+        cands.push_back((int)_schemas.size() - 1);
+        return cands.back();
+    }
     
     void indent(int depth) {
         for(int i = 0; i < depth; i++) std::cout << " ";
@@ -46,199 +389,1652 @@ class DumpTgl : public UcapiVisitor {
     }
 
 public:
-    DumpTgl(covdbHandle design)
-            : UcapiVisitor(design)
+    DumpTgl(covdbHandle design, covdbHandle test)
+            : UcapiWalker(design, test), _module_index(_arena),
+              _record_arena(new Arena), _signal_paths(new StringIndex(*_record_arena)),
+              _current_module(NULL), _mem_budget(0), _spilled_records(0),
+              _signal_path(NULL),
+              _in_instance(false), _container_depth(0),
+              _inst_bits(0), _signal_objects(0), _filter(NULL),
+              _module_verdict(PathFilter::Accept), _uncovered_only(false),
+              _id_names(NULL), _state(NULL), _signal_key(0),
+              _hole_instances(0), _hole_signals(0), _hole_modules(0),
+              _signal_uncovered(0), _signal_coverable(0)
     {
         setErrorCallback(errorFilter);
     }
 
 
+    /// Prune instances, modules and signals rejected by filter.  The
+    /// instance view matches full instance paths (top.u_cd.clk); the
+    /// module view matches module-relative paths (cd.clk).
+    void setFilter(const PathFilter* filter) {
+        _filter = filter;
+    }
+
+    bool acceptInstance(covdbHandle inst) {
+        if (!_filter) return true;
+        const char* path = covdb_get_str(inst, covdbFullName);
+        PathFilter::Verdict parent = _filter_verdicts.empty() ?
+                _filter->root() : _filter_verdicts.back();
+        PathFilter::Verdict v = _filter->classify(path ? path : "", parent);
+        if (v == PathFilter::Reject) return false;
+        _filter_verdicts.push_back(v);
+        _filter_paths.push_back(path ? path : "");
+        return true;
+    }
+
+    bool acceptDefinition(covdbHandle def) {
+        if (!_filter) return true;
+        const char* mn = covdb_get_str(def, covdbName);
+        _module_verdict = _filter->classify(mn ? mn : "", _filter->root());
+        return _module_verdict != PathFilter::Reject;
+    }
+
+    /// Only report objects that are not covered.  Fully covered signals
+    /// are accounted for from their container counts without visiting
+    /// their objects.
+    void setUncoveredOnly(bool on) {
+        _uncovered_only = on;
+    }
+
+    bool acceptContainer(covdbHandle obj,
+                                 covdbHandle region,
+                                 covdbHandle metric,
+                                 covdbHandle parent) {
+        if (!_in_instance && !_current_module) return true;
+        if (_filter && _container_depth == 0 &&
+            !acceptSignal(covdb_get_str(obj, covdbName))) {
+            return false;
+        }
+        // a state has to see every object to record its hits
+        return !_uncovered_only || _state || !skipCovered(obj, region);
+    }
+
+    /// In uncovered-only mode, account for a fully covered container
+    /// without visiting it.  The instance view still needs one status bit
+    /// per object, so there only whole signals whose objects are all
+    /// coverable (2 * width of them) are skipped.
+    bool skipCovered(covdbHandle obj, covdbHandle region) {
+        int ab = covdb_get(obj, region, getTest(), covdbCoverable);
+        if (ab <= 0 || covdb_get(obj, region, getTest(), covdbCovered) < ab) {
+            return false;
+        }
+        if (!_in_instance) {
+            _variant_rollup.covered += ab;
+            _variant_rollup.coverable += ab;
+            _object_index.back()++;
+            return true;
+        }
+        if (_container_depth > 0 ||
+            2 * covdb_get(obj, region, NULL, covdbWidth) != ab) {
+            return false;
+        }
+        const char* name = covdb_get_str(obj, covdbName);
+        openSignal(name ? name : "");
+        for (int i = 0; i < ab; i++) setBit(_inst_covered, _inst_bits++);
+        _signal_objects = ab;
+        closeSignal();
+        _inst_rollup.covered += ab;
+        _inst_rollup.coverable += ab;
+        return true;
+    }
+
     /// Visited for every metric-qualified definition (variant) in the design
-    virtual void startVariant(covdbHandle var, covdbHandle met) {
-        const char* mn = covdb_get_str(var, covdbName);
-        if (mn && strlen(mn) > 0) {
-            _current_module = mn;
-            // Initialize module data if it doesn't exist
-            if (_modules_data.find(_current_module) == _modules_data.end()) {
-                _modules_data[_current_module] = ModuleData();
-                _modules_data[_current_module].module_name = _current_module;
+    void startVariant(covdbHandle var, covdbHandle met) {
+        std::string_view mn = names().regionName;
+        if (!mn.empty()) {
+            // one lookup per variant; objects use the cached pointer
+            bool inserted;
+            StringIndex::Entry& e = _module_index.get(mn, inserted);
+            if (inserted) {
+                e.value = (uint32_t)_modules.size();
+                _modules.push_back(_arena.make<ModuleData>());
+                _modules.back()->module_name = e.key;
+                _modules.back()->index = e.value;
             }
+            _current_module = _modules[e.value];
         }
+        _variant_rollup = Rollup();
+        _object_index.assign(1, 0);
     }
-    virtual void finishVariant(covdbHandle var, covdbHandle met) {
-        _current_module = "";
+    /// Rank the biggest holes as the walk goes: instance subtrees and
+    /// instance signals by their uncovered objects, and modules by those
+    /// of the module view, top of each for writeHoles()
+    void enableHoles(size_t top) {
+        _holes.reset(new HoleReport(top));
+        _hole_instances = _holes->level("instances");
+        _hole_signals = _holes->level("signals");
+        _hole_modules = _holes->level("modules");
+    }
+
+    void finishVariant(covdbHandle var, covdbHandle met) {
+        _object_index.clear();
+        if (_current_module) {
+            _current_module->rollup.add(_variant_rollup);
+        }
+        _current_module = NULL;
+        if (_mem_budget && _record_arena->bytes() > _mem_budget) spillModules();
+    }
+
+    void startQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        if (!isToggleMetric(met) || _instance_stack.empty()) return;
+        _in_instance = true;
+        _container_depth = 0;
+        _inst_signals.clear();
+        _inst_covered.clear();
+        _inst_excluded.clear();
+        _inst_bits = 0;
+        _signal_objects = 0;
+        _inst_rollup = Rollup();
+        if (_holes) _hole_path = names().regionFullName;
     }
 
-    virtual void startQualifiedInstance(covdbHandle inst, covdbHandle met) {
+    void finishQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        if (!_in_instance) return;
+        _in_instance = false;
+        closeSignal();
+        if (_inst_bits == 0) return;
+
+        InstanceData& node = _instances[_instance_stack.back()];
+        node.schema = lookupSchema(node.module_name);
+        node.covered.swap(_inst_covered);
+        node.excluded.swap(_inst_excluded);
+        node.own = _inst_rollup;
+        _inst_signals.clear();
+    }
+
+    void startInstance(covdbHandle inst) {
         const char* inst_name = covdb_get_str(inst, covdbName);
-        if (inst_name && strlen(inst_name) > 0) {
-            _current_instance = inst_name;
-            _instance_hierarchy.push_back(inst_name);
+        covdbHandle def = covdb_get_handle(inst, covdbDefinition);
+        const char* mn = def ? covdb_get_str(def, covdbName) : NULL;
+
+        _instances.push_back(InstanceData());
+        InstanceData& node = _instances.back();
+        node.name = inst_name ? inst_name : "";
+        node.module_name = mn ? mn : "";
+        node.schema = -1;
+
+        size_t idx = _instances.size() - 1;
+        if (_instance_stack.empty()) {
+            _top_instances.push_back(idx);
+        } else {
+            _instances[_instance_stack.back()].children.push_back(idx);
         }
+        _instance_stack.push_back(idx);
     }
 
-    virtual void finishQualifiedInstance(covdbHandle inst, covdbHandle met) {
-        if (!_instance_hierarchy.empty()) {
-            _instance_hierarchy.pop_back();
+    /// Children finish before their parent, so the subtree rollup is
+    /// complete once the parent's own objects have been added.
+    void finishInstance(covdbHandle inst) {
+        if (_instance_stack.empty()) return;
+        InstanceData& node = _instances[_instance_stack.back()];
+        node.total = node.own;
+        for (size_t i = 0; i < node.children.size(); i++) {
+            node.total.add(_instances[node.children[i]].total);
+        }
+        long uncovered = node.total.coverable - node.total.covered;
+        if (_holes && _holes->wants(_hole_instances, uncovered)) {
+            const char* path = covdb_get_str(inst, covdbFullName);
+            _holes->add(_hole_instances, path ? path : node.name, uncovered,
+                        node.total.coverable);
+        }
+        _instance_stack.pop_back();
+        if (_filter) {
+            _filter_verdicts.pop_back();
+            _filter_paths.pop_back();
         }
-        _current_instance = _instance_hierarchy.empty() ? "" : _instance_hierarchy.back();
     }
 
-    virtual void startInstance(covdbHandle inst) {
-        const char* inst_name = covdb_get_str(inst, covdbName);
-        if (inst_name && strlen(inst_name) > 0) {
-            _current_instance = inst_name;
-            _instance_hierarchy.push_back(inst_name);
+    void startContainer(covdbHandle obj,
+                                covdbHandle region,
+                                covdbHandle metric,
+                                covdbHandle parent) {
+        // top-level containers of an instance region are its signals
+        if (_in_instance && _container_depth == 0) {
+            openSignal(names().parentName);
         }
+        _container_depth++;
+        _signal_path = NULL;
+        _object_index.push_back(0);
     }
 
-    virtual void finishInstance(covdbHandle inst) {
-        if (!_instance_hierarchy.empty()) {
-            _instance_hierarchy.pop_back();
+    void finishContainer(covdbHandle obj,
+                                 covdbHandle region,
+                                 covdbHandle metric,
+                                 covdbHandle parent) {
+        _container_depth--;
+        _signal_path = NULL;
+        _object_index.pop_back();
+        if (!_object_index.empty()) _object_index.back()++;
+    }
+
+    /// Record one toggle object of the current instance as a status bit
+    void visitInstanceObject(covdbHandle obj, covdbHandle region) {
+        if (_container_depth == 0) {
+            // bare object directly under the region: a signal of its own
+            const char* name = covdb_get_str(obj, covdbName);
+            openSignal(name ? name : "");
         }
-        _current_instance = _instance_hierarchy.empty() ? "" : _instance_hierarchy.back();
+        int st = covdb_get(obj, region, getTest(), covdbCovStatus);
+        if (_state) st = mergeStatus(memberId(_signal_key, _signal_objects), st);
+        if (st & covdbStatusCovered) {
+            setBit(_inst_covered, _inst_bits);
+            _inst_rollup.covered++;
+            _inst_rollup.coverable++;
+            _signal_coverable++;
+        } else if (st & covdbStatusExcluded) {
+            setBit(_inst_excluded, _inst_bits);
+        } else {
+            _inst_rollup.coverable++;
+            _signal_uncovered++;
+            _signal_coverable++;
+        }
+        _inst_bits++;
+        _signal_objects++;
+        if (_container_depth == 0) closeSignal();
     }
 
-    virtual void visitCovObject(covdbHandle obj,
+    /// Region and signal names come pre-resolved from the visitor, so a
+    /// toggle object costs one status lookup (names are only fetched for
+    /// bare objects that have no enclosing container).
+    void visitNamedCovObject(covdbHandle obj,
                              covdbHandle region,
                              covdbHandle metric,
-                             covdbHandle parent)
+                             covdbHandle parent,
+                             const ObjectNames& names)
     {
-        if (_current_module.empty()) return;
-
-        const char* pnm = covdb_get_str(parent, covdbName);
-        const char* onm = covdb_get_str(obj, covdbName);
+        if (_in_instance || _current_module) {
+            // a bare object under the region is filtered as a signal
+            if (_filter && _container_depth == 0 &&
+                !acceptSignal(covdb_get_str(obj, covdbName))) {
+                return;
+            }
+        }
+        if (_in_instance) {
+            visitInstanceObject(obj, region);
+            return;
+        }
+        if (!_current_module || _object_index.empty()) return;
+        unsigned index = _object_index.back()++;
 
+        // status first: in uncovered-only mode nothing else is fetched
+        // for covered or excluded objects, unless a state needs the id
         int st = covdb_get(obj, region, getTest(), covdbCovStatus);
-        std::string status;
+        const char* path = NULL;
+        uint64_t id = 0;
+        if (_state) {
+            path = signalPath(obj, names);
+            id = moduleObjectId(path, index);
+            st = mergeStatus(id, st);
+        }
+        ToggleStatus status;
         if (st & covdbStatusCovered) {
-            status = "Covered";
+            status = StatusCovered;
+            _variant_rollup.covered++;
+            _variant_rollup.coverable++;
         } else if (st & covdbStatusExcluded) {
-            status = "Excluded";
+            status = StatusExcluded;
         } else {
-            status = "Uncovered";
+            status = StatusUncovered;
+            _variant_rollup.coverable++;
         }
+        if (_uncovered_only && status != StatusUncovered) return;
+
+        ToggleRecord rec;
+        rec.hdl_signal_path = path ? path : signalPath(obj, names);
+        // Objects alternate "0 -> 1" and "1 -> 0" within their container
+        rec.toggle_type = index % 2;
+        rec.status = status;
+        rec.id = path ? id : moduleObjectId(rec.hdl_signal_path, index);
+        if (_id_names) {
+            IdName idn;
+            idn.id = rec.id;
+            idn.name = _id_buf;
+            _id_names->push_back(idn);
+        }
+        _current_module->append(rec, *_record_arena);
+    }
+
+    /// Interned HDL path <region>.<signal> of a module-view object.  All
+    /// objects of a container share it, so it is built and looked up
+    /// once per container.
+    const char* signalPath(covdbHandle obj, const ObjectNames& names) {
+        if (_signal_path) return _signal_path;
 
-        // Extract signal name and build HDL signal path
-        std::string signal_name = "unknown";
-        std::string hdl_signal_path = "";
-        
-        // Try to get the full name of the object
-        const char* obj_full_name = covdb_get_str(obj, covdbFullName);
-        const char* parent_full_name = covdb_get_str(parent, covdbFullName);
-        const char* region_name = covdb_get_str(region, covdbName);
-        const char* region_full_name = covdb_get_str(region, covdbFullName);
-        
         // Use the full name for the signal name - this gives us the correct signal names
-        if (parent_full_name && strlen(parent_full_name) > 0) {
-            signal_name = parent_full_name;
-            hdl_signal_path = parent_full_name;
-        } else if (obj_full_name && strlen(obj_full_name) > 0) {
-            signal_name = obj_full_name;
-            hdl_signal_path = obj_full_name;
+        std::string_view signal_name = "unknown";
+        if (!names.parentFullName.empty()) {
+            signal_name = names.parentFullName;
         } else {
-            signal_name = pnm ? pnm : "unknown";
-            hdl_signal_path = signal_name;
+            const char* obj_full_name = covdb_get_str(obj, covdbFullName);
+            if (obj_full_name && strlen(obj_full_name) > 0) {
+                signal_name = obj_full_name;
+            } else if (!names.parentName.empty()) {
+                signal_name = names.parentName;
+            }
         }
-        
+
         // Use region information to build HDL signal path
-        if (region_name && strlen(region_name) > 0) {
-            hdl_signal_path = std::string(region_name) + "." + signal_name;
+        _path_buf.clear();
+        if (!names.regionName.empty()) {
+            _path_buf += names.regionName;
+            _path_buf += ".";
+        }
+        _path_buf += signal_name;
+
+        bool inserted;
+        const char* path = _signal_paths->get(_path_buf, inserted).key.data();
+        // bare objects directly under the region each name their own signal
+        if (_container_depth > 0) _signal_path = path;
+        return path;
+    }
+
+    /// Memory use of the collected data, for --stats
+    void printStats(std::ostream& os) {
+        size_t records = 0;
+        for (size_t i = 0; i < _modules.size(); i++) {
+            for (const RecordChunk* c = _modules[i]->first; c; c = c->next) {
+                records += c->count;
+            }
+        }
+        os << "stats: " << _modules.size() << " modules, " << records
+           << " toggle records, " << _signal_paths->size() << " signal paths\n"
+           << "stats: arena " << _arena.allocations() + _record_arena->allocations()
+           << " allocations in " << _arena.blocks() + _record_arena->blocks()
+           << " blocks (" << _arena.bytes() + _record_arena->bytes() << " bytes)\n";
+        if (!_module_runs.empty()) {
+            uint64_t bytes = 0;
+            for (size_t i = 0; i < _module_runs.size(); i++) bytes += _module_runs[i].file->bytes();
+            os << "stats: spilled " << _spilled_records << " toggle records in "
+               << _module_runs.size() << " runs (" << bytes << " bytes)\n";
+        }
+        os
+           << "stats: heap " << HeapStats::allocations() << " allocations ("
+           << HeapStats::bytes() << " bytes requested)\n"
+           << "stats: peak RSS " << HeapStats::peakRssKb() << " kB" << std::endl;
+    }
+
+    /// Percentage rounded to two decimals
+    static double rollupScore(const Rollup& r) {
+        double score = 100.0 * r.covered / r.coverable;
+        return floor(score * 100 + 0.5) / 100;
+    }
+
+    /// Rollup as {"covered", "coverable", "score"}; score is a percentage
+    /// rounded to two decimals and omitted when nothing is coverable.
+    static rapidjson::Value rollupJson(const Rollup& r,
+                                       rapidjson::Document::AllocatorType& allocator) {
+        rapidjson::Value cov(rapidjson::kObjectType);
+        cov.AddMember("covered", (int64_t)r.covered, allocator);
+        cov.AddMember("coverable", (int64_t)r.coverable, allocator);
+        if (r.coverable > 0) {
+            cov.AddMember("score", rollupScore(r), allocator);
+        }
+        return cov;
+    }
+
+    /// rollupJson() written directly
+    static void rollupOut(const Rollup& r, JsonOut& out) {
+        out.StartObject();
+        out.key(coveredKey);
+        out.Int64(r.covered);
+        out.key(coverableKey);
+        out.Int64(r.coverable);
+        if (r.coverable > 0) {
+            out.key(scoreKey);
+            out.Double(rollupScore(r));
+        }
+        out.EndObject();
+    }
+
+    rapidjson::Value instanceJson(const InstanceData& node, const std::string& path,
+                                  rapidjson::Document::AllocatorType& allocator) {
+        rapidjson::Value inst_obj(rapidjson::kObjectType);
+        inst_obj.AddMember("name", rapidjson::Value(node.name.c_str(), allocator), allocator);
+        std::string id = idToHex(objectId("inst:" + path));
+        inst_obj.AddMember("id", rapidjson::Value(id.c_str(), allocator), allocator);
+        inst_obj.AddMember("module", rapidjson::Value(node.module_name.c_str(), allocator), allocator);
+        inst_obj.AddMember("coverage", rollupJson(node.total, allocator), allocator);
+        if (node.schema >= 0) {
+            size_t nbits = _schemas[node.schema].num_bits;
+            inst_obj.AddMember("schema", node.schema, allocator);
+            std::string covered = bitsToHex(node.covered, nbits);
+            inst_obj.AddMember("toggle_bits", rapidjson::Value(covered.c_str(), allocator), allocator);
+            if (!node.excluded.empty()) {
+                std::string excluded = bitsToHex(node.excluded, nbits);
+                inst_obj.AddMember("excluded_bits", rapidjson::Value(excluded.c_str(), allocator), allocator);
+            }
+        }
+        if (!node.children.empty()) {
+            rapidjson::Value children(rapidjson::kArrayType);
+            for (size_t i = 0; i < node.children.size(); i++) {
+                const InstanceData& child = _instances[node.children[i]];
+                children.PushBack(instanceJson(child, path + "." + child.name, allocator), allocator);
+            }
+            inst_obj.AddMember("instances", children, allocator);
+        }
+        return inst_obj;
+    }
+
+    /// Design-wide instance tree: module signal lists are emitted once
+    /// in "schemas"; each instance only carries its packed status bits.
+    rapidjson::Value designJson(rapidjson::Document::AllocatorType& allocator) {
+        rapidjson::Value design(rapidjson::kObjectType);
+
+        rapidjson::Value schemas(rapidjson::kArrayType);
+        for (size_t i = 0; i < _schemas.size(); i++) {
+            const ModuleSchema& schema = _schemas[i];
+            rapidjson::Value schema_obj(rapidjson::kObjectType);
+            schema_obj.AddMember("module", rapidjson::Value(schema.module_name.c_str(), allocator), allocator);
+            rapidjson::Value signals(rapidjson::kArrayType);
+            for (size_t j = 0; j < schema.signals.size(); j++) {
+                rapidjson::Value sig(rapidjson::kObjectType);
+                sig.AddMember("name", rapidjson::Value(schema.signals[j].name.c_str(), allocator), allocator);
+                sig.AddMember("width", schema.signals[j].width, allocator);
+                signals.PushBack(sig, allocator);
+            }
+            schema_obj.AddMember("signals", signals, allocator);
+            schemas.PushBack(schema_obj, allocator);
+        }
+        design.AddMember("schemas", schemas, allocator);
+
+        Rollup total;
+        rapidjson::Value instances(rapidjson::kArrayType);
+        for (size_t i = 0; i < _top_instances.size(); i++) {
+            const InstanceData& top = _instances[_top_instances[i]];
+            total.add(top.total);
+            instances.PushBack(instanceJson(top, top.name, allocator), allocator);
+        }
+        design.AddMember("coverage", rollupJson(total, allocator), allocator);
+        design.AddMember("instances", instances, allocator);
+        return design;
+    }
+
+    /// Expand the packed bits of node and its subtree into snapshot
+    /// records keyed <instance path>.<signal>[<bit>]:<direction>.  Bits
+    /// are numbered in UCAPI object order; the index is left off for
+    /// single-bit signals, and padding is no object.
+    template <class Fn>
+    void collectSnapshot(const InstanceData& node, const std::string& parent_path,
+                         Fn& add) {
+        std::string path = parent_path.empty() ? node.name
+                                               : parent_path + "." + node.name;
+        if (node.schema >= 0) {
+            const ModuleSchema& schema = _schemas[node.schema];
+            size_t obj = 0;
+            for (size_t i = 0; i < schema.signals.size(); i++) {
+                const SignalSchema& sig = schema.signals[i];
+                for (unsigned b = 0; b < sig.width; b++) {
+                    std::string bit = path + "." + sig.name;
+                    if (sig.width > 1) bit += "[" + std::to_string(b) + "]";
+                    for (int dir = 0; dir < 2; dir++, obj++) {
+                        if (2 * b + dir >= sig.objects) continue;
+                        SnapRecord rec;
+                        rec.key = bit + (dir ? ":1->0" : ":0->1");
+                        rec.id = objectId("tgl:" + rec.key);
+                        rec.covered = testBit(node.covered, obj);
+                        rec.coverable = !testBit(node.excluded, obj);
+                        add(rec);
+                    }
+                }
+            }
+        }
+        for (size_t i = 0; i < node.children.size(); i++) {
+            collectSnapshot(_instances[node.children[i]], path, add);
+        }
+    }
+
+    /// Merge the hits of the loaded tests into state and report the
+    /// merged coverage.  Every object is visited, also in uncovered-only
+    /// mode.
+    void setState(CovState* state) {
+        _state = state;
+    }
+
+    /// Collect canonical names of module-view records as they are visited
+    void collectIdNames(std::vector<IdName>* names) {
+        _id_names = names;
+    }
+
+    /// Collision check pass over every id this run assigns: module-view
+    /// records gathered during traversal plus all instance-view objects.
+    size_t checkIds() {
+        auto add = [&](SnapRecord& rec) {
+            IdName idn;
+            idn.id = rec.id;
+            idn.name = "tgl:" + rec.key;
+            _id_names->push_back(idn);
+        };
+        for (size_t i = 0; i < _top_instances.size(); i++) {
+            collectSnapshot(_instances[_top_instances[i]], "", add);
         }
+        return checkIdCollisions(*_id_names, std::cerr);
+    }
+
+    /// Write the holes ranked during the walk to file.  Modules collect
+    /// their counts over every variant, so they are ranked here.
+    bool writeHoles(const char* file, JsonOut::Style style, std::string& err) {
+        Rollup design, modules;
+        for (size_t i = 0; i < _top_instances.size(); i++) {
+            design.add(_instances[_top_instances[i]].total);
+        }
+        for (size_t i = 0; i < _modules.size(); i++) {
+            const Rollup& r = _modules[i]->rollup;
+            modules.add(r);
+            _holes->add(_hole_modules, std::string(_modules[i]->module_name),
+                        r.coverable - r.covered, r.coverable);
+        }
+        long uncovered = design.coverable - design.covered;
+        _holes->setTotal(_hole_instances, uncovered, uncovered);
+        _holes->setTotal(_hole_signals, uncovered, uncovered);
+        uncovered = modules.coverable - modules.covered;
+        _holes->setTotal(_hole_modules, uncovered, uncovered);
+        return _holes->write(file, "dumptgl", style, err);
+    }
+
+    /// Write the instance view as a snapshot sorted by path (see
+    /// covsnap/src/snapshot.hh for the format), renamed into place.  The
+    /// records are sorted in runs of at most the memory budget.
+    bool writeSnapshot(const char* file, std::string& err) {
+        SortedRuns<SnapRecord> records(_mem_budget);
+        auto add = [&](SnapRecord& rec) {
+            std::replace(rec.key.begin(), rec.key.end(), '\t', ' ');
+            std::replace(rec.key.begin(), rec.key.end(), '\n', ' ');
+            records.add(std::move(rec));
+        };
+        for (size_t i = 0; i < _top_instances.size(); i++) {
+            collectSnapshot(_instances[_top_instances[i]], "", add);
+        }
+        if (!records.finish(err)) return false;
+
+        AtomicFile out(file);
+        if (!out.open(err)) return false;
+        FILE* fp = out.stream();
+        fprintf(fp, "#covsnap 2 toggle\n");
+        std::string last;
+        bool first = true;
+        while (SnapRecord* rec = records.next()) {
+            // identical paths can only come from duplicate signal names
+            if (!first && rec->key == last) continue;
+            fprintf(fp, "%s\t%s\t%d\t%d\t%d\n", rec->key.c_str(),
+                    idToHex(rec->id).c_str(), rec->covered, rec->coverable,
+                    rec->covered);
+            last.swap(rec->key);
+            first = false;
+        }
+        if (!records.error().empty()) {
+            err = records.error();
+            return false;
+        }
+        return out.commit(err);
+    }
+
+    /// One entry of the "modules" array
+    static rapidjson::Value moduleJson(const ModuleData& module_data,
+                                       rapidjson::Document::AllocatorType& allocator) {
+        rapidjson::Value module_obj(rapidjson::kObjectType);
         
-        ToggleData data;
-        data.signal_name = signal_name;
-        data.hdl_signal_path = hdl_signal_path;
-        // Since both onm and obj_full_name are giving signal names, let me try a different approach
-        // For now, let me try to construct the toggle type from the pattern
-        // The original shows alternating "0 -> 1" and "1 -> 0" patterns
-        std::string toggle_type;
-        if (_modules_data[_current_module].toggle_data.size() % 2 == 0) {
-            toggle_type = "0 -> 1";
-        } else {
-            toggle_type = "1 -> 0";
+        // Add module name
+        rapidjson::Value module_name(module_data.module_name.data(),
+                                     module_data.module_name.size(), allocator);
+        module_obj.AddMember("module", module_name, allocator);
+        module_obj.AddMember("coverage", rollupJson(module_data.rollup, allocator), allocator);
+        
+        // Add toggle data array for this module
+        rapidjson::Value toggle_array(rapidjson::kArrayType);
+        
+        for (const RecordChunk* chunk = module_data.first; chunk; chunk = chunk->next) {
+            for (unsigned i = 0; i < chunk->count; i++) {
+                const ToggleRecord& data = chunk->records[i];
+                rapidjson::Value toggle_obj(rapidjson::kObjectType);
+
+                // paths and names outlive the document, so they are
+                // referenced rather than copied
+                std::string id = idToHex(data.id);
+                toggle_obj.AddMember("id", rapidjson::Value(id.c_str(), allocator), allocator);
+                toggle_obj.AddMember("hdl_signal_path",
+                                     rapidjson::StringRef(data.hdl_signal_path), allocator);
+                toggle_obj.AddMember("toggle_type",
+                                     rapidjson::StringRef(toggleTypeNames[data.toggle_type]), allocator);
+                toggle_obj.AddMember("status",
+                                     rapidjson::StringRef(toggleStatusNames[data.status]), allocator);
+
+                toggle_array.PushBack(toggle_obj, allocator);
+            }
         }
         
-        data.toggle_type = toggle_type;
-        data.status = status;
-        _modules_data[_current_module].toggle_data.push_back(data);
+        module_obj.AddMember("toggle_coverage", toggle_array, allocator);
+        return module_obj;
+    }
+
+    static void recordOut(const ToggleRecord& data, JsonOut& out) {
+        char id[16];
+        out.StartObject();
+        out.key(idKey);
+        idToHex(data.id, id);
+        out.string(std::string_view(id, sizeof(id)));
+        out.key(pathKey);
+        out.string(std::string_view(data.hdl_signal_path));
+        out.key(typeKey);
+        out.string(toggleTypeJson[data.toggle_type]);
+        out.key(statusKey);
+        out.string(toggleStatusJson[data.status]);
+        out.EndObject();
+    }
+
+    /// moduleJson() written directly, without building a Value.  With
+    /// runs, the module's spilled records come first.
+    static void moduleOut(const ModuleData& module_data, JsonOut& out,
+                          std::vector<RunCursor>* runs = NULL) {
+        out.StartObject();
+        out.key(moduleKey);
+        out.string(module_data.module_name);
+        out.key(coverageKey);
+        rollupOut(module_data.rollup, out);
+
+        out.key(toggleCoverageKey);
+        out.StartArray();
+        if (runs) spilledRecordsOut(module_data, *runs, out);
+        for (const RecordChunk* chunk = module_data.first; chunk; chunk = chunk->next) {
+            for (unsigned i = 0; i < chunk->count; i++) {
+                recordOut(chunk->records[i], out);
+            }
+        }
+        out.EndArray();
+        out.EndObject();
+    }
+
+    /// Keep the module records under bytes of memory by spilling them
+    /// (and the snapshot records under as much by sorting them in runs)
+    void setMemBudget(size_t bytes) {
+        _mem_budget = bytes;
+    }
+
+    const std::string& spillError() const { return _spill_err; }
+
+    /// Write the module records collected so far as a run in module name
+    /// order and drop them from memory.  Per module with records: its
+    /// index + 1 and the record count; per record: the id, a byte with
+    /// the toggle type (bit 0), the status (bits 1-2) and whether a path
+    /// follows (bit 3), and the path if it is not the previous record's.
+    /// Index 0 ends the run.
+    void spillModules() {
+        if (!_spill_err.empty()) return;
+        ModuleRun run;
+        run.file.reset(new SpillFile);
+        run.round = 0;
+        if (!run.file->create(_spill_err)) return;
+        std::vector<const ModuleData*> modules = sortedModules();
+        for (size_t i = 0; i < modules.size(); i++) {
+            const ModuleData& module_data = *modules[i];
+            if (!module_data.first) continue;
+            run.file->putVarint(module_data.index + 1);
+            run.file->putVarint(module_data.records());
+            const char* last = NULL;
+            for (const RecordChunk* chunk = module_data.first; chunk; chunk = chunk->next) {
+                for (unsigned k = 0; k < chunk->count; k++) {
+                    const ToggleRecord& data = chunk->records[k];
+                    // paths are interned, so equal paths are one pointer
+                    bool path = data.hdl_signal_path != last;
+                    run.file->putFixed64(data.id);
+                    run.file->putByte(data.toggle_type | data.status << 1 | (path ? 8 : 0));
+                    if (path) run.file->putString(data.hdl_signal_path);
+                    last = data.hdl_signal_path;
+                }
+            }
+            _spilled_records += module_data.records();
+        }
+        run.file->putVarint(0);
+        _module_runs.push_back(std::move(run));
+
+        // the last SortedRuns' Fanout runs of a round make one of the next,
+        // so few files are open however often the records are spilled
+        size_t fanout = SortedRuns<SnapRecord>::Fanout;
+        while (_spill_err.empty() && _module_runs.size() >= fanout &&
+               _module_runs[_module_runs.size() - fanout].round ==
+                       _module_runs.back().round) {
+            mergeRuns(_module_runs.size() - fanout);
+        }
+
+        for (size_t i = 0; i < _modules.size(); i++) {
+            _modules[i]->first = _modules[i]->last = NULL;
+        }
+        _signal_paths.reset();
+        _record_arena.reset(new Arena);
+        _signal_paths.reset(new StringIndex(*_record_arena));
+        _signal_path = NULL;
+    }
+
+    /// Start reading the runs from first on at their first module
+    bool openRuns(std::vector<RunCursor>& runs, size_t first = 0) {
+        runs.clear();
+        for (size_t i = first; i < _module_runs.size(); i++) {
+            RunCursor c;
+            c.file = _module_runs[i].file.get();
+            if (!c.file->rewind(_spill_err)) return false;
+            c.advance();
+            runs.push_back(c);
+        }
+        return true;
     }
 
-    void outputJson() {
+    bool runsGood(const std::vector<RunCursor>& runs) {
+        for (size_t r = 0; r < runs.size(); r++) {
+            if (!runs[r].file->good()) {
+                _spill_err = "cannot read back a spilled run";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Merge the runs from first on into one: per module, their records
+    /// in run order.  Records are copied as they are; the first one of
+    /// each run carries its path.
+    void mergeRuns(size_t first) {
+        ModuleRun merged;
+        merged.file.reset(new SpillFile);
+        merged.round = _module_runs.back().round + 1;
+        std::vector<RunCursor> runs;
+        if (!merged.file->create(_spill_err) || !openRuns(runs, first)) return;
+        SpillFile& to = *merged.file;
+        std::string path;
+        std::vector<const ModuleData*> modules = sortedModules();
+        for (size_t i = 0; i < modules.size(); i++) {
+            uint64_t next = modules[i]->index + 1, total = 0;
+            for (size_t r = 0; r < runs.size(); r++) {
+                if (runs[r].next == next) total += runs[r].count;
+            }
+            if (!total) continue;
+            to.putVarint(next);
+            to.putVarint(total);
+            for (size_t r = 0; r < runs.size(); r++) {
+                RunCursor& c = runs[r];
+                if (c.next != next) continue;
+                for (uint64_t k = 0; k < c.count && c.file->good(); k++) {
+                    to.putFixed64(c.file->getFixed64());
+                    uint8_t b = c.file->getByte();
+                    to.putByte(b);
+                    if (b & 8) {
+                        c.file->getString(path);
+                        to.putString(path);
+                    }
+                }
+                c.advance();
+            }
+        }
+        to.putVarint(0);
+        if (!runsGood(runs)) return;
+        _module_runs.erase(_module_runs.begin() + first, _module_runs.end());
+        _module_runs.push_back(std::move(merged));
+    }
+
+    /// Write the records of module_data from every run that has some,
+    /// in run order
+    static void spilledRecordsOut(const ModuleData& module_data,
+                                  std::vector<RunCursor>& runs, JsonOut& out) {
+        ToggleRecord data;
+        std::string path;
+        for (size_t r = 0; r < runs.size(); r++) {
+            RunCursor& c = runs[r];
+            if (c.next != module_data.index + 1) continue;
+            for (uint64_t k = 0; k < c.count && c.file->good(); k++) {
+                data.id = c.file->getFixed64();
+                uint8_t b = c.file->getByte();
+                if (b & 8) c.file->getString(path);
+                data.toggle_type = b & 1;
+                data.status = (b >> 1) & 3;
+                data.hdl_signal_path = path.c_str();
+                recordOut(data, out);
+            }
+            c.advance();
+        }
+    }
+
+    /// Modules in name order
+    std::vector<const ModuleData*> sortedModules() const {
+        std::vector<const ModuleData*> modules(_modules.begin(), _modules.end());
+        std::sort(modules.begin(), modules.end(),
+                  [](const ModuleData* a, const ModuleData* b) {
+                      return a->module_name < b->module_name;
+                  });
+        return modules;
+    }
+
+    /// Write the JSON report to fd.  With opt.jobs > 1 the modules are
+    /// formatted on that many threads and written in order with writev;
+    /// the bytes are the same as the serial writer's, and the same again
+    /// when module records were spilled and are merged back here.
+    bool outputJson(const JsonOptions& opt, int fd) {
+        std::vector<const ModuleData*> modules = sortedModules();
+        std::cout.flush();
+        if (!opt.useRapidJson) {
+            JsonOut out(fd, opt.style);
+            out.StartObject();
+            out.key(modulesKey);
+            out.StartArray();
+            if (!_module_runs.empty()) {
+                // the runs are read back in order, so on this thread
+                std::vector<RunCursor> runs;
+                if (!openRuns(runs)) return false;
+                for (size_t i = 0; i < modules.size(); i++) {
+                    moduleOut(*modules[i], out, &runs);
+                }
+                if (!runsGood(runs)) return false;
+            } else if (opt.jobs > 1) {
+                forkElements(out, modules.size(), opt.jobs,
+                             [&](size_t i, JsonOut& writer) {
+                                 moduleOut(*modules[i], writer);
+                             });
+            } else {
+                for (size_t i = 0; i < modules.size(); i++) {
+                    moduleOut(*modules[i], out);
+                }
+            }
+            out.EndArray();
+
+            // the design view is small next to the modules
+            rapidjson::Document::AllocatorType allocator;
+            out.key(designKey);
+            designJson(allocator).Accept(out);
+            out.EndObject();
+            out.raw("\n");
+            return out.flush();
+        }
+
         rapidjson::Document document;
         document.SetObject();
         rapidjson::Document::AllocatorType& allocator = document.GetAllocator();
 
+        if (opt.jobs > 1) {
+            document.AddMember("modules", rapidjson::Value(rapidjson::kArrayType), allocator);
+            document.AddMember("design", designJson(allocator), allocator);
+
+            // each module gets its own allocator
+            auto emit = [&](size_t i, auto& writer) {
+                rapidjson::Document::AllocatorType local;
+                moduleJson(*modules[i], local).Accept(writer);
+            };
+            std::vector<std::string> chunks;
+            if (opt.style == JsonOut::Compact) {
+                jsonChunks<rapidjson::Writer<rapidjson::StringBuffer> >(
+                    document, "modules", modules.size(), opt.jobs, emit, chunks);
+            } else {
+                jsonChunks<rapidjson::PrettyWriter<rapidjson::StringBuffer> >(
+                    document, "modules", modules.size(), opt.jobs, emit, chunks);
+            }
+            chunks.push_back("\n");
+            return writeChunks(fd, chunks);
+        }
+
         // Add modules array
         rapidjson::Value modules_array(rapidjson::kArrayType);
-        
-        for (const auto& module_pair : _modules_data) {
-            const ModuleData& module_data = module_pair.second;
-            
-            rapidjson::Value module_obj(rapidjson::kObjectType);
-            
-            // Add module name
-            rapidjson::Value module_name(module_data.module_name.c_str(), allocator);
-            module_obj.AddMember("module", module_name, allocator);
-            
-            // Add toggle data array for this module
-            rapidjson::Value toggle_array(rapidjson::kArrayType);
-            
-            for (const auto& data : module_data.toggle_data) {
-                rapidjson::Value toggle_obj(rapidjson::kObjectType);
-                
-                rapidjson::Value hdl_signal_path(data.hdl_signal_path.c_str(), allocator);
-                rapidjson::Value toggle_type(data.toggle_type.c_str(), allocator);
-                rapidjson::Value status(data.status.c_str(), allocator);
-                
-                toggle_obj.AddMember("hdl_signal_path", hdl_signal_path, allocator);
-                toggle_obj.AddMember("toggle_type", toggle_type, allocator);
-                toggle_obj.AddMember("status", status, allocator);
-                
-                toggle_array.PushBack(toggle_obj, allocator);
-            }
-            
-            module_obj.AddMember("toggle_coverage", toggle_array, allocator);
-            modules_array.PushBack(module_obj, allocator);
+        for (size_t i = 0; i < modules.size(); i++) {
+            modules_array.PushBack(moduleJson(*modules[i], allocator), allocator);
         }
         
         document.AddMember("modules", modules_array, allocator);
+        document.AddMember("design", designJson(allocator), allocator);
 
-        // Output pretty JSON
         rapidjson::StringBuffer buffer;
-        rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
-        document.Accept(writer);
-        
-        std::cout << buffer.GetString() << std::endl;
+        writeRapidJson(document, opt.style, buffer);
+
+        std::vector<std::string> chunks;
+        chunks.push_back(std::string(buffer.GetString(), buffer.GetSize()));
+        chunks.push_back("\n");
+        return writeChunks(fd, chunks);
+    }
+
+    /// Write the report to dir instead: modules/<module>.json[.gz] with
+    /// one module each, design.json[.gz] with the design view and
+    /// manifest.json listing them.  Shards are formatted and compressed
+    /// on opt.jobs threads.
+    bool outputShards(const char* dir, const JsonOptions& opt, bool gzip,
+                      std::string& err) {
+        std::vector<const ModuleData*> modules = sortedModules();
+        ShardWriter writer(dir, gzip, opt.style);
+        if (!writer.open(err)) return false;
+
+        std::vector<ShardFile> files;
+        if (!writer.write("modules", modules.size(), opt.jobs,
+                          [&](size_t i) { return std::string(modules[i]->module_name); },
+                          [&](size_t i, JsonOut& out) { moduleOut(*modules[i], out); },
+                          files, err)) {
+            return false;
+        }
+        ShardFile design;
+        if (!writer.writeOne("design",
+                             [&](JsonOut& out) {
+                                 rapidjson::Document::AllocatorType allocator;
+                                 designJson(allocator).Accept(out);
+                             }, design, err)) {
+            return false;
+        }
+
+        return writer.writeManifest([&](JsonOut& out) {
+            out.StartObject();
+            out.key("format");
+            out.string("covshard 1");
+            out.key("tool");
+            out.string("dumptgl");
+            out.key("compression");
+            out.string(writer.compression());
+            out.key(designKey);
+            out.StartObject();
+            ShardWriter::describe(design, out);
+            out.EndObject();
+            out.key(modulesKey);
+            out.StartArray();
+            for (size_t i = 0; i < modules.size(); i++) {
+                out.StartObject();
+                out.key(moduleKey);
+                out.string(modules[i]->module_name);
+                ShardWriter::describe(files[i], out);
+                out.key("records");
+                out.Uint64(modules[i]->records());
+                out.key(coverageKey);
+                rollupOut(modules[i]->rollup, out);
+                out.EndObject();
+            }
+            out.EndArray();
+            out.EndObject();
+        }, err);
+    }
+
+    void trendInstance(const InstanceData& node, const std::string& parent_path,
+                       TrendWriter& trend) {
+        std::string path = parent_path.empty() ? node.name
+                                               : parent_path + "." + node.name;
+        if (node.total.coverable == 0) return;
+        trend.add("instance", path, node.total.covered, node.total.coverable);
+        for (size_t i = 0; i < node.children.size(); i++) {
+            trendInstance(_instances[node.children[i]], path, trend);
+        }
+    }
+
+    /// Append this run's rollups to the trend store at file: every
+    /// instance subtree by path and every module by name, skipping those
+    /// with nothing coverable
+    bool appendTrend(const char* file, std::string& err) {
+        TrendWriter trend;
+        for (size_t i = 0; i < _top_instances.size(); i++) {
+            trendInstance(_instances[_top_instances[i]], "", trend);
+        }
+        std::vector<const ModuleData*> modules = sortedModules();
+        for (size_t i = 0; i < modules.size(); i++) {
+            const Rollup& r = modules[i]->rollup;
+            if (r.coverable == 0) continue;
+            trend.add("module", std::string(modules[i]->module_name),
+                      r.covered, r.coverable);
+        }
+        return trend.append(file, (int64_t)time(NULL), err);
+    }
+
+    /// Score for HtmlOut::coverage(), -1 when nothing is coverable
+    static double htmlScore(const Rollup& r) {
+        return r.coverable > 0 ? rollupScore(r) : -1;
+    }
+
+    /// Write the HTML report to dir: index.html with the design rollup
+    /// and a table of the modules, and modules/<module>.html (split into
+    /// pages of rowsPerPage toggles) listing each module's toggles with
+    /// the uncovered ones highlighted.  Modules are written on jobs
+    /// threads.
+    bool outputHtml(const char* dir, size_t rowsPerPage, unsigned jobs,
+                    std::string& err) {
+        std::vector<const ModuleData*> modules = sortedModules();
+        if (!htmlStart(dir, "modules", err)) return false;
+
+        std::vector<std::string> names;
+        for (size_t i = 0; i < modules.size(); i++) {
+            names.push_back(std::string(modules[i]->module_name));
+        }
+        std::vector<std::string> stems = fileStems(names);
+
+        static const std::vector<std::string> columns = {
+            "id", "hdl_signal_path", "toggle_type", "status"
+        };
+        std::vector<std::string> errs(modules.size());
+        parallelFor(modules.size(), jobs, [&](size_t i) {
+            const ModuleData& module_data = *modules[i];
+            const Rollup& r = module_data.rollup;
+            std::string summary = std::to_string(r.covered) + " of " +
+                                  std::to_string(r.coverable) +
+                                  " toggles covered";
+            HtmlPages pages(std::string(dir) + "/modules", stems[i],
+                            "module " + names[i], summary, columns,
+                            module_data.records(), rowsPerPage);
+            char id[16];
+            for (const RecordChunk* chunk = module_data.first; chunk; chunk = chunk->next) {
+                for (unsigned k = 0; k < chunk->count; k++) {
+                    const ToggleRecord& data = chunk->records[k];
+                    HtmlOut& out = pages.row(data.status == StatusUncovered);
+                    idToHex(data.id, id);
+                    out.cell(std::string_view(id, sizeof(id)));
+                    out.cell(data.hdl_signal_path);
+                    out.cell(toggleTypeNames[data.toggle_type]);
+                    out.cell(toggleStatusNames[data.status]);
+                }
+            }
+            pages.finish(errs[i]);
+        });
+        for (size_t i = 0; i < errs.size(); i++) {
+            if (!errs[i].empty()) {
+                err = errs[i];
+                return false;
+            }
+        }
+
+        Rollup total;
+        for (size_t i = 0; i < _top_instances.size(); i++) {
+            total.add(_instances[_top_instances[i]].total);
+        }
+        std::string index = std::string(dir) + "/index.html";
+        AtomicFile file(index);
+        if (!file.open(err)) return false;
+        {
+            HtmlOut out(file.fd());
+            out.beginPage("Toggle coverage", "style.css");
+            out.raw("<table>\n<tr><th></th><th>covered</th><th>coverable</th>"
+                    "<th>score</th></tr>\n<tr><td>design</td>");
+            out.coverage(total.covered, total.coverable, htmlScore(total));
+            out.raw("</tr>\n</table>\n<h2>Modules</h2>\n<table>\n<tr><th>module</th>"
+                    "<th>records</th><th>covered</th><th>coverable</th>"
+                    "<th>score</th></tr>\n");
+            for (size_t i = 0; i < modules.size(); i++) {
+                const Rollup& r = modules[i]->rollup;
+                out.raw(r.covered < r.coverable ? "<tr class=\"hole\">" : "<tr>");
+                out.raw("<td><a href=\"modules/");
+                out.text(stems[i]);
+                out.raw(".html\">");
+                out.text(names[i]);
+                out.raw("</a></td>");
+                out.cell((int64_t)modules[i]->records());
+                out.coverage(r.covered, r.coverable, htmlScore(r));
+                out.raw("</tr>\n");
+            }
+            out.raw("</table>\n");
+            out.endPage();
+            if (!out.flush()) {
+                err = "cannot write " + index;
+                return false;
+            }
+        }
+        return file.commit(err);
     }
 
 };
 
+/// Toggle traversal for --sample: reads only the instances and signals
+/// sample draws, a signal from its container's counts, and reports
+/// estimates instead of the module and instance views
+class SampleTgl : public UcapiWalker<SampleTgl, ToggleMetric> {
+    CoverageSample& _sample;
+    const PathFilter* _filter;
 
-int main(int argc, const char *argv[])
+    // path, module and filter verdict of each open instance
+    std::vector<std::string> _paths;
+    std::vector<std::string> _module_names;
+    std::vector<PathFilter::Verdict> _verdicts;
+
+    // the instance whose signals are being drawn
+    bool _reading;
+
+    /// Draw the signal name of the instance being read
+    bool drawSignal(const char* name) {
+        std::string path = _paths.back();
+        path += ".";
+        path += name ? name : "unknown";
+        if (_filter &&
+            _filter->classify(path, _verdicts.back()) != PathFilter::Accept) {
+            return false;
+        }
+        return _sample.signal(path);
+    }
+
+public:
+    // instances and signals are named from their handles, never from names()
+    static constexpr bool RegionNames = false;
+    static constexpr bool ContainerNames = false;
+
+    SampleTgl(covdbHandle design, covdbHandle test, CoverageSample& sample,
+              const PathFilter* filter)
+            : UcapiWalker(design, test), _sample(sample), _filter(filter),
+              _reading(false) { }
+
+    bool acceptInstance(covdbHandle inst) {
+        const char* path = covdb_get_str(inst, covdbFullName);
+        PathFilter::Verdict v = PathFilter::Accept;
+        if (_filter) {
+            v = _filter->classify(path ? path : "", _verdicts.empty() ?
+                                  _filter->root() : _verdicts.back());
+            if (v == PathFilter::Reject) return false;
+        }
+        covdbHandle def = covdb_get_handle(inst, covdbDefinition);
+        const char* mn = def ? covdb_get_str(def, covdbName) : NULL;
+        _paths.push_back(path ? path : "");
+        _module_names.push_back(mn ? mn : "");
+        _verdicts.push_back(v);
+        return true;
+    }
+
+    void finishInstance(covdbHandle inst) {
+        _paths.pop_back();
+        _module_names.pop_back();
+        _verdicts.pop_back();
+    }
+
+    /// The module view is not sampled
+    bool acceptDefinition(covdbHandle def) { return false; }
+
+    /// Called once the instance's children are done: decide whether its
+    /// own signals are read
+    bool acceptQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        if (!isToggleMetric(met) || _paths.empty()) return false;
+        _reading = _sample.enter(_module_names.back(), _paths.size() - 1,
+                                 _paths.back());
+        return _reading;
+    }
+
+    void finishQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        if (!_reading) return;
+        _sample.leave();
+        _reading = false;
+    }
+
+    /// A top-level container is a signal: counted as a whole if drawn,
+    /// never descended into
+    bool acceptContainer(covdbHandle obj, covdbHandle region,
+                         covdbHandle metric, covdbHandle parent) {
+        if (_reading && drawSignal(covdb_get_str(obj, covdbName))) {
+            _sample.add(covdb_get(obj, region, getTest(), covdbCovered),
+                        covdb_get(obj, region, getTest(), covdbCoverable));
+        }
+        return false;
+    }
+
+    /// A bare object directly under the region is a signal of its own
+    void visitNamedCovObject(covdbHandle obj, covdbHandle region,
+                             covdbHandle metric, covdbHandle parent,
+                             const ObjectNames& names) {
+        if (!_reading || !drawSignal(covdb_get_str(obj, covdbName))) return;
+        int st = covdb_get(obj, region, getTest(), covdbCovStatus);
+        if (st & covdbStatusCovered) {
+            _sample.add(1, 1);
+        } else if (st & covdbStatusExcluded) {
+            _sample.add(0, 0);
+        } else {
+            _sample.add(0, 1);
+        }
+    }
+};
+
+
+static void usage(const char* nm)
 {
-    covdbHandle design;
+    std::cout << "Usage: " << nm << " [options] vdbdir\n"
+              << "Options:\n"
+              << "  --filter FILE     include/exclude rules for instance,"
+                 " module and signal paths; a re: include\n"
+              << "                    turns off pruning, so the whole design"
+                 " is walked\n"
+              << "  --snapshot FILE   also write a sorted per-bit snapshot"
+                 " of the instance view (see covsnap)\n"
+              << "  --check-ids       verify that no two objects share an id\n"
+              << "  --uncovered-only  list only uncovered toggles in the module"
+                 " view and skip fully covered signals\n"
+              << "  --stats           print allocation counts and peak RSS"
+                 " to stderr\n"
+              << "  --jobs N          format the JSON modules on N threads\n"
+              << "  --compact         write JSON without whitespace\n"
+              << "  --json-writer W   fast (default) or rapidjson\n"
+              << "  --outdir DIR      write one file per module and a manifest"
+                 " to DIR instead of stdout\n"
+              << "  --compress C      gzip (default) or none, for --outdir\n"
+              << "  --cache-dir DIR   reuse the outputs of an earlier run on the"
+                 " same VDB and options\n"
+              << "  --state FILE      merge only tests not yet in FILE and save"
+                 " the merged coverage to it\n"
+              << "  --output FILE     write the JSON report to FILE, renamed into"
+                 " place, instead of stdout\n"
+              << "  --watch           keep running and update the outputs as"
+                 " tests land in the VDB (needs --output or --html)\n"
+              << "  --debounce MS     with --watch, wait until the VDB has been"
+                 " quiet for MS ms (default 2000)\n"
+              << "  --html DIR        write an HTML report to DIR: an index and"
+                 " paged module tables\n"
+              << "  --html-rows N     toggles per HTML page (default 1000)\n"
+              << "  --trend FILE      append the instance and module rollups"
+                 " to the trend store FILE\n"
+              << "  --progress FD     write a JSON progress line to file"
+                 " descriptor FD (2: stderr) periodically\n"
+              << "  --progress-interval S\n"
+              << "                    seconds between progress lines"
+                 " (default 10)\n"
+              << "  --deadline S      start no instance subtree or module after"
+                 " S seconds; write what was done\n"
+              << "  --skipped FILE    with --deadline, list the subtrees and"
+                 " modules not done in FILE\n"
+              << "  --resume FILE     walk only the subtrees and modules listed"
+                 " in FILE by --skipped\n"
+              << "  --sample F        estimate coverage from a fraction F of the"
+                 " instances of each module and depth\n"
+              << "  --sample-signals F\n"
+              << "                    fraction of the signals of a sampled"
+                 " instance read (default: as --sample)\n"
+              << "  --seed N          seed of the sample (default 1)\n"
+              << "  --mem-budget SIZE keep the collected records under SIZE"
+                 " (k, m, g) and spill the rest to $TMPDIR\n"
+              << "  --holes FILE      write the biggest coverage holes (instances,"
+                 " signals, modules) to FILE\n"
+              << "  --holes-top K     holes listed per level (default 20)\n";
+}
+
+/// Options of one extraction
+struct DumpOptions {
+    const char* filterFile;
+    const PathFilter* filter;
+    const char* snapshotFile;
+    bool checkIds;
+    bool uncoveredOnly;
+    bool stats;
+    JsonOptions json;
+    const char* outDir;
+    bool gzip;
+    const char* outputFile;
+    const char* stateFile;
+    const char* htmlDir;
+    size_t htmlRows;
+    const char* trendFile;
+    double sampleFraction;      // 0: read everything
+    double sampleSignals;
+    uint64_t seed;
+    size_t memBudget;           // 0: no budget
+    const char* holesFile;
+    size_t holesTop;
+
+    DumpOptions()
+            : filterFile(NULL), filter(NULL), snapshotFile(NULL),
+              checkIds(false), uncoveredOnly(false), stats(false),
+              outDir(NULL), gzip(true), outputFile(NULL), stateFile(NULL),
+              htmlDir(NULL), htmlRows(1000), trendFile(NULL),
+              sampleFraction(0), sampleSignals(0), seed(1), memBudget(0),
+              holesFile(NULL), holesTop(20) { }
+};
 
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " vdbdir" << std::endl;
+// heartbeat for --progress, stopped (with a last line) at exit
+static Progress progress;
+
+/// Walk the sample opt asks for and write its estimates in place of
+/// the report
+static int writeSample(covdbHandle design, covdbHandle test,
+                       const DumpOptions& opt)
+{
+    CoverageSample sample(opt.sampleFraction, opt.sampleSignals, opt.seed);
+    SampleTgl vis(design, test, sample, opt.filter);
+    vis.execute();
+    sample.finish();
+    progress.phase("write");
+
+    auto write = [&](int fd) {
+        JsonOut out(fd, opt.json.style);
+        sample.write(out);
+        return out.flush();
+    };
+    std::string err;
+    if (opt.outputFile) {
+        AtomicFile out(opt.outputFile);
+        if (!out.open(err) || !write(out.fd()) || !out.commit(err)) {
+            std::cerr << "Error: could not write JSON output " << opt.outputFile
+                      << (err.empty() ? "" : ": ") << err << std::endl;
+            return 1;
+        }
+    } else if (!write(STDOUT_FILENO)) {
+        std::cerr << "Error: could not write JSON output" << std::endl;
         return 1;
     }
+    if (opt.stats) {
+        std::cerr << "stats: sample read " << sample.instancesRead()
+                  << " instances, " << sample.signalsRead() << " signals"
+                  << std::endl;
+    }
+    return 0;
+}
 
-    const char* dir = argv[1];
-
-    design = covdb_load(covdbDesign, nullptr, dir);
+/// Load the VDB in dir, merge the tests state has not seen yet (all of
+/// them without a state) and write the outputs.  With newTestsOnly,
+/// nothing is written if there are no new tests.  Returns the exit
+/// status.
+static int dumpVdb(const char* dir, const DumpOptions& opt, CovState* state,
+                   bool newTestsOnly)
+{
+    progress.restart();
+    covdbHandle design = covdb_load(covdbDesign, nullptr, dir);
     covdb_qualified_configure(design, covdbExcludeMode, "adaptive");
 
     if (!design) {
         std::cerr << "Error: you must specify at least one -dir" << std::endl;
         return 1;
-    } else {
-        DumpTgl vis(design);
+    }
+
+    // with a state only the tests it has not seen are loaded
+    std::vector<std::string> tests = UcapiBase::availableTests(design);
+    if (state) {
+        tests = state->testsToLoad(tests);
+        if (!state->restarted().empty()) {
+            std::cerr << "Warning: " << state->restarted()
+                      << ", merging all tests" << std::endl;
+        }
+        if (newTestsOnly && state->replaying()) {
+            covdb_unload(design);
+            return 0;
+        }
+    }
 
-        vis.execute();
-        vis.outputJson();
+    covdbHandle test = UcapiBase::loadTests(design, tests);
+    if (opt.sampleFraction > 0) {
+        int rc = writeSample(design, test, opt);
         covdb_unload(design);
+        return rc;
+    }
+
+    DumpTgl vis(design, test);
+
+    std::vector<IdName> idNames;
+    if (opt.filter) vis.setFilter(opt.filter);
+    if (state) vis.setState(state);
+    if (opt.checkIds) vis.collectIdNames(&idNames);
+    vis.setUncoveredOnly(opt.uncoveredOnly);
+    vis.setMemBudget(opt.memBudget);
+    if (opt.holesFile) vis.enableHoles(opt.holesTop);
+    vis.execute();
+    if (!vis.spillError().empty()) {
+        std::cerr << "Error: " << vis.spillError() << std::endl;
+        return 1;
+    }
+    if (opt.checkIds && vis.checkIds() > 0) {
+        std::cerr << "Error: object id collisions found" << std::endl;
+        return 2;
+    }
+    progress.phase("write");
+    std::string err;
+    if (opt.outDir) {
+        if (!vis.outputShards(opt.outDir, opt.json, opt.gzip, err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+    } else if (opt.outputFile) {
+        AtomicFile out(opt.outputFile);
+        if (!out.open(err) || !vis.outputJson(opt.json, out.fd()) ||
+            !out.commit(err)) {
+            if (err.empty()) err = vis.spillError();
+            std::cerr << "Error: could not write JSON output " << opt.outputFile
+                      << (err.empty() ? "" : ": ") << err << std::endl;
+            return 1;
+        }
+    } else if (!opt.htmlDir && !vis.outputJson(opt.json, STDOUT_FILENO)) {
+        std::cerr << "Error: could not write JSON output"
+                  << (vis.spillError().empty() ? "" : ": ") << vis.spillError()
+                  << std::endl;
+        return 1;
+    }
+    if (opt.htmlDir &&
+        !vis.outputHtml(opt.htmlDir, opt.htmlRows, opt.json.jobs, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    if (opt.snapshotFile && !vis.writeSnapshot(opt.snapshotFile, err)) {
+        std::cerr << "Error: could not write snapshot " << opt.snapshotFile
+                  << ": " << err << std::endl;
+        return 1;
+    }
+    if (opt.trendFile && !vis.appendTrend(opt.trendFile, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    if (opt.holesFile && !vis.writeHoles(opt.holesFile, opt.json.style, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    if (opt.stats) vis.printStats(std::cerr);
+    if (opt.stateFile && !state->save(opt.stateFile, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    covdb_unload(design);
+    return 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    const char* dir = NULL;
+    DumpOptions opt;
+    const char* cacheDir = NULL;
+    bool watch = false;
+    unsigned debounceMs = 2000;
+    int progressFd = -1;
+    double progressInterval = 10;
+    double deadlineSec = 0;
+    const char* skippedFile = NULL;
+    const char* resumeFile = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--filter") && i + 1 < argc) {
+            opt.filterFile = argv[++i];
+        } else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+            opt.snapshotFile = argv[++i];
+        } else if (!strcmp(argv[i], "--check-ids")) {
+            opt.checkIds = true;
+        } else if (!strcmp(argv[i], "--uncovered-only")) {
+            opt.uncoveredOnly = true;
+        } else if (!strcmp(argv[i], "--stats")) {
+            opt.stats = true;
+        } else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+            opt.json.jobs = (unsigned)atoi(argv[++i]);
+            if (opt.json.jobs == 0) opt.json.jobs = std::thread::hardware_concurrency();
+        } else if (!strcmp(argv[i], "--compact")) {
+            opt.json.style = JsonOut::Compact;
+        } else if (!strcmp(argv[i], "--json-writer") && i + 1 < argc &&
+                   (!strcmp(argv[i + 1], "fast") || !strcmp(argv[i + 1], "rapidjson"))) {
+            opt.json.useRapidJson = !strcmp(argv[++i], "rapidjson");
+        } else if (!strcmp(argv[i], "--outdir") && i + 1 < argc) {
+            opt.outDir = argv[++i];
+        } else if (!strcmp(argv[i], "--compress") && i + 1 < argc &&
+                   (!strcmp(argv[i + 1], "gzip") || !strcmp(argv[i + 1], "none"))) {
+            opt.gzip = !strcmp(argv[++i], "gzip");
+        } else if (!strcmp(argv[i], "--cache-dir") && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (!strcmp(argv[i], "--state") && i + 1 < argc) {
+            opt.stateFile = argv[++i];
+        } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            opt.outputFile = argv[++i];
+        } else if (!strcmp(argv[i], "--watch")) {
+            watch = true;
+        } else if (!strcmp(argv[i], "--debounce") && i + 1 < argc) {
+            debounceMs = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--html") && i + 1 < argc) {
+            opt.htmlDir = argv[++i];
+        } else if (!strcmp(argv[i], "--html-rows") && i + 1 < argc) {
+            opt.htmlRows = (size_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--trend") && i + 1 < argc) {
+            opt.trendFile = argv[++i];
+        } else if (!strcmp(argv[i], "--holes") && i + 1 < argc) {
+            opt.holesFile = argv[++i];
+        } else if (!strcmp(argv[i], "--holes-top") && i + 1 < argc) {
+            opt.holesTop = (size_t)atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--progress") && i + 1 < argc) {
+            progressFd = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--progress-interval") && i + 1 < argc) {
+            progressInterval = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--deadline") && i + 1 < argc) {
+            deadlineSec = atof(argv[++i]);
+            if (!(deadlineSec > 0)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--skipped") && i + 1 < argc) {
+            skippedFile = argv[++i];
+        } else if (!strcmp(argv[i], "--resume") && i + 1 < argc) {
+            resumeFile = argv[++i];
+        } else if (!strcmp(argv[i], "--sample") && i + 1 < argc) {
+            opt.sampleFraction = atof(argv[++i]);
+            if (!(opt.sampleFraction > 0 && opt.sampleFraction <= 1)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--sample-signals") && i + 1 < argc) {
+            opt.sampleSignals = atof(argv[++i]);
+            if (!(opt.sampleSignals > 0 && opt.sampleSignals <= 1)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+            opt.seed = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--mem-budget") && i + 1 < argc) {
+            if (!parseSize(argv[++i], opt.memBudget)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (argv[i][0] == '-' || dir) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            dir = argv[i];
+        }
+    }
+    if (!dir || (opt.outDir && opt.outputFile) ||
+        (cacheDir && (opt.outDir || opt.outputFile || opt.htmlDir ||
+                      opt.trendFile || opt.holesFile || opt.stateFile ||
+                      watch)) ||
+        (watch && (opt.outDir || (!opt.outputFile && !opt.htmlDir))) ||
+        opt.htmlRows == 0 || opt.holesTop == 0 || !(progressInterval > 0) ||
+        (skippedFile && !deadlineSec) ||
+        ((deadlineSec || resumeFile) &&
+         (cacheDir || opt.stateFile || opt.trendFile || watch)) ||
+        (opt.sampleSignals && !opt.sampleFraction) ||
+        (opt.sampleFraction &&
+         (opt.outDir || opt.htmlDir || opt.snapshotFile || opt.trendFile ||
+          opt.holesFile || opt.stateFile || cacheDir || watch || opt.checkIds ||
+          opt.uncoveredOnly || deadlineSec || resumeFile)) ||
+        (opt.memBudget &&
+         (opt.outDir || opt.htmlDir || opt.json.useRapidJson))) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (opt.sampleFraction && !opt.sampleSignals) {
+        opt.sampleSignals = opt.sampleFraction;
+    }
+    if (progressFd >= 0) {
+        if (fcntl(progressFd, F_GETFD) < 0) {
+            std::cerr << "Error: --progress " << progressFd
+                      << " is not an open file descriptor" << std::endl;
+            return 1;
+        }
+        UcapiBase::setProgress(&progress);
+        progress.start(progressFd, (unsigned)(progressInterval * 1000));
+    }
+    Deadline deadline;
+    if (deadlineSec || resumeFile) {
+        std::string err;
+        if (resumeFile && !deadline.resume(resumeFile, err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        if (deadlineSec) deadline.set(deadlineSec);
+        UcapiBase::setDeadline(&deadline);
+    }
+
+    PathFilter filter;
+    if (opt.filterFile) {
+        std::string err;
+        if (!filter.load(opt.filterFile, err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        if (!filter.empty()) opt.filter = &filter;
+    }
+
+    // watch mode keeps the merged coverage in memory between updates
+    CovState state("dumptgl");
+    if (opt.stateFile) {
+        std::vector<std::string> inputs;
+        if (opt.filterFile) inputs.push_back(opt.filterFile);
+        std::string err;
+        if (!state.load(opt.stateFile, inputs, err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        if (!state.restarted().empty()) {
+            std::cerr << "Warning: " << opt.stateFile << ": " << state.restarted()
+                      << ", merging all tests" << std::endl;
+        }
     }
 
+    if (watch) {
+        VdbWatcher watcher(dir, debounceMs);
+        std::string err;
+        if (!watcher.open(err)) {
+            std::cerr << "Error: " << err << std::endl;
+            return 1;
+        }
+        // the outputs are written once up front, then after every burst
+        // of changes that brought new tests
+        int rc = dumpVdb(dir, opt, &state, false);
+        while (rc == 0) {
+            progress.phase("wait");
+            if (!watcher.wait(err)) {
+                std::cerr << "Error: " << err << std::endl;
+                return 1;
+            }
+            rc = dumpVdb(dir, opt, &state, true);
+        }
+        return rc;
+    }
+
+    ExtractCache cache(cacheDir ? cacheDir : "");
+    bool caching = cacheDir != NULL;
+    if (caching) {
+        // options that change the outputs; --jobs and the writer don't
+        std::vector<std::string> options;
+        if (opt.snapshotFile) options.push_back("--snapshot");
+        if (opt.checkIds) options.push_back("--check-ids");
+        if (opt.uncoveredOnly) options.push_back("--uncovered-only");
+        if (opt.json.style == JsonOut::Compact) options.push_back("--compact");
+        std::vector<std::string> inputs;
+        if (opt.filterFile) inputs.push_back(opt.filterFile);
+
+        std::string err;
+        if (!cache.fingerprint("dumptgl", options, inputs, dir, err) ||
+            !cache.lock(err)) {
+            std::cerr << "Warning: not using the cache: " << err << std::endl;
+            caching = false;
+        } else if (cache.fetch(opt.snapshotFile)) {
+            return 0;
+        } else if (!cache.capture(err)) {
+            std::cerr << "Warning: not using the cache: " << err << std::endl;
+            caching = false;
+        }
+    }
+
+    int rc = dumpVdb(dir, opt, opt.stateFile ? &state : NULL, false);
+    if (rc) return rc;
+
+    std::string err;
+    if (skippedFile && !deadline.writeManifest(skippedFile, err)) {
+        std::cerr << "Error: " << err << std::endl;
+        return 1;
+    }
+    if (deadline.skipped()) {
+        // the outputs are complete for everything but the skipped units
+        std::cerr << "Warning: deadline reached, " << deadline.skipped()
+                  << " units skipped";
+        if (skippedFile) std::cerr << ", listed in " << skippedFile;
+        std::cerr << std::endl;
+        return 3;
+    }
+    if (caching && !cache.store(opt.snapshotFile, err)) {
+        std::cerr << "Warning: " << err << std::endl;
+    }
     return 0;
 }
@@ -0,0 +1,119 @@
+/// Ranked coverage holes - see holes.hh.
+
+#include "holes.hh"
+#include "shards.hh"
+#include <math.h>
+#include <algorithm>
+
+/// Ranking order: heavier first, then by name
+static bool heavier(const Hole& a, const Hole& b)
+{
+    if (a.weight != b.weight) return a.weight > b.weight;
+    return a.name < b.name;
+}
+
+void TopHoles::add(Hole&& hole)
+{
+    if (!wants(hole.weight)) return;
+    if (_heap.size() == _k) {
+        // equal weights only get in ahead by name
+        if (!heavier(hole, _heap.front())) return;
+        std::pop_heap(_heap.begin(), _heap.end(), heavier);
+        _heap.pop_back();
+    }
+    _heap.push_back(std::move(hole));
+    std::push_heap(_heap.begin(), _heap.end(), heavier);
+}
+
+std::vector<Hole> TopHoles::ranked() const
+{
+    std::vector<Hole> holes(_heap);
+    std::sort(holes.begin(), holes.end(), heavier);
+    return holes;
+}
+
+HoleReport::HoleReport(size_t top)
+        : _top(top)
+{
+}
+
+size_t HoleReport::level(const char* name, bool weighted)
+{
+    Level l = { name, weighted, TopHoles(_top), 0, 0 };
+    _levels.push_back(l);
+    return _levels.size() - 1;
+}
+
+void HoleReport::add(size_t level, std::string name, long uncovered,
+                     long coverable, long weight)
+{
+    Hole hole;
+    hole.name = std::move(name);
+    hole.uncovered = uncovered;
+    hole.coverable = coverable;
+    hole.weight = weight;
+    _levels[level].top.add(std::move(hole));
+}
+
+void HoleReport::setTotal(size_t level, long uncovered, long weight)
+{
+    _levels[level].uncovered = uncovered;
+    _levels[level].weight = weight;
+}
+
+bool HoleReport::write(const std::string& file, const char* tool,
+                       JsonOut::Style style, std::string& err) const
+{
+    AtomicFile f(file);
+    if (!f.open(err)) return false;
+    {
+        JsonOut out(f.fd(), style);
+        out.StartObject();
+        out.key("tool");
+        out.string(tool);
+        out.key("top");
+        out.Uint64(_top);
+        for (size_t i = 0; i < _levels.size(); i++) {
+            const Level& l = _levels[i];
+            std::vector<Hole> holes = l.top.ranked();
+            out.key(l.name);
+            out.StartObject();
+            out.key("uncovered");
+            out.Int64(l.uncovered);
+            if (l.weighted) {
+                out.key("weighted");
+                out.Int64(l.weight);
+            }
+            out.key("holes");
+            out.StartArray();
+            for (size_t k = 0; k < holes.size(); k++) {
+                const Hole& h = holes[k];
+                out.StartObject();
+                out.key("name");
+                out.string(h.name);
+                out.key("uncovered");
+                out.Int64(h.uncovered);
+                out.key("coverable");
+                out.Int64(h.coverable);
+                if (l.weighted) {
+                    out.key("weighted");
+                    out.Int64(h.weight);
+                }
+                if (l.weight > 0) {
+                    out.key("share");
+                    out.Double(floor(10000.0 * h.weight / l.weight + 0.5) / 100);
+                }
+                out.EndObject();
+            }
+            out.EndArray();
+            out.EndObject();
+        }
+        out.EndObject();
+        out.raw("\n");
+        if (!out.flush()) {
+            err = "cannot write " + file;
+            return false;
+        }
+    }
+    return f.commit(err);
+}
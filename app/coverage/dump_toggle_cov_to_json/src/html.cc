@@ -0,0 +1,252 @@
+/// HTML coverage report - see html.hh.
+
+#include "html.hh"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char styleSheet[] =
+    "body { font-family: sans-serif; margin: 20px; color: #222; }\n"
+    "h1 { font-size: 1.4em; }\n"
+    "nav { margin: 10px 0; }\n"
+    "nav a, nav b { margin-right: 6px; }\n"
+    "table { border-collapse: collapse; font-size: 0.9em; }\n"
+    "th, td { border: 1px solid #ccc; padding: 2px 8px; text-align: left; }\n"
+    "th { background: #eee; position: sticky; top: 0; }\n"
+    "td { font-family: monospace; }\n"
+    "td.num { text-align: right; }\n"
+    "td.score { white-space: nowrap; }\n"
+    ".bar { display: inline-block; width: 60px; height: 8px; margin-right: 6px;"
+    " background: #f4c7c3; }\n"
+    ".bar span { display: block; height: 8px; background: #57bb8a; }\n"
+    "tr.hole td { background: #fde8e6; }\n"
+    "tr.hole td:first-child { border-left: 4px solid #d93025; }\n"
+    ".summary { margin: 10px 0; }\n";
+
+HtmlOut::HtmlOut(int fd, size_t bufSize)
+        : _fd(fd), _bufSize(bufSize), _good(true)
+{
+    _buf.reserve(bufSize);
+}
+
+HtmlOut::~HtmlOut()
+{
+    flush();
+}
+
+void HtmlOut::text(std::string_view s)
+{
+    size_t plain = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+        const char* esc;
+        switch (s[i]) {
+            case '&': esc = "&amp;"; break;
+            case '<': esc = "&lt;"; break;
+            case '>': esc = "&gt;"; break;
+            case '"': esc = "&quot;"; break;
+            case '\'': esc = "&#39;"; break;
+            default: continue;
+        }
+        raw(s.substr(plain, i - plain));
+        raw(esc);
+        plain = i + 1;
+    }
+    raw(s.substr(plain));
+}
+
+void HtmlOut::coverage(int64_t covered, int64_t coverable, double score)
+{
+    cell(covered);
+    cell(coverable);
+    raw("<td class=\"score\">");
+    if (score < 0) {
+        raw("-");
+    } else {
+        char buf[96];
+        snprintf(buf, sizeof(buf),
+                 "<span class=\"bar\"><span style=\"width:%.0f%%\"></span></span>%.2f%%",
+                 score, score);
+        raw(buf);
+    }
+    raw("</td>");
+}
+
+void HtmlOut::beginPage(std::string_view title, std::string_view css)
+{
+    raw("<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"UTF-8\">\n<title>");
+    text(title);
+    raw("</title>\n<link rel=\"stylesheet\" href=\"");
+    text(css);
+    raw("\">\n</head>\n<body>\n<h1>");
+    text(title);
+    raw("</h1>\n");
+}
+
+void HtmlOut::endPage()
+{
+    raw("</body>\n</html>\n");
+}
+
+bool HtmlOut::flush()
+{
+    const char* p = _buf.data();
+    size_t n = _buf.size();
+    while (_good && n > 0) {
+        ssize_t w = ::write(_fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            _good = false;
+            break;
+        }
+        p += w;
+        n -= w;
+    }
+    _buf.clear();
+    return _good;
+}
+
+bool htmlStart(const std::string& dir, const char* subdir, std::string& err)
+{
+    if (!makeDirs(dir + "/" + subdir, err)) return false;
+    AtomicFile css(dir + "/style.css");
+    if (!css.open(err)) return false;
+    HtmlOut out(css.fd());
+    out.raw(styleSheet);
+    if (!out.flush()) {
+        err = "cannot write " + dir + "/style.css";
+        return false;
+    }
+    return css.commit(err);
+}
+
+HtmlPages::HtmlPages(const std::string& dir, const std::string& stem,
+                     const std::string& title, const std::string& summary,
+                     const std::vector<std::string>& columns, size_t rows,
+                     size_t perPage)
+        : _dir(dir), _stem(stem), _title(title), _summary(summary),
+          _columns(columns), _perPage(perPage ? perPage : 1),
+          _pages(rows ? (rows + _perPage - 1) / _perPage : 1),
+          _page(0), _row(0), _inRow(false)
+{
+}
+
+HtmlPages::~HtmlPages()
+{
+}
+
+std::string HtmlPages::pageFile(size_t k) const
+{
+    return k ? _stem + "-" + std::to_string(k + 1) + ".html" : _stem + ".html";
+}
+
+/// Links to the index, the first and last pages and the pages around
+/// this one
+void HtmlPages::nav()
+{
+    HtmlOut& out = *_out;
+    out.raw("<nav><a href=\"../index.html\">index</a>");
+    if (_pages > 1) {
+        out.raw(" page ");
+        out.number(_page + 1);
+        out.raw(" of ");
+        out.number(_pages);
+        out.raw(":");
+        size_t lo = _page > 5 ? _page - 5 : 0;
+        size_t hi = _page + 6 < _pages ? _page + 6 : _pages;
+        if (lo > 0) {
+            out.raw(" <a href=\"");
+            out.text(pageFile(0));
+            out.raw("\">1</a> ...");
+        }
+        for (size_t k = lo; k < hi; k++) {
+            if (k == _page) {
+                out.raw(" <b>");
+                out.number(k + 1);
+                out.raw("</b>");
+                continue;
+            }
+            out.raw(" <a href=\"");
+            out.text(pageFile(k));
+            out.raw("\">");
+            out.number(k + 1);
+            out.raw("</a>");
+        }
+        if (hi < _pages) {
+            out.raw(" ... <a href=\"");
+            out.text(pageFile(_pages - 1));
+            out.raw("\">");
+            out.number(_pages);
+            out.raw("</a>");
+        }
+    }
+    out.raw("</nav>\n");
+}
+
+void HtmlPages::openPage(size_t k)
+{
+    _page = k;
+    _row = 0;
+    _file.reset(new AtomicFile(_dir + "/" + pageFile(k)));
+    if (!_file->open(_err)) {
+        // keep writing into nowhere; finish() reports the error
+        _out.reset(new HtmlOut(-1));
+        return;
+    }
+    _out.reset(new HtmlOut(_file->fd()));
+    _out->beginPage(_title, "../style.css");
+    _out->raw("<div class=\"summary\">");
+    _out->raw(_summary);
+    _out->raw("</div>\n");
+    nav();
+    _out->raw("<table>\n<tr>");
+    for (size_t i = 0; i < _columns.size(); i++) {
+        _out->raw("<th>");
+        _out->text(_columns[i]);
+        _out->raw("</th>");
+    }
+    _out->raw("</tr>\n");
+}
+
+void HtmlPages::closePage()
+{
+    if (!_out) return;
+    if (_inRow) _out->raw("</tr>\n");
+    _inRow = false;
+    _out->raw("</table>\n");
+    nav();
+    _out->endPage();
+    bool ok = _out->flush();
+    _out.reset();
+    if (_err.empty()) {
+        if (!ok) {
+            _err = "cannot write " + _dir + "/" + pageFile(_page);
+        } else {
+            _file->commit(_err);
+        }
+    }
+    _file.reset();
+}
+
+HtmlOut& HtmlPages::row(bool hole)
+{
+    if (!_out) {
+        openPage(0);
+    } else if (_row == _perPage) {
+        closePage();
+        openPage(_page + 1);
+    }
+    if (_inRow) _out->raw("</tr>\n");
+    _out->raw(hole ? "<tr class=\"hole\">" : "<tr>");
+    _inRow = true;
+    _row++;
+    return *_out;
+}
+
+bool HtmlPages::finish(std::string& err)
+{
+    if (!_out && _err.empty()) openPage(0);
+    closePage();
+    err = _err;
+    return err.empty();
+}
@@ -0,0 +1,195 @@
+/// jsonbench - time JsonOut against the rapidjson path on toggle records.
+///
+/// Usage: jsonbench [records] [repeat]
+///
+/// Writes the same synthetic module view (modules of toggle records shaped
+/// like dumptgl's) to memory in four ways: rapidjson Values with
+/// PrettyWriter and with Writer, and JsonOut pretty and compact.  Prints
+/// the best time and throughput of each and checks that JsonOut's bytes
+/// equal rapidjson's for the same style.  Needs no VDB or UCAPI.
+
+#include "jsonout.hh"
+#include "objid.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct BenchRecord {
+    std::string path;
+    uint64_t id;
+    int type;
+    int status;
+};
+
+struct BenchModule {
+    std::string name;
+    std::vector<BenchRecord> records;
+};
+
+static const char* const typeNames[] = { "0 -> 1", "1 -> 0" };
+static const char* const statusNames[] = { "Covered", "Excluded", "Uncovered" };
+
+/// Modules of 2 * width records per signal, 500 signals per module
+static std::vector<BenchModule> makeModules(size_t records)
+{
+    std::vector<BenchModule> modules;
+    char buf[128];
+    for (size_t n = 0; n < records; ) {
+        BenchModule m;
+        m.name = "bench_mod_" + std::to_string(modules.size());
+        for (int s = 0; s < 500 && n < records; s++) {
+            int width = 1 + s % 32;
+            for (int b = 0; b < width && n < records; b++) {
+                snprintf(buf, sizeof(buf), "top.u_core_%zu.u_pipe.stage_%d_data[%d]",
+                         modules.size(), s, b);
+                for (int dir = 0; dir < 2; dir++, n++) {
+                    BenchRecord r;
+                    r.path = buf;
+                    r.id = objectId("tglmod:" + r.path + ":" + typeNames[dir]);
+                    r.type = dir;
+                    r.status = (int)(r.id % 3);
+                    m.records.push_back(r);
+                }
+            }
+        }
+        modules.push_back(m);
+    }
+    return modules;
+}
+
+/// The rapidjson path: a Value per record, then one of its writers
+static std::string viaRapidJson(const std::vector<BenchModule>& modules,
+                                JsonOut::Style style)
+{
+    rapidjson::Document doc;
+    doc.SetObject();
+    rapidjson::Document::AllocatorType& allocator = doc.GetAllocator();
+    rapidjson::Value array(rapidjson::kArrayType);
+    for (size_t i = 0; i < modules.size(); i++) {
+        const BenchModule& m = modules[i];
+        rapidjson::Value module_obj(rapidjson::kObjectType);
+        module_obj.AddMember("module", rapidjson::Value(m.name.c_str(), allocator), allocator);
+        rapidjson::Value toggles(rapidjson::kArrayType);
+        for (size_t j = 0; j < m.records.size(); j++) {
+            const BenchRecord& r = m.records[j];
+            rapidjson::Value t(rapidjson::kObjectType);
+            std::string id = idToHex(r.id);
+            t.AddMember("id", rapidjson::Value(id.c_str(), allocator), allocator);
+            t.AddMember("hdl_signal_path", rapidjson::StringRef(r.path.c_str()), allocator);
+            t.AddMember("toggle_type", rapidjson::StringRef(typeNames[r.type]), allocator);
+            t.AddMember("status", rapidjson::StringRef(statusNames[r.status]), allocator);
+            toggles.PushBack(t, allocator);
+        }
+        module_obj.AddMember("toggle_coverage", toggles, allocator);
+        array.PushBack(module_obj, allocator);
+    }
+    doc.AddMember("modules", array, allocator);
+
+    rapidjson::StringBuffer buffer;
+    writeRapidJson(doc, style, buffer);
+    return std::string(buffer.GetString(), buffer.GetSize());
+}
+
+static const JsonName typeJson[] = { JsonName("0 -> 1"), JsonName("1 -> 0") };
+static const JsonName statusJson[] = {
+    JsonName("Covered"), JsonName("Excluded"), JsonName("Uncovered")
+};
+static const JsonName modulesKey("modules"), moduleKey("module"),
+    toggleCoverageKey("toggle_coverage"), idKey("id"),
+    pathKey("hdl_signal_path"), typeKey("toggle_type"), statusKey("status");
+
+/// The JsonOut path, as dumptgl's moduleOut()
+static std::string viaJsonOut(const std::vector<BenchModule>& modules,
+                              JsonOut::Style style)
+{
+    JsonOut out(-1, style);
+    out.StartObject();
+    out.key(modulesKey);
+    out.StartArray();
+    char id[16];
+    for (size_t i = 0; i < modules.size(); i++) {
+        const BenchModule& m = modules[i];
+        out.StartObject();
+        out.key(moduleKey);
+        out.string(m.name);
+        out.key(toggleCoverageKey);
+        out.StartArray();
+        for (size_t j = 0; j < m.records.size(); j++) {
+            const BenchRecord& r = m.records[j];
+            out.StartObject();
+            out.key(idKey);
+            idToHex(r.id, id);
+            out.string(std::string_view(id, sizeof(id)));
+            out.key(pathKey);
+            out.string(r.path);
+            out.key(typeKey);
+            out.string(typeJson[r.type]);
+            out.key(statusKey);
+            out.string(statusJson[r.status]);
+            out.EndObject();
+        }
+        out.EndArray();
+        out.EndObject();
+    }
+    out.EndArray();
+    out.EndObject();
+    return std::string(out.data(), out.size());
+}
+
+typedef std::string (*BenchFn)(const std::vector<BenchModule>&, JsonOut::Style);
+
+/// Best of repeat runs; the output of the last is left in out
+static double timeBest(BenchFn fn, const std::vector<BenchModule>& modules,
+                       JsonOut::Style style, int repeat, std::string& out)
+{
+    double best = 0;
+    for (int i = 0; i < repeat; i++) {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        out = fn(modules, style);
+        std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+        if (i == 0 || dt.count() < best) best = dt.count();
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    size_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+    int repeat = argc > 2 ? atoi(argv[2]) : 3;
+    if (records == 0 || repeat <= 0) {
+        fprintf(stderr, "Usage: %s [records] [repeat]\n", argv[0]);
+        return 1;
+    }
+    std::vector<BenchModule> modules = makeModules(records);
+
+    static const struct {
+        const char* name;
+        BenchFn fn;
+        JsonOut::Style style;
+    } cases[] = {
+        { "rapidjson pretty", viaRapidJson, JsonOut::Pretty },
+        { "jsonout   pretty", viaJsonOut, JsonOut::Pretty },
+        { "rapidjson compact", viaRapidJson, JsonOut::Compact },
+        { "jsonout   compact", viaJsonOut, JsonOut::Compact },
+    };
+
+    int rc = 0;
+    std::string reference;
+    printf("%zu records in %zu modules, best of %d\n", records, modules.size(), repeat);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        std::string out;
+        double t = timeBest(cases[i].fn, modules, cases[i].style, repeat, out);
+        printf("%-18s %8.3f s %8.1f MB/s %12zu bytes\n", cases[i].name, t,
+               out.size() / t / 1e6, out.size());
+        // rapidjson runs first for each style
+        if (cases[i].fn == viaRapidJson) {
+            reference.swap(out);
+        } else if (out != reference) {
+            printf("error: %s output differs from rapidjson\n", cases[i].name);
+            rc = 1;
+        }
+    }
+    return rc;
+}
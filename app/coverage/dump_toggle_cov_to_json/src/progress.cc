@@ -0,0 +1,203 @@
+/// Progress heartbeat - see progress.hh.
+
+#include "progress.hh"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+Progress::Progress()
+        : _fd(-1), _intervalMs(0), _stopping(false), _phase("load"),
+          _lastObjects(0), _testsMerged(0), _testsTotal(0), _regions(0),
+          _objects(0), _unitsDone(0), _unitsTotal(0), _pathStale(false)
+{
+    _start = _walkStart = _lastBeat = Clock::now();
+}
+
+Progress::~Progress()
+{
+    stop();
+}
+
+void Progress::start(int fd, unsigned intervalMs)
+{
+    _fd = fd;
+    _intervalMs = intervalMs ? intervalMs : 1;
+    _start = _lastBeat = Clock::now();
+    _thread = std::thread([this]() { run(); });
+}
+
+void Progress::stop()
+{
+    if (!_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        _phase = "done";
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+void Progress::restart()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _phase = "load";
+    {
+        std::lock_guard<std::mutex> pathLock(_pathMutex);
+        _walkPath.clear();
+        _path.clear();
+        _pathStale = false;
+    }
+    _testsMerged = _testsTotal = _regions = 0;
+    _objects = _unitsDone = _unitsTotal = 0;
+    _lastObjects = 0;
+}
+
+void Progress::phase(const char* name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _phase = name;
+    if (!strcmp(name, "walk")) _walkStart = Clock::now();
+}
+
+void Progress::tests(size_t merged, size_t total)
+{
+    if (merged == 0) phase("merge");
+    _testsMerged.store(merged, std::memory_order_relaxed);
+    _testsTotal.store(total, std::memory_order_relaxed);
+}
+
+void Progress::units(size_t total)
+{
+    _unitsDone.store(0, std::memory_order_relaxed);
+    _unitsTotal.store(total, std::memory_order_relaxed);
+}
+
+void Progress::region(std::string_view path)
+{
+    _regions.fetch_add(1, std::memory_order_relaxed);
+    _walkPath.assign(path.data(), path.size());
+    publishPath();
+}
+
+/// Copy the walk's path for the heartbeat unless it is reading it; the
+/// next region() or object() tries again
+void Progress::publishPath()
+{
+    std::unique_lock<std::mutex> lock(_pathMutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        _pathStale.store(true, std::memory_order_relaxed);
+        return;
+    }
+    _path = _walkPath;
+    _pathStale.store(false, std::memory_order_relaxed);
+}
+
+void Progress::run()
+{
+    // EPIPE from write() rather than a SIGPIPE that would end the run
+    sigset_t pipe;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe, NULL);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopping) {
+        _wake.wait_for(lock, std::chrono::milliseconds(_intervalMs));
+        std::string line = beat();
+        lock.unlock();
+        emit(line);
+        lock.lock();
+    }
+}
+
+/// Append s as a JSON string
+static void appendString(std::string& out, const std::string& s)
+{
+    out += '"';
+    for (size_t i = 0; i < s.size(); i++) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+/// Format one line; called with _mutex held
+std::string Progress::beat()
+{
+    Clock::time_point now = Clock::now();
+    double elapsed = std::chrono::duration<double>(now - _start).count();
+    double since = std::chrono::duration<double>(now - _lastBeat).count();
+    uint64_t objects = _objects.load(std::memory_order_relaxed);
+    uint64_t done = _unitsDone.load(std::memory_order_relaxed);
+    uint64_t total = _unitsTotal.load(std::memory_order_relaxed);
+
+    char buf[512];
+    std::string line;
+    snprintf(buf, sizeof(buf),
+             "{\"phase\":\"%s\",\"elapsed_s\":%.1f,\"tests_merged\":%llu,"
+             "\"tests_total\":%llu,\"regions\":%llu,\"objects\":%llu,"
+             "\"objects_per_s\":%.1f,\"units_done\":%llu,\"units_total\":%llu,"
+             "\"path\":",
+             _phase, elapsed,
+             (unsigned long long)_testsMerged.load(std::memory_order_relaxed),
+             (unsigned long long)_testsTotal.load(std::memory_order_relaxed),
+             (unsigned long long)_regions.load(std::memory_order_relaxed),
+             (unsigned long long)objects,
+             since > 0 ? (objects - _lastObjects) / since : 0.0,
+             (unsigned long long)done, (unsigned long long)total);
+    line = buf;
+    {
+        std::lock_guard<std::mutex> pathLock(_pathMutex);
+        appendString(line, _path);
+    }
+    if (!strcmp(_phase, "walk") && done > 0 && done <= total) {
+        double walked = std::chrono::duration<double>(now - _walkStart).count();
+        snprintf(buf, sizeof(buf), ",\"eta_s\":%.1f}\n", walked * (total - done) / done);
+        line += buf;
+    } else if (!strcmp(_phase, "done")) {
+        line += ",\"eta_s\":0}\n";
+    } else {
+        line += ",\"eta_s\":null}\n";
+    }
+    _lastBeat = now;
+    _lastObjects = objects;
+    return line;
+}
+
+/// Write one line to _fd, dropping it if the reader does not take any
+/// of it within an interval, and giving up on _fd once the reader is gone
+void Progress::emit(const std::string& line)
+{
+    const char* p = line.data();
+    size_t n = line.size();
+    while (n > 0 && _fd >= 0) {
+        struct pollfd pfd = { _fd, POLLOUT, 0 };
+        int r = poll(&pfd, 1, _intervalMs);
+        if (r < 0 && errno == EINTR) continue;
+        // a line half written is finished, lest the next one be garbled
+        if (r == 0 && p == line.data()) return;
+        if (r == 0) continue;
+        ssize_t w = write(_fd, p, n);
+        if (w < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (w <= 0) {
+            _fd = -1;
+            return;
+        }
+        p += w;
+        n -= w;
+    }
+}
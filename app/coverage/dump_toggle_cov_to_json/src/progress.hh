@@ -0,0 +1,100 @@
+/// Progress heartbeat (--progress FD).
+///
+/// Extraction runs on one thread and only bumps counters here; a
+/// separate thread writes them to a file descriptor as one JSON object
+/// per line at a fixed interval, so a log follower can tell a slow run
+/// from a hung one without the traversal ever blocking on output:
+///
+///     {"phase":"walk","elapsed_s":73.0,"tests_merged":12,"tests_total":12,
+///      "regions":4521,"objects":1832334,"objects_per_s":25101.4,
+///      "units_done":3,"units_total":17,"path":"top.u_soc.u_ddr","eta_s":95.2}
+///
+/// Phases are load, merge (tests being loaded and merged), walk, write,
+/// wait (--watch, between updates) and done, the last written once by
+/// stop().  Units are the pieces of the walk counted up front (see
+/// UcapiBase::countUnits); eta_s extrapolates the walk time so far over
+/// the units left and is null until one is done.  objects_per_s is the
+/// rate since the previous line.
+///
+/// The walk never waits on the heartbeat: region() and object() only
+/// touch atomics and a path copy of their own, lines are written with no
+/// lock held, and a line the reader cannot take within an interval is
+/// dropped.  A reader that goes away ends the heartbeat, not the run.
+
+#ifndef PROGRESS_HH
+#define PROGRESS_HH
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+class Progress {
+public:
+    Progress();
+    ~Progress();
+
+    /// Start the heartbeat: a line to fd every intervalMs
+    void start(int fd, unsigned intervalMs);
+
+    /// Write a last line with phase "done" and stop the heartbeat
+    void stop();
+
+    /// Start counting a new extraction (load phase)
+    void restart();
+
+    void phase(const char* name);
+    void tests(size_t merged, size_t total);
+    void units(size_t total);
+    void unitDone() { _unitsDone.fetch_add(1, std::memory_order_relaxed); }
+
+    /// A region was entered: count it and make path the current one
+    void region(std::string_view path);
+    void object() {
+        _objects.fetch_add(1, std::memory_order_relaxed);
+        if (_pathStale.load(std::memory_order_relaxed)) publishPath();
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    int _fd;
+    unsigned _intervalMs;
+    std::thread _thread;
+    std::mutex _mutex;              // guards everything below but the atomics
+    std::condition_variable _wake;
+    bool _stopping;
+    const char* _phase;
+    Clock::time_point _start;
+    Clock::time_point _walkStart;
+    Clock::time_point _lastBeat;
+    uint64_t _lastObjects;
+
+    std::atomic<uint64_t> _testsMerged;
+    std::atomic<uint64_t> _testsTotal;
+    std::atomic<uint64_t> _regions;
+    std::atomic<uint64_t> _objects;
+    std::atomic<uint64_t> _unitsDone;
+    std::atomic<uint64_t> _unitsTotal;
+
+    // the current region: _walkPath is the walk's own, copied to _path
+    // whenever _pathMutex is free and left stale until then
+    std::string _walkPath;
+    std::mutex _pathMutex;
+    std::string _path;
+    std::atomic<bool> _pathStale;
+
+    void publishPath();
+    void run();
+    std::string beat();
+    void emit(const std::string& line);
+
+    Progress(const Progress&);
+    Progress& operator=(const Progress&);
+};
+
+#endif
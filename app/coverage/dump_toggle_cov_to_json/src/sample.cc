@@ -0,0 +1,215 @@
+/// Sampled toggle coverage estimates - see sample.hh.
+
+#include "sample.hh"
+#include "jsonout.hh"
+#include "objid.hh"
+#include <math.h>
+#include <algorithm>
+
+/// Normal quantile of the 95% interval
+static const double z95 = 1.959964;
+
+CoverageSample::CoverageSample(double fraction, double signalFraction,
+                               uint64_t seed)
+        : _fraction(fraction), _signalFraction(signalFraction), _seed(seed),
+          _stratum(NULL), _u(0), _signalU(0), _instancesRead(0),
+          _signalsRead(0)
+{
+}
+
+double CoverageSample::draw(std::string_view path) const
+{
+    std::string name = "sample:" + std::to_string(_seed) + ":";
+    name.append(path.data(), path.size());
+    // the top 53 bits, as a double in [0, 1)
+    return (objectId(name) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+bool CoverageSample::enter(std::string_view module, unsigned depth,
+                           std::string_view path)
+{
+    auto ins = _strata.try_emplace(std::make_pair(std::string(module), depth));
+    Stratum& stratum = ins.first->second;
+    if (ins.second) {
+        stratum.module = module;
+        stratum.units = StreamDraw<Unit>(_fraction);
+    }
+    stratum.units.seen();
+    double u = draw(path);
+    if (!stratum.units.wants(u)) return false;
+    _stratum = &stratum;
+    _u = u;
+    _signals = StreamDraw<Signal>(_signalFraction);
+    _instancesRead++;
+    return true;
+}
+
+bool CoverageSample::signal(std::string_view path)
+{
+    _signals.seen();
+    _signalU = draw(path);
+    return _signals.wants(_signalU);
+}
+
+void CoverageSample::add(long covered, long coverable)
+{
+    Signal s;
+    s.y = covered;
+    s.x = coverable;
+    _signals.add(_signalU, s);
+    _signalsRead++;
+}
+
+void CoverageSample::leave()
+{
+    _signals.finish();
+    const std::vector<Signal>& drawn = _signals.drawn();
+    Unit unit;
+    unit.population = _signals.population();
+    unit.drawn = drawn.size();
+    unit.sy = unit.sx = unit.syy = unit.sxy = unit.sxx = 0;
+    for (size_t i = 0; i < drawn.size(); i++) {
+        unit.sy += drawn[i].y;
+        unit.sx += drawn[i].x;
+        unit.syy += drawn[i].y * drawn[i].y;
+        unit.sxy += drawn[i].x * drawn[i].y;
+        unit.sxx += drawn[i].x * drawn[i].x;
+    }
+    double expand = unit.drawn > 0 ? unit.population / unit.drawn : 0;
+    unit.y = unit.sy * expand;
+    unit.x = unit.sx * expand;
+    _stratum->units.add(_u, unit);
+    _stratum = NULL;
+}
+
+void CoverageSample::finish()
+{
+    for (auto& s : _strata) s.second.units.finish();
+}
+
+/// Combined ratio estimate over strata.  The variance is the two-stage
+/// one of the linearized residuals e = y - R x: between the instances of
+/// each stratum, and between the signals of each drawn instance.
+CoverageSample::Estimate CoverageSample::estimate(
+        const std::vector<const Stratum*>& strata) const
+{
+    Estimate e;
+    e.covered = e.coverable = e.variance = 0;
+    e.instances = e.drawn = 0;
+    for (size_t h = 0; h < strata.size(); h++) {
+        const std::vector<Unit>& units = strata[h]->units.drawn();
+        double expand = (double)strata[h]->units.population() / units.size();
+        for (size_t i = 0; i < units.size(); i++) {
+            e.covered += expand * units[i].y;
+            e.coverable += expand * units[i].x;
+        }
+        e.instances += strata[h]->units.population();
+        e.drawn += units.size();
+    }
+    if (e.coverable <= 0) return e;
+
+    double r = e.covered / e.coverable;
+    double v = 0;
+    for (size_t h = 0; h < strata.size(); h++) {
+        const std::vector<Unit>& units = strata[h]->units.drawn();
+        double N = strata[h]->units.population();
+        double n = units.size();
+        double sum = 0, sum2 = 0;
+        for (size_t i = 0; i < units.size(); i++) {
+            const Unit& u = units[i];
+            double res = u.y - r * u.x;
+            sum += res;
+            sum2 += res * res;
+
+            // within the instance, over its drawn signals
+            double m = u.drawn;
+            if (m > 1 && m < u.population) {
+                double rs = u.sy - r * u.sx;
+                double s2 = (u.syy - 2 * r * u.sxy + r * r * u.sxx - rs * rs / m) / (m - 1);
+                v += N / n * u.population * u.population * (1 - m / u.population) *
+                     std::max(s2, 0.0) / m;
+            }
+        }
+        if (n > 1 && n < N) {
+            double s2 = (sum2 - sum * sum / n) / (n - 1);
+            v += N * N * (1 - n / N) * std::max(s2, 0.0) / n;
+        }
+    }
+    e.variance = v / (e.coverable * e.coverable);
+    return e;
+}
+
+/// Percentage rounded to two decimals, clamped to [0, 100]
+static double percent(double ratio)
+{
+    double p = std::min(std::max(ratio, 0.0), 1.0) * 100;
+    return floor(p * 100 + 0.5) / 100;
+}
+
+void CoverageSample::estimateOut(const Estimate& e, JsonOut& out)
+{
+    out.key("covered");
+    out.Int64((int64_t)floor(e.covered + 0.5));
+    out.key("coverable");
+    out.Int64((int64_t)floor(e.coverable + 0.5));
+    if (e.coverable > 0) {
+        double r = e.covered / e.coverable;
+        double half = z95 * sqrt(e.variance);
+        out.key("score");
+        out.Double(percent(r));
+        out.key("ci_low");
+        out.Double(percent(r - half));
+        out.key("ci_high");
+        out.Double(percent(r + half));
+    }
+    out.key("instances");
+    out.Uint64(e.instances);
+    out.key("sampled_instances");
+    out.Uint64(e.drawn);
+}
+
+void CoverageSample::write(JsonOut& out) const
+{
+    std::vector<const Stratum*> all;
+    for (const auto& s : _strata) all.push_back(&s.second);
+
+    out.StartObject();
+    out.key("sample");
+    out.StartObject();
+    out.key("fraction");
+    out.Double(_fraction);
+    out.key("signal_fraction");
+    out.Double(_signalFraction);
+    out.key("seed");
+    out.Uint64(_seed);
+    out.key("confidence");
+    out.Double(0.95);
+    out.key("instances_read");
+    out.Uint64(_instancesRead);
+    out.key("signals_read");
+    out.Uint64(_signalsRead);
+    out.EndObject();
+
+    out.key("design");
+    out.StartObject();
+    estimateOut(estimate(all), out);
+    out.EndObject();
+
+    // strata are ordered by module, then depth
+    out.key("modules");
+    out.StartArray();
+    for (size_t first = 0; first < all.size(); ) {
+        size_t last = first + 1;
+        while (last < all.size() && all[last]->module == all[first]->module) last++;
+        std::vector<const Stratum*> module(all.begin() + first, all.begin() + last);
+        out.StartObject();
+        out.key("module");
+        out.string(all[first]->module);
+        estimateOut(estimate(module), out);
+        out.EndObject();
+        first = last;
+    }
+    out.EndArray();
+    out.EndObject();
+    out.raw("\n");
+}
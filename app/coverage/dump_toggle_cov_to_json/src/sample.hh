@@ -0,0 +1,159 @@
+/// Sampled toggle coverage estimates (--sample, --seed).
+///
+/// Instead of reading every toggle bit, the walk reads a two-stage
+/// sample: instances are drawn within strata (one stratum per module and
+/// instance depth), and signals are drawn within each drawn instance.
+/// Every instance and signal gets a pseudo-random u in [0, 1) hashed from
+/// the seed and its path, so the same seed draws the same sample in
+/// every run.  A stratum draws every instance with u below the instance
+/// fraction, and at least the two with the smallest u; an instance draws
+/// its signals the same way.  Both are decided while streaming: an item
+/// that may still turn out to be among the smallest two is read and held
+/// in reserve until the stratum or instance is complete.
+///
+/// Estimates are combined ratio estimators over the strata, with the
+/// usual two-stage variance (between instances within a stratum, plus
+/// between signals within an instance, each with its finite population
+/// correction) and a normal 95% confidence interval.  A fraction of 1
+/// reads everything and gives the exact coverage with a zero-width
+/// interval.
+
+#ifndef SAMPLE_HH
+#define SAMPLE_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class JsonOut;
+
+/// The items of a stream drawn by "u < fraction, and at least the two
+/// smallest u": wants() says whether an item has to be read, add() takes
+/// it once read, finish() settles the reserve
+template <class T>
+class StreamDraw {
+public:
+    enum { Min = 2 };
+
+    explicit StreamDraw(double fraction = 1) : _fraction(fraction), _seen(0) { }
+
+    bool wants(double u) const {
+        if (u < _fraction) return true;
+        if (_drawn.size() >= Min) return false;
+        return _reserve.size() < Min || u < _reserve.back().first;
+    }
+
+    /// Count an item of the population, read or not
+    void seen() { _seen++; }
+
+    void add(double u, const T& item) {
+        if (u < _fraction) {
+            _drawn.push_back(item);
+            // enough drawn: the reserve will never be needed
+            if (_drawn.size() == Min) _reserve.clear();
+            return;
+        }
+        if (_drawn.size() >= Min) return;
+        // the reserve holds the smallest u at or above the fraction
+        size_t i = _reserve.size();
+        while (i > 0 && _reserve[i - 1].first > u) i--;
+        _reserve.insert(_reserve.begin() + i, std::make_pair(u, item));
+        if (_reserve.size() > Min) _reserve.pop_back();
+    }
+
+    void finish() {
+        for (size_t i = 0; i < _reserve.size() && _drawn.size() < Min; i++) {
+            _drawn.push_back(_reserve[i].second);
+        }
+        _reserve.clear();
+    }
+
+    size_t population() const { return _seen; }
+    const std::vector<T>& drawn() const { return _drawn; }
+
+private:
+    double _fraction;
+    size_t _seen;
+    std::vector<T> _drawn;
+    std::vector<std::pair<double, T> > _reserve;
+};
+
+class CoverageSample {
+public:
+    CoverageSample(double fraction, double signalFraction, uint64_t seed);
+
+    /// u of the instance or signal at path
+    double draw(std::string_view path) const;
+
+    /// An instance of module at depth (0: top) is visited: true when it
+    /// has to be read, and then its signals follow until leave()
+    bool enter(std::string_view module, unsigned depth, std::string_view path);
+
+    /// A signal of the instance being read: true when it has to be read,
+    /// and then its counts follow with add()
+    bool signal(std::string_view path);
+    void add(long covered, long coverable);
+
+    void leave();
+
+    /// Settle the strata once the walk is done
+    void finish();
+
+    /// Write the estimates for the design and every module
+    void write(JsonOut& out) const;
+
+    size_t instancesRead() const { return _instancesRead; }
+    size_t signalsRead() const { return _signalsRead; }
+
+private:
+    /// Counts of a drawn signal
+    struct Signal {
+        double y;       // covered
+        double x;       // coverable
+    };
+
+    /// A drawn instance: its estimated totals and the sums over its
+    /// drawn signals its second-stage variance is computed from
+    struct Unit {
+        double population;  // signals
+        double drawn;
+        double sy, sx, syy, sxy, sxx;
+        double y, x;        // estimated covered, coverable
+    };
+
+    struct Stratum {
+        std::string module;
+        StreamDraw<Unit> units;
+    };
+
+    struct Estimate {
+        double covered;
+        double coverable;
+        double variance;    // of the ratio
+        size_t instances;
+        size_t drawn;
+    };
+
+    double _fraction;
+    double _signalFraction;
+    uint64_t _seed;
+    std::map<std::pair<std::string, unsigned>, Stratum> _strata;
+
+    // the instance being read
+    Stratum* _stratum;
+    double _u;
+    StreamDraw<Signal> _signals;
+    double _signalU;
+
+    size_t _instancesRead;
+    size_t _signalsRead;
+
+    Estimate estimate(const std::vector<const Stratum*>& strata) const;
+    static void estimateOut(const Estimate& e, JsonOut& out);
+};
+
+#endif
@@ -0,0 +1,220 @@
+/// ShardWriter - see shards.hh.
+
+#include "shards.hh"
+#include "objid.hh"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <set>
+#include <zlib.h>
+
+bool makeDirs(const std::string& path, std::string& err)
+{
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/') continue;
+        std::string part = path.substr(0, i);
+        if (mkdir(part.c_str(), 0777) && errno != EEXIST) {
+            err = "cannot create " + part + ": " + strerror(errno);
+            return false;
+        }
+    }
+    return true;
+}
+
+AtomicFile::AtomicFile(const std::string& path)
+        : _path(path), _fd(-1), _fp(NULL)
+{
+}
+
+AtomicFile::~AtomicFile()
+{
+    if (_fp) {
+        fclose(_fp);
+    } else if (_fd >= 0) {
+        close(_fd);
+    }
+    if (!_tmp.empty()) unlink(_tmp.c_str());
+}
+
+bool AtomicFile::open(std::string& err)
+{
+    _tmp = _path + ".tmp." + std::to_string((long)getpid());
+    _fd = ::open(_tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (_fd < 0) {
+        err = "cannot write " + _tmp + ": " + strerror(errno);
+        _tmp.clear();
+        return false;
+    }
+    return true;
+}
+
+FILE* AtomicFile::stream()
+{
+    if (!_fp && _fd >= 0) _fp = fdopen(_fd, "w");
+    return _fp;
+}
+
+bool AtomicFile::commit(std::string& err)
+{
+    bool ok = _fd >= 0;
+    if (_fp) {
+        ok = ok && !ferror(_fp);
+        if (fclose(_fp)) ok = false;
+    } else if (_fd >= 0 && close(_fd)) {
+        ok = false;
+    }
+    _fp = NULL;
+    _fd = -1;
+    if (!ok || rename(_tmp.c_str(), _path.c_str())) {
+        err = "cannot write " + _path + ": " + strerror(errno);
+        return false;
+    }
+    _tmp.clear();
+    return true;
+}
+
+/// name with everything but letters, digits, '_', '-' and inner '.'
+/// replaced by '_', so it is a safe file name on any file system
+static std::string fileStem(const std::string& name)
+{
+    std::string stem = name.empty() ? "_" : name;
+    for (size_t i = 0; i < stem.size(); i++) {
+        char c = stem[i];
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                  (c >= '0' && c <= '9') || c == '_' || c == '-' ||
+                  (c == '.' && i > 0);
+        if (!ok) stem[i] = '_';
+    }
+    return stem;
+}
+
+/// gzip in into out
+static bool gzipCompress(std::string_view in, std::string& out)
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    // 15 + 16: largest window, gzip header and trailer
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.clear();
+    out.reserve(in.size() / 4);
+
+    const char* next = in.data();
+    size_t left = in.size();
+    unsigned char buf[1 << 16];
+    int rc;
+    do {
+        // avail_in is 32 bits; feed very large shards in pieces
+        if (!zs.avail_in && left) {
+            uInt n = left > (1u << 30) ? (1u << 30) : (uInt)left;
+            zs.next_in = (Bytef*)next;
+            zs.avail_in = n;
+            next += n;
+            left -= n;
+        }
+        zs.next_out = buf;
+        zs.avail_out = sizeof(buf);
+        rc = deflate(&zs, left || zs.avail_in ? Z_NO_FLUSH : Z_FINISH);
+        out.append((const char*)buf, sizeof(buf) - zs.avail_out);
+    } while (rc == Z_OK || rc == Z_BUF_ERROR);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+ShardWriter::ShardWriter(const std::string& dir, bool gzip, JsonOut::Style style)
+        : _dir(dir), _gzip(gzip), _style(style)
+{
+}
+
+bool ShardWriter::open(std::string& err)
+{
+    return makeDirs(_dir, err);
+}
+
+/// Names that had to be changed to be file names get a hash of the real
+/// name appended, so two names mapping to the same stem still get
+/// different files
+std::vector<std::string> fileStems(const std::vector<std::string>& names)
+{
+    std::vector<std::string> stems(names.size());
+    std::set<std::string> used;
+    for (size_t i = 0; i < names.size(); i++) {
+        std::string stem = fileStem(names[i]);
+        if (stem != names[i]) {
+            stem += "-" + idToHex(objectId("shard:" + names[i])).substr(0, 8);
+        }
+        while (!used.insert(stem).second) stem += "_";
+        stems[i] = stem;
+    }
+    return stems;
+}
+
+/// Give every shard a unique file under subdir
+bool ShardWriter::shardFiles(const char* subdir,
+                             const std::vector<std::string>& names,
+                             std::vector<ShardFile>& files, std::string& err)
+{
+    if (!makeDirs(_dir + "/" + subdir, err)) return false;
+    std::vector<std::string> stems = fileStems(names);
+    for (size_t i = 0; i < names.size(); i++) {
+        files[i].name = names[i];
+        files[i].file = std::string(subdir) + "/" + stems[i] + suffix();
+    }
+    return true;
+}
+
+void ShardWriter::store(std::string_view json, ShardFile& f)
+{
+    f.bytes = json.size();
+    std::string compressed;
+    if (_gzip) {
+        if (!gzipCompress(json, compressed)) {
+            f.error = "cannot compress " + f.file;
+            return;
+        }
+        json = compressed;
+    }
+    f.stored = json.size();
+    writeFile(f.file, json.data(), json.size(), f.error);
+}
+
+bool ShardWriter::writeFile(const std::string& file, const char* data, size_t n,
+                            std::string& err)
+{
+    std::string path = _dir + "/" + file;
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        err = "cannot write " + path + ": " + strerror(errno);
+        return false;
+    }
+    while (n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            err = "cannot write " + path + ": " + strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        data += w;
+        n -= w;
+    }
+    if (::close(fd)) {
+        err = "cannot write " + path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+void ShardWriter::describe(const ShardFile& f, JsonOut& out)
+{
+    out.key("file");
+    out.string(f.file);
+    out.key("bytes");
+    out.Uint64(f.bytes);
+    out.key("stored");
+    out.Uint64(f.stored);
+}
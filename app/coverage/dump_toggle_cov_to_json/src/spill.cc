@@ -0,0 +1,250 @@
+/// Spilling collected records to disk - see spill.hh.
+
+#include "spill.hh"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+SpillFile::SpillFile()
+        : _fp(NULL), _good(true), _bytes(0)
+{
+}
+
+SpillFile::~SpillFile()
+{
+    if (_fp) fclose(_fp);
+}
+
+bool SpillFile::create(std::string& err)
+{
+    const char* dir = getenv("TMPDIR");
+    std::string path = std::string(dir && *dir ? dir : "/tmp") + "/covspill.XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        err = "cannot create a spill file in " + path.substr(0, path.rfind('/')) +
+              ": " + strerror(errno);
+        return false;
+    }
+    // nothing is left behind however the run ends
+    unlink(path.c_str());
+    _fp = fdopen(fd, "w+");
+    if (!_fp) {
+        err = std::string("cannot open a spill file: ") + strerror(errno);
+        close(fd);
+        return false;
+    }
+    setvbuf(_fp, NULL, _IOFBF, 1 << 20);
+    return true;
+}
+
+void SpillFile::putVarint(uint64_t v)
+{
+    while (v >= 0x80) {
+        putc((int)(v & 0x7f) | 0x80, _fp);
+        v >>= 7;
+        _bytes++;
+    }
+    putc((int)v, _fp);
+    _bytes++;
+}
+
+void SpillFile::putFixed64(uint64_t v)
+{
+    unsigned char b[8];
+    for (int i = 0; i < 8; i++) b[i] = (unsigned char)(v >> (8 * i));
+    fwrite(b, 1, 8, _fp);
+    _bytes += 8;
+}
+
+void SpillFile::putDouble(double d)
+{
+    uint64_t v;
+    memcpy(&v, &d, sizeof(v));
+    putFixed64(v);
+}
+
+void SpillFile::putString(std::string_view s)
+{
+    putVarint(s.size());
+    fwrite(s.data(), 1, s.size(), _fp);
+    _bytes += s.size();
+}
+
+bool SpillFile::rewind(std::string& err)
+{
+    if (fflush(_fp) || ferror(_fp) || fseek(_fp, 0, SEEK_SET)) {
+        err = std::string("cannot write a spill file: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+uint8_t SpillFile::getByte()
+{
+    int c = getc(_fp);
+    if (c == EOF) {
+        _good = false;
+        return 0;
+    }
+    return (uint8_t)c;
+}
+
+uint64_t SpillFile::getVarint()
+{
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t b = getByte();
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    _good = false;
+    return v;
+}
+
+uint64_t SpillFile::getFixed64()
+{
+    unsigned char b[8];
+    if (fread(b, 1, 8, _fp) != 8) {
+        _good = false;
+        return 0;
+    }
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)b[i] << (8 * i);
+    return v;
+}
+
+double SpillFile::getDouble()
+{
+    uint64_t v = getFixed64();
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return d;
+}
+
+void SpillFile::getString(std::string& s)
+{
+    uint64_t n = getVarint();
+    if (!_good) return;
+    s.resize(n);
+    if (n && fread(&s[0], 1, n, _fp) != n) _good = false;
+}
+
+// value tags of the binary form
+enum { TagNull, TagFalse, TagTrue, TagInt, TagUint, TagDouble, TagString,
+       TagArray, TagObject };
+
+void spillValue(SpillFile& f, const rapidjson::Value& v)
+{
+    switch (v.GetType()) {
+    case rapidjson::kNullType:
+        f.putByte(TagNull);
+        break;
+    case rapidjson::kFalseType:
+        f.putByte(TagFalse);
+        break;
+    case rapidjson::kTrueType:
+        f.putByte(TagTrue);
+        break;
+    case rapidjson::kNumberType:
+        if (v.IsInt64()) {
+            f.putByte(TagInt);
+            f.putSigned(v.GetInt64());
+        } else if (v.IsUint64()) {
+            f.putByte(TagUint);
+            f.putVarint(v.GetUint64());
+        } else {
+            f.putByte(TagDouble);
+            f.putDouble(v.GetDouble());
+        }
+        break;
+    case rapidjson::kStringType:
+        f.putByte(TagString);
+        f.putString(std::string_view(v.GetString(), v.GetStringLength()));
+        break;
+    case rapidjson::kArrayType:
+        f.putByte(TagArray);
+        f.putVarint(v.Size());
+        for (rapidjson::SizeType i = 0; i < v.Size(); i++) spillValue(f, v[i]);
+        break;
+    case rapidjson::kObjectType:
+        f.putByte(TagObject);
+        f.putVarint(v.MemberCount());
+        for (rapidjson::Value::ConstMemberIterator m = v.MemberBegin();
+             m != v.MemberEnd(); ++m) {
+            f.putString(std::string_view(m->name.GetString(), m->name.GetStringLength()));
+            spillValue(f, m->value);
+        }
+        break;
+    }
+}
+
+bool unspillValue(SpillFile& f, rapidjson::Value& v,
+                  rapidjson::Document::AllocatorType& allocator)
+{
+    std::string s;
+    switch (f.getByte()) {
+    case TagNull:
+        v.SetNull();
+        break;
+    case TagFalse:
+        v.SetBool(false);
+        break;
+    case TagTrue:
+        v.SetBool(true);
+        break;
+    case TagInt:
+        v.SetInt64(f.getSigned());
+        break;
+    case TagUint:
+        v.SetUint64(f.getVarint());
+        break;
+    case TagDouble:
+        v.SetDouble(f.getDouble());
+        break;
+    case TagString:
+        f.getString(s);
+        v.SetString(s.data(), (rapidjson::SizeType)s.size(), allocator);
+        break;
+    case TagArray: {
+        uint64_t n = f.getVarint();
+        v.SetArray();
+        for (uint64_t i = 0; i < n && f.good(); i++) {
+            rapidjson::Value e;
+            if (!unspillValue(f, e, allocator)) return false;
+            v.PushBack(e, allocator);
+        }
+        break;
+    }
+    case TagObject: {
+        uint64_t n = f.getVarint();
+        v.SetObject();
+        for (uint64_t i = 0; i < n && f.good(); i++) {
+            f.getString(s);
+            rapidjson::Value name(s.data(), (rapidjson::SizeType)s.size(), allocator);
+            rapidjson::Value e;
+            if (!unspillValue(f, e, allocator)) return false;
+            v.AddMember(name, e, allocator);
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+    return f.good();
+}
+
+bool parseSize(const char* s, size_t& bytes)
+{
+    char* end;
+    double v = strtod(s, &end);
+    size_t unit = 1;
+    switch (*end) {
+    case 'k': case 'K': unit = (size_t)1 << 10; end++; break;
+    case 'm': case 'M': unit = (size_t)1 << 20; end++; break;
+    case 'g': case 'G': unit = (size_t)1 << 30; end++; break;
+    }
+    if (end == s || *end || !(v > 0)) return false;
+    bytes = (size_t)(v * unit);
+    return bytes > 0;
+}
@@ -7,42 +7,53 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <utility>
 #include "covdb_user.h"
 #include "visit.hh"
 
-UcapiVisitor::UcapiVisitor(covdbHandle design)
-        : _design(design)
+UcapiBase::UcapiBase(covdbHandle design)
+        : _design(design), _instDepth(0), _topAdmit(Deadline::Walk)
 {
-    covdbHandle tns, tn;
     /* load and merge all tests found in the design */
-    tns = covdb_iterate(_design, covdbAvailableTests);
-    tn = covdb_scan(tns);
-    visitTestName(tn);
-    _test = covdb_load(covdbTest, _design, covdb_get_str(tn, covdbName));
+    _test = loadTests(_design, availableTests(_design));
+}
+
+UcapiBase::UcapiBase(covdbHandle design, covdbHandle test)
+        : _design(design), _test(test), _instDepth(0),
+          _topAdmit(Deadline::Walk)
+{
+}
+
+std::vector<std::string> UcapiBase::availableTests(covdbHandle design)
+{
+    std::vector<std::string> names;
+    covdbHandle tns, tn;
+    tns = covdb_iterate(design, covdbAvailableTests);
     while((tn = covdb_scan(tns))) {
-        visitTestName(tn);
-        _test = covdb_loadmerge(covdbTest, _test,
-                               covdb_get_str(tn, covdbName));
+        const char* name = covdb_get_str(tn, covdbName);
+        if (name) names.push_back(name);
     }
     covdb_release_handle(tns);
-
+    return names;
 }
 
-UcapiVisitor::UcapiVisitor(covdbHandle design, covdbHandle test)
-        : _design(design), _test(test)
+covdbHandle UcapiBase::loadTests(covdbHandle design,
+                                 const std::vector<std::string>& names)
 {
+    if (names.empty()) return NULL;
+    if (_progress) _progress->tests(0, names.size());
+    covdbHandle test = covdb_load(covdbTest, design, names[0].c_str());
+    for (size_t i = 1; i < names.size(); i++) {
+        if (_progress) _progress->tests(i, names.size());
+        test = covdb_loadmerge(covdbTest, test, names[i].c_str());
+    }
+    if (_progress) _progress->tests(names.size(), names.size());
+    return test;
 }
 
-
-void UcapiVisitor::execute(covdbErrorCB cbf) 
+void UcapiBase::installErrorCallback(covdbErrorCB cbf)
 {
-    covdbHandle met, mets;
-    covdbHandle tbMet = NULL, astMet = NULL;
-    covdbHandle inst, insts;
-    covdbHandle def, defs;
-
-    covdb_configure(covdbDisplayErrors, (char*)"false");
-
     /* register error callback function */
     if (cbf)
         // Use function passed to execute
@@ -53,254 +64,163 @@ void UcapiVisitor::execute(covdbErrorCB cbf)
     else
         // Use default
         covdb_set_error_callback(errorCB, NULL);
+}
 
-    /* iterate through all top instances in the design */
-    insts = covdb_iterate(_design, covdbInstances);
-    while((inst = covdb_scan(insts))) {
-        recurseIntoObjectsInUnqualifiedInst(inst);
-    }
-    covdb_release_handle(insts);
-
-    /* iterate through all definitions in the design */
-    defs = covdb_iterate(_design, covdbDefinitions);
-    while((def = covdb_scan(defs))) {
-        recurseIntoObjectsInUnqualifiedDef(def);
-    }
-    covdb_release_handle(defs);
-
-    /* Find the group and assertion metrics if they are present in _test */
-    mets = covdb_iterate(_test, covdbMetrics);
-    while((met = covdb_scan(mets))) {
-        if (isTestbenchMetric(met)) {
-            tbMet = covdb_make_persistent_handle(met);
-        } else if (isAssertMetric(met)) {
-            astMet = covdb_make_persistent_handle(met);
-        }
-    }
-
-    /* iterate through assertions from the test handle.  We could do this
-     * from the instances or modules, but then we'd miss assertions in the
-     * root scope
-     */
-    if (astMet) {
-        covdbHandle ast, asts =
-                covdb_qualified_iterate(_test, astMet, covdbObjects);
-        while((ast = covdb_scan(asts))) {
-            covdbHandle parent = covdb_get_handle(ast, covdbParent);
-            covdbHandle blk, blks = covdb_iterate(ast, covdbObjects);
-            while((blk = covdb_scan(blks))) {
-                const char* blkname = covdb_get_str(blk, covdbName);
-                /* find the block name corresponding to covered/success */
-                if (!strcmp(blkname, "realsuccesses") ||
-                    !strcmp(blkname, "allsuccesses"))
-                {
-                    visitCovObject(blk, parent, astMet, ast);
-                    break;
-                }
-            }
-            covdb_release_handle(blks);
+size_t UcapiBase::countUnits(bool regions, bool groups)
+{
+    size_t n = 0;
+    covdbHandle h, hs;
+    if (regions) {
+        covdbHandle inst, insts = covdb_iterate(_design, covdbInstances);
+        while((inst = covdb_scan(insts))) {
+            n++;
+            hs = covdb_iterate(inst, covdbInstances);
+            while((h = covdb_scan(hs))) n++;
+            covdb_release_handle(hs);
         }
-        covdb_release_handle(asts);
+        covdb_release_handle(insts);
+        hs = covdb_iterate(_design, covdbDefinitions);
+        while((h = covdb_scan(hs))) n++;
+        covdb_release_handle(hs);
     }
-
-    /* iterate through covergroups */
-    if (tbMet) {
-        covdbHandle grp, grps;
-        grps = covdb_qualified_iterate(_test, tbMet, covdbDefinitions);
-        while((grp = covdb_scan(grps))) {
-            grp = covdb_make_persistent_handle(grp);
-
-            /* Iterate through grp's variants */
-            covdbHandle var, vars =
-                    covdb_qualified_iterate(grp, tbMet, covdbDefinitions);
-            while((var = covdb_scan(vars))) {
-                var = covdb_make_persistent_handle(var);
-
-                /* recurse into covergroup contents */
-                recurseIntoObjectsInQualifiedRegion(var, tbMet,
-                                                    covdbSourceDefinition);
-
-                /* recurse into instances of this variant */
-                covdbHandle inst, insts = covdb_iterate(var, covdbInstances);
-                while((inst = covdb_scan(insts))) {
-                    inst = covdb_make_persistent_handle(inst);
-                    recurseIntoObjectsInQualifiedRegion(inst, tbMet, 
-                                                        covdbSourceInstance);
-                    covdb_release_handle(inst);
-                }
-                covdb_release_handle(var);
-            }
-            covdb_release_handle(grp);
+    if (groups && _test) {
+        covdbHandle met, mets = covdb_iterate(_test, covdbMetrics);
+        while((met = covdb_scan(mets))) {
+            if (!isTestbenchMetric(met)) continue;
+            hs = covdb_qualified_iterate(_test, met, covdbDefinitions);
+            while((h = covdb_scan(hs))) n++;
+            covdb_release_handle(hs);
         }
-        covdb_release_handle(tbMet);
-        covdb_release_handle(grps);
+        covdb_release_handle(mets);
     }
+    return n;
 }
 
-/*
- * If obj is a coverable object, assign it a code number.  If it's 
- * a container, recurse into its list of contained objects.
- */
-void UcapiVisitor::recurseIntoObjects(covdbHandle obj, covdbHandle qinst,
-                                      covdbHandle met, covdbHandle parent)
+/// Number of instances in the subtree of inst, itself included
+static size_t subtreeSize(covdbHandle inst)
 {
-    covdbObjTypesT ty = (covdbObjTypesT)covdb_get(obj, qinst, NULL, covdbType);
-
-    switch(ty) {
-        case covdbBlock:
-        case covdbSequence:
-        case covdbCross:
-        case covdbIntegerValue:
-        case covdbScalarValue:
-        case covdbValueSet:
-            visitLeafObject(obj, qinst, met, parent);
-            if (!isLineMetric(met)) {
-                visitCovObject(obj, qinst, met, parent);
-            }
-            break;
-
-        case covdbContainer:
-            {
-                obj = covdb_make_persistent_handle(obj);
-
-                startContainer(obj, qinst, met, parent);
-
-                covdbHandle kids, kid;
-                kids = covdb_iterate(obj, covdbObjects);
-                kid = covdb_scan(kids);
-
-                if (isAssertMetric(met)) {
-                    // These are visited from the test handle
-                } else {
-                    // Recurse into kids
-                    if (kid && isLineMetric(met)) {
-                        covdbObjTypesT kty = (covdbObjTypesT)
-                                covdb_get(kid, qinst, NULL, covdbType);
-                        if (covdbBlock == kty) {
-                            visitCovObject(obj, qinst, met, parent);
-                        }
-                    }
-
-                    while(kid) {
-                        recurseIntoObjects(kid, qinst, met, obj);
-                        kid = covdb_scan(kids);
-                    }
-                }
-                finishContainer(obj, qinst, met, parent);
-                covdb_release_handle(kids);
-                covdb_release_handle(obj);
-            }
-            break;
-
-        default:
-            printf("Error: unrecognized object type %d\n", ty);
-            break;
-    }
+    size_t n = 1;
+    covdbHandle kid, kids = covdb_iterate(inst, covdbInstances);
+    while((kid = covdb_scan(kids))) n += subtreeSize(kid);
+    covdb_release_handle(kids);
+    return n;
 }
 
-void UcapiVisitor::recurseIntoObjectsInQualifiedRegion(covdbHandle qreg,
-                                                       covdbHandle met,
-                                                       covdbObjTypesT ty)
+/// The handles of costed, cheapest first; ties keep UCAPI order
+static std::vector<covdbHandle> byCost(std::vector<std::pair<size_t, covdbHandle> >& costed)
 {
-    covdbHandle objs, obj;
+    std::stable_sort(costed.begin(), costed.end(),
+                     [](const std::pair<size_t, covdbHandle>& a,
+                        const std::pair<size_t, covdbHandle>& b) {
+        return a.first < b.first;
+    });
+    std::vector<covdbHandle> order;
+    for (size_t i = 0; i < costed.size(); i++) order.push_back(costed[i].second);
+    return order;
+}
 
-    objs = covdb_iterate(qreg, covdbObjects);
-    if (covdbSourceDefinition == ty) {
-        startVariant(qreg, met);
-    } else if (covdbSourceInstance == ty) {
-        startQualifiedInstance(qreg, met);
-    }
-    while((obj = covdb_scan(objs))) {
-        recurseIntoObjects(obj, qreg, met, NULL);
-    }
-    covdb_release_handle(objs);
-    if (covdbSourceDefinition == ty) {
-        finishVariant(qreg, met);
-    } else if (covdbSourceInstance == ty) {
-        finishQualifiedInstance(qreg, met);
+std::vector<covdbHandle> UcapiBase::instancesByCost(covdbHandle parent)
+{
+    std::vector<std::pair<size_t, covdbHandle> > costed;
+    covdbHandle kid, kids = covdb_iterate(parent, covdbInstances);
+    while((kid = covdb_scan(kids))) {
+        costed.push_back(std::make_pair(subtreeSize(kid),
+                                        covdb_make_persistent_handle(kid)));
     }
+    covdb_release_handle(kids);
+    return byCost(costed);
 }
 
-void UcapiVisitor::recurseIntoObjectsInUnqualifiedDef(covdbHandle reg)
+std::vector<covdbHandle> UcapiBase::covergroupsByCost(covdbHandle met)
 {
-    covdbHandle objs, obj;
-    covdbHandle met, mets;
-
-    reg = covdb_make_persistent_handle(reg);
-
-    startDefinition(reg);
-
-    /* visit the objects for each metric */
-    mets = covdb_iterate(_test, covdbMetrics);
-    while((met = covdb_scan(mets))) {
-        if (isPathMetric(met)) continue; // path coverage is deprecated
-        if (isTestbenchMetric(met) || isAssertMetric(met)) {
-            // these test-qualified metrics are accessed through the
-            // test handle
-            continue;
-        }
-        covdbHandle var, vars;
-        met = covdb_make_persistent_handle(met);
-        vars = covdb_qualified_iterate(reg, met, covdbDefinitions);
+    std::vector<std::pair<size_t, covdbHandle> > costed;
+    covdbHandle grp, grps = covdb_qualified_iterate(_test, met, covdbDefinitions);
+    while((grp = covdb_scan(grps))) {
+        size_t n = 0;
+        covdbHandle var, vars = covdb_qualified_iterate(grp, met, covdbDefinitions);
         while((var = covdb_scan(vars))) {
-            recurseIntoObjectsInQualifiedRegion(var, met,
-                                                covdbSourceDefinition);
+            n++;
+            covdbHandle inst, insts = covdb_iterate(var, covdbInstances);
+            while((inst = covdb_scan(insts))) n++;
+            covdb_release_handle(insts);
         }
         covdb_release_handle(vars);
-        covdb_release_handle(met);
+        costed.push_back(std::make_pair(n, covdb_make_persistent_handle(grp)));
     }
-    covdb_release_handle(mets);
-
-    finishDefinition(reg);
+    covdb_release_handle(grps);
+    return byCost(costed);
 }
 
-void UcapiVisitor::recurseIntoObjectsInUnqualifiedInst(covdbHandle reg)
+unsigned UcapiBase::metricBit(covdbHandle met)
 {
-    covdbHandle objs, obj;
-    covdbHandle met, mets;
-    covdbHandle kid, kids;
-
-    reg = covdb_make_persistent_handle(reg);
+    if (isLineMetric(met)) return LineMetric;
+    if (isCondMetric(met)) return CondMetric;
+    if (isFsmMetric(met)) return FsmMetric;
+    if (isToggleMetric(met)) return ToggleMetric;
+    if (isBranchMetric(met)) return BranchMetric;
+    if (isAssertMetric(met)) return AssertMetric;
+    if (isTestbenchMetric(met)) return TestbenchMetric;
+    return 0;
+}
 
-    startInstance(reg);
+/*
+ * Name cache: region names are looked up once per qualified region,
+ * container names once per container, instead of once per object.
+ * Only the names of containers directly above objects matter, but
+ * looking them up per container is cheap next to per-object lookups.
+ * Walkers that read neither skip the lookups; progress still needs the
+ * region's full name.
+ */
+static const char* nameOf(covdbHandle obj, bool full)
+{
+    const char* name = covdb_get_str(obj, full ? covdbFullName : covdbName);
+    return name ? name : "";
+}
 
-    /* descend into children of this instance */
-    kids = covdb_iterate(reg, covdbInstances);
-    while((kid = covdb_scan(kids))) {
-        recurseIntoObjectsInUnqualifiedInst(kid);
+void UcapiBase::enterRegion(covdbHandle region, bool names)
+{
+    _containerNames.clear();
+    _names = ObjectNames();
+    if (names) {
+        _regionName = nameOf(region, false);
+        _regionFullName = nameOf(region, true);
+        _names.regionName = _regionName;
+        _names.regionFullName = _regionFullName;
+    } else if (_progress) {
+        _regionFullName = nameOf(region, true);
     }
+    if (_progress) _progress->region(_regionFullName);
+}
 
-    /* visit the objects for each metric */
-    mets = covdb_iterate(_test, covdbMetrics);
-    while((met = covdb_scan(mets))) {
-        if (isPathMetric(met)) continue; // path coverage is deprecated
-        if (isTestbenchMetric(met) || isAssertMetric(met)) {
-            // these test-qualified metrics are accessed through the
-            // test handle
-            continue;
-        }
-
-        covdbHandle qreg;
-        met = covdb_make_persistent_handle(met);
-        qreg = covdb_get_qualified_handle(reg, met, covdbIdentity);
-
-        recurseIntoObjectsInQualifiedRegion(qreg, met, covdbSourceInstance);
+void UcapiBase::enterContainer(covdbHandle obj)
+{
+    _containerNames.push_back(nameOf(obj, false));
+    _containerNames.push_back(nameOf(obj, true));
+    _names.parentName = _containerNames[_containerNames.size() - 2];
+    _names.parentFullName = _containerNames.back();
+}
 
-        covdb_release_handle(qreg);
-        covdb_release_handle(met);
+void UcapiBase::leaveContainer()
+{
+    _containerNames.pop_back();
+    _containerNames.pop_back();
+    if (_containerNames.empty()) {
+        _names.parentName = std::string_view();
+        _names.parentFullName = std::string_view();
+    } else {
+        _names.parentName = _containerNames[_containerNames.size() - 2];
+        _names.parentFullName = _containerNames.back();
     }
-    covdb_release_handle(mets);
-
-    finishInstance(reg);
-    covdb_release_handle(reg);
 }
 
-covdbErrorCB UcapiVisitor::_errorCallback = NULL;
+covdbErrorCB UcapiBase::_errorCallback = NULL;
+Progress* UcapiBase::_progress = NULL;
+Deadline* UcapiBase::_deadline = NULL;
 
 /*
  * callback function we register with UCAPI for errors
  */
-void UcapiVisitor::errorCB(covdbHandle errHdl, void *data)
+void UcapiBase::errorCB(covdbHandle errHdl, void *data)
 {
     int errcode = covdb_get(errHdl, NULL, NULL, covdbValue);
     if (covdbInvalidPropertyError == errcode ||
@@ -321,7 +241,7 @@ void UcapiVisitor::errorCB(covdbHandle errHdl, void *data)
     }
 }
 
-const char* UcapiVisitor::ucapiObjTypeName(covdbHandle obj, covdbHandle reg) 
+const char* UcapiBase::ucapiObjTypeName(covdbHandle obj, covdbHandle reg) 
 {
     const char* res = NULL;
     if (!obj || !reg) return "Null handle";
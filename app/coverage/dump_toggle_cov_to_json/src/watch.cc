@@ -0,0 +1,127 @@
+/// VdbWatcher - see watch.hh.
+
+#include "watch.hh"
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// what a test being written or copied in shows up as; reads by the
+// dumper itself are not watched
+static const uint32_t watchMask = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO |
+                                  IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF;
+
+VdbWatcher::VdbWatcher(const std::string& vdb, unsigned debounceMs)
+        : _vdb(vdb), _debounceMs(debounceMs), _fd(-1)
+{
+}
+
+VdbWatcher::~VdbWatcher()
+{
+    if (_fd >= 0) close(_fd);
+}
+
+bool VdbWatcher::open(std::string& err)
+{
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd < 0) {
+        err = std::string("inotify: ") + strerror(errno);
+        return false;
+    }
+    return watchRoot(err);
+}
+
+/// Watch the test data directory, or the VDB if there is none
+bool VdbWatcher::watchRoot(std::string& err)
+{
+    std::string root = _vdb + "/snps/coverage/db/testdata";
+    struct stat st;
+    if (stat(root.c_str(), &st) || !S_ISDIR(st.st_mode)) root = _vdb;
+    addTree(root);
+    if (_dirs.empty()) {
+        err = "cannot watch " + root + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+/// Watch dir and every directory below it.  Directories created while
+/// this runs are caught either here or by their IN_CREATE event.
+void VdbWatcher::addTree(const std::string& dir)
+{
+    int wd = inotify_add_watch(_fd, dir.c_str(), watchMask | IN_ONLYDIR);
+    if (wd < 0) return;
+    _dirs[wd] = dir;
+
+    DIR* d = opendir(dir.c_str());
+    if (!d) return;
+    while (struct dirent* e = readdir(d)) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        std::string path = dir + "/" + e->d_name;
+        struct stat st;
+        if (!lstat(path.c_str(), &st) && S_ISDIR(st.st_mode)) addTree(path);
+    }
+    closedir(d);
+}
+
+/// Read the pending events, watching new directories; changed is set if
+/// there were any
+bool VdbWatcher::drain(bool& changed, std::string& err)
+{
+    alignas(struct inotify_event) char buf[1 << 16];
+    for (;;) {
+        ssize_t n = read(_fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            // the test data directory itself was removed or replaced
+            if (errno == EAGAIN) return !_dirs.empty() || watchRoot(err);
+            err = std::string("inotify: ") + strerror(errno);
+            return false;
+        }
+        for (char* p = buf; p < buf + n; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            changed = true;
+            if (ev->mask & IN_IGNORED) {
+                _dirs.erase(ev->wd);
+            } else if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                       (ev->mask & IN_ISDIR) && ev->len) {
+                std::map<int, std::string>::iterator it = _dirs.find(ev->wd);
+                if (it != _dirs.end()) addTree(it->second + "/" + ev->name);
+            }
+        }
+    }
+}
+
+bool VdbWatcher::wait(std::string& err)
+{
+    struct pollfd pfd;
+    pfd.fd = _fd;
+    pfd.events = POLLIN;
+
+    // first change: wait as long as it takes
+    bool changed = false;
+    while (!changed) {
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            err = std::string("poll: ") + strerror(errno);
+            return false;
+        }
+        if (!drain(changed, err)) return false;
+    }
+
+    // then until a whole debounce period passes without one
+    for (;;) {
+        int rc = poll(&pfd, 1, (int)_debounceMs);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            err = std::string("poll: ") + strerror(errno);
+            return false;
+        }
+        if (rc == 0) return true;
+        changed = false;
+        if (!drain(changed, err)) return false;
+    }
+}
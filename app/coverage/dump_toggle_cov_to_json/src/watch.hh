@@ -0,0 +1,43 @@
+/// VdbWatcher - wait for tests to land in a VDB (--watch).
+///
+/// Watches the test data directory of a VDB (snps/coverage/db/testdata)
+/// and every directory below it with inotify; directories created later
+/// are added as they appear.  If the VDB has no test data directory yet,
+/// the whole VDB directory tree is watched instead.  A simulation
+/// writes its test in a burst of file operations, so wait() returns
+/// only after changes have stopped for the debounce time, and a burst
+/// of tests finishing together costs one update.
+
+#ifndef WATCH_HH
+#define WATCH_HH
+
+#include <map>
+#include <string>
+
+class VdbWatcher {
+public:
+    VdbWatcher(const std::string& vdb, unsigned debounceMs);
+    ~VdbWatcher();
+
+    /// Start watching
+    bool open(std::string& err);
+
+    /// Block until something changed below the watched directories and
+    /// then nothing changed for the debounce time
+    bool wait(std::string& err);
+
+private:
+    std::string _vdb;
+    unsigned _debounceMs;
+    int _fd;
+    std::map<int, std::string> _dirs;   // watch descriptor -> directory
+
+    bool watchRoot(std::string& err);
+    void addTree(const std::string& dir);
+    bool drain(bool& changed, std::string& err);
+
+    VdbWatcher(const VdbWatcher&);
+    VdbWatcher& operator=(const VdbWatcher&);
+};
+
+#endif
@@ -0,0 +1,334 @@
+/// Traversals filling the tables of collect.hh.
+
+#include "collect.hh"
+#include "visit.hh"
+#include "objid.hh"
+
+TableColumn CovTable::pathData() const
+{
+    static const char none = 0;
+    TableColumn col;
+    col.name = "path_data";
+    col.format = "B";
+    col.itemSize = 1;
+    col.data = _pathData.empty() ? &none : _pathData.data();
+    col.rows = _pathData.size();
+    return col;
+}
+
+TableColumn CovTable::pathOffsets() const
+{
+    TableColumn col;
+    col.name = "path_offsets";
+    col.format = "Q";
+    col.itemSize = sizeof(uint64_t);
+    col.data = _pathOffsets.data();
+    col.rows = _pathOffsets.size();
+    return col;
+}
+
+uint32_t CovTable::intern(const std::string& path)
+{
+    std::unordered_map<std::string, uint32_t>::iterator it = _pathIndex.find(path);
+    if (it != _pathIndex.end()) return it->second;
+    uint32_t k = (uint32_t)(_pathOffsets.size() - 1);
+    _pathData += path;
+    _pathData += '\0';
+    _pathOffsets.push_back(_pathData.size());
+    _pathIndex.emplace(path, k);
+    return k;
+}
+
+/// Rows of a toggle table
+class ToggleTable : public CovTable {
+public:
+    std::vector<uint32_t> signal;
+    std::vector<uint32_t> bit;
+    std::vector<uint8_t> direction;
+    std::vector<uint8_t> status;
+    std::vector<int64_t> count;
+    std::vector<uint64_t> id;
+
+    ToggleTable() : CovTable("toggle") { }
+
+    using CovTable::intern;
+
+    void finish() {
+        _rows = status.size();
+        addColumn("signal", "I", signal);
+        addColumn("bit", "I", bit);
+        addColumn("direction", "B", direction);
+        addColumn("status", "B", status);
+        addColumn("count", "q", count);
+        addColumn("id", "Q", id);
+        // the lookup is only needed while paths are added
+        std::unordered_map<std::string, uint32_t>().swap(_pathIndex);
+    }
+};
+
+/// Instance view of the toggle metric, as in dumptgl: the top-level
+/// containers of an instance are its signals, each bit two objects.
+/// The module view is not walked.
+class ToggleCollector : public UcapiWalker<ToggleCollector, ToggleMetric> {
+    ToggleTable& _table;
+    const PathFilter* _filter;
+    std::vector<PathFilter::Verdict> _verdicts;
+    std::vector<std::string> _paths;
+    bool _inInstance;
+    int _depth;
+    std::string _signal;        // <instance>.<signal> being visited
+    uint32_t _signalIndex;
+    size_t _signalStart;        // first row of the signal
+
+    /// Start a signal of the current instance
+    void openSignal(std::string_view name) {
+        closeSignal();
+        _signal = names().regionFullName;
+        _signal += ".";
+        _signal += name.empty() ? std::string_view("unknown") : name;
+        _signalIndex = _table.intern(_signal);
+        _signalStart = _table.status.size();
+    }
+
+    /// Give the rows of the signal just finished their ids; the bit
+    /// index is left off for single-bit signals
+    void closeSignal() {
+        size_t end = _table.status.size();
+        if (_signal.empty() || _signalStart == end) return;
+        bool vector = end - _signalStart > 2;
+        std::string key;
+        for (size_t r = _signalStart; r < end; r++) {
+            key = "tgl:" + _signal;
+            if (vector) key += "[" + std::to_string(_table.bit[r]) + "]";
+            key += _table.direction[r] ? ":1->0" : ":0->1";
+            _table.id[r] = objectId(key);
+        }
+        _signal.clear();
+    }
+
+    bool acceptSignal(const char* name) {
+        std::string path = _paths.back() + "." + (name ? name : "unknown");
+        return _filter->classify(path, _verdicts.back()) == PathFilter::Accept;
+    }
+
+public:
+    ToggleCollector(covdbHandle design, ToggleTable& table,
+                    const PathFilter* filter)
+            : UcapiWalker(design), _table(table), _filter(filter),
+              _inInstance(false), _depth(0), _signalIndex(0),
+              _signalStart(0) { }
+
+    bool acceptInstance(covdbHandle inst) {
+        if (!_filter) return true;
+        const char* path = covdb_get_str(inst, covdbFullName);
+        PathFilter::Verdict parent = _verdicts.empty() ?
+                _filter->root() : _verdicts.back();
+        PathFilter::Verdict v = _filter->classify(path ? path : "", parent);
+        if (v == PathFilter::Reject) return false;
+        _verdicts.push_back(v);
+        _paths.push_back(path ? path : "");
+        return true;
+    }
+
+    void finishInstance(covdbHandle inst) {
+        if (!_filter) return;
+        _verdicts.pop_back();
+        _paths.pop_back();
+    }
+
+    bool acceptDefinition(covdbHandle def) { return false; }
+
+    void startQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        _inInstance = isToggleMetric(met);
+        _depth = 0;
+    }
+
+    void finishQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        closeSignal();
+        _inInstance = false;
+    }
+
+    bool acceptContainer(covdbHandle obj, covdbHandle region,
+                         covdbHandle metric, covdbHandle parent) {
+        return !_filter || !_inInstance || _depth > 0 ||
+               acceptSignal(covdb_get_str(obj, covdbName));
+    }
+
+    void startContainer(covdbHandle obj, covdbHandle region,
+                        covdbHandle metric, covdbHandle parent) {
+        if (_inInstance && _depth == 0) openSignal(names().parentName);
+        _depth++;
+    }
+
+    void finishContainer(covdbHandle obj, covdbHandle region,
+                         covdbHandle metric, covdbHandle parent) {
+        _depth--;
+    }
+
+    void visitNamedCovObject(covdbHandle obj, covdbHandle region,
+                             covdbHandle metric, covdbHandle parent,
+                             const ObjectNames& names) {
+        if (!_inInstance) return;
+        if (_depth == 0) {
+            // bare object directly under the region: a signal of its own
+            const char* name = covdb_get_str(obj, covdbName);
+            if (_filter && !acceptSignal(name)) return;
+            openSignal(name ? name : "");
+        }
+        size_t index = _table.status.size() - _signalStart;
+        int st = covdb_get(obj, region, getTest(), covdbCovStatus);
+        _table.signal.push_back(_signalIndex);
+        _table.bit.push_back((uint32_t)(index / 2));
+        _table.direction.push_back((uint8_t)(index % 2));
+        _table.status.push_back(st & covdbStatusCovered ? 0 :
+                                st & covdbStatusExcluded ? 1 : 2);
+        _table.count.push_back(covdb_get(obj, region, getTest(), covdbCovCount));
+        _table.id.push_back(0);
+        if (_depth == 0) closeSignal();
+    }
+};
+
+CovTable* collectToggles(covdbHandle design, const PathFilter* filter)
+{
+    covdb_qualified_configure(design, covdbExcludeMode, "adaptive");
+    ToggleTable* table = new ToggleTable;
+    ToggleCollector walker(design, *table, filter);
+    walker.execute();
+    table->finish();
+    return table;
+}
+
+/// Rows of a group table
+class GroupTable : public CovTable {
+public:
+    std::vector<uint32_t> path;
+    std::vector<uint32_t> container;
+    std::vector<int32_t> covered;
+    std::vector<int32_t> coverable;
+    std::vector<int64_t> count;
+    std::vector<int32_t> weight;
+    std::vector<uint8_t> cross;
+    std::vector<uint64_t> id;
+
+    GroupTable() : CovTable("group") { }
+
+    using CovTable::intern;
+
+    void finish() {
+        _rows = path.size();
+        addColumn("path", "I", path);
+        addColumn("container", "I", container);
+        addColumn("covered", "i", covered);
+        addColumn("coverable", "i", coverable);
+        addColumn("count", "q", count);
+        addColumn("weight", "i", weight);
+        addColumn("cross", "B", cross);
+        addColumn("id", "Q", id);
+        std::unordered_map<std::string, uint32_t>().swap(_pathIndex);
+    }
+};
+
+/// Covergroup bins, named and filtered as in dump_func_cov_to_json:
+/// <variant parent>.<variant>.<coverpoint>.<container>.<bin>
+class GroupCollector : public UcapiWalker<GroupCollector, TestbenchMetric> {
+    GroupTable& _table;
+    const PathFilter* _filter;
+    std::string _variantPath;
+    PathFilter::Verdict _variantVerdict;
+
+    PathFilter::Verdict extendPath(std::string& path, const char* name,
+                                   PathFilter::Verdict parent) {
+        path += ".";
+        path += name ? name : "unknown";
+        return _filter ? _filter->classify(path, parent) : PathFilter::Accept;
+    }
+
+public:
+    // bins are named from their handles, never from names()
+    static constexpr bool ContainerNames = false;
+
+    GroupCollector(covdbHandle design, GroupTable& table,
+                   const PathFilter* filter)
+            : UcapiWalker(design), _table(table), _filter(filter),
+              _variantVerdict(PathFilter::Accept) { }
+
+    bool acceptQualifiedInstance(covdbHandle inst, covdbHandle met) {
+        if (!_filter || !isTestbenchMetric(met)) return true;
+        return _filter->classify(std::string(names().regionFullName), _filter->root())
+                != PathFilter::Reject;
+    }
+
+    bool acceptVariant(covdbHandle var, covdbHandle met) {
+        if (!isTestbenchMetric(met)) return true;
+        const char* parName = "";
+        covdbHandle par = covdb_get_handle(var, covdbParent);
+        if (par) {
+            covdbObjTypesT pty = (covdbObjTypesT)covdb_get(par, NULL, NULL, covdbType);
+            parName = covdb_get_str(par, covdbSourceDefinition == pty ?
+                                         covdbName : covdbFullName);
+        }
+        _variantPath = parName ? parName : "";
+        _variantPath += ".";
+        _variantPath += names().regionName;
+        _variantVerdict = _filter ? _filter->classify(_variantPath, _filter->root())
+                                  : PathFilter::Accept;
+        return _variantVerdict != PathFilter::Reject;
+    }
+
+    /// Every coverpoint and cross of the variant, their containers and
+    /// the containers' bins
+    void startVariant(covdbHandle var, covdbHandle met) {
+        if (!isTestbenchMetric(met)) return;
+        covdbHandle cp, cps = covdb_iterate(var, covdbObjects);
+        while ((cp = covdb_scan(cps))) {
+            std::string cpPath = _variantPath;
+            PathFilter::Verdict cpVerdict =
+                    extendPath(cpPath, covdb_get_str(cp, covdbName), _variantVerdict);
+            if (cpVerdict == PathFilter::Reject) continue;
+            const char* ann = covdb_get_annotation(cp, IS_CROSS);
+            uint8_t isCross = ann && *ann == '1';
+
+            covdbHandle cont, conts = covdb_iterate(cp, covdbObjects);
+            if (!conts) continue;
+            while ((cont = covdb_scan(conts))) {
+                std::string contPath = cpPath;
+                PathFilter::Verdict contVerdict =
+                        extendPath(contPath, covdb_get_str(cont, covdbName), cpVerdict);
+                if (contVerdict == PathFilter::Reject) continue;
+                uint32_t contIndex = _table.intern(contPath);
+                int wt = covdb_get(cont, var, getTest(), covdbWeight);
+
+                covdbHandle bin, bins = covdb_iterate(cont, covdbObjects);
+                if (!bins) continue;
+                while ((bin = covdb_scan(bins))) {
+                    std::string binPath = contPath;
+                    if (extendPath(binPath, covdb_get_str(bin, covdbName),
+                                   contVerdict) != PathFilter::Accept) {
+                        continue;
+                    }
+                    _table.path.push_back(_table.intern(binPath));
+                    _table.container.push_back(contIndex);
+                    _table.covered.push_back(covdb_get(bin, var, getTest(), covdbCovered));
+                    _table.coverable.push_back(covdb_get(bin, var, getTest(), covdbCoverable));
+                    _table.count.push_back(covdb_get(bin, var, getTest(), covdbCovCount));
+                    _table.weight.push_back(wt);
+                    _table.cross.push_back(isCross);
+                    _table.id.push_back(objectId("cg:" + binPath));
+                }
+                covdb_release_handle(bins);
+            }
+            covdb_release_handle(conts);
+        }
+        covdb_release_handle(cps);
+    }
+};
+
+CovTable* collectGroups(covdbHandle design, const PathFilter* filter)
+{
+    covdb_qualified_configure(design, covdbShowGroupsInDesign, "1");
+    GroupTable* table = new GroupTable;
+    GroupCollector walker(design, *table, filter);
+    walker.execute();
+    table->finish();
+    return table;
+}
@@ -0,0 +1,104 @@
+/// Columnar coverage tables for the Python module.
+///
+/// A CovTable holds one row per coverable item as a set of typed arrays
+/// (one std::vector per column) plus an interned path table, so Python
+/// can wrap every column as a buffer without copying it.  Tables are
+/// filled by a traversal and never change afterwards; the column
+/// descriptors point straight into the vectors.
+///
+/// toggle tables have one row per toggle object of the instance view,
+/// in UCAPI order:
+///     signal     uint32   path index of <instance>.<signal>
+///     bit        uint32   bit of the signal (objects come in pairs)
+///     direction  uint8    0: 0 -> 1, 1: 1 -> 0
+///     status     uint8    0 covered, 1 excluded, 2 uncovered
+///     count      int64    hit count
+///     id         uint64   id of tgl:<signal>[<bit>]:<direction>
+///
+/// group tables have one row per top-level covergroup bin:
+///     path       uint32   path index of <variant>.<coverpoint>.<container>.<bin>
+///     container  uint32   path index of the bin's container
+///     covered    int32
+///     coverable  int32
+///     count      int64    hit count
+///     weight     int32    covdbWeight of the container
+///     cross      uint8    1 for bins of a cross
+///     id         uint64   id of cg:<path>
+///
+/// Paths and ids are those of the dumpers' snapshots (see covsnap).
+
+#ifndef COLLECT_HH
+#define COLLECT_HH
+
+#include "covdb_user.h"
+#include "pathfilter.hh"
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// A column: rows items of itemSize bytes each, described by a struct
+/// module format character
+struct TableColumn {
+    const char* name;
+    const char* format;
+    size_t itemSize;
+    const void* data;
+    size_t rows;
+};
+
+class CovTable {
+public:
+    explicit CovTable(const char* kind)
+            : _kind(kind), _rows(0), _pathOffsets(1, 0) { }
+    virtual ~CovTable() { }
+
+    const char* kind() const { return _kind; }
+    size_t rows() const { return _rows; }
+    const std::vector<TableColumn>& columns() const { return _columns; }
+
+    /// Path k of the path table
+    std::string_view path(size_t k) const {
+        return std::string_view(_pathData.data() + _pathOffsets[k],
+                                _pathOffsets[k + 1] - _pathOffsets[k] - 1);
+    }
+    size_t paths() const { return _pathOffsets.size() - 1; }
+
+    /// The path table itself: every path followed by a NUL, and the
+    /// offset of each path (plus one past the end)
+    TableColumn pathData() const;
+    TableColumn pathOffsets() const;
+
+protected:
+    const char* _kind;
+    size_t _rows;
+    std::vector<TableColumn> _columns;
+    std::string _pathData;
+    std::vector<uint64_t> _pathOffsets;
+    std::unordered_map<std::string, uint32_t> _pathIndex;
+
+    /// Index of path in the path table, adding it if new
+    uint32_t intern(const std::string& path);
+
+    template <class T>
+    void addColumn(const char* name, const char* format,
+                   const std::vector<T>& v) {
+        static const T none = T();
+        TableColumn col;
+        col.name = name;
+        col.format = format;
+        col.itemSize = sizeof(T);
+        col.data = v.empty() ? &none : v.data();
+        col.rows = v.size();
+        _columns.push_back(col);
+    }
+};
+
+/// Toggle coverage of the instance view of the design
+CovTable* collectToggles(covdbHandle design, const PathFilter* filter);
+
+/// Covergroup bins of the design
+CovTable* collectGroups(covdbHandle design, const PathFilter* filter);
+
+#endif
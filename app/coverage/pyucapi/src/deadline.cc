@@ -0,0 +1,85 @@
+/// Deadline-bounded extraction - see deadline.hh.
+
+#include "deadline.hh"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+
+static const char manifestHeader[] = "#covskip 1";
+static const char* kindNames[] = { "instance", "definition", "covergroup" };
+
+Deadline::Deadline()
+        : _set(false), _resuming(false)
+{
+}
+
+void Deadline::set(double seconds)
+{
+    _set = true;
+    _end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(seconds));
+}
+
+bool Deadline::resume(const std::string& file, std::string& err)
+{
+    std::ifstream in(file.c_str());
+    std::string line;
+    if (!in || !std::getline(in, line) || line != manifestHeader) {
+        err = file + ": not a skipped-units manifest";
+        return false;
+    }
+    while (std::getline(in, line)) {
+        if (!line.empty()) _resume.insert(line);
+    }
+    _resuming = true;
+    return true;
+}
+
+bool Deadline::expired() const
+{
+    return _set && Clock::now() >= _end;
+}
+
+Deadline::Admit Deadline::admit(Kind kind, const char* name, Admit parent)
+{
+    std::string key = kindNames[kind];
+    key += '\t';
+    key += name ? name : "";
+    if (parent != Walk && !_resume.count(key)) {
+        // not listed itself: an instance is passed through if units
+        // below it are
+        if (kind != Instance) return Skip;
+        std::string below = key + ".";
+        std::set<std::string>::const_iterator it = _resume.lower_bound(below);
+        bool listed = it != _resume.end() && !it->compare(0, below.size(), below);
+        return listed ? Through : Skip;
+    }
+    if (expired()) {
+        _skipped.push_back(key);
+        return Skip;
+    }
+    return Walk;
+}
+
+bool Deadline::writeManifest(const std::string& file, std::string& err) const
+{
+    std::string tmp = file + ".tmp." + std::to_string(getpid());
+    FILE* fp = fopen(tmp.c_str(), "w");
+    if (!fp) {
+        err = "cannot create " + tmp + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = fprintf(fp, "%s\n", manifestHeader) > 0;
+    for (size_t i = 0; ok && i < _skipped.size(); i++) {
+        ok = fprintf(fp, "%s\n", _skipped[i].c_str()) > 0;
+    }
+    ok = !fclose(fp) && ok;
+    if (!ok || rename(tmp.c_str(), file.c_str())) {
+        err = "cannot write " + file + ": " + strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
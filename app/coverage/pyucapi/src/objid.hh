@@ -0,0 +1,101 @@
+/// Stable 64-bit object identifiers.
+///
+/// An object's id is MurmurHash64A of its canonical name: a metric tag,
+/// the hierarchical path and the direction or bin name, e.g.
+///     tgl:top.u_cd.trk[2]:0->1
+///     cg:top.cg_inst.cp_mode.Automatically.auto[3]
+/// Input bytes are read little-endian regardless of host, so the same
+/// name hashes to the same id on every platform and in every run.
+
+#ifndef OBJID_HH
+#define OBJID_HH
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+inline uint64_t objectId(const char* s, size_t n)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const unsigned char* p = (const unsigned char*)s;
+    uint64_t h = 0x436f764f626a4964ULL ^ (n * m);
+
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t k = (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+                     (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+                     (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+                     (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (n) {
+        case 7: h ^= (uint64_t)p[6] << 48;  // fall through
+        case 6: h ^= (uint64_t)p[5] << 40;  // fall through
+        case 5: h ^= (uint64_t)p[4] << 32;  // fall through
+        case 4: h ^= (uint64_t)p[3] << 24;  // fall through
+        case 3: h ^= (uint64_t)p[2] << 16;  // fall through
+        case 2: h ^= (uint64_t)p[1] << 8;   // fall through
+        case 1: h ^= (uint64_t)p[0];
+                h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+inline uint64_t objectId(const std::string& name)
+{
+    return objectId(name.data(), name.size());
+}
+
+/// Fixed-width lowercase hex, the form ids take in JSON and snapshots,
+/// written to hex[0..15] (not NUL-terminated)
+inline void idToHex(uint64_t id, char* hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 15; i >= 0; i--, id >>= 4) hex[i] = digits[id & 0xf];
+}
+
+inline std::string idToHex(uint64_t id)
+{
+    std::string hex(16, '0');
+    idToHex(id, &hex[0]);
+    return hex;
+}
+
+/// An id together with the canonical name it was computed from
+struct IdName {
+    uint64_t id;
+    std::string name;
+
+    bool operator<(const IdName& o) const {
+        return id < o.id || (id == o.id && name < o.name);
+    }
+};
+
+/// Collision check pass: sort by id and report every id that is shared
+/// by two different canonical names.  Returns the number of collisions.
+inline size_t checkIdCollisions(std::vector<IdName>& ids, std::ostream& err)
+{
+    size_t collisions = 0;
+    std::sort(ids.begin(), ids.end());
+    for (size_t i = 1; i < ids.size(); i++) {
+        if (ids[i].id == ids[i - 1].id && ids[i].name != ids[i - 1].name) {
+            err << "Warning: id " << idToHex(ids[i].id) << " shared by '"
+                << ids[i - 1].name << "' and '" << ids[i].name << "'"
+                << std::endl;
+            collisions++;
+        }
+    }
+    return collisions;
+}
+
+#endif
@@ -0,0 +1,251 @@
+/// PathFilter - compiled include/exclude rules over hierarchical paths.
+/// See pathfilter.hh for the rule syntax.
+
+#include "pathfilter.hh"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+PathFilter::PathFilter()
+        : _nrules(0)
+{
+}
+
+/// Split a glob into the literal characters before its first wildcard
+/// (unescaped) and the remaining pattern text.
+static void splitGlob(const std::string& glob, std::string& prefix,
+                      std::string& tail)
+{
+    size_t i = 0;
+    prefix.clear();
+    while (i < glob.size()) {
+        char c = glob[i];
+        if (c == '*' || c == '?' || c == '[') break;
+        if (c == '\\') {
+            if (i + 1 >= glob.size()) break;
+            c = glob[++i];
+        }
+        prefix += c;
+        i++;
+    }
+    tail = glob.substr(i);
+}
+
+void PathFilter::GlobSet::add(const std::string& glob)
+{
+    std::string prefix, tail;
+    splitGlob(glob, prefix, tail);
+
+    int n = 0;
+    for (size_t i = 0; i < prefix.size(); i++) {
+        int next = child(n, prefix[i]);
+        if (next < 0) {
+            next = (int)nodes.size();
+            nodes.push_back(Node());
+            std::vector<std::pair<char, int> >& kids = nodes[n].next;
+            kids.insert(std::lower_bound(kids.begin(), kids.end(),
+                                         std::make_pair(prefix[i], 0)),
+                        std::make_pair(prefix[i], next));
+        }
+        n = next;
+    }
+    tails.push_back(tail);
+    nodes[n].globs.push_back((int)tails.size() - 1);
+}
+
+int PathFilter::GlobSet::child(int node, char c) const
+{
+    const std::vector<std::pair<char, int> >& kids = nodes[node].next;
+    std::vector<std::pair<char, int> >::const_iterator it =
+            std::lower_bound(kids.begin(), kids.end(), std::make_pair(c, 0));
+    if (it == kids.end() || it->first != c) return -1;
+    return it->second;
+}
+
+/// Walk the trie along path; only globs whose literal prefix matches the
+/// start of path are ever run through the wildcard matcher.
+bool PathFilter::GlobSet::match(const std::string& path) const
+{
+    int n = 0;
+    size_t i = 0;
+    for (;;) {
+        const std::vector<int>& globs = nodes[n].globs;
+        for (size_t g = 0; g < globs.size(); g++) {
+            if (globMatch(tails[globs[g]].c_str(), path.c_str() + i)) {
+                return true;
+            }
+        }
+        if (i == path.size()) return false;
+        n = child(n, path[i++]);
+        if (n < 0) return false;
+    }
+}
+
+/// Conservative test whether some descendant of path (path + ".")
+/// could match a glob in the set.
+bool PathFilter::GlobSet::mayMatchBelow(const std::string& path) const
+{
+    std::string below = path + ".";
+    int n = 0;
+    for (size_t i = 0; i < below.size(); i++) {
+        if (!nodes[n].globs.empty()) return true;
+        n = child(n, below[i]);
+        if (n < 0) return false;
+    }
+    return true;
+}
+
+bool PathFilter::globMatch(const char* pat, const char* str)
+{
+    while (*pat) {
+        if (pat[0] == '*' && pat[1] == '*') {
+            pat += 2;
+            for (const char* s = str; ; s++) {
+                if (globMatch(pat, s)) return true;
+                if (!*s) return false;
+            }
+        } else if (*pat == '*') {
+            pat++;
+            for (const char* s = str; ; s++) {
+                if (globMatch(pat, s)) return true;
+                if (!*s || *s == '.') return false;
+            }
+        } else if (*pat == '?') {
+            if (!*str || *str == '.') return false;
+            pat++;
+            str++;
+        } else if (*pat == '[' && strchr(pat + 2, ']')) {
+            const char* p = pat + 1;
+            bool negate = (*p == '!' || *p == '^');
+            if (negate) p++;
+            bool found = false;
+            // a ']' right after '[' or '[!' is a literal member
+            do {
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    if (*str >= p[0] && *str <= p[2]) found = true;
+                    p += 3;
+                } else {
+                    if (*str == *p) found = true;
+                    p++;
+                }
+            } while (*p && *p != ']');
+            if (!*p || !*str || found == negate) return false;
+            pat = p + 1;
+            str++;
+        } else {
+            if (*pat == '\\' && pat[1]) pat++;
+            if (*pat != *str) return false;
+            pat++;
+            str++;
+        }
+    }
+    return *str == 0;
+}
+
+/// Whether any of res is found in path.  Each is searched on its own:
+/// joined into one alternation they would renumber each other's groups
+/// and break backreferences.
+static bool searchAny(const std::vector<std::regex>& res, const std::string& path)
+{
+    for (size_t i = 0; i < res.size(); i++) {
+        if (std::regex_search(path, res[i])) return true;
+    }
+    return false;
+}
+
+bool PathFilter::load(const char* file, std::string& err)
+{
+    std::ifstream in(file);
+    if (!in) {
+        err = std::string("cannot open filter file ") + file;
+        return false;
+    }
+
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        size_t b = line.find_first_not_of(" \t\r");
+        if (b == std::string::npos || line[b] == '#') continue;
+        size_t e = line.find_last_not_of(" \t\r");
+        line = line.substr(b, e - b + 1);
+
+        bool include;
+        std::string pat;
+        if (line[0] == '+' || line[0] == '-') {
+            include = (line[0] == '+');
+            pat = line.substr(1);
+            pat.erase(0, pat.find_first_not_of(" \t"));
+        } else if (!line.compare(0, 8, "include ") ||
+                   !line.compare(0, 8, "exclude ")) {
+            include = (line[0] == 'i');
+            pat = line.substr(line.find_first_not_of(" \t", 8));
+        } else {
+            std::ostringstream os;
+            os << file << ":" << lineno
+               << ": expected 'include', 'exclude', '+' or '-'";
+            err = os.str();
+            return false;
+        }
+
+        bool re = !pat.compare(0, 3, "re:");
+        if (re) pat = pat.substr(3);
+        if (pat.empty()) {
+            std::ostringstream os;
+            os << file << ":" << lineno << ": missing pattern";
+            err = os.str();
+            return false;
+        }
+
+        if (re) {
+            try {
+                (include ? _includeRes : _excludeRes).push_back(
+                        std::regex(pat, std::regex::ECMAScript | std::regex::optimize));
+            } catch (const std::regex_error& ex) {
+                std::ostringstream os;
+                os << file << ":" << lineno << ": bad regex '" << pat
+                   << "': " << ex.what();
+                err = os.str();
+                return false;
+            }
+        } else {
+            (include ? _includeGlobs : _excludeGlobs).add(pat);
+        }
+        _nrules++;
+    }
+    return true;
+}
+
+bool PathFilter::hasIncludes() const
+{
+    return !_includeGlobs.tails.empty() || !_includeRes.empty();
+}
+
+bool PathFilter::included(const std::string& path) const
+{
+    return _includeGlobs.match(path) || searchAny(_includeRes, path);
+}
+
+bool PathFilter::excluded(const std::string& path) const
+{
+    return _excludeGlobs.match(path) || searchAny(_excludeRes, path);
+}
+
+PathFilter::Verdict PathFilter::root() const
+{
+    return hasIncludes() ? Maybe : Accept;
+}
+
+PathFilter::Verdict PathFilter::classify(const std::string& path,
+                                         Verdict parent) const
+{
+    if (parent == Reject || excluded(path)) return Reject;
+    if (parent == Accept || included(path)) return Accept;
+    // includes exist and none matched: keep descending only if one of
+    // them could still match further down, which a regex always could
+    if (!_includeRes.empty() || _includeGlobs.mayMatchBelow(path)) {
+        return Maybe;
+    }
+    return Reject;
+}
@@ -0,0 +1,337 @@
+/// pyucapi - VDB coverage as arrays for Python.
+///
+///     import numpy as np, pyucapi
+///     tgl = pyucapi.toggle("simv.vdb")
+///     status = np.asarray(tgl["status"])       # no copy
+///     holes = np.flatnonzero(status == 2)
+///     paths = tgl.paths()
+///
+/// toggle() and groups() walk the VDB once and return a Coverage table
+/// (see collect.hh for the columns).  Each column is a Column object
+/// exporting the table's own memory through the buffer protocol, so
+/// numpy.asarray(), memoryview() or anything else taking a buffer wraps
+/// it without a copy; columns keep their table alive.  The path table is
+/// exposed the same way (path_data, path_offsets), or decoded by paths().
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "collect.hh"
+#include "pathfilter.hh"
+#include <string>
+
+/// A table
+struct CoverageObject {
+    PyObject_HEAD
+    CovTable* table;
+    PyObject* paths;        // list of str, built by the first paths()
+};
+
+/// One column of a table, or of its path table
+struct ColumnObject {
+    PyObject_HEAD
+    PyObject* owner;        // the Coverage holding the data
+    TableColumn column;
+    Py_ssize_t shape;
+    Py_ssize_t stride;
+};
+
+static PyTypeObject CoverageType = { PyVarObject_HEAD_INIT(NULL, 0) };
+static PyTypeObject ColumnType = { PyVarObject_HEAD_INIT(NULL, 0) };
+
+// ---------------------------------------------------------------- Column
+
+static PyObject* newColumn(PyObject* owner, const TableColumn& column)
+{
+    ColumnObject* self = PyObject_New(ColumnObject, &ColumnType);
+    if (!self) return NULL;
+    Py_INCREF(owner);
+    self->owner = owner;
+    self->column = column;
+    self->shape = (Py_ssize_t)column.rows;
+    self->stride = (Py_ssize_t)column.itemSize;
+    return (PyObject*)self;
+}
+
+static void Column_dealloc(ColumnObject* self)
+{
+    Py_XDECREF(self->owner);
+    PyObject_Free(self);
+}
+
+/// Read-only, one-dimensional and contiguous
+static int Column_getbuffer(ColumnObject* self, Py_buffer* view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "coverage columns are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    view->buf = (void*)self->column.data;
+    view->obj = (PyObject*)self;
+    Py_INCREF(self);
+    view->len = self->shape * self->stride;
+    view->readonly = 1;
+    view->itemsize = self->stride;
+    view->format = (flags & PyBUF_FORMAT) ? (char*)self->column.format : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->stride : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+static Py_ssize_t Column_length(ColumnObject* self)
+{
+    return self->shape;
+}
+
+static PyObject* Column_repr(ColumnObject* self)
+{
+    return PyUnicode_FromFormat("<pyucapi.Column %s: %zd x '%s'>",
+                                self->column.name, self->shape,
+                                self->column.format);
+}
+
+static PyObject* Column_get_name(ColumnObject* self, void*)
+{
+    return PyUnicode_FromString(self->column.name);
+}
+
+static PyObject* Column_get_format(ColumnObject* self, void*)
+{
+    return PyUnicode_FromString(self->column.format);
+}
+
+static PyBufferProcs Column_as_buffer = {
+    (getbufferproc)Column_getbuffer, NULL
+};
+
+static PySequenceMethods Column_as_sequence = {
+    (lenfunc)Column_length
+};
+
+static PyGetSetDef Column_getset[] = {
+    { "name", (getter)Column_get_name, NULL, "column name", NULL },
+    { "format", (getter)Column_get_format, NULL,
+      "struct module format of an item", NULL },
+    { NULL }
+};
+
+// -------------------------------------------------------------- Coverage
+
+static PyObject* newCoverage(CovTable* table)
+{
+    CoverageObject* self = PyObject_New(CoverageObject, &CoverageType);
+    if (!self) {
+        delete table;
+        return NULL;
+    }
+    self->table = table;
+    self->paths = NULL;
+    return (PyObject*)self;
+}
+
+static void Coverage_dealloc(CoverageObject* self)
+{
+    Py_XDECREF(self->paths);
+    delete self->table;
+    PyObject_Free(self);
+}
+
+static Py_ssize_t Coverage_length(CoverageObject* self)
+{
+    return (Py_ssize_t)self->table->rows();
+}
+
+/// table["name"]: the column of that name
+static PyObject* Coverage_subscript(CoverageObject* self, PyObject* key)
+{
+    const char* name = PyUnicode_AsUTF8(key);
+    if (!name) return NULL;
+    const std::vector<TableColumn>& columns = self->table->columns();
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (!strcmp(columns[i].name, name)) {
+            return newColumn((PyObject*)self, columns[i]);
+        }
+    }
+    PyErr_SetObject(PyExc_KeyError, key);
+    return NULL;
+}
+
+static PyObject* Coverage_repr(CoverageObject* self)
+{
+    return PyUnicode_FromFormat("<pyucapi.Coverage %s: %zu rows, %zu paths>",
+                                self->table->kind(), self->table->rows(),
+                                self->table->paths());
+}
+
+/// The path table as a list of str, decoded once
+static PyObject* Coverage_paths(CoverageObject* self, PyObject*)
+{
+    if (!self->paths) {
+        size_t n = self->table->paths();
+        PyObject* list = PyList_New((Py_ssize_t)n);
+        if (!list) return NULL;
+        for (size_t k = 0; k < n; k++) {
+            std::string_view path = self->table->path(k);
+            PyObject* s = PyUnicode_DecodeUTF8(path.data(), (Py_ssize_t)path.size(),
+                                               "replace");
+            if (!s) {
+                Py_DECREF(list);
+                return NULL;
+            }
+            PyList_SET_ITEM(list, (Py_ssize_t)k, s);
+        }
+        self->paths = list;
+    }
+    Py_INCREF(self->paths);
+    return self->paths;
+}
+
+static PyObject* Coverage_get_kind(CoverageObject* self, void*)
+{
+    return PyUnicode_FromString(self->table->kind());
+}
+
+static PyObject* Coverage_get_columns(CoverageObject* self, void*)
+{
+    const std::vector<TableColumn>& columns = self->table->columns();
+    PyObject* names = PyTuple_New((Py_ssize_t)columns.size());
+    if (!names) return NULL;
+    for (size_t i = 0; i < columns.size(); i++) {
+        PyObject* s = PyUnicode_FromString(columns[i].name);
+        if (!s) {
+            Py_DECREF(names);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(names, (Py_ssize_t)i, s);
+    }
+    return names;
+}
+
+static PyObject* Coverage_get_path_data(CoverageObject* self, void*)
+{
+    return newColumn((PyObject*)self, self->table->pathData());
+}
+
+static PyObject* Coverage_get_path_offsets(CoverageObject* self, void*)
+{
+    return newColumn((PyObject*)self, self->table->pathOffsets());
+}
+
+static PyMappingMethods Coverage_as_mapping = {
+    (lenfunc)Coverage_length, (binaryfunc)Coverage_subscript, NULL
+};
+
+static PyMethodDef Coverage_methods[] = {
+    { "paths", (PyCFunction)Coverage_paths, METH_NOARGS,
+      "paths() -> list of str, indexed by the path columns" },
+    { NULL }
+};
+
+static PyGetSetDef Coverage_getset[] = {
+    { "kind", (getter)Coverage_get_kind, NULL, "'toggle' or 'group'", NULL },
+    { "columns", (getter)Coverage_get_columns, NULL, "column names", NULL },
+    { "path_data", (getter)Coverage_get_path_data, NULL,
+      "the paths, each followed by a NUL byte", NULL },
+    { "path_offsets", (getter)Coverage_get_path_offsets, NULL,
+      "offset of each path in path_data, plus the end", NULL },
+    { NULL }
+};
+
+// ---------------------------------------------------------------- module
+
+/// Load the VDB, collect one table and unload it again
+static PyObject* collect(PyObject* args, PyObject* kwargs, bool toggles)
+{
+    static const char* keywords[] = { "vdb", "filter", NULL };
+    const char* dir;
+    const char* filterFile = NULL;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s|z", (char**)keywords,
+                                     &dir, &filterFile)) {
+        return NULL;
+    }
+
+    PathFilter filter;
+    if (filterFile) {
+        std::string err;
+        if (!filter.load(filterFile, err)) {
+            PyErr_SetString(PyExc_ValueError, err.c_str());
+            return NULL;
+        }
+    }
+
+    covdbHandle design = covdb_load(covdbDesign, NULL, dir);
+    if (!design) {
+        PyErr_Format(PyExc_OSError, "could not open design in directory %s", dir);
+        return NULL;
+    }
+    const PathFilter* f = filter.empty() ? NULL : &filter;
+    // UCAPI is not thread-safe, so the GIL is kept while it runs
+    CovTable* table = toggles ? collectToggles(design, f) : collectGroups(design, f);
+    covdb_unload(design);
+    return newCoverage(table);
+}
+
+static PyObject* pyucapi_toggle(PyObject*, PyObject* args, PyObject* kwargs)
+{
+    return collect(args, kwargs, true);
+}
+
+static PyObject* pyucapi_groups(PyObject*, PyObject* args, PyObject* kwargs)
+{
+    return collect(args, kwargs, false);
+}
+
+static PyMethodDef pyucapi_methods[] = {
+    { "toggle", (PyCFunction)(void(*)(void))pyucapi_toggle,
+      METH_VARARGS | METH_KEYWORDS,
+      "toggle(vdb, filter=None) -> Coverage of every toggle object" },
+    { "groups", (PyCFunction)(void(*)(void))pyucapi_groups,
+      METH_VARARGS | METH_KEYWORDS,
+      "groups(vdb, filter=None) -> Coverage of every covergroup bin" },
+    { NULL }
+};
+
+static PyModuleDef pyucapi_module = {
+    PyModuleDef_HEAD_INIT, "pyucapi",
+    "VDB coverage as zero-copy arrays", -1, pyucapi_methods
+};
+
+PyMODINIT_FUNC PyInit_pyucapi(void)
+{
+    ColumnType.tp_name = "pyucapi.Column";
+    ColumnType.tp_basicsize = sizeof(ColumnObject);
+    ColumnType.tp_dealloc = (destructor)Column_dealloc;
+    ColumnType.tp_repr = (reprfunc)Column_repr;
+    ColumnType.tp_as_sequence = &Column_as_sequence;
+    ColumnType.tp_as_buffer = &Column_as_buffer;
+    ColumnType.tp_flags = Py_TPFLAGS_DEFAULT;
+    ColumnType.tp_doc = "A read-only column exporting the buffer protocol";
+    ColumnType.tp_getset = Column_getset;
+
+    CoverageType.tp_name = "pyucapi.Coverage";
+    CoverageType.tp_basicsize = sizeof(CoverageObject);
+    CoverageType.tp_dealloc = (destructor)Coverage_dealloc;
+    CoverageType.tp_repr = (reprfunc)Coverage_repr;
+    CoverageType.tp_as_mapping = &Coverage_as_mapping;
+    CoverageType.tp_flags = Py_TPFLAGS_DEFAULT;
+    CoverageType.tp_doc = "Coverage of one metric, one row per item";
+    CoverageType.tp_methods = Coverage_methods;
+    CoverageType.tp_getset = Coverage_getset;
+
+    if (PyType_Ready(&ColumnType) < 0 || PyType_Ready(&CoverageType) < 0) {
+        return NULL;
+    }
+    PyObject* m = PyModule_Create(&pyucapi_module);
+    if (!m) return NULL;
+    Py_INCREF(&ColumnType);
+    Py_INCREF(&CoverageType);
+    if (PyModule_AddObject(m, "Column", (PyObject*)&ColumnType) < 0 ||
+        PyModule_AddObject(m, "Coverage", (PyObject*)&CoverageType) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
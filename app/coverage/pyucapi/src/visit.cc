@@ -0,0 +1,283 @@
+/******************************************************************
+ *   Copyright (c) 2016 by Synopys Inc. - All Rights Reserved     *
+ *              VCS is a trademark of Synopsys Inc.               *
+ *                                                                *
+ *    CONFIDENTIAL AND PROPRIETARY INFORMATION OF SYNOPSYS INC.   *
+ ******************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <utility>
+#include "covdb_user.h"
+#include "visit.hh"
+
+UcapiBase::UcapiBase(covdbHandle design)
+        : _design(design), _instDepth(0), _topAdmit(Deadline::Walk)
+{
+    /* load and merge all tests found in the design */
+    _test = loadTests(_design, availableTests(_design));
+}
+
+UcapiBase::UcapiBase(covdbHandle design, covdbHandle test)
+        : _design(design), _test(test), _instDepth(0),
+          _topAdmit(Deadline::Walk)
+{
+}
+
+std::vector<std::string> UcapiBase::availableTests(covdbHandle design)
+{
+    std::vector<std::string> names;
+    covdbHandle tns, tn;
+    tns = covdb_iterate(design, covdbAvailableTests);
+    while((tn = covdb_scan(tns))) {
+        const char* name = covdb_get_str(tn, covdbName);
+        if (name) names.push_back(name);
+    }
+    covdb_release_handle(tns);
+    return names;
+}
+
+covdbHandle UcapiBase::loadTests(covdbHandle design,
+                                 const std::vector<std::string>& names)
+{
+    if (names.empty()) return NULL;
+    if (_progress) _progress->tests(0, names.size());
+    covdbHandle test = covdb_load(covdbTest, design, names[0].c_str());
+    for (size_t i = 1; i < names.size(); i++) {
+        if (_progress) _progress->tests(i, names.size());
+        test = covdb_loadmerge(covdbTest, test, names[i].c_str());
+    }
+    if (_progress) _progress->tests(names.size(), names.size());
+    return test;
+}
+
+void UcapiBase::installErrorCallback(covdbErrorCB cbf)
+{
+    /* register error callback function */
+    if (cbf)
+        // Use function passed to execute
+        covdb_set_error_callback(cbf, NULL);
+    else if (_errorCallback) 
+        // Use function specified at constructor time
+        covdb_set_error_callback(_errorCallback, NULL);
+    else
+        // Use default
+        covdb_set_error_callback(errorCB, NULL);
+}
+
+size_t UcapiBase::countUnits(bool regions, bool groups)
+{
+    size_t n = 0;
+    covdbHandle h, hs;
+    if (regions) {
+        covdbHandle inst, insts = covdb_iterate(_design, covdbInstances);
+        while((inst = covdb_scan(insts))) {
+            n++;
+            hs = covdb_iterate(inst, covdbInstances);
+            while((h = covdb_scan(hs))) n++;
+            covdb_release_handle(hs);
+        }
+        covdb_release_handle(insts);
+        hs = covdb_iterate(_design, covdbDefinitions);
+        while((h = covdb_scan(hs))) n++;
+        covdb_release_handle(hs);
+    }
+    if (groups && _test) {
+        covdbHandle met, mets = covdb_iterate(_test, covdbMetrics);
+        while((met = covdb_scan(mets))) {
+            if (!isTestbenchMetric(met)) continue;
+            hs = covdb_qualified_iterate(_test, met, covdbDefinitions);
+            while((h = covdb_scan(hs))) n++;
+            covdb_release_handle(hs);
+        }
+        covdb_release_handle(mets);
+    }
+    return n;
+}
+
+/// Number of instances in the subtree of inst, itself included
+static size_t subtreeSize(covdbHandle inst)
+{
+    size_t n = 1;
+    covdbHandle kid, kids = covdb_iterate(inst, covdbInstances);
+    while((kid = covdb_scan(kids))) n += subtreeSize(kid);
+    covdb_release_handle(kids);
+    return n;
+}
+
+/// The handles of costed, cheapest first; ties keep UCAPI order
+static std::vector<covdbHandle> byCost(std::vector<std::pair<size_t, covdbHandle> >& costed)
+{
+    std::stable_sort(costed.begin(), costed.end(),
+                     [](const std::pair<size_t, covdbHandle>& a,
+                        const std::pair<size_t, covdbHandle>& b) {
+        return a.first < b.first;
+    });
+    std::vector<covdbHandle> order;
+    for (size_t i = 0; i < costed.size(); i++) order.push_back(costed[i].second);
+    return order;
+}
+
+std::vector<covdbHandle> UcapiBase::instancesByCost(covdbHandle parent)
+{
+    std::vector<std::pair<size_t, covdbHandle> > costed;
+    covdbHandle kid, kids = covdb_iterate(parent, covdbInstances);
+    while((kid = covdb_scan(kids))) {
+        costed.push_back(std::make_pair(subtreeSize(kid),
+                                        covdb_make_persistent_handle(kid)));
+    }
+    covdb_release_handle(kids);
+    return byCost(costed);
+}
+
+std::vector<covdbHandle> UcapiBase::covergroupsByCost(covdbHandle met)
+{
+    std::vector<std::pair<size_t, covdbHandle> > costed;
+    covdbHandle grp, grps = covdb_qualified_iterate(_test, met, covdbDefinitions);
+    while((grp = covdb_scan(grps))) {
+        size_t n = 0;
+        covdbHandle var, vars = covdb_qualified_iterate(grp, met, covdbDefinitions);
+        while((var = covdb_scan(vars))) {
+            n++;
+            covdbHandle inst, insts = covdb_iterate(var, covdbInstances);
+            while((inst = covdb_scan(insts))) n++;
+            covdb_release_handle(insts);
+        }
+        covdb_release_handle(vars);
+        costed.push_back(std::make_pair(n, covdb_make_persistent_handle(grp)));
+    }
+    covdb_release_handle(grps);
+    return byCost(costed);
+}
+
+unsigned UcapiBase::metricBit(covdbHandle met)
+{
+    if (isLineMetric(met)) return LineMetric;
+    if (isCondMetric(met)) return CondMetric;
+    if (isFsmMetric(met)) return FsmMetric;
+    if (isToggleMetric(met)) return ToggleMetric;
+    if (isBranchMetric(met)) return BranchMetric;
+    if (isAssertMetric(met)) return AssertMetric;
+    if (isTestbenchMetric(met)) return TestbenchMetric;
+    return 0;
+}
+
+/*
+ * Name cache: region names are looked up once per qualified region,
+ * container names once per container, instead of once per object.
+ * Only the names of containers directly above objects matter, but
+ * looking them up per container is cheap next to per-object lookups.
+ * Walkers that read neither skip the lookups; progress still needs the
+ * region's full name.
+ */
+static const char* nameOf(covdbHandle obj, bool full)
+{
+    const char* name = covdb_get_str(obj, full ? covdbFullName : covdbName);
+    return name ? name : "";
+}
+
+void UcapiBase::enterRegion(covdbHandle region, bool names)
+{
+    _containerNames.clear();
+    _names = ObjectNames();
+    if (names) {
+        _regionName = nameOf(region, false);
+        _regionFullName = nameOf(region, true);
+        _names.regionName = _regionName;
+        _names.regionFullName = _regionFullName;
+    } else if (_progress) {
+        _regionFullName = nameOf(region, true);
+    }
+    if (_progress) _progress->region(_regionFullName);
+}
+
+void UcapiBase::enterContainer(covdbHandle obj)
+{
+    _containerNames.push_back(nameOf(obj, false));
+    _containerNames.push_back(nameOf(obj, true));
+    _names.parentName = _containerNames[_containerNames.size() - 2];
+    _names.parentFullName = _containerNames.back();
+}
+
+void UcapiBase::leaveContainer()
+{
+    _containerNames.pop_back();
+    _containerNames.pop_back();
+    if (_containerNames.empty()) {
+        _names.parentName = std::string_view();
+        _names.parentFullName = std::string_view();
+    } else {
+        _names.parentName = _containerNames[_containerNames.size() - 2];
+        _names.parentFullName = _containerNames.back();
+    }
+}
+
+covdbErrorCB UcapiBase::_errorCallback = NULL;
+Progress* UcapiBase::_progress = NULL;
+Deadline* UcapiBase::_deadline = NULL;
+
+/*
+ * callback function we register with UCAPI for errors
+ */
+void UcapiBase::errorCB(covdbHandle errHdl, void *data)
+{
+    int errcode = covdb_get(errHdl, NULL, NULL, covdbValue);
+    if (covdbInvalidPropertyError == errcode ||
+        covdbNotImplementedError == errcode ||
+        covdbInvalidRelationError == errcode)
+    {
+        /* There are some unimplemented properties that return errors,
+           such as covdbLineNo on condition coverage, which we ignore */
+        ;
+    } else {
+        if (_errorCallback) {
+            (_errorCallback)(errHdl, data);
+        } else {
+            fprintf(stderr, "Error occurred: %s\n",
+                    covdb_get_str(errHdl, covdbName));
+            exit(1);
+        }
+    }
+}
+
+const char* UcapiBase::ucapiObjTypeName(covdbHandle obj, covdbHandle reg) 
+{
+    const char* res = NULL;
+    if (!obj || !reg) return "Null handle";
+
+    covdbObjTypesT ty = (covdbObjTypesT)covdb_get(obj, reg, NULL, covdbType);
+    switch(ty) {
+        case covdbNullHandle: res = "covdbNullHandle"; break;
+        case covdbInternal: res = "covdbInternal"; break;
+        case covdbDesign: res = "covdbDesign"; break;
+        case covdbIterator: res = "covdbIterator"; break;
+        case covdbContainer: res = "covdbContainer"; break;
+        case covdbMetric: res = "covdbMetric"; break;
+        case covdbSourceInstance: res = "covdbSourceInstance"; break;
+        case covdbSourceDefinition: res = "covdbSourceDefinition"; break;
+        case covdbBlock: res = "covdbBlock"; break;
+        case covdbIntegerValue: res = "covdbIntegerValue"; break;
+        case covdbScalarValue: res = "covdbScalarValue"; break;
+        case covdbVectorValue: res = "covdbVectorValue"; break;
+        case covdbIntervalValue: res = "covdbIntervalValue"; break;
+        case covdbBDDValue: res = "covdbBDDValue"; break;
+        case covdbCross: res = "covdbCross"; break;
+        case covdbSequence: res = "covdbSequence"; break;
+        case covdbAnnotation: res = "covdbAnnotation"; break;
+        case covdbTest: res = "covdbTest"; break;
+        case covdbTestName: res = "covdbTestName"; break;
+        case covdbInterval: res = "covdbInterval"; break;
+        case covdbExcludeFile: res = "covdbExcludeFile"; break;
+        case covdbHierFile: res = "covdbHierFile"; break;
+        case covdbEditFile: res = "covdbEditFile"; break;
+        case covdbBDD: res = "covdbBDD"; break;
+        case covdbError: res = "covdbError"; break;
+        case covdbTable: res = "covdbTable"; break;
+        case covdbValueSet: res = "covdbValueSet"; break;
+        case covdbSBNRange: res = "covdbSBNRange"; break;
+        case covdbTestInfo: res = "covdbTestInfo"; break;
+        default: res = "unknown?"; break;
+    }
+    return res;
+}
@@ -0,0 +1,701 @@
+/******************************************************************
+ *   Copyright (c) 2015 by Synopys Inc. - All Rights Reserved     *
+ *              VCS is a trademark of Synopsys Inc.               *
+ *                                                                *
+ *    CONFIDENTIAL AND PROPRIETARY INFORMATION OF SYNOPSYS INC.   *
+ ******************************************************************/
+
+#ifndef VISIT_HH
+#define VISIT_HH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "covdb_user.h"
+#include "progress.hh"
+#include "deadline.hh"
+
+/// Names of the region and the enclosing container of a coverable
+/// object.  They are the same for every object of a region/container, so
+/// the visitor resolves them once when the region or container is
+/// entered rather than once per object.  The views stay valid until the
+/// region or container is finished.  A walker that never reads region or
+/// container names turns their lookups off (see UcapiWalker::RegionNames
+/// and ContainerNames); they are then empty.
+struct ObjectNames {
+    std::string_view regionName;
+    std::string_view regionFullName;
+    std::string_view parentName;       // empty directly under the region
+    std::string_view parentFullName;
+};
+
+/// Metrics a traversal can be restricted to, as a bit set
+enum UcapiMetrics {
+    LineMetric      = 1 << 0,
+    CondMetric      = 1 << 1,
+    FsmMetric       = 1 << 2,
+    ToggleMetric    = 1 << 3,
+    BranchMetric    = 1 << 4,
+    AssertMetric    = 1 << 5,
+    TestbenchMetric = 1 << 6,
+    AllMetrics      = (1 << 7) - 1
+};
+
+/// State and helpers shared by every traversal: the design and merged
+/// test handles, error handling and the name cache.
+class UcapiBase {
+protected:
+    covdbHandle _design;
+    covdbHandle _test;
+    static covdbErrorCB _errorCallback;
+    static Progress* _progress;
+    static Deadline* _deadline;
+    int _instDepth;             // unqualified instances open
+    Deadline::Admit _topAdmit;  // how the open top instance is walked
+
+    // names of the current region and of each open container, innermost
+    // last; a deque keeps the strings (and views into them) in place
+    std::string _regionName;
+    std::string _regionFullName;
+    std::deque<std::string> _containerNames;
+    ObjectNames _names;
+
+    void enterRegion(covdbHandle region, bool names);
+    void enterContainer(covdbHandle obj);
+    void leaveContainer();
+
+    /// Register the error callback for execute()
+    void installErrorCallback(covdbErrorCB cbf);
+
+    /// The UcapiMetrics bit of met (0 for deprecated path coverage)
+    static unsigned metricBit(covdbHandle met);
+
+    /// Units of progress of a walk: each top instance and each of its
+    /// children, and with regions each definition; with groups each
+    /// covergroup
+    size_t countUnits(bool regions, bool groups);
+
+    /// Persistent handles of the child instances of parent (an instance
+    /// or the design), fewest instances below them first
+    static std::vector<covdbHandle> instancesByCost(covdbHandle parent);
+
+    /// Persistent handles of the covergroups of met in _test, fewest
+    /// instances first
+    std::vector<covdbHandle> covergroupsByCost(covdbHandle met);
+
+public:
+    /// Constructor that takes an already-loaded design handle.
+    /// Will automatically load/merge all available tests from the design.
+    UcapiBase(covdbHandle design);
+
+    /// Constructor that takes already-loaded design and test handles.
+    UcapiBase(covdbHandle design, covdbHandle test);
+
+    /// Names of the tests in design, in covdbAvailableTests order
+    static std::vector<std::string> availableTests(covdbHandle design);
+
+    /// Load the named tests of design merged into one test handle, or
+    /// NULL if names is empty.  Only these tests are read.
+    static covdbHandle loadTests(covdbHandle design,
+                                 const std::vector<std::string>& names);
+
+    /// If an error is detected, and this is set, it will be called
+    /// after UcapiVisitor filters known ignore-able errors
+    void setErrorCallback(covdbErrorCB errfn) {
+        _errorCallback = errfn;
+    }
+
+    /// Report test merging and traversal to progress (NULL: don't)
+    static void setProgress(Progress* progress) {
+        _progress = progress;
+    }
+
+    /// Walk units cheapest first and only as deadline admits them
+    /// (NULL: walk everything in UCAPI order)
+    static void setDeadline(Deadline* deadline) {
+        _deadline = deadline;
+    }
+
+    covdbHandle getDesign() { return _design; }
+    covdbHandle getTest() { return _test; }
+
+    /// Cached names for the region and innermost container being
+    /// visited.  In accept/start/finishContainer the container itself is
+    /// the parent.
+    const ObjectNames& names() const { return _names; }
+
+    // Error handler - will be used by default, or user can invoke
+    // after checking for special error conditions in their own
+    // callback first
+    static void errorCB(covdbHandle errHdl, void *data);
+
+    static const char* ucapiObjTypeName(covdbHandle obj, covdbHandle reg);
+};
+
+/// Compile-time specialized traversal engine.
+///
+/// Derived inherits from UcapiWalker<Derived, Metrics> and declares the
+/// hooks it needs, with the same signatures as below, as ordinary
+/// (non-virtual) public members.  Whether Derived declares a hook is
+/// detected at compile time: hooks it does not declare are never called,
+/// and metrics outside Metrics are skipped along with every branch that
+/// only serves them.  See UcapiVisitor for what each hook is called for.
+template <class Derived, unsigned Metrics = AllMetrics>
+class UcapiWalker : public UcapiBase {
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
+    /// True when Derived declares its own version of a hook, i.e. the
+    /// member pointer types differ from the default's
+    template <class A, class B>
+    static constexpr bool overrides(A, B) {
+        return !std::is_same<A, B>::value;
+    }
+
+    void recurseIntoObjects(covdbHandle obj, covdbHandle qinst,
+                            covdbHandle met, covdbHandle parent);
+    void recurseIntoObjectsInUnqualifiedInst(covdbHandle inst);
+    void recurseIntoObjectsInUnqualifiedDef(covdbHandle def);
+    void recurseIntoCovergroup(covdbHandle grp, covdbHandle met);
+    void recurseIntoObjectsInQualifiedRegion(covdbHandle region,
+                                             covdbHandle met,
+                                             covdbObjTypesT ty);
+    void coverableObject(covdbHandle obj, covdbHandle region,
+                         covdbHandle met, covdbHandle parent);
+
+    /// Metrics iterated per instance/definition (the test-qualified ones
+    /// are visited from the test handle)
+    static constexpr unsigned RegionMetrics =
+            Metrics & ~(AssertMetric | TestbenchMetric);
+
+public:
+    UcapiWalker(covdbHandle design) : UcapiBase(design) { }
+    UcapiWalker(covdbHandle design, covdbHandle test)
+            : UcapiBase(design, test) { }
+
+    /// Whether names() is kept up to date with the region and container
+    /// names, two string lookups per region and per container.  Derived
+    /// that never reads them declares its own, e.g.
+    ///     static constexpr bool ContainerNames = false;
+    static constexpr bool RegionNames = true;
+    static constexpr bool ContainerNames = true;
+
+    // Default hooks: no-ops that are never called
+    void startInstance(covdbHandle inst) { }
+    void finishInstance(covdbHandle inst) { }
+    void startQualifiedInstance(covdbHandle inst, covdbHandle met) { }
+    void finishQualifiedInstance(covdbHandle inst, covdbHandle met) { }
+    void startDefinition(covdbHandle var) { }
+    void finishDefinition(covdbHandle var) { }
+    void startVariant(covdbHandle var, covdbHandle met) { }
+    void finishVariant(covdbHandle var, covdbHandle met) { }
+    bool acceptInstance(covdbHandle inst) { return true; }
+    bool acceptQualifiedInstance(covdbHandle inst, covdbHandle met) { return true; }
+    bool acceptDefinition(covdbHandle def) { return true; }
+    bool acceptVariant(covdbHandle var, covdbHandle met) { return true; }
+    bool acceptContainer(covdbHandle obj, covdbHandle region,
+                         covdbHandle metric, covdbHandle parent) { return true; }
+    void startContainer(covdbHandle obj, covdbHandle region,
+                        covdbHandle metric, covdbHandle parent) { }
+    void finishContainer(covdbHandle obj, covdbHandle region,
+                         covdbHandle metric, covdbHandle parent) { }
+    void visitLeafObject(covdbHandle obj, covdbHandle region,
+                         covdbHandle metric, covdbHandle parent) { }
+    void visitCovObject(covdbHandle obj, covdbHandle region,
+                        covdbHandle metric, covdbHandle parent) { }
+    void visitNamedCovObject(covdbHandle obj, covdbHandle region,
+                             covdbHandle metric, covdbHandle parent,
+                             const ObjectNames& names) { }
+
+    // Call this function to iterate the design
+    void execute(covdbErrorCB cbf=NULL);
+};
+
+// Call Derived's hook if it has one.  The condition is a constant, so
+// calls to hooks Derived does not declare are compiled out.
+#define UCAPI_HOOK(hook, ...) \
+    do { \
+        if constexpr (overrides(&Derived::hook, &UcapiWalker::hook)) { \
+            derived().hook(__VA_ARGS__); \
+        } \
+    } while (0)
+
+// Ask Derived's accept hook; true when it has none
+#define UCAPI_ACCEPT(hook, ...) \
+    (!overrides(&Derived::hook, &UcapiWalker::hook) || \
+     derived().hook(__VA_ARGS__))
+
+template <class Derived, unsigned Metrics>
+void UcapiWalker<Derived, Metrics>::execute(covdbErrorCB cbf)
+{
+    covdb_configure(covdbDisplayErrors, (char*)"false");
+    installErrorCallback(cbf);
+    if (_progress) {
+        _progress->phase("walk");
+        _progress->units(countUnits(RegionMetrics != 0, Metrics & TestbenchMetric));
+    }
+
+    if constexpr (RegionMetrics != 0) {
+        covdbHandle inst, insts;
+        covdbHandle def, defs;
+
+        /* iterate through all top instances in the design */
+        if (_deadline) {
+            std::vector<covdbHandle> order = instancesByCost(_design);
+            for (size_t i = 0; i < order.size(); i++) {
+                recurseIntoObjectsInUnqualifiedInst(order[i]);
+                covdb_release_handle(order[i]);
+            }
+        } else {
+            insts = covdb_iterate(_design, covdbInstances);
+            while((inst = covdb_scan(insts))) {
+                recurseIntoObjectsInUnqualifiedInst(inst);
+            }
+            covdb_release_handle(insts);
+        }
+
+        /* iterate through all definitions in the design */
+        defs = covdb_iterate(_design, covdbDefinitions);
+        while((def = covdb_scan(defs))) {
+            recurseIntoObjectsInUnqualifiedDef(def);
+        }
+        covdb_release_handle(defs);
+    }
+
+    if constexpr ((Metrics & (AssertMetric | TestbenchMetric)) == 0) {
+        return;
+    }
+
+    /* Find the group and assertion metrics if they are present in _test */
+    covdbHandle met, mets;
+    covdbHandle tbMet = NULL, astMet = NULL;
+    mets = covdb_iterate(_test, covdbMetrics);
+    while((met = covdb_scan(mets))) {
+        if ((Metrics & TestbenchMetric) && isTestbenchMetric(met)) {
+            tbMet = covdb_make_persistent_handle(met);
+        } else if ((Metrics & AssertMetric) && isAssertMetric(met)) {
+            astMet = covdb_make_persistent_handle(met);
+        }
+    }
+
+    /* iterate through assertions from the test handle.  We could do this
+     * from the instances or modules, but then we'd miss assertions in the
+     * root scope
+     */
+    if (astMet) {
+        covdbHandle ast, asts =
+                covdb_qualified_iterate(_test, astMet, covdbObjects);
+        while((ast = covdb_scan(asts))) {
+            covdbHandle parent = covdb_get_handle(ast, covdbParent);
+            covdbHandle blk, blks = covdb_iterate(ast, covdbObjects);
+            while((blk = covdb_scan(blks))) {
+                const char* blkname = covdb_get_str(blk, covdbName);
+                /* find the block name corresponding to covered/success */
+                if (!strcmp(blkname, "realsuccesses") ||
+                    !strcmp(blkname, "allsuccesses"))
+                {
+                    if constexpr (overrides(&Derived::visitNamedCovObject,
+                                            &UcapiWalker::visitNamedCovObject)) {
+                        enterRegion(parent, Derived::RegionNames);
+                    }
+                    coverableObject(blk, parent, astMet, ast);
+                    break;
+                }
+            }
+            covdb_release_handle(blks);
+        }
+        covdb_release_handle(asts);
+    }
+
+    /* iterate through covergroups */
+    if (tbMet) {
+        covdbHandle grp, grps;
+        if (_deadline) {
+            std::vector<covdbHandle> order = covergroupsByCost(tbMet);
+            for (size_t i = 0; i < order.size(); i++) {
+                recurseIntoCovergroup(order[i], tbMet);
+                covdb_release_handle(order[i]);
+            }
+        } else {
+            grps = covdb_qualified_iterate(_test, tbMet, covdbDefinitions);
+            while((grp = covdb_scan(grps))) {
+                grp = covdb_make_persistent_handle(grp);
+                recurseIntoCovergroup(grp, tbMet);
+                covdb_release_handle(grp);
+            }
+            covdb_release_handle(grps);
+        }
+        covdb_release_handle(tbMet);
+    }
+}
+
+/// Every variant of the covergroup grp and every instance of those
+template <class Derived, unsigned Metrics>
+void UcapiWalker<Derived, Metrics>::recurseIntoCovergroup(
+        covdbHandle grp, covdbHandle tbMet)
+{
+    if (_deadline &&
+        _deadline->admit(Deadline::Covergroup, covdb_get_str(grp, covdbName),
+                         _deadline->start()) == Deadline::Skip) {
+        if (_progress) _progress->unitDone();
+        return;
+    }
+
+    /* Iterate through grp's variants */
+    covdbHandle var, vars =
+            covdb_qualified_iterate(grp, tbMet, covdbDefinitions);
+    while((var = covdb_scan(vars))) {
+        var = covdb_make_persistent_handle(var);
+
+        /* recurse into covergroup contents */
+        recurseIntoObjectsInQualifiedRegion(var, tbMet,
+                                            covdbSourceDefinition);
+
+        /* recurse into instances of this variant */
+        covdbHandle inst, insts = covdb_iterate(var, covdbInstances);
+        while((inst = covdb_scan(insts))) {
+            inst = covdb_make_persistent_handle(inst);
+            recurseIntoObjectsInQualifiedRegion(inst, tbMet,
+                                                covdbSourceInstance);
+            covdb_release_handle(inst);
+        }
+        covdb_release_handle(var);
+    }
+    if (_progress) _progress->unitDone();
+}
+
+/// Hand a coverable object to whichever of visitNamedCovObject and
+/// visitCovObject Derived implements
+template <class Derived, unsigned Metrics>
+inline void UcapiWalker<Derived, Metrics>::coverableObject(
+        covdbHandle obj, covdbHandle region, covdbHandle met,
+        covdbHandle parent)
+{
+    if (_progress) _progress->object();
+    if constexpr (overrides(&Derived::visitNamedCovObject,
+                            &UcapiWalker::visitNamedCovObject)) {
+        derived().visitNamedCovObject(obj, region, met, parent, _names);
+    } else {
+        UCAPI_HOOK(visitCovObject, obj, region, met, parent);
+    }
+}
+
+/*
+ * If obj is a coverable object, assign it a code number.  If it's
+ * a container, recurse into its list of contained objects.
+ */
+template <class Derived, unsigned Metrics>
+void UcapiWalker<Derived, Metrics>::recurseIntoObjects(
+        covdbHandle obj, covdbHandle qinst, covdbHandle met,
+        covdbHandle parent)
+{
+    covdbObjTypesT ty = (covdbObjTypesT)covdb_get(obj, qinst, NULL, covdbType);
+
+    switch(ty) {
+        case covdbBlock:
+        case covdbSequence:
+        case covdbCross:
+        case covdbIntegerValue:
+        case covdbScalarValue:
+        case covdbValueSet:
+            UCAPI_HOOK(visitLeafObject, obj, qinst, met, parent);
+            if (!(Metrics & LineMetric) || !isLineMetric(met)) {
+                coverableObject(obj, qinst, met, parent);
+            }
+            break;
+
+        case covdbContainer:
+            {
+                if (!UCAPI_ACCEPT(acceptContainer, obj, qinst, met, parent)) {
+                    break;
+                }
+
+                obj = covdb_make_persistent_handle(obj);
+
+                if constexpr (Derived::ContainerNames) enterContainer(obj);
+                UCAPI_HOOK(startContainer, obj, qinst, met, parent);
+
+                covdbHandle kids, kid;
+                kids = covdb_iterate(obj, covdbObjects);
+                kid = covdb_scan(kids);
+
+                if ((Metrics & AssertMetric) && isAssertMetric(met)) {
+                    // These are visited from the test handle
+                } else {
+                    // Recurse into kids
+                    if constexpr ((Metrics & LineMetric) != 0) {
+                        if (kid && isLineMetric(met)) {
+                            covdbObjTypesT kty = (covdbObjTypesT)
+                                    covdb_get(kid, qinst, NULL, covdbType);
+                            if (covdbBlock == kty) {
+                                coverableObject(obj, qinst, met, parent);
+                            }
+                        }
+                    }
+
+                    while(kid) {
+                        recurseIntoObjects(kid, qinst, met, obj);
+                        kid = covdb_scan(kids);
+                    }
+                }
+                UCAPI_HOOK(finishContainer, obj, qinst, met, parent);
+                if constexpr (Derived::ContainerNames) leaveContainer();
+                covdb_release_handle(kids);
+                covdb_release_handle(obj);
+            }
+            break;
+
+        default:
+            printf("Error: unrecognized object type %d\n", ty);
+            break;
+    }
+}
+
+template <class Derived, unsigned Metrics>
+void UcapiWalker<Derived, Metrics>::recurseIntoObjectsInQualifiedRegion(
+        covdbHandle qreg, covdbHandle met, covdbObjTypesT ty)
+{
+    covdbHandle objs, obj;
+
+    enterRegion(qreg, Derived::RegionNames);
+    if (covdbSourceDefinition == ty) {
+        if (!UCAPI_ACCEPT(acceptVariant, qreg, met)) return;
+    } else if (covdbSourceInstance == ty) {
+        if (!UCAPI_ACCEPT(acceptQualifiedInstance, qreg, met)) return;
+    }
+
+    objs = covdb_iterate(qreg, covdbObjects);
+    if (covdbSourceDefinition == ty) {
+        UCAPI_HOOK(startVariant, qreg, met);
+    } else if (covdbSourceInstance == ty) {
+        UCAPI_HOOK(startQualifiedInstance, qreg, met);
+    }
+    while((obj = covdb_scan(objs))) {
+        recurseIntoObjects(obj, qreg, met, NULL);
+    }
+    covdb_release_handle(objs);
+    if (covdbSourceDefinition == ty) {
+        UCAPI_HOOK(finishVariant, qreg, met);
+    } else if (covdbSourceInstance == ty) {
+        UCAPI_HOOK(finishQualifiedInstance, qreg, met);
+    }
+}
+
+template <class Derived, unsigned Metrics>
+void UcapiWalker<Derived, Metrics>::recurseIntoObjectsInUnqualifiedDef(
+        covdbHandle reg)
+{
+    covdbHandle met, mets;
+
+    if ((_deadline &&
+         _deadline->admit(Deadline::Definition, covdb_get_str(reg, covdbName),
+                          _deadline->start()) == Deadline::Skip) ||
+        !UCAPI_ACCEPT(acceptDefinition, reg)) {
+        if (_progress) _progress->unitDone();
+        return;
+    }
+
+    reg = covdb_make_persistent_handle(reg);
+
+    UCAPI_HOOK(startDefinition, reg);
+
+    /* visit the objects for each metric; test-qualified metrics are
+     * accessed through the test handle, path coverage is deprecated */
+    mets = covdb_iterate(_test, covdbMetrics);
+    while((met = covdb_scan(mets))) {
+        if (!(RegionMetrics & metricBit(met))) continue;
+        covdbHandle var, vars;
+        met = covdb_make_persistent_handle(met);
+        vars = covdb_qualified_iterate(reg, met, covdbDefinitions);
+        while((var = covdb_scan(vars))) {
+            recurseIntoObjectsInQualifiedRegion(var, met,
+                                                covdbSourceDefinition);
+        }
+        covdb_release_handle(vars);
+        covdb_release_handle(met);
+    }
+    covdb_release_handle(mets);
+
+    UCAPI_HOOK(finishDefinition, reg);
+    if (_progress) _progress->unitDone();
+}
+
+template <class Derived, unsigned Metrics>
+void UcapiWalker<Derived, Metrics>::recurseIntoObjectsInUnqualifiedInst(
+        covdbHandle reg)
+{
+    covdbHandle met, mets;
+    covdbHandle kid, kids;
+
+    // top instances and their children are units of progress and of
+    // the deadline; the deadline is asked first so that a skipped
+    // instance is never accepted
+    Deadline::Admit admit = Deadline::Walk;
+    if (_deadline && _instDepth < 2) {
+        admit = _deadline->admit(Deadline::Instance, covdb_get_str(reg, covdbFullName),
+                                 _instDepth == 0 ? _deadline->start() : _topAdmit);
+    }
+    if (admit == Deadline::Skip || !UCAPI_ACCEPT(acceptInstance, reg)) {
+        if (_progress && _instDepth < 2) _progress->unitDone();
+        return;
+    }
+    if (_instDepth == 0) _topAdmit = admit;
+
+    reg = covdb_make_persistent_handle(reg);
+    _instDepth++;
+
+    UCAPI_HOOK(startInstance, reg);
+
+    /* descend into children of this instance, those of a top instance
+     * cheapest first under a deadline */
+    if (_deadline && _instDepth == 1) {
+        std::vector<covdbHandle> order = instancesByCost(reg);
+        for (size_t i = 0; i < order.size(); i++) {
+            recurseIntoObjectsInUnqualifiedInst(order[i]);
+            covdb_release_handle(order[i]);
+        }
+    } else {
+        kids = covdb_iterate(reg, covdbInstances);
+        while((kid = covdb_scan(kids))) {
+            recurseIntoObjectsInUnqualifiedInst(kid);
+        }
+    }
+
+    /* visit the objects for each metric; test-qualified metrics are
+     * accessed through the test handle, path coverage is deprecated.
+     * An instance only passed through on the way to resumed units has
+     * had its own objects walked already. */
+    if (admit != Deadline::Through) {
+        mets = covdb_iterate(_test, covdbMetrics);
+        while((met = covdb_scan(mets))) {
+            if (!(RegionMetrics & metricBit(met))) continue;
+
+            covdbHandle qreg;
+            met = covdb_make_persistent_handle(met);
+            qreg = covdb_get_qualified_handle(reg, met, covdbIdentity);
+
+            recurseIntoObjectsInQualifiedRegion(qreg, met, covdbSourceInstance);
+
+            covdb_release_handle(qreg);
+            covdb_release_handle(met);
+        }
+        covdb_release_handle(mets);
+    }
+
+    UCAPI_HOOK(finishInstance, reg);
+    covdb_release_handle(reg);
+    _instDepth--;
+    if (_progress && _instDepth < 2) _progress->unitDone();
+}
+
+#undef UCAPI_HOOK
+#undef UCAPI_ACCEPT
+
+/// Generic visitor class for a UCAPI coverage database.
+/// Override the visitors you wish to use.  There are metric-specific
+/// visitors (e.g., for toggle) and generic visitors that will visit
+/// all regions, containers and/or leaf objects in the coverage model.
+///
+/// This is the virtual-dispatch adapter over UcapiWalker: every hook is
+/// called for every region, container and object.  Derive from
+/// UcapiWalker directly to have unused hooks compiled out.
+class UcapiVisitor : public UcapiWalker<UcapiVisitor> {
+public:
+    /// Constructor that takes an already-loaded design handle.
+    /// Will automatically load/merge all available tests from the design.
+    UcapiVisitor(covdbHandle design) : UcapiWalker(design) { }
+
+    /// Constructor that takes already-loaded design and test handles.
+    UcapiVisitor(covdbHandle design, covdbHandle test)
+            : UcapiWalker(design, test) { }
+
+    virtual ~UcapiVisitor() { }
+
+    /// Visited for every unqualified instance in the design
+    /// After startInstance(I) is called, start and finish will be called
+    /// for every descendent of I before finishInstance(I) is called
+    virtual void startInstance(covdbHandle inst) { }
+    virtual void finishInstance(covdbHandle inst) { }
+
+    /// Visited for every metric-qualified instance in the design.
+    /// For a given qualifed instance Q, startInstance(Q) will be called
+    /// only after all descendent instances have been started and finished
+    virtual void startQualifiedInstance(covdbHandle inst, covdbHandle met) { }
+    virtual void finishQualifiedInstance(covdbHandle inst, covdbHandle met) { }
+
+    /// Visited once for every unqualified definition (module)
+    virtual void startDefinition(covdbHandle var) { }
+    virtual void finishDefinition(covdbHandle var) { }
+
+    /// Visited for every metric-qualified definition (variant) in the design
+    virtual void startVariant(covdbHandle var, covdbHandle met) { }
+    virtual void finishVariant(covdbHandle var, covdbHandle met) { }
+
+    /// Each metric is started and finished once for each instance
+    virtual void startMetric(covdbHandle met) { }
+    virtual void finishMetric(covdbHandle met) { }
+
+    /// Visited once for each testname found in design
+    virtual void visitTestName(covdbHandle testNameHdl) { }
+
+    /// Filtering hooks, each called just before the matching start
+    /// visitor.  Return false to prune that region or container: nothing
+    /// below it is iterated and none of its start/finish visitors run.
+    virtual bool acceptInstance(covdbHandle inst) { return true; }
+    virtual bool acceptQualifiedInstance(covdbHandle inst,
+                                         covdbHandle met) { return true; }
+    virtual bool acceptDefinition(covdbHandle def) { return true; }
+    virtual bool acceptVariant(covdbHandle var,
+                               covdbHandle met) { return true; }
+    virtual bool acceptContainer(covdbHandle obj,
+                                 covdbHandle region,
+                                 covdbHandle metric,
+                                 covdbHandle parent) { return true; }
+
+    /// Visits each container
+    virtual void startContainer(covdbHandle obj,
+                                covdbHandle region,
+                                covdbHandle metric,
+                                covdbHandle parent) { }
+    virtual void finishContainer(covdbHandle obj,
+                                 covdbHandle region,
+                                 covdbHandle metric,
+                                 covdbHandle parent) { }
+
+    /// Visits once for each leaf object in the design across all
+    /// metrics. Corresponding start/finish visitors will be called for
+    /// containing regions.
+    virtual void visitLeafObject(covdbHandle obj,
+                                 covdbHandle region,
+                                 covdbHandle metric,
+                                 covdbHandle parent) { }
+
+    /// Visits once for each coverable object in the design across
+    /// all metrics.  This is different from visitLeafObject in that it
+    /// may pass a container if that is the metric's lowest-level
+    /// coverable object (e.g., basic blocks for line coverage), whereas
+    /// visitLeafObject will never pass a container.
+    /// This is the preferred method to use in general.  If you use both
+    /// there will be a lot of overlap between the two.
+    virtual void visitCovObject(covdbHandle obj,
+                                covdbHandle region,
+                                covdbHandle metric,
+                                covdbHandle parent) { }
+
+    /// Same as visitCovObject, with the region and parent names already
+    /// resolved.  Override this one instead to avoid looking them up
+    /// again for every object; by default it forwards to visitCovObject.
+    virtual void visitNamedCovObject(covdbHandle obj,
+                                     covdbHandle region,
+                                     covdbHandle metric,
+                                     covdbHandle parent,
+                                     const ObjectNames& names) {
+        visitCovObject(obj, region, metric, parent);
+    }
+};
+
+#endif
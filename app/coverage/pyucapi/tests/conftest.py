@@ -0,0 +1,87 @@
+"""Shared helpers of the pyucapi tests.
+
+make test builds pyucapi against the fake UCAPI of fake/ and runs these
+with it on PYTHONPATH; make test-examples runs test_parity.py against
+the real one on the VDBs of the example designs.
+"""
+
+import os
+
+import pytest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DESIGNS = os.path.join(HERE, "designs")
+
+
+def fake_designs():
+    """The fake VDBs of designs/"""
+    return sorted(os.path.join(DESIGNS, f) for f in os.listdir(DESIGNS)
+                  if f.endswith(".fake"))
+
+
+def object_id(name):
+    """MurmurHash64A of name, as objectId() in src/objid.hh"""
+    m = 0xc6a4a7935bd1e995
+    mask = (1 << 64) - 1
+    data = name.encode()
+    n = len(data)
+    h = (0x436f764f626a4964 ^ (n * m)) & mask
+    end = n - n % 8
+    for i in range(0, end, 8):
+        k = int.from_bytes(data[i:i + 8], "little")
+        k = (k * m) & mask
+        k ^= k >> 47
+        k = (k * m) & mask
+        h ^= k
+        h = (h * m) & mask
+    if n % 8:
+        h ^= int.from_bytes(data[end:], "little")
+        h = (h * m) & mask
+    h ^= h >> 47
+    h = (h * m) & mask
+    h ^= h >> 47
+    return h
+
+
+def toggle_keys(table):
+    """Snapshot key of every row of a toggle table:
+    <instance>.<signal>[<bit>]:<direction>, the bit left off for
+    single-bit signals"""
+    paths = table.paths()
+    signal = memoryview(table["signal"]).tolist()
+    bit = memoryview(table["bit"]).tolist()
+    direction = memoryview(table["direction"]).tolist()
+    rows = {}
+    for s in signal:
+        rows[s] = rows.get(s, 0) + 1
+    keys = []
+    for s, b, d in zip(signal, bit, direction):
+        key = paths[s]
+        if rows[s] > 2:
+            key += "[%d]" % b
+        keys.append(key + (":1->0" if d else ":0->1"))
+    return keys
+
+
+def group_keys(table):
+    """Snapshot key of every row of a group table: its path"""
+    paths = table.paths()
+    return [paths[p] for p in memoryview(table["path"]).tolist()]
+
+
+def read_snapshot(file):
+    """The records of a snapshot file as {key: (id, covered, coverable,
+    count)}, and its kind"""
+    with open(file) as f:
+        header = f.readline().split()
+        assert header[:2] == ["#covsnap", "2"], header
+        records = {}
+        for line in f:
+            key, ident, covered, coverable, count = line.rstrip("\n").split("\t")
+            records[key] = (int(ident, 16), int(covered), int(coverable), int(count))
+    return header[2], records
+
+
+@pytest.fixture(params=fake_designs(), ids=os.path.basename)
+def design(request):
+    return request.param
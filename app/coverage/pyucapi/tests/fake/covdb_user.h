@@ -0,0 +1,85 @@
+/// Fake UCAPI: the part of covdb_user.h the coverage tools use, for
+/// building them against fakeucapi.cc instead of libucapi.  The values
+/// only have to agree with fakeucapi.cc, not with a real VCS release.
+
+#ifndef COVDB_USER_H
+#define COVDB_USER_H
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void* covdbHandle;
+
+typedef enum {
+    covdbNullHandle, covdbInternal, covdbDesign, covdbIterator,
+    covdbContainer, covdbMetric, covdbSourceInstance, covdbSourceDefinition,
+    covdbBlock, covdbIntegerValue, covdbScalarValue, covdbVectorValue,
+    covdbIntervalValue, covdbBDDValue, covdbCross, covdbSequence,
+    covdbAnnotation, covdbTest, covdbTestName, covdbInterval,
+    covdbExcludeFile, covdbHierFile, covdbEditFile, covdbBDD, covdbError,
+    covdbTable, covdbValueSet, covdbSBNRange, covdbTestInfo
+} covdbObjTypesT;
+
+/* properties, relations, configuration keys and error codes */
+enum {
+    covdbName = 1, covdbFullName, covdbValueName, covdbType, covdbCovStatus,
+    covdbCovered, covdbCoverable, covdbCovCount, covdbWidth, covdbAutomatic,
+    covdbWeight, covdbValue, covdbLineNo,
+    covdbAvailableTests, covdbInstances, covdbDefinitions, covdbMetrics,
+    covdbObjects, covdbComponents, covdbParent, covdbDefinition, covdbIdentity,
+    covdbDisplayErrors, covdbExcludeMode, covdbShowGroupsInDesign,
+    covdbInvalidPropertyError, covdbNotImplementedError,
+    covdbInvalidRelationError
+};
+
+/* covdbCovStatus bits */
+enum {
+    covdbStatusCovered = 1,
+    covdbStatusExcluded = 2,
+    covdbStatusUnreachable = 4
+};
+
+#define IS_CROSS "IS_CROSS"
+
+typedef void (*covdbErrorCB)(covdbHandle, void*);
+
+covdbHandle covdb_load(int type, covdbHandle design, const char* name);
+covdbHandle covdb_loadmerge(int type, covdbHandle test, const char* name);
+void covdb_unload(covdbHandle design);
+
+covdbHandle covdb_iterate(covdbHandle obj, int relation);
+covdbHandle covdb_qualified_iterate(covdbHandle obj, covdbHandle qualifier,
+                                    int relation);
+covdbHandle covdb_scan(covdbHandle iter);
+void covdb_release_handle(covdbHandle obj);
+covdbHandle covdb_make_persistent_handle(covdbHandle obj);
+
+char* covdb_get_str(covdbHandle obj, int property);
+int covdb_get(covdbHandle obj, covdbHandle region, covdbHandle test,
+              int property);
+covdbHandle covdb_get_handle(covdbHandle obj, int relation);
+covdbHandle covdb_get_qualified_handle(covdbHandle obj, covdbHandle qualifier,
+                                       int relation);
+const char* covdb_get_annotation(covdbHandle obj, const char* key);
+
+void covdb_configure(int key, char* value);
+void covdb_qualified_configure(covdbHandle design, int key, const char* value);
+void covdb_set_error_callback(covdbErrorCB cb, void* data);
+
+int isLineMetric(covdbHandle met);
+int isCondMetric(covdbHandle met);
+int isFsmMetric(covdbHandle met);
+int isToggleMetric(covdbHandle met);
+int isBranchMetric(covdbHandle met);
+int isPathMetric(covdbHandle met);
+int isAssertMetric(covdbHandle met);
+int isTestbenchMetric(covdbHandle met);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,505 @@
+/// Fake UCAPI backend for the tests: a design read from a small text file
+/// and held in memory, served through the covdb_* calls the coverage
+/// tools make.  It needs no VCS, so pyucapi and the dumpers can be built
+/// and compared on the same design anywhere.
+///
+/// The "VDB" is a text file, one node per line, nested by indentation:
+///
+///     # comment
+///     test t1                                 available test
+///     instance top module=soc                 design instance
+///       signal clk c4 c4                      toggle container: two
+///       signal data[1:0] c1 u x x             objects per bit
+///       toggle en c2                          bare toggle object
+///       instance u_sub module=sub
+///     covergroup cg_bus
+///       variant cg_bus parent=top             or parent=module:soc
+///         coverpoint cp_addr width=8          or: cross x_addr_op
+///           container auto weight=2 auto
+///             bin low 1/1 3                   covered/coverable count
+///         instance cg_bus_0                   covergroup instance, with
+///           coverpoint ...                    coverpoints of its own
+///
+/// Toggle objects are c<count> (covered), u (uncovered) or x (excluded).
+/// Only the toggle and testbench metrics exist.  The tests are all the
+/// same data, so loading and merging them is a no-op; modules have no
+/// variants of their own.  Every handle is persistent and iterators are
+/// freed by covdb_release_handle().
+
+#include "covdb_user.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum Kind {
+    Design, TestName, Test, Metric, Instance, Module, Region, Signal, Object,
+    Group, Variant, Coverpoint, Container, Bin, GroupInstance
+};
+
+enum { ToggleMetricKind, TestbenchMetricKind };
+
+struct Handle {
+    bool iterator;
+    explicit Handle(bool iter) : iterator(iter) { }
+};
+
+struct Node : Handle {
+    Kind kind;
+    int type;
+    std::string name;
+    std::string fullName;
+    int metric;                 // metrics: which one
+    bool cross;                 // coverpoints
+    int status;                 // toggle objects
+    long count;
+    int covered;
+    int coverable;
+    int width;
+    int weight;
+    int automatic;
+    Node* parent;               // variants: the instance or module
+    Node* definition;           // instances: the module; group instances: the variant
+    Node* region;               // instances: the toggle-qualified region
+    Node* test;                 // design: the merged test
+    std::vector<Node*> objects;
+    std::vector<Node*> instances;
+    std::vector<Node*> definitions;
+    std::vector<Node*> tests;   // design: available tests
+    std::vector<Node*> metrics; // test
+    std::vector<std::unique_ptr<Node> > owned;  // design: every node
+
+    Node(Kind k, int t)
+            : Handle(false), kind(k), type(t), metric(-1), cross(false),
+              status(0), count(0), covered(0), coverable(0), width(0),
+              weight(1), automatic(0), parent(NULL), definition(NULL),
+              region(NULL), test(NULL) { }
+};
+
+struct Iterator : Handle {
+    std::vector<Node*> items;
+    size_t next;
+    Iterator() : Handle(true), next(0) { }
+};
+
+Node* node(covdbHandle h)
+{
+    Handle* p = (Handle*)h;
+    return p && !p->iterator ? (Node*)p : NULL;
+}
+
+covdbHandle iterate(const std::vector<Node*>& items)
+{
+    Iterator* it = new Iterator;
+    it->items = items;
+    return it;
+}
+
+/// Builds the node tree of one design file
+class Loader {
+    Node* _design;
+    Node* _test;
+    std::string _file;
+    int _line;
+    std::string _err;
+
+    Node* make(Kind kind, int type, const std::string& name) {
+        _design->owned.push_back(std::unique_ptr<Node>(new Node(kind, type)));
+        Node* n = _design->owned.back().get();
+        n->name = name;
+        n->fullName = name;
+        return n;
+    }
+
+    bool fail(const std::string& msg) {
+        std::ostringstream os;
+        os << _file << ":" << _line << ": " << msg;
+        _err = os.str();
+        return false;
+    }
+
+    Node* module(const std::string& name) {
+        for (size_t i = 0; i < _design->definitions.size(); i++) {
+            if (_design->definitions[i]->name == name) return _design->definitions[i];
+        }
+        Node* m = make(Module, covdbSourceDefinition, name);
+        _design->definitions.push_back(m);
+        return m;
+    }
+
+    Node* findInstance(const std::vector<Node*>& insts, const std::string& path) {
+        for (size_t i = 0; i < insts.size(); i++) {
+            if (insts[i]->fullName == path) return insts[i];
+            Node* n = findInstance(insts[i]->instances, path);
+            if (n) return n;
+        }
+        return NULL;
+    }
+
+    /// key=value option of a line, or def
+    static std::string option(const std::vector<std::string>& words,
+                              const std::string& key, const std::string& def) {
+        for (size_t i = 2; i < words.size(); i++) {
+            if (words[i].compare(0, key.size() + 1, key + "=") == 0) {
+                return words[i].substr(key.size() + 1);
+            }
+        }
+        return def;
+    }
+
+    static bool flag(const std::vector<std::string>& words, const std::string& key) {
+        for (size_t i = 2; i < words.size(); i++) {
+            if (words[i] == key) return true;
+        }
+        return false;
+    }
+
+    bool toggleObject(Node* parent, const std::string& name, const std::string& word) {
+        Node* obj = make(Object, covdbScalarValue, name);
+        obj->fullName = parent->fullName + "." + name;
+        if (word[0] == 'c') {
+            obj->status = covdbStatusCovered;
+            obj->count = atol(word.c_str() + 1);
+            obj->covered = obj->coverable = 1;
+        } else if (word == "u") {
+            obj->coverable = 1;
+        } else if (word == "x") {
+            obj->status = covdbStatusExcluded;
+        } else {
+            return fail("bad toggle object '" + word + "'");
+        }
+        parent->objects.push_back(obj);
+        return true;
+    }
+
+    /// Add the node of one line below parent; returns it, or NULL for a
+    /// leaf or on error (then _err is set)
+    Node* add(Node* parent, const std::vector<std::string>& words) {
+        const std::string& what = words[0];
+        const std::string name = words.size() > 1 ? words[1] : "";
+        if (name.empty()) {
+            fail(what + " without a name");
+            return NULL;
+        }
+        Kind in = parent->kind;
+
+        if (what == "test" && in == Design) {
+            _design->tests.push_back(make(TestName, covdbTestName, name));
+            return NULL;
+        }
+        if (what == "instance" && (in == Design || in == Instance)) {
+            Node* inst = make(Instance, covdbSourceInstance, name);
+            if (in == Instance) inst->fullName = parent->fullName + "." + name;
+            inst->definition = module(option(words, "module", name));
+            inst->region = make(Region, covdbSourceInstance, name);
+            inst->region->fullName = inst->fullName;
+            (in == Design ? _design->instances : parent->instances).push_back(inst);
+            return inst;
+        }
+        if (what == "signal" && in == Instance) {
+            Node* sig = make(Signal, covdbContainer, name);
+            sig->fullName = parent->fullName + "." + name;
+            parent->region->objects.push_back(sig);
+            if (words.size() < 4 || words.size() % 2) {
+                fail("signal " + name + " needs two objects per bit");
+                return NULL;
+            }
+            for (size_t i = 2; i < words.size(); i++) {
+                if (!toggleObject(sig, i % 2 ? "1 -> 0" : "0 -> 1", words[i])) return NULL;
+            }
+            sig->width = (int)(words.size() - 2) / 2;
+            return NULL;
+        }
+        if (what == "toggle" && in == Instance) {
+            if (words.size() != 3) {
+                fail("toggle " + name + " needs one object");
+                return NULL;
+            }
+            toggleObject(parent->region, name, words[2]);
+            return NULL;
+        }
+        if (what == "covergroup" && in == Design) {
+            Node* grp = make(Group, covdbSourceDefinition, name);
+            _test->definitions.push_back(grp);
+            return grp;
+        }
+        if (what == "variant" && in == Group) {
+            Node* var = make(Variant, covdbSourceDefinition, name);
+            std::string par = option(words, "parent", "");
+            if (par.compare(0, 7, "module:") == 0) {
+                var->parent = module(par.substr(7));
+            } else if (!par.empty()) {
+                var->parent = findInstance(_design->instances, par);
+                if (!var->parent) {
+                    fail("no instance " + par);
+                    return NULL;
+                }
+            }
+            var->fullName = (var->parent ? var->parent->fullName + "." : "") + name;
+            parent->definitions.push_back(var);
+            return var;
+        }
+        if (what == "instance" && in == Variant) {
+            Node* inst = make(GroupInstance, covdbSourceInstance, name);
+            inst->fullName = (parent->parent ? parent->parent->fullName + "." : "") + name;
+            inst->definition = parent;
+            parent->instances.push_back(inst);
+            return inst;
+        }
+        if ((what == "coverpoint" || what == "cross") &&
+            (in == Variant || in == GroupInstance)) {
+            Node* cp = make(Coverpoint, covdbContainer, name);
+            cp->cross = what == "cross";
+            cp->width = atoi(option(words, "width", "1").c_str());
+            parent->objects.push_back(cp);
+            return cp;
+        }
+        if (what == "container" && in == Coverpoint) {
+            Node* cont = make(Container, covdbContainer, name);
+            cont->weight = atoi(option(words, "weight", "1").c_str());
+            cont->automatic = flag(words, "auto");
+            parent->objects.push_back(cont);
+            return cont;
+        }
+        if (what == "bin" && in == Container) {
+            Node* bin = make(Bin, covdbIntegerValue, name);
+            int ed, ab;
+            if (words.size() < 3 || sscanf(words[2].c_str(), "%d/%d", &ed, &ab) != 2) {
+                fail("bin " + name + " needs covered/coverable");
+                return NULL;
+            }
+            bin->covered = ed;
+            bin->coverable = ab;
+            bin->count = words.size() > 3 ? atol(words[3].c_str()) : ed;
+            parent->objects.push_back(bin);
+            return NULL;
+        }
+        fail("unexpected '" + what + "'");
+        return NULL;
+    }
+
+    /// Containers count what they hold; cross bins are crosses
+    void rollUp(Node* n) {
+        for (size_t i = 0; i < n->objects.size(); i++) {
+            Node* kid = n->objects[i];
+            if (n->kind == Container && n->cross) kid->type = covdbCross;
+            if (kid->kind == Container) kid->cross = n->cross;
+            rollUp(kid);
+            if (n->type == covdbContainer) {
+                n->covered += kid->covered;
+                n->coverable += kid->coverable;
+            }
+        }
+        for (size_t i = 0; i < n->instances.size(); i++) rollUp(n->instances[i]);
+        for (size_t i = 0; i < n->definitions.size(); i++) rollUp(n->definitions[i]);
+        if (n->region) rollUp(n->region);
+    }
+
+public:
+    Loader() : _design(NULL), _test(NULL), _line(0) { }
+
+    Node* load(const char* file) {
+        std::ifstream in(file);
+        if (!in) {
+            _err = std::string("cannot open ") + file;
+            return NULL;
+        }
+        _file = file;
+        std::unique_ptr<Node> design(new Node(Design, covdbDesign));
+        _design = design.get();
+        _design->name = _design->fullName = file;
+        _test = make(Test, covdbTest, "merged");
+        const char* metricNames[] = { "Toggle", "Group" };
+        for (int m = 0; m < 2; m++) {
+            Node* met = make(Metric, covdbMetric, metricNames[m]);
+            met->metric = m;
+            _test->metrics.push_back(met);
+        }
+
+        std::vector<std::pair<size_t, Node*> > stack;
+        std::string line;
+        while (std::getline(in, line)) {
+            _line++;
+            size_t indent = line.find_first_not_of(' ');
+            if (indent == std::string::npos || line[indent] == '#') continue;
+            std::istringstream ws(line);
+            std::vector<std::string> words;
+            std::string w;
+            while (ws >> w && w[0] != '#') words.push_back(w);
+            while (!stack.empty() && stack.back().first >= indent) stack.pop_back();
+            Node* parent = stack.empty() ? _design : stack.back().second;
+            Node* n = add(parent, words);
+            if (!_err.empty()) return NULL;
+            if (n) stack.push_back(std::make_pair(indent, n));
+        }
+        if (_design->tests.empty()) _design->tests.push_back(make(TestName, covdbTestName, "test"));
+        rollUp(_design);
+        rollUp(_test);
+        _design->test = _test;
+        return design.release();
+    }
+
+    const std::string& error() const { return _err; }
+};
+
+} // namespace
+
+extern "C" {
+
+covdbHandle covdb_load(int type, covdbHandle design, const char* name)
+{
+    if (type == covdbDesign) {
+        Loader loader;
+        Node* d = loader.load(name);
+        if (!d) fprintf(stderr, "fakeucapi: %s\n", loader.error().c_str());
+        return d;
+    }
+    Node* d = node(design);
+    if (type != covdbTest || !d || d->kind != Design) return NULL;
+    for (size_t i = 0; i < d->tests.size(); i++) {
+        if (d->tests[i]->name == name) return d->test;
+    }
+    return NULL;
+}
+
+covdbHandle covdb_loadmerge(int type, covdbHandle test, const char* name)
+{
+    return test;
+}
+
+void covdb_unload(covdbHandle design)
+{
+    Node* d = node(design);
+    if (d && d->kind == Design) delete d;
+}
+
+covdbHandle covdb_iterate(covdbHandle obj, int relation)
+{
+    Node* n = node(obj);
+    if (!n) return NULL;
+    switch (relation) {
+        case covdbAvailableTests: return iterate(n->tests);
+        case covdbInstances: return iterate(n->instances);
+        case covdbDefinitions: return iterate(n->kind == Design ? n->definitions
+                                                                : std::vector<Node*>());
+        case covdbMetrics: return iterate(n->metrics);
+        case covdbObjects: return iterate(n->objects);
+        default: return iterate(std::vector<Node*>());
+    }
+}
+
+/// Only the testbench metric has qualified definitions: the covergroups
+/// of the test and the variants of a covergroup
+covdbHandle covdb_qualified_iterate(covdbHandle obj, covdbHandle qualifier,
+                                    int relation)
+{
+    Node* n = node(obj);
+    Node* met = node(qualifier);
+    if (!n) return NULL;
+    if (relation == covdbDefinitions && met && met->metric == TestbenchMetricKind &&
+        (n->kind == Test || n->kind == Group)) {
+        return iterate(n->definitions);
+    }
+    return iterate(std::vector<Node*>());
+}
+
+covdbHandle covdb_scan(covdbHandle iter)
+{
+    Handle* h = (Handle*)iter;
+    if (!h || !h->iterator) return NULL;
+    Iterator* it = (Iterator*)h;
+    return it->next < it->items.size() ? it->items[it->next++] : NULL;
+}
+
+void covdb_release_handle(covdbHandle obj)
+{
+    Handle* h = (Handle*)obj;
+    if (h && h->iterator) delete (Iterator*)h;
+}
+
+covdbHandle covdb_make_persistent_handle(covdbHandle obj)
+{
+    return obj;
+}
+
+char* covdb_get_str(covdbHandle obj, int property)
+{
+    Node* n = node(obj);
+    if (!n) return NULL;
+    switch (property) {
+        case covdbName: return (char*)n->name.c_str();
+        case covdbFullName: return (char*)n->fullName.c_str();
+        default: return NULL;
+    }
+}
+
+int covdb_get(covdbHandle obj, covdbHandle region, covdbHandle test, int property)
+{
+    Node* n = node(obj);
+    if (!n) return 0;
+    switch (property) {
+        case covdbType: return n->type;
+        case covdbCovStatus: return n->status;
+        case covdbCovered: return n->covered;
+        case covdbCoverable: return n->coverable;
+        case covdbCovCount: return (int)n->count;
+        case covdbWidth: return n->width;
+        case covdbWeight: return n->weight;
+        case covdbAutomatic: return n->automatic;
+        default: return 0;
+    }
+}
+
+covdbHandle covdb_get_handle(covdbHandle obj, int relation)
+{
+    Node* n = node(obj);
+    if (!n) return NULL;
+    if (relation == covdbParent) return n->parent;
+    if (relation == covdbDefinition) return n->definition;
+    return NULL;
+}
+
+covdbHandle covdb_get_qualified_handle(covdbHandle obj, covdbHandle qualifier,
+                                       int relation)
+{
+    Node* n = node(obj);
+    Node* met = node(qualifier);
+    if (!n || !met || relation != covdbIdentity) return NULL;
+    return met->metric == ToggleMetricKind ? n->region : NULL;
+}
+
+const char* covdb_get_annotation(covdbHandle obj, const char* key)
+{
+    Node* n = node(obj);
+    if (!n || n->kind != Coverpoint || strcmp(key, IS_CROSS)) return NULL;
+    return n->cross ? "1" : "0";
+}
+
+void covdb_configure(int key, char* value) { }
+
+void covdb_qualified_configure(covdbHandle design, int key, const char* value) { }
+
+/// Nothing here ever fails, so there are no errors to report
+void covdb_set_error_callback(covdbErrorCB cb, void* data) { }
+
+static int isMetric(covdbHandle met, int kind)
+{
+    Node* n = node(met);
+    return n && n->kind == Metric && n->metric == kind;
+}
+
+int isLineMetric(covdbHandle met) { return 0; }
+int isCondMetric(covdbHandle met) { return 0; }
+int isFsmMetric(covdbHandle met) { return 0; }
+int isToggleMetric(covdbHandle met) { return isMetric(met, ToggleMetricKind); }
+int isBranchMetric(covdbHandle met) { return 0; }
+int isPathMetric(covdbHandle met) { return 0; }
+int isAssertMetric(covdbHandle met) { return 0; }
+int isTestbenchMetric(covdbHandle met) { return isMetric(met, TestbenchMetricKind); }
+
+}
@@ -0,0 +1,60 @@
+"""pyucapi against the dumpers.
+
+collect.cc walks the VDB with traversals of its own, so its keys, ids
+and counts are checked here against the snapshots that dumptgl and
+dump_func_cov_to_json write with --snapshot for the same VDB.  The
+dumpers are $DUMPTGL and $DUMP_FUNC_COV_TO_JSON, built against the same
+UCAPI as the module; the VDBs are those of $PYUCAPI_VDBS (separated by
+whitespace) or else the fake designs.  make test and make test-examples
+set all of these.
+"""
+
+import os
+import subprocess
+
+import pytest
+
+import pyucapi
+from conftest import fake_designs, group_keys, read_snapshot, toggle_keys
+
+VDBS = os.environ.get("PYUCAPI_VDBS", "").split() or fake_designs()
+
+
+def snapshot(tool, vdb, tmp_path):
+    dumper = os.environ.get(tool)
+    if not dumper:
+        pytest.skip("$%s is not set" % tool)
+    snap = str(tmp_path / "out.snap")
+    subprocess.run([dumper, "--snapshot", snap, vdb], check=True,
+                   stdout=subprocess.DEVNULL)
+    return read_snapshot(snap)
+
+
+@pytest.mark.parametrize("vdb", VDBS, ids=os.path.basename)
+def test_toggle_matches_dumptgl(vdb, tmp_path):
+    kind, records = snapshot("DUMPTGL", vdb, tmp_path)
+    assert kind == "toggle"
+    t = pyucapi.toggle(vdb)
+    status = memoryview(t["status"]).tolist()
+    ids = memoryview(t["id"]).tolist()
+    rows = {}
+    for key, ident, st in zip(toggle_keys(t), ids, status):
+        # the snapshot keeps the first of duplicate keys
+        rows.setdefault(key, (ident, int(st == 0), int(st != 1)))
+    assert sorted(rows) == sorted(records)
+    for key, (ident, covered, coverable, _) in records.items():
+        assert rows[key] == (ident, covered, coverable), key
+
+
+@pytest.mark.parametrize("vdb", VDBS, ids=os.path.basename)
+def test_groups_match_dump_func_cov_to_json(vdb, tmp_path):
+    kind, records = snapshot("DUMP_FUNC_COV_TO_JSON", vdb, tmp_path)
+    assert kind == "group"
+    t = pyucapi.groups(vdb)
+    columns = [memoryview(t[c]).tolist() for c in ("id", "covered", "coverable", "count")]
+    rows = {}
+    for key, row in zip(group_keys(t), zip(*columns)):
+        rows.setdefault(key, row)
+    assert sorted(rows) == sorted(records)
+    for key, record in records.items():
+        assert rows[key] == record, key
@@ -0,0 +1,227 @@
+"""The Coverage and Column objects of pyucapi, on the fake designs.
+
+The numpy checks are skipped when numpy is not installed; the rest only
+need the buffer protocol through memoryview.
+"""
+
+import gc
+import os
+
+import pytest
+
+import pyucapi
+from conftest import DESIGNS, group_keys, object_id, toggle_keys
+
+JUKEBOX = os.path.join(DESIGNS, "jukebox.fake")
+
+TOGGLE_COLUMNS = (
+    ("signal", "I", "uint32"),
+    ("bit", "I", "uint32"),
+    ("direction", "B", "uint8"),
+    ("status", "B", "uint8"),
+    ("count", "q", "int64"),
+    ("id", "Q", "uint64"),
+)
+
+GROUP_COLUMNS = (
+    ("path", "I", "uint32"),
+    ("container", "I", "uint32"),
+    ("covered", "i", "int32"),
+    ("coverable", "i", "int32"),
+    ("count", "q", "int64"),
+    ("weight", "i", "int32"),
+    ("cross", "B", "uint8"),
+    ("id", "Q", "uint64"),
+)
+
+
+def column(table, name):
+    return memoryview(table[name]).tolist()
+
+
+@pytest.mark.parametrize("collect, kind, columns", [
+    (pyucapi.toggle, "toggle", TOGGLE_COLUMNS),
+    (pyucapi.groups, "group", GROUP_COLUMNS),
+])
+def test_columns(design, collect, kind, columns):
+    t = collect(design)
+    assert t.kind == kind
+    assert t.columns == tuple(c[0] for c in columns)
+    assert len(t) > 0
+    for name, fmt, _ in columns:
+        col = t[name]
+        assert col.name == name and col.format == fmt
+        assert len(col) == len(t)
+        view = memoryview(col)
+        assert view.format == fmt and view.readonly
+        assert view.ndim == 1 and view.shape == (len(t),)
+        assert view.itemsize == view.nbytes // len(t)
+
+
+@pytest.mark.parametrize("collect, columns", [
+    (pyucapi.toggle, TOGGLE_COLUMNS),
+    (pyucapi.groups, GROUP_COLUMNS),
+])
+def test_dtypes(design, collect, columns):
+    np = pytest.importorskip("numpy")
+    t = collect(design)
+    for name, _, dtype in columns:
+        a = np.asarray(t[name])
+        assert a.dtype == np.dtype(dtype), name
+        assert a.shape == (len(t),)
+    assert np.asarray(t.path_data).dtype == np.uint8
+    assert np.asarray(t.path_offsets).dtype == np.uint64
+
+
+def test_asarray_shares_memory(design):
+    np = pytest.importorskip("numpy")
+    t = pyucapi.toggle(design)
+    # two columns objects, two arrays: one buffer, the table's own
+    a = np.asarray(t["count"])
+    b = np.asarray(t["count"])
+    assert np.shares_memory(a, b)
+    assert a.__array_interface__["data"][0] == b.__array_interface__["data"][0]
+    assert not a.flags.owndata and not a.flags.writeable
+    with pytest.raises(ValueError):
+        a.setflags(write=True)
+    assert np.shares_memory(np.asarray(t.path_data), np.asarray(t.path_data))
+
+
+def test_views_keep_table_alive():
+    t = pyucapi.toggle(JUKEBOX)
+    ids = column(t, "id")
+    paths = t.paths()
+    col = t["id"]
+    view = memoryview(t["id"])
+    offsets = memoryview(t.path_offsets)
+    del t
+    gc.collect()
+    # reuse whatever memory a freed table would have left behind
+    others = [pyucapi.toggle(JUKEBOX) for _ in range(4)]
+    assert view.tolist() == ids
+    assert memoryview(col).tolist() == ids
+    assert len(offsets) == len(paths) + 1
+    del others
+
+
+def test_arrays_keep_table_alive():
+    np = pytest.importorskip("numpy")
+    t = pyucapi.groups(JUKEBOX)
+    covered = np.asarray(t["covered"])
+    expected = covered.copy()
+    del t
+    gc.collect()
+    others = [pyucapi.groups(JUKEBOX) for _ in range(4)]
+    assert (covered == expected).all()
+    del others
+
+
+def test_path_table(design):
+    for t in (pyucapi.toggle(design), pyucapi.groups(design)):
+        data = bytes(memoryview(t.path_data))
+        offsets = memoryview(t.path_offsets).tolist()
+        decoded = [data[offsets[k]:offsets[k + 1] - 1].decode()
+                   for k in range(len(offsets) - 1)]
+        assert decoded == t.paths()
+        assert t.paths() is t.paths()
+        assert len(set(decoded)) == len(decoded)
+
+
+def test_toggle_rows():
+    t = pyucapi.toggle(JUKEBOX)
+    keys = toggle_keys(t)
+    status = dict(zip(keys, column(t, "status")))
+    count = dict(zip(keys, column(t, "count")))
+    assert len(t) == 134
+    assert len(set(keys)) == len(keys)
+    # children before their parent, each in design order
+    assert keys[0] == "jukebox.u_cd.clk:0->1"
+    assert keys[-1] == "jukebox.y_tot:0->1"
+    assert status["jukebox.u_cd.track[0]:1->0"] == 0
+    assert status["jukebox.u_cd.track[2]:0->1"] == 2
+    assert status["jukebox.u_cd.track[4]:0->1"] == 1
+    assert status["jukebox.x_not:0->1"] == 2
+    assert status["jukebox.y_tot:0->1"] == 1
+    assert count["jukebox.clk:1->0"] == 40
+    assert column(t, "id") == [object_id("tgl:" + k) for k in keys]
+
+
+def test_group_rows():
+    t = pyucapi.groups(JUKEBOX)
+    keys = group_keys(t)
+    paths = t.paths()
+    assert keys == [
+        "cd.song.track.t.t_1", "cd.song.track.t.t_2", "cd.song.track.t.t_3",
+        "cd.song.track.t.t_19", "cd.song.disk.d.d_1", "cd.song.disk.d.d_2",
+        "cd.song.track_x_disk.auto.<t_1,d_1>", "cd.song.track_x_disk.auto.<t_1,d_2>",
+        "cd.song.track_x_disk.auto.<t_2,d_1>", "cd.song.track_x_disk.auto.<t_2,d_2>",
+        "jukebox.u_fifo.fifo_level.level.levels.empty",
+        "jukebox.u_fifo.fifo_level.level.levels.half",
+        "jukebox.u_fifo.fifo_level.level.levels.full",
+        "jukebox.u_fifo.fifo_level.level.illegal.overflow",
+    ]
+    assert [paths[c] for c in column(t, "container")] == \
+        [k.rsplit(".", 1)[0] for k in keys]
+    assert column(t, "covered") == [1, 1, 0, 0, 1, 0, 1, 0, 1, 0, 1, 0, 0, 0]
+    assert column(t, "coverable") == [1] * 13 + [0]
+    assert column(t, "count") == [4, 1, 0, 0, 2, 0, 2, 0, 1, 0, 7, 0, 0, 0]
+    assert column(t, "weight") == [1] * 6 + [2] * 4 + [3] * 3 + [0]
+    assert column(t, "cross") == [0] * 6 + [1] * 4 + [0] * 4
+    assert column(t, "id") == [object_id("cg:" + k) for k in keys]
+
+
+def test_filter(tmp_path):
+    rules = tmp_path / "tgl.filter"
+    rules.write_text("exclude jukebox.u_cd2\nexclude **.clk\n")
+    keys = toggle_keys(pyucapi.toggle(JUKEBOX, filter=str(rules)))
+    assert keys and not [k for k in keys if "u_cd2" in k or ".clk:" in k]
+
+    rules.write_text("include cd.song\n")
+    keys = group_keys(pyucapi.groups(JUKEBOX, filter=str(rules)))
+    assert len(keys) == 10 and all(k.startswith("cd.song.") for k in keys)
+
+    # each regex has its own groups: \1 is (t), not the (x) before it
+    rules.write_text("include re:^cd\\.song\\.track\\.\n"
+                     "exclude re:(x)z\nexclude re:(t)\\.\\1_1$\n")
+    keys = group_keys(pyucapi.groups(JUKEBOX, filter=str(rules)))
+    assert keys == ["cd.song.track.t.t_2", "cd.song.track.t.t_3", "cd.song.track.t.t_19"]
+
+
+def test_empty_table(tmp_path):
+    rules = tmp_path / "none.filter"
+    rules.write_text("exclude **\n")
+    t = pyucapi.toggle(JUKEBOX, str(rules))
+    assert len(t) == 0 and t.paths() == []
+    for name in t.columns:
+        assert len(t[name]) == 0
+        assert memoryview(t[name]).tolist() == []
+    assert memoryview(t.path_offsets).tolist() == [0]
+
+
+def test_errors(tmp_path):
+    with pytest.raises(OSError, match="could not open design"):
+        pyucapi.toggle(str(tmp_path / "missing.vdb"))
+    with pytest.raises(OSError):
+        pyucapi.groups(str(tmp_path / "missing.vdb"))
+    with pytest.raises(ValueError, match="cannot open filter file"):
+        pyucapi.toggle(JUKEBOX, filter=str(tmp_path / "missing.filter"))
+    bad = tmp_path / "bad.filter"
+    bad.write_text("exclude re:scan_(in\n")
+    with pytest.raises(ValueError):
+        pyucapi.groups(JUKEBOX, filter=str(bad))
+    bad.write_text("include cd.song\n+\n")
+    with pytest.raises(ValueError, match="missing pattern"):
+        pyucapi.toggle(JUKEBOX, filter=str(bad))
+    with pytest.raises(TypeError):
+        pyucapi.toggle()
+    with pytest.raises(TypeError):
+        pyucapi.toggle(JUKEBOX, filter=3)
+
+    t = pyucapi.toggle(JUKEBOX)
+    with pytest.raises(KeyError):
+        t["nosuchcolumn"]
+    with pytest.raises(TypeError):
+        t[0]
+    view = memoryview(t["status"])
+    with pytest.raises(TypeError):
+        view[0] = 1